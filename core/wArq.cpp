@@ -0,0 +1,384 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <algorithm>
+#include "wArq.h"
+#include "wMisc.h"
+
+namespace hnet {
+
+wArq::wArq(uint32_t conv, const Output_t& output) : mConv(conv), mMtu(kArqMtu), mMss(kArqMtu - kArqHeadLen), mSndUna(0), mSndNxt(0), mRcvNxt(0),
+mSndWnd(kArqWnd), mRcvWnd(kArqWnd), mRmtWnd(kArqWnd), mSrtt(0), mRttVar(0), mRto(kArqRto), mRtoMin(kArqRtoMin), mFastResend(kArqFastResend),
+mInterval(kArqInterval), mCurrent(0), mTsFlush(kArqInterval), mTsProbe(0), mProbeWait(0), mProbe(0), mUpdated(false), mDead(false),
+mRetrans(0), mFastRetrans(0), mOutput(output) {
+	mBuf.reserve(mMtu);
+}
+
+int wArq::Send(const char* buf, size_t len) {
+	const size_t count = len == 0? 1: (len + mMss - 1) / mMss;
+	if (count > kArqFragMax || mSndQueue.size() + count > kArqQueueMax) {
+		return -1;
+	}
+	for (size_t i = 0; i < count; i++) {
+		const size_t size = std::min(static_cast<size_t>(mMss), len - i * mMss);
+		mSndQueue.push_back(Segment_t());
+		Segment_t& seg = mSndQueue.back();
+		seg.mData.assign(buf + i * mMss, size);
+		seg.mFrg = static_cast<uint32_t>(count - i - 1);
+		seg.mSn = seg.mTs = seg.mResendTs = seg.mRto = seg.mFastAck = seg.mXmit = 0;
+	}
+	return 0;
+}
+
+int wArq::Recv(std::string* msg) {
+	if (mRcvQueue.empty() || mRcvQueue.size() < mRcvQueue.front().mFrg + 1) {
+		return -1;
+	}
+	const bool recover = mRcvQueue.size() >= mRcvWnd;
+
+	msg->clear();
+	while (!mRcvQueue.empty()) {
+		const uint32_t frg = mRcvQueue.front().mFrg;
+		msg->append(mRcvQueue.front().mData);
+		mRcvQueue.pop_front();
+		if (frg == 0) {
+			break;
+		}
+	}
+	MoveRcv();
+
+	// 接收窗口由满恢复，通告对端
+	if (recover && mRcvQueue.size() < mRcvWnd) {
+		mProbe |= 2;
+	}
+	return 0;
+}
+
+int wArq::Input(const char* data, size_t len) {
+	if (len < kArqHeadLen) {
+		return -1;
+	}
+
+	bool hasmax = false;
+	uint32_t maxack = 0;
+	while (len >= kArqHeadLen) {
+		if (coding::DecodeFixed32(data) != mConv) {
+			return -1;
+		}
+		const uint8_t cmd = static_cast<uint8_t>(data[4]);
+		const uint32_t frg = static_cast<uint8_t>(data[5]);
+		const uint32_t wnd = coding::DecodeFixed16(data + 6);
+		const uint32_t ts = coding::DecodeFixed32(data + 8);
+		const uint32_t sn = coding::DecodeFixed32(data + 12);
+		const uint32_t una = coding::DecodeFixed32(data + 16);
+		const uint32_t size = coding::DecodeFixed32(data + 20);
+		data += kArqHeadLen;
+		len -= kArqHeadLen;
+		if (size > len || cmd < kArqPush || cmd > kArqWins) {
+			return -1;
+		}
+
+		mRmtWnd = wnd;
+		ParseUna(una);
+		ShrinkBuf();
+
+		if (cmd == kArqAck) {
+			if (Diff(mCurrent, ts) >= 0) {
+				UpdateRtt(Diff(mCurrent, ts));
+			}
+			ParseAck(sn);
+			ShrinkBuf();
+			if (!hasmax || Diff(sn, maxack) > 0) {
+				hasmax = true;
+				maxack = sn;
+			}
+		} else if (cmd == kArqPush) {
+			// 窗口内分段均确认（含重复分段，对端可能未收到之前的确认）
+			if (Diff(sn, mRcvNxt + mRcvWnd) < 0) {
+				mAckList.push_back(std::make_pair(sn, ts));
+				if (Diff(sn, mRcvNxt) >= 0) {
+					Segment_t seg;
+					seg.mSn = sn;
+					seg.mFrg = frg;
+					seg.mTs = ts;
+					seg.mResendTs = seg.mRto = seg.mFastAck = seg.mXmit = 0;
+					seg.mData.assign(data, size);
+					ParseData(&seg);
+				}
+			}
+		} else if (cmd == kArqWask) {
+			mProbe |= 2;
+		}
+		data += size;
+		len -= size;
+	}
+
+	if (hasmax) {
+		ParseFastAck(maxack);
+	}
+	return 0;
+}
+
+void wArq::Update(uint32_t current) {
+	mCurrent = current;
+	if (!mUpdated) {
+		mUpdated = true;
+		mTsFlush = current;
+	}
+
+	int32_t slap = Diff(current, mTsFlush);
+	if (slap >= 10000 || slap < -10000) {
+		mTsFlush = current;
+		slap = 0;
+	}
+	if (slap >= 0) {
+		mTsFlush += mInterval;
+		if (Diff(current, mTsFlush) >= 0) {
+			mTsFlush = current + mInterval;
+		}
+		Flush();
+	}
+}
+
+void wArq::Flush() {
+	const uint32_t current = mCurrent;
+
+	// 确认
+	for (size_t i = 0; i < mAckList.size(); i++) {
+		Output(kArqAck, 0, mAckList[i].second, mAckList[i].first, NULL);
+	}
+	mAckList.clear();
+
+	// 对端窗口为0时探测
+	if (mRmtWnd == 0) {
+		if (mProbeWait == 0) {
+			mProbeWait = kArqProbeInit;
+			mTsProbe = current + mProbeWait;
+		} else if (Diff(current, mTsProbe) >= 0) {
+			mProbeWait = std::min(mProbeWait + mProbeWait / 2, kArqProbeMax);
+			mTsProbe = current + mProbeWait;
+			mProbe |= 1;
+		}
+	} else {
+		mTsProbe = mProbeWait = 0;
+	}
+	if (mProbe & 1) {
+		Output(kArqWask, 0, 0, 0, NULL);
+	}
+	if (mProbe & 2) {
+		Output(kArqWins, 0, 0, 0, NULL);
+	}
+	mProbe = 0;
+
+	// 发送队列进入窗口
+	const uint32_t wnd = std::min(mSndWnd, mRmtWnd);
+	while (!mSndQueue.empty() && Diff(mSndNxt, mSndUna + wnd) < 0) {
+		mSndBuf.push_back(Segment_t());
+		Segment_t& seg = mSndBuf.back();
+		seg.mData.swap(mSndQueue.front().mData);
+		seg.mFrg = mSndQueue.front().mFrg;
+		seg.mSn = mSndNxt++;
+		seg.mTs = seg.mResendTs = current;
+		seg.mRto = mRto;
+		seg.mFastAck = seg.mXmit = 0;
+		mSndQueue.pop_front();
+	}
+
+	// 首次发送、超时重传、快速重传
+	const uint32_t resend = mFastResend > 0? mFastResend: 0xffffffff;
+	for (std::deque<Segment_t>::iterator it = mSndBuf.begin(); it != mSndBuf.end(); it++) {
+		bool send = false;
+		if (it->mXmit == 0) {
+			send = true;
+			it->mRto = mRto;
+			it->mResendTs = current + it->mRto;
+		} else if (Diff(current, it->mResendTs) >= 0) {
+			send = true;
+			mRetrans++;
+			it->mRto = std::min(it->mRto + std::max(it->mRto, mRto) / 2, kArqRtoMax);
+			it->mResendTs = current + it->mRto;
+		} else if (it->mFastAck >= resend) {
+			send = true;
+			mFastRetrans++;
+			it->mFastAck = 0;
+			it->mResendTs = current + it->mRto;
+		}
+
+		if (send) {
+			it->mXmit++;
+			it->mTs = current;
+			Output(kArqPush, it->mFrg, it->mTs, it->mSn, &it->mData);
+			if (it->mXmit >= kArqDeadLink) {
+				mDead = true;
+			}
+		}
+	}
+	OutputFlush();
+}
+
+int wArq::SetMtu(uint32_t mtu) {
+	if (mtu <= kArqHeadLen || mtu > 65507) {	// ipv4 udp负载上限
+		return -1;
+	}
+	mMtu = mtu;
+	mMss = mtu - kArqHeadLen;
+	mBuf.reserve(mMtu);
+	return 0;
+}
+
+void wArq::SetWindow(uint32_t snd, uint32_t rcv) {
+	if (snd > 0) {
+		mSndWnd = snd;
+	}
+	if (rcv > 0) {
+		mRcvWnd = std::max(rcv, kArqFragMax);
+	}
+}
+
+void wArq::SetRto(uint32_t rto, uint32_t minrto) {
+	if (minrto > 0) {
+		mRtoMin = minrto;
+	}
+	if (rto > 0) {
+		mRto = std::min(std::max(rto, mRtoMin), kArqRtoMax);
+	}
+}
+
+void wArq::SetFastResend(uint32_t resend) {
+	mFastResend = resend;
+}
+
+void wArq::SetInterval(uint32_t interval) {
+	mInterval = std::min(std::max(interval, static_cast<uint32_t>(1)), static_cast<uint32_t>(5000));
+}
+
+int wArq::PeekConv(const char* data, size_t len, uint32_t* conv) {
+	if (len < kArqHeadLen) {
+		return -1;
+	}
+	*conv = coding::DecodeFixed32(data);
+	return 0;
+}
+
+void wArq::Output(uint8_t cmd, uint32_t frg, uint32_t ts, uint32_t sn, const std::string* data) {
+	const uint32_t size = data != NULL? static_cast<uint32_t>(data->size()): 0;
+	if (mBuf.size() + kArqHeadLen + size > mMtu) {
+		OutputFlush();
+	}
+
+	char head[kArqHeadLen];
+	coding::EncodeFixed32(head, mConv);
+	head[4] = static_cast<char>(cmd);
+	head[5] = static_cast<char>(frg);
+	coding::EncodeFixed16(head + 6, static_cast<uint16_t>(std::min(WndUnused(), static_cast<uint32_t>(0xffff))));
+	coding::EncodeFixed32(head + 8, ts);
+	coding::EncodeFixed32(head + 12, sn);
+	coding::EncodeFixed32(head + 16, mRcvNxt);
+	coding::EncodeFixed32(head + 20, size);
+	mBuf.append(head, kArqHeadLen);
+	if (size > 0) {
+		mBuf.append(*data);
+	}
+}
+
+void wArq::OutputFlush() {
+	if (!mBuf.empty()) {
+		mOutput(mBuf.data(), static_cast<uint32_t>(mBuf.size()));
+		mBuf.clear();
+	}
+}
+
+void wArq::UpdateRtt(int32_t rtt) {
+	if (mSrtt == 0) {
+		mSrtt = rtt;
+		mRttVar = rtt / 2;
+	} else {
+		const int32_t delta = rtt > static_cast<int32_t>(mSrtt)? rtt - mSrtt: mSrtt - rtt;
+		mRttVar = (3 * mRttVar + delta) / 4;
+		mSrtt = (7 * mSrtt + rtt) / 8;
+		if (mSrtt < 1) {
+			mSrtt = 1;
+		}
+	}
+	const uint32_t rto = mSrtt + std::max(mInterval, 4 * mRttVar);
+	mRto = std::min(std::max(rto, mRtoMin), kArqRtoMax);
+}
+
+void wArq::ParseUna(uint32_t una) {
+	while (!mSndBuf.empty() && Diff(una, mSndBuf.front().mSn) > 0) {
+		mSndBuf.pop_front();
+	}
+}
+
+void wArq::ParseAck(uint32_t sn) {
+	if (Diff(sn, mSndUna) < 0 || Diff(sn, mSndNxt) >= 0) {
+		return;
+	}
+	for (std::deque<Segment_t>::iterator it = mSndBuf.begin(); it != mSndBuf.end(); it++) {
+		if (it->mSn == sn) {
+			mSndBuf.erase(it);
+			break;
+		} else if (Diff(it->mSn, sn) > 0) {
+			break;
+		}
+	}
+}
+
+void wArq::ParseFastAck(uint32_t sn) {
+	if (Diff(sn, mSndUna) < 0 || Diff(sn, mSndNxt) >= 0) {
+		return;
+	}
+	// sn之前未确认的分段被越过一次
+	for (std::deque<Segment_t>::iterator it = mSndBuf.begin(); it != mSndBuf.end() && Diff(sn, it->mSn) > 0; it++) {
+		it->mFastAck++;
+	}
+}
+
+void wArq::ParseData(Segment_t* seg) {
+	if (Diff(seg->mSn, mRcvNxt + mRcvWnd) >= 0 || Diff(seg->mSn, mRcvNxt) < 0) {
+		return;
+	}
+
+	// 按sn插入乱序缓冲，重复分段丢弃
+	std::deque<Segment_t>::iterator it = mRcvBuf.end();
+	while (it != mRcvBuf.begin()) {
+		std::deque<Segment_t>::iterator prev = it - 1;
+		if (prev->mSn == seg->mSn) {
+			return;
+		} else if (Diff(seg->mSn, prev->mSn) > 0) {
+			break;
+		}
+		it = prev;
+	}
+	it = mRcvBuf.insert(it, Segment_t());
+	it->mSn = seg->mSn;
+	it->mFrg = seg->mFrg;
+	it->mTs = seg->mTs;
+	it->mData.swap(seg->mData);
+	MoveRcv();
+}
+
+void wArq::ShrinkBuf() {
+	mSndUna = mSndBuf.empty()? mSndNxt: mSndBuf.front().mSn;
+}
+
+void wArq::MoveRcv() {
+	while (!mRcvBuf.empty() && mRcvBuf.front().mSn == mRcvNxt && mRcvQueue.size() < mRcvWnd) {
+		mRcvQueue.push_back(Segment_t());
+		Segment_t& seg = mRcvQueue.back();
+		seg.mSn = mRcvBuf.front().mSn;
+		seg.mFrg = mRcvBuf.front().mFrg;
+		seg.mData.swap(mRcvBuf.front().mData);
+		mRcvBuf.pop_front();
+		mRcvNxt++;
+	}
+}
+
+uint32_t wArq::WndUnused() const {
+	return mRcvQueue.size() < mRcvWnd? static_cast<uint32_t>(mRcvWnd - mRcvQueue.size()): 0;
+}
+
+}	// namespace hnet
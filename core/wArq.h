@@ -0,0 +1,156 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_ARQ_H_
+#define _W_ARQ_H_
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include "wCore.h"
+#include "wNoncopyable.h"
+
+namespace hnet {
+
+// 分段头：conv(4) + cmd(1) + frg(1) + wnd(2) + ts(4) + sn(4) + una(4) + len(4)，小端
+const uint32_t	kArqHeadLen = 24;
+
+// 默认配置（见wArq::Set*）
+const uint32_t	kArqMtu = 1400;			// 数据报最大长度（含分段头）
+const uint32_t	kArqWnd = 128;			// 发送、接收窗口（分段数）
+const uint32_t	kArqRto = 200;			// 初始重传超时（毫秒）
+const uint32_t	kArqRtoMin = 30;		// 最小重传超时（毫秒）
+const uint32_t	kArqRtoMax = 60000;		// 最大重传超时（毫秒）
+const uint32_t	kArqInterval = 10;		// 刷新周期（毫秒）
+const uint32_t	kArqFastResend = 2;		// 被越过kArqFastResend次即快速重传，0为关闭
+const uint32_t	kArqDeadLink = 20;		// 单个分段发送次数上限，超过视为链路断开
+const uint32_t	kArqQueueMax = 4096;	// 发送队列上限（分段数，不含发送窗口中的分段）
+const uint32_t	kArqProbeInit = 7000;	// 对端窗口为0时首次探测等待（毫秒）
+const uint32_t	kArqProbeMax = 120000;
+const uint32_t	kArqFragMax = 128;		// 单个消息最多分段数（接收窗口不小于此值，以容纳完整消息）
+
+// 分段命令
+enum ArqCmd {
+	kArqPush = 81,	// 数据
+	kArqAck = 82,	// 确认（sn、ts为被确认分段）
+	kArqWask = 83,	// 窗口探测
+	kArqWins = 84	// 窗口通告
+};
+
+// 可靠有序udp会话（ARQ，协议同KCP）：一端一个实例，以conv标识会话
+// 可靠：每个数据分段以sn编号；接收端逐个确认收到的分段（选择确认），每个分段头携带una（之前全部已收到，累积确认）
+// 重传：超时重传（RTO按RFC6298由往返时间估算，每次重传增加当前RTO的一半）；被后续分段的确认越过kArqFastResend次即快速重传，不等超时
+// 有序：接收端按sn重组，消息（至多kArqFragMax个分段）按发送顺序交付；丢包只推迟其后消息的交付，窗口内新分段照常发送
+// 流控：发送窗口、对端接收窗口（分段头wnd）取小；对端窗口为0时周期探测
+// 不做拥塞控制（用于延迟敏感、带宽占用低的业务），丢包严重时由对端窗口限速
+// 不含I/O：Input输入收到的数据报；Send、Recv收发消息；Update周期刷新（或Flush立即刷新）时以output回调输出数据报（至多mtu字节）
+// 时间为毫秒（uint32，回绕安全）
+class wArq : private wNoncopyable {
+public:
+	typedef std::function<void(const char* buf, uint32_t len)> Output_t;
+
+	wArq(uint32_t conv, const Output_t& output);
+
+	// 发送消息：按mss分段加入发送队列，下次刷新时在窗口内发出。消息过长（超过kArqFragMax个分段）或队列满返回-1
+	int Send(const char* buf, size_t len);
+	// 接收一条完整消息（按发送顺序），无完整消息返回-1
+	int Recv(std::string* msg);
+	// 输入一个数据报（一个或多个分段），conv不符、格式错误返回-1
+	int Input(const char* data, size_t len);
+
+	// 周期调用（间隔不超过interval），更新当前时刻（毫秒），到刷新时刻时Flush
+	void Update(uint32_t current);
+	// 立即输出确认、窗口探测、窗口内新分段及需重传分段（时刻为最近一次Update）
+	void Flush();
+
+	// 配置：mtu（含分段头），发送、接收窗口（分段数，接收窗口不小于kArqFragMax），初始、最小RTO，快速重传阈值（0关闭），刷新周期
+	int SetMtu(uint32_t mtu);
+	void SetWindow(uint32_t snd, uint32_t rcv);
+	void SetRto(uint32_t rto, uint32_t minrto);
+	void SetFastResend(uint32_t resend);
+	void SetInterval(uint32_t interval);
+
+	// 数据报首个分段的conv，长度不足返回-1
+	static int PeekConv(const char* data, size_t len, uint32_t* conv);
+
+	inline uint32_t Conv() const { return mConv;}
+	// 链路断开（分段发送次数超过kArqDeadLink）
+	inline bool Dead() const { return mDead;}
+	// 待发送、待确认分段数
+	inline size_t WaitSnd() const { return mSndBuf.size() + mSndQueue.size();}
+	inline uint32_t Srtt() const { return mSrtt;}
+	inline uint32_t Rto() const { return mRto;}
+	// 超时重传、快速重传分段数
+	inline uint64_t Retrans() const { return mRetrans;}
+	inline uint64_t FastRetrans() const { return mFastRetrans;}
+
+protected:
+	struct Segment_t {
+		uint32_t mSn;
+		uint32_t mFrg;
+		uint32_t mTs;
+		uint32_t mResendTs;
+		uint32_t mRto;
+		uint32_t mFastAck;
+		uint32_t mXmit;
+		std::string mData;
+	};
+
+	static inline int32_t Diff(uint32_t later, uint32_t earlier) {
+		return static_cast<int32_t>(later - earlier);
+	}
+
+	// 分段写入输出缓冲，缓冲满mtu时输出
+	void Output(uint8_t cmd, uint32_t frg, uint32_t ts, uint32_t sn, const std::string* data);
+	void OutputFlush();
+
+	void UpdateRtt(int32_t rtt);
+	void ParseUna(uint32_t una);
+	void ParseAck(uint32_t sn);
+	void ParseFastAck(uint32_t sn);
+	void ParseData(Segment_t* seg);
+	void ShrinkBuf();
+	void MoveRcv();
+	uint32_t WndUnused() const;
+
+	uint32_t mConv;
+	uint32_t mMtu;
+	uint32_t mMss;
+	uint32_t mSndUna;		// 首个未确认sn
+	uint32_t mSndNxt;		// 下一个发送sn
+	uint32_t mRcvNxt;		// 下一个待交付sn
+	uint32_t mSndWnd;
+	uint32_t mRcvWnd;
+	uint32_t mRmtWnd;		// 对端接收窗口
+	uint32_t mSrtt;
+	uint32_t mRttVar;
+	uint32_t mRto;
+	uint32_t mRtoMin;
+	uint32_t mFastResend;
+	uint32_t mInterval;
+	uint32_t mCurrent;
+	uint32_t mTsFlush;
+	uint32_t mTsProbe;
+	uint32_t mProbeWait;
+	uint8_t mProbe;			// 待发送窗口探测（1）、窗口通告（2）
+	bool mUpdated;
+	bool mDead;
+	uint64_t mRetrans;
+	uint64_t mFastRetrans;
+
+	std::deque<Segment_t> mSndQueue;	// 待进入发送窗口
+	std::deque<Segment_t> mSndBuf;		// 已发送待确认（sn递增）
+	std::deque<Segment_t> mRcvBuf;		// 乱序到达（sn递增）
+	std::deque<Segment_t> mRcvQueue;	// 有序待交付
+	std::vector<std::pair<uint32_t, uint32_t> > mAckList;	// 待确认sn、ts
+
+	std::string mBuf;	// 输出缓冲
+	Output_t mOutput;
+};
+
+}	// namespace hnet
+
+#endif
@@ -0,0 +1,300 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <sys/timerfd.h>
+#include <algorithm>
+#include "wArqTask.h"
+#include "wTcpSocket.h"
+#include "wServer.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+namespace {
+
+// 会话定时器（timerfd，kArqInterval周期）注册至wServer事件循环
+class wArqTimer : public wTask {
+public:
+	wArqTimer(wSocket* socket, wArqTask* task) : wTask(socket), mTask(task) { }
+
+	virtual int TaskRecv(ssize_t *size) {
+		*size = 0;
+		uint64_t expire;
+		if (read(mSocket->FD(), &expire, sizeof(expire)) == -1 && errno != EAGAIN) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTimer::TaskRecv read() failed", error::Strerror(errno).c_str());
+		}
+		mTask->Update();
+		return 0;
+	}
+
+protected:
+	wArqTask* mTask;
+};
+
+inline uint32_t CurrentMs() {
+	return static_cast<uint32_t>(soft::TimeUpdate() / 1000);
+}
+
+}	// namespace anonymous
+
+wArqTask::wArqTask(wSocket *socket, int32_t type) : wUdpTask(socket, type), mSession(NULL), mTimer(NULL), mTimerOn(false) { }
+
+wArqTask::~wArqTask() {
+	for (SessionMap_t::iterator it = mSessions.begin(); it != mSessions.end(); it++) {
+		HNET_DELETE(it->second->mArq);
+		HNET_DELETE(it->second);
+	}
+}
+
+int wArqTask::Dispatch(char buf[], uint32_t len) {
+	uint32_t conv = 0;
+	if (wArq::PeekConv(buf, len, &conv) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Dispatch () failed", "segment too short");
+		return -1;
+	}
+	wArqSession_t* session = Session(mPeer, conv, true);
+	if (session == NULL) {
+		return -1;
+	}
+
+	session->mArq->Update(CurrentMs());
+	if (session->mArq->Input(buf, len) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Dispatch Input() failed", "segment illegal");
+		return -1;
+	}
+	session->mRecvTm = soft::TimeUsec();
+	if (!session->mDirty) {
+		session->mDirty = true;
+		mDirty.push_back(session);
+	}
+
+	// 按序交付的完整消息
+	mSession = session;
+	while (session->mArq->Recv(&mMsg) == 0) {
+		if (mMsg.size() > 0) {
+			wUdpTask::Dispatch(&mMsg[0], static_cast<uint32_t>(mMsg.size()));
+		}
+	}
+	mSession = NULL;
+	return 0;
+}
+
+void wArqTask::DispatchEnd() {
+	for (std::vector<wArqSession_t*>::iterator it = mDirty.begin(); it != mDirty.end(); it++) {
+		(*it)->mDirty = false;
+		(*it)->mArq->Flush();
+	}
+	mDirty.clear();
+}
+
+void wArqTask::Update() {
+	const uint32_t current = CurrentMs();
+	const int64_t idle = soft::TimeUsec() - static_cast<int64_t>(kArqIdleTm) * 1000000;
+	for (SessionMap_t::iterator it = mSessions.begin(); it != mSessions.end();) {
+		SessionMap_t::iterator cur = it++;
+		cur->second->mArq->Update(current);
+		if (cur->second->mArq->Dead() || cur->second->mRecvTm < idle) {
+			SessionErase(cur);
+		}
+	}
+	if (mOutHead < mOut.size()) {
+		Flush();
+	}
+	if (mSessions.empty()) {
+		Timer(false);
+	}
+}
+
+int wArqTask::Send2Buf(char cmd[], size_t len) {
+	if (mSession == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Send2Buf () failed", "no session");
+		return -1;
+	} else if (sizeof(uint32_t) + sizeof(uint8_t) + len > kPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Send2Buf () failed", "message too large");
+		return -1;
+	}
+	Assertbuf(mTempBuff, cmd, len);
+	return SessionSend(mSession, mTempBuff, sizeof(uint32_t) + sizeof(uint8_t) + len);
+}
+
+#ifdef _USE_PROTOBUF_
+int wArqTask::Send2Buf(const google::protobuf::Message* msg, bool cached) {
+	if (mSession == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Send2Buf () failed", "no session");
+		return -1;
+	}
+	size_t len = PbPackLen(msg, cached);
+	if (sizeof(uint32_t) + len > kPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Send2Buf () failed", "message too large");
+		return -1;
+	}
+	Assertbuf(mTempBuff, msg, true);
+	return SessionSend(mSession, mTempBuff, sizeof(uint32_t) + len);
+}
+#endif
+
+int wArqTask::SendTo(const struct sockaddr_in& addr, uint32_t conv, char cmd[], size_t len) {
+	wArqSession_t* session = Session(addr, conv, false);
+	if (session == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::SendTo () failed", "no session");
+		return -1;
+	}
+	wArqSession_t* current = mSession;
+	mSession = session;
+	int ret = Send2Buf(cmd, len);
+	mSession = current;
+	return ret;
+}
+
+#ifdef _USE_PROTOBUF_
+int wArqTask::SendTo(const struct sockaddr_in& addr, uint32_t conv, const google::protobuf::Message* msg) {
+	wArqSession_t* session = Session(addr, conv, false);
+	if (session == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::SendTo () failed", "no session");
+		return -1;
+	}
+	wArqSession_t* current = mSession;
+	mSession = session;
+	int ret = Send2Buf(msg);
+	mSession = current;
+	return ret;
+}
+#endif
+
+int wArqTask::MemoSend(const std::string& data) {
+	// 缓存为连续的完整消息，逐个发往当前会话
+	const char* p = data.data();
+	const char* end = p + data.size();
+	while (p < end) {
+		size_t len = sizeof(uint32_t) + coding::DecodeFixed32(p);
+		if (mSession == NULL || SessionSend(mSession, p, len) == -1) {
+			return p == data.data()? -1: 0;
+		}
+		p += len;
+	}
+	return 0;
+}
+
+int wArqTask::SessionSend(wArqSession_t* session, const char* buf, size_t len) {
+	if (session->mArq->Send(buf, len) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::SessionSend () failed", "message too large or send queue full");
+		return -1;
+	}
+	if (mMemoCapture) {
+		mMemoData.append(buf, len);
+	}
+
+	if (mBatching) {
+		if (!session->mDirty) {
+			session->mDirty = true;
+			mDirty.push_back(session);
+		}
+		return 0;
+	}
+	// 处理函数外立即发送
+	session->mArq->Update(CurrentMs());
+	session->mArq->Flush();
+	return Flush();
+}
+
+wArqSession_t* wArqTask::Session(const struct sockaddr_in& addr, uint32_t conv, bool create) {
+	const std::pair<uint64_t, uint32_t> key(AddrKey(addr), conv);
+	SessionMap_t::iterator it = mSessions.find(key);
+	if (it != mSessions.end()) {
+		return it->second;
+	} else if (!create) {
+		return NULL;
+	} else if (mSessions.size() >= kArqSessionMax) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Session () failed", "too many sessions");
+		return NULL;
+	}
+
+	wArqSession_t* session;
+	HNET_NEW(wArqSession_t(), session);
+	if (session == NULL) {
+		return NULL;
+	}
+	session->mAddr = addr;
+	session->mRecvTm = soft::TimeUsec();
+	session->mDirty = false;
+	HNET_NEW(wArq(conv, [this, session] (const char* buf, uint32_t len) {
+		char* p = Queue(session->mAddr, len);
+		if (p == NULL) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Output () failed", "left buffer not enough");
+			return;
+		}
+		memcpy(p, buf, len);
+	}), session->mArq);
+	if (session->mArq == NULL || SessionOpen(session) == -1) {
+		HNET_DELETE(session->mArq);
+		HNET_DELETE(session);
+		return NULL;
+	}
+
+	mSessions.insert(std::make_pair(key, session));
+	Timer(true);
+	return session;
+}
+
+void wArqTask::SessionErase(SessionMap_t::iterator it) {
+	wArqSession_t* session = it->second;
+	SessionClose(session);
+	mSessions.erase(it);
+	if (session->mDirty) {
+		mDirty.erase(std::find(mDirty.begin(), mDirty.end(), session));
+	}
+	HNET_DELETE(session->mArq);
+	HNET_DELETE(session);
+}
+
+int wArqTask::Timer(bool on) {
+	if (mTimerOn == on) {
+		return 0;
+	}
+
+	if (mTimer == NULL) {
+		if (!on || mServer == NULL) {
+			return -1;
+		}
+		const int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (tfd == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Timer timerfd_create() failed", error::Strerror(errno).c_str());
+			return -1;
+		}
+		wSocket* socket;
+		HNET_NEW(wTcpSocket(kStConnect, kSpUnknown), socket);
+		if (socket == NULL) {
+			close(tfd);
+			return -1;
+		}
+		socket->FD() = tfd;
+		socket->SS() = kSsConnected;
+		HNET_NEW(wArqTimer(socket, this), mTimer);
+		if (mTimer == NULL) {
+			HNET_DELETE(socket);
+			return -1;
+		} else if (mServer->AddTask(mTimer, EPOLLIN) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Timer AddTask() failed", "");
+			HNET_DELETE(mTimer);
+			return -1;
+		}
+	}
+
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	if (on) {
+		spec.it_interval.tv_nsec = spec.it_value.tv_nsec = kArqInterval * 1000000;
+	}
+	if (timerfd_settime(static_cast<int>(mTimer->Socket()->FD()), 0, &spec, NULL) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wArqTask::Timer timerfd_settime() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	mTimerOn = on;
+	return 0;
+}
+
+}	// namespace hnet
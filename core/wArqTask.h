@@ -0,0 +1,92 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_ARQ_TASK_H_
+#define _W_ARQ_TASK_H_
+
+#include <map>
+#include <vector>
+#include "wCore.h"
+#include "wUdpTask.h"
+#include "wArq.h"
+
+namespace hnet {
+
+const uint32_t	kArqIdleTm = 60;			// 会话空闲（未收到数据报）超时（秒）
+const uint32_t	kArqSessionMax = 65536;		// 每进程最多会话数
+
+// 可靠udp会话
+struct wArqSession_t {
+	wArq* mArq;
+	struct sockaddr_in mAddr;
+	int64_t mRecvTm;	// 最近收到数据报时刻（微秒）
+	bool mDirty;		// 本批次有输入或发送，批次结束时刷新
+};
+
+// 可靠有序udp任务（wServer监听协议"ARQ"）：每个对端地址 + conv一个wArq会话（首个数据报建立，空闲kArqIdleTm秒或链路断开时关闭）
+// 会话消息为完整的tcp格式消息（[uint32长度][uint8数据协议][消息]），按command、protobuf路由分发，可超过单个数据报长度
+// 处理函数中Send2Buf（含AsyncSend）发往当前会话；本批数据报处理完后各会话立即输出确认及响应，之后由定时器（kArqInterval）重传
+// 会话状态在worker进程内，监听udp socket为全部worker共享：同一对端的数据报须由同一进程接收，应以单worker运行（或每worker独立端口）
+class wArqTask : public wUdpTask {
+public:
+	wArqTask(wSocket *socket, int32_t type = 0);
+	virtual ~wArqTask();
+
+	virtual int Send2Buf(char cmd[], size_t len);
+#ifdef _USE_PROTOBUF_
+	virtual int Send2Buf(const google::protobuf::Message* msg, bool cached = false);
+#endif
+
+	// 发往指定会话（处理函数外，如保存的Peer()、Conv()），会话不存在返回-1
+	int SendTo(const struct sockaddr_in& addr, uint32_t conv, char cmd[], size_t len);
+#ifdef _USE_PROTOBUF_
+	int SendTo(const struct sockaddr_in& addr, uint32_t conv, const google::protobuf::Message* msg);
+#endif
+
+	// 定时刷新全部会话：重传、窗口探测，关闭空闲、断开会话
+	void Update();
+
+	// 当前会话conv（处理函数中）
+	inline uint32_t Conv() const { return mSession != NULL? mSession->mArq->Conv(): 0;}
+	inline size_t Sessions() const { return mSessions.size();}
+
+protected:
+	typedef std::map<std::pair<uint64_t, uint32_t>, wArqSession_t*> SessionMap_t;
+
+	// 数据报输入会话，交付的完整消息逐个分发
+	virtual int Dispatch(char buf[], uint32_t len);
+	// 刷新本批次的会话
+	virtual void DispatchEnd();
+	// 缓存响应按消息发往当前会话
+	virtual int MemoSend(const std::string& data);
+
+	// 新会话（派生类可配置窗口、RTO等），返回-1拒绝
+	virtual int SessionOpen(wArqSession_t* session) { return 0;}
+	virtual void SessionClose(wArqSession_t* session) { }
+
+	wArqSession_t* Session(const struct sockaddr_in& addr, uint32_t conv, bool create);
+	void SessionErase(SessionMap_t::iterator it);
+	// 完整消息（含长度头）发往会话
+	int SessionSend(wArqSession_t* session, const char* buf, size_t len);
+	// 有会话时启动定时器，无会话时停止
+	int Timer(bool on);
+
+	static inline uint64_t AddrKey(const struct sockaddr_in& addr) {
+		return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+	}
+
+	SessionMap_t mSessions;
+	wArqSession_t* mSession;	// 当前会话（处理函数中）
+	std::vector<wArqSession_t*> mDirty;
+	std::string mMsg;
+
+	wTask* mTimer;		// 定时器任务（timerfd，首个会话建立时注册至server）
+	bool mTimerOn;
+};
+
+}	// namespace hnet
+
+#endif
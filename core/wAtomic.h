@@ -37,6 +37,11 @@ public:
         mRep.store(v, std::memory_order_relaxed);
     }
 
+    // 加v并返回原来的值
+    inline T FetchAdd(T v) {
+        return mRep.fetch_add(v, std::memory_order_acq_rel);
+    }
+
     // 更改为v并返回原来的值
     inline T Exchange(T v) {
         return mRep.exchange(v, std::memory_order_acq_rel);
@@ -31,7 +31,8 @@ const uint8_t CHANNEL_REQ_OPEN = 10;
 struct wChannelReqOpen_t : public wChannelReqCmd_s {
     int32_t mSlot;
     int32_t mFd;
-    wChannelReqOpen_t() : wChannelReqCmd_s(CHANNEL_REQ_OPEN), mSlot(-1), mFd(-1) { }
+    int32_t mEvent;     // 消息环门铃eventfd（与mFd一同经SCM_RIGHTS传递）
+    wChannelReqOpen_t() : wChannelReqCmd_s(CHANNEL_REQ_OPEN), mSlot(-1), mFd(-1), mEvent(-1) { }
 
     inline void set_slot(int32_t slot) {
         mSlot = slot;
@@ -39,12 +40,18 @@ struct wChannelReqOpen_t : public wChannelReqCmd_s {
     inline void set_fd(int32_t fd) {
         mFd = fd;
     }
+    inline void set_event(int32_t event) {
+        mEvent = event;
+    }
     inline int32_t slot() {
         return mSlot;
     }
     inline int32_t fd() {
         return mFd;
     }
+    inline int32_t event() {
+        return mEvent;
+    }
 };
 
 const uint8_t CHANNEL_REQ_CLOSE = 11;
@@ -70,6 +77,19 @@ struct wChannelReqTerminate_t : public wChannelReqCmd_s {
     wChannelReqTerminate_t() : wChannelReqCmd_s(CHANNEL_REQ_TERMINATE) { }
 };
 
+const uint8_t CHANNEL_REQ_LOGLEVEL = 14;
+struct wChannelReqLogLevel_t : public wChannelReqCmd_s {
+    int8_t mLevel;
+    wChannelReqLogLevel_t() : wChannelReqCmd_s(CHANNEL_REQ_LOGLEVEL), mLevel(kLogDebug) { }
+
+    inline void set_level(int8_t level) {
+        mLevel = level;
+    }
+    inline int8_t level() {
+        return mLevel;
+    }
+};
+
 #pragma pack()
 
 }	// namespace hnet
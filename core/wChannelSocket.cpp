@@ -6,6 +6,7 @@
 
 #include <sys/un.h>
 #include <sys/uio.h>
+#include <sys/eventfd.h>
 #include "wLogger.h"
 #include "wMisc.h"
 #include "wTask.h"
@@ -38,12 +39,22 @@ int wChannelSocket::Open() {
     } else if (fcntl(mChannel[1], F_SETFD, FD_CLOEXEC) == -1) {
     	HNET_DEBUG(soft::GetLogPath(), "%s : %s", "wChannelSocket::Open fcntl(1,FD_CLOEXEC) failed", error::Strerror(errno).c_str());
     }
+
+    mEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mEvent == -1) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::Open eventfd() failed", error::Strerror(errno).c_str());
+        return -1;
+    }
     return 0;
 }
 
 int wChannelSocket::Close() {
 	close(mChannel[0]);
 	close(mChannel[1]);
+	if (mEvent != kFDUnknown) {
+		close(mEvent);
+		mEvent = kFDUnknown;
+	}
 	mFD = kFDUnknown;
     return 0;
 }
@@ -53,7 +64,7 @@ int wChannelSocket::RecvBytes(char buf[], size_t len, ssize_t *size) {
 
     union {
         struct cmsghdr  cm;
-        char space[CMSG_SPACE(sizeof(int32_t))];
+        char space[CMSG_SPACE(sizeof(int32_t) * 2)];
     } cmsg;
 
     // 实际的数据缓冲区，I/O向量引用。当要同步文件描述符，iov_base 至少一字节
@@ -78,7 +89,7 @@ int wChannelSocket::RecvBytes(char buf[], size_t len, ssize_t *size) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg(0) failed", error::Strerror(errno).c_str());
     } else if (*size == -1) {
         if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
-            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg(-1) failed", error::Strerror(errno).c_str());
+            HNET_WARN_LIMIT(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg(-1) failed", error::Strerror(errno).c_str());
         } else {
             HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg() failed", error::Strerror(errno).c_str());
             ret = -1;
@@ -104,6 +115,12 @@ int wChannelSocket::RecvBytes(char buf[], size_t len, ssize_t *size) {
                     open.ParseFromArray(buf + sizeof(uint32_t) + sizeof(uint8_t), *size - sizeof(uint32_t) - sizeof(uint8_t));
                     int32_t fd = *(int32_t *) CMSG_DATA(&cmsg.cm);
                     open.set_fd(fd);
+                    // 第二个描述符为消息环门铃
+                    if (cmsg.cm.cmsg_len >= static_cast<socklen_t>(CMSG_LEN(sizeof(int32_t) * 2))) {
+                        open.set_event(*((int32_t *) CMSG_DATA(&cmsg.cm) + 1));
+                    } else {
+                        open.set_event(kFDUnknown);
+                    }
                     wTask::Assertbuf(buf, reinterpret_cast<char*>(&open), sizeof(open));
                 }
             }
@@ -117,14 +134,14 @@ int wChannelSocket::SendBytes(char buf[], size_t len, ssize_t *size) {
 
     union {
         struct cmsghdr  cm;
-        char space[CMSG_SPACE(sizeof(int32_t))];
+        char space[CMSG_SPACE(sizeof(int32_t) * 2)];
     } cmsg;
 
     struct msghdr msg;
 
     // 数据协议
     uint8_t sp = static_cast<uint8_t>(coding::DecodeFixed8(buf + sizeof(uint32_t)));
-    if (sp == kMpProtobuf) {
+    if (sp == kMpProtobuf || sp == kMpProtobufId) {
         msg.msg_control = NULL;
         msg.msg_controllen = 0;
 
@@ -134,16 +151,21 @@ int wChannelSocket::SendBytes(char buf[], size_t len, ssize_t *size) {
             wChannelReqOpen_t open;
             open.ParseFromArray(buf + sizeof(uint32_t) + sizeof(uint8_t), len - sizeof(uint32_t) - sizeof(uint8_t));
 
+            // 有消息环门铃时一并传递
+            int num = open.event() != kFDUnknown? 2: 1;
             msg.msg_control = reinterpret_cast<caddr_t>(&cmsg);
-            msg.msg_controllen = sizeof(cmsg);
+            msg.msg_controllen = CMSG_SPACE(sizeof(int32_t) * num);
             memset(&cmsg, 0, sizeof(cmsg));
 
             cmsg.cm.cmsg_level = SOL_SOCKET;
             cmsg.cm.cmsg_type = SCM_RIGHTS; // 附属数据对象是文件描述符
-            cmsg.cm.cmsg_len = CMSG_LEN(sizeof(int32_t));
+            cmsg.cm.cmsg_len = CMSG_LEN(sizeof(int32_t) * num);
 
             // 文件描述符
             *(int32_t *) CMSG_DATA(&cmsg.cm) = open.fd();
+            if (num == 2) {
+                *((int32_t *) CMSG_DATA(&cmsg.cm) + 1) = open.event();
+            }
         } else {
             msg.msg_control = NULL;
             msg.msg_controllen = 0;
@@ -171,7 +193,7 @@ int wChannelSocket::SendBytes(char buf[], size_t len, ssize_t *size) {
         ret = -1;
     } else if (*size == -1) {
         if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
-            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::SendBytes sendmsg() failed", error::Strerror(errno).c_str());
+            HNET_WARN_LIMIT(soft::GetLogPath(), "%s : %s", "wChannelSocket::SendBytes sendmsg() failed", error::Strerror(errno).c_str());
         } else {
             HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::SendBytes sendmsg() failed", error::Strerror(errno).c_str());
             ret = -1;
@@ -17,6 +17,7 @@ class wChannelSocket : public wSocket {
 public:
     wChannelSocket(SockType type = kStConnect, SockProto proto = kSpChannel, SockFlag flag = kSfRvsd) : wSocket(type, proto, flag) {
         mChannel[0] = mChannel[1] = kFDUnknown;
+        mEvent = kFDUnknown;
     }
     
     virtual ~wChannelSocket();
@@ -30,6 +31,8 @@ public:
         return mChannel[i];
     }
 
+    inline int& Event() { return mEvent;}
+
 protected:
     virtual int Bind(const std::string& host, uint16_t port = 0) {
         return 0;
@@ -38,6 +41,9 @@ protected:
     // 0:传递给其他进程，供写入数据
     // 1:当前进程读取其他进程写入0中的数据
     int mChannel[2];
+
+    // 消息环门铃（eventfd）：其他进程写入该worker消息环后唤醒，该worker读取
+    int mEvent;
 };
 
 }   // namespace hnet
@@ -4,6 +4,7 @@
  * Copyright (C) Hupu, Inc.
  */
 
+#include <algorithm>
 #include "wChannelTask.h" 
 #include "wMisc.h"
 #include "wLogger.h"
@@ -11,14 +12,17 @@
 #include "wMaster.h"
 #include "wWorker.h"
 #include "wChannelCmd.h"
+#include "wChannelSocket.h"
+#include "wShmRing.h"
 
 namespace hnet {
 
-wChannelTask::wChannelTask(wSocket *socket, wMaster *master, int32_t type) : wTask(socket, type), mMaster(master) {
+wChannelTask::wChannelTask(wSocket *socket, wMaster *master, int32_t type) : wTask(socket, type), mMaster(master), mRingEnable(false) {
 	On(CMD_CHANNEL_REQ, CHANNEL_REQ_OPEN, &wChannelTask::ChannelOpen, this);
 	On(CMD_CHANNEL_REQ, CHANNEL_REQ_CLOSE, &wChannelTask::ChannelClose, this);
 	On(CMD_CHANNEL_REQ, CHANNEL_REQ_QUIT, &wChannelTask::ChannelQuit, this);
 	On(CMD_CHANNEL_REQ, CHANNEL_REQ_TERMINATE, &wChannelTask::ChannelTerminate, this);
+	On(CMD_CHANNEL_REQ, CHANNEL_REQ_LOGLEVEL, &wChannelTask::ChannelLogLevel, this);
 }
 
 int wChannelTask::ChannelOpen(struct Request_t *request) {
@@ -28,7 +32,9 @@ int wChannelTask::ChannelOpen(struct Request_t *request) {
 	// 更新描述符
 	mMaster->Worker(open.slot())->Pid() = open.pid();
 	mMaster->Worker(open.slot())->ChannelFD(0) = open.fd();
+	mMaster->Worker(open.slot())->Channel()->Event() = open.event();
 	mMaster->Worker(open.slot())->Timeline() = soft::TimeUnix();
+	mMaster->SlotMax() = std::max(mMaster->SlotMax(), static_cast<uint32_t>(open.slot() + 1));
 
 	// 添加task对象，预备channel的异步写事件
 	wChannelSocket *socket = mMaster->Worker(open.slot())->Channel();
@@ -51,6 +57,7 @@ int wChannelTask::ChannelOpen(struct Request_t *request) {
 			//return -1;
 			exit(0);	// 进程重启
 		}
+		mMaster->Worker(open.slot())->ChannelTask() = task;
 	}
 	return 0;
 }
@@ -87,6 +94,13 @@ int wChannelTask::ChannelClose(struct Request_t *request) {
 	}
 	mMaster->Worker(cls.slot())->ChannelFD(0) = kFDUnknown;
 	mMaster->Worker(cls.slot())->Pid() = -1;
+
+	// 关闭消息环门铃
+	int& event = mMaster->Worker(cls.slot())->Channel()->Event();
+	if (event != kFDUnknown) {
+		close(event);
+		event = kFDUnknown;
+	}
 	return 0;
 }
 
@@ -100,4 +114,50 @@ int wChannelTask::ChannelTerminate(struct Request_t *request) {
 	return 0;
 }
 
+int wChannelTask::ChannelLogLevel(struct Request_t *request) {
+	wChannelReqLogLevel_t loglevel;
+	loglevel.ParseFromArray(request->mBuf, request->mLen);
+	if (loglevel.level() < kLogDebug || loglevel.level() > kLogOff) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[level=%d]", "wChannelTask::ChannelLogLevel () failed", "level invalid", loglevel.level());
+		return -1;
+	}
+	SetLogLevel(loglevel.level());
+	return 0;
+}
+
+int wChannelTask::TaskRecv(ssize_t *size) {
+	if (mRingEnable) {
+		RingRecv();
+	}
+	return wTask::TaskRecv(size);
+}
+
+int wChannelTask::RingRecv() {
+	wMpscRing* ring = mMaster->Worker()->Ring();
+	do {
+		char* msg;
+		uint32_t len;
+		int ret;
+		while ((ret = ring->Front(&msg, &len)) == 1) {
+			Handlemsg(msg, len);
+			ring->Pop();
+		}
+		if (ret == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelTask::RingRecv Front() failed", "ring broken");
+
+			exit(0);	// 进程重启（master重置消息环）
+		}
+	} while (!ring->Sleep());
+	return 0;
+}
+
+int wChannelRingTask::TaskRecv(ssize_t *size) {
+	*size = 0;
+	uint64_t count;
+	if (read(mSocket->FD(), &count, sizeof(count)) == -1 && errno != EAGAIN) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelRingTask::TaskRecv read() failed", error::Strerror(errno).c_str());
+	}
+	return mChannel->RingRecv();
+}
+
 }	// namespace hnet
@@ -23,9 +23,31 @@ public:
     int ChannelClose(struct Request_t *request);
     int ChannelQuit(struct Request_t *request);
     int ChannelTerminate(struct Request_t *request);
+    int ChannelLogLevel(struct Request_t *request);
+
+    // 先处理消息环再读取socket：发送方改经socket前写入环的消息先于socket消息分发
+    virtual int TaskRecv(ssize_t *size);
+
+    // 处理本worker消息环中消息（同channel socket消息分发），处理完标记空闲
+    int RingRecv();
+
+    // 本worker channel，消息环门铃已注册
+    inline bool& RingEnable() { return mRingEnable;}
 
 protected:
     wMaster *mMaster;
+    bool mRingEnable;
+};
+
+// 本worker消息环门铃（eventfd）任务：唤醒时由channel任务处理环中消息
+class wChannelRingTask : public wTask {
+public:
+    wChannelRingTask(wSocket *socket, wChannelTask *channel) : wTask(socket), mChannel(channel) { }
+
+    virtual int TaskRecv(ssize_t *size);
+
+protected:
+    wChannelTask *mChannel;
 };
 
 }	// namespace hnet
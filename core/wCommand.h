@@ -25,6 +25,23 @@ inline uint16_t CmdId(uint8_t cmd, uint8_t para) {
     }
 }
 
+const uint32_t kPbIdBasis = 2166136261u;
+const uint32_t kPbIdPrime = 16777619u;
+
+// protobuf消息类型ID（kMpProtobufId协议），完整类名的FNV-1a哈希
+// 可编译期计算，如 constexpr uint32_t id = PbId("example.ExampleEchoReq");
+inline constexpr uint32_t PbId(const char* name, uint32_t hash = kPbIdBasis) {
+    return *name == '\0' ? hash : PbId(name + 1, (hash ^ static_cast<uint8_t>(*name)) * kPbIdPrime);
+}
+
+// 运行期版本，name无需'\0'结尾
+inline uint32_t PbId(const char* name, size_t len, uint32_t hash = kPbIdBasis) {
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ static_cast<uint8_t>(name[i])) * kPbIdPrime;
+    }
+    return hash;
+}
+
 struct wNull_t {
 public:
     wNull_t(const uint8_t cmd, const uint8_t para): mCmd(cmd), mPara(para) { }
@@ -144,6 +144,21 @@ for (int i = 1; i < argc; i++) {
                 std::cout << "wConfig::ParseArgs failed, invalid option" << " : " << "option \"-l\" requires log_path" << std::endl;
                 return -1;
 
+            case 'u':
+                if (*p) {
+                    SetStrConf("upstream", p);
+                    goto next;
+                }
+
+                p = argv[++i]; // 多一个空格
+                if (*p) {
+                    SetStrConf("upstream", p);
+                    goto next;
+                }
+                //HNET_ERROR(soft::GetLogPath(), "%s : %s", "wConfig::ParseArgs failed, invalid option", "option \"-u\" requires upstream");
+                std::cout << "wConfig::ParseArgs failed, invalid option" << " : " << "option \"-u\" requires upstream" << std::endl;
+                return -1;
+
             case 'n':
                 if (*p) {
                     int i = atoi(p);
@@ -80,6 +80,30 @@ const off_t		kMaxLoggerSize = 104857600;
 const uint8_t	kLoggerNum = 10;
 const uint8_t 	kFFlushPerLog = 0;
 
+// 异步日志：每线程256k无锁缓冲，单条最大4k（多的截断），后台线程空闲时10ms刷盘一次
+const uint32_t	kLoggerRingSize = 262144;
+const uint32_t	kLoggerLineSize = 4096;
+const uint32_t	kLoggerFlushUsec = 10000;
+const uint32_t	kLoggerWriteSize = 65536;	// 日志对象缓冲超过时写入（按记录切分，单次write）
+
+// 日志级别，低于当前级别（SetLogLevel）的日志在格式化前丢弃
+const int8_t	kLogDebug = 0;
+const int8_t	kLogInfo = 1;
+const int8_t	kLogWarn = 2;
+const int8_t	kLogError = 3;
+const int8_t	kLogOff = 4;
+
+// 热点日志限流：每周期（1s）每调用点最多输出10条
+const uint32_t	kLoggerLimitNum = 10;
+const int64_t	kLoggerLimitUsec = 1000000;
+
+// 异步日志缓冲满时策略：丢弃（计数，刷盘时记录丢弃条数）|阻塞等待
+const int8_t	kLoggerDrop = 0;
+const int8_t	kLoggerBlock = 1;
+
+// 二进制日志（_USE_BINLOG_）文件后缀：hnet.log -> hnet.log.bin，由example/logdecode还原为文本
+const char		kLoggerBinSuffix[] = ".bin";
+
 // 1M共享消息队列大小
 const uint32_t  kMsgQueueLen = 1048576;
 
@@ -87,6 +111,8 @@ const uint32_t  kMsgQueueLen = 1048576;
 const uint32_t  kPackageSize = 524288;
 const uint32_t  kMaxPackageSize = 524284;
 const uint32_t  kMinPackageSize = 3;
+const uint32_t  kPbArenaSize = 8192;	// protobuf消息解析arena首块大小
+const uint32_t  kIovMax = 16;	// 单次聚集发送（writev）最多段数
 
 const uint32_t  kPageSize = 4096;
 const bool		kLittleEndian = true;
@@ -105,7 +131,12 @@ const int8_t    kProcessDetached = -5;		// 分离进程
 
 // 消息协议
 const int8_t	kMpCommand = 1;
-const int8_t	kMpProtobuf = 2;
+const int8_t	kMpProtobuf = 2;		// [uint16类名长度][类名][消息体]
+const int8_t	kMpProtobufId = 3;	// [uint32类型ID][消息体]，类型ID见PbId()
+
+// protobuf消息发送时使用kMpProtobufId协议（接收端兼容两种协议）
+// 默认关闭：旧版本对端不识别kMpProtobufId，全部对端升级后再开启
+const bool		kPbIdTurn = false;
 
 // 执行用户
 const uid_t     kDeamonUser = 0;
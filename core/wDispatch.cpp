@@ -0,0 +1,171 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <map>
+#include <typeindex>
+#include "wDispatch.h"
+#include "wMutex.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+namespace {
+
+// 类型 -> 路由表，进程内常驻
+std::map<std::type_index, wDispatch*>& Registry() {
+	static std::map<std::type_index, wDispatch*> registry;
+	return registry;
+}
+
+wMutex& RegistryMutex() {
+	static wMutex mutex;
+	return mutex;
+}
+
+}	// namespace anonymous
+
+wDispatch::wDispatch() : mPbUsed(0) {
+	for (uint32_t i = 0; i < kCmdSize; i++) {
+		mCmd[i] = -1;
+	}
+}
+
+wDispatch::wDispatch(const wDispatch* parent) : mHandler(parent->mHandler), mPbSlot(parent->mPbSlot), mPbUsed(parent->mPbUsed), mRoute(parent->mRoute) {
+	memcpy(mCmd, parent->mCmd, sizeof(mCmd));
+}
+
+wDispatch* wDispatch::Entry(const std::type_info& tid, const wDispatch* parent, bool* build) {
+	wMutexWrapper lock(&RegistryMutex());
+	std::map<std::type_index, wDispatch*>& registry = Registry();
+	std::map<std::type_index, wDispatch*>::iterator it = registry.find(std::type_index(tid));
+	if (it != registry.end()) {
+		*build = false;
+		return it->second;
+	}
+
+	wDispatch* dispatch;
+	if (parent != NULL) {
+		HNET_NEW(wDispatch(parent), dispatch);
+	} else {
+		HNET_NEW(wDispatch(), dispatch);
+	}
+	if (dispatch == NULL) {
+		*build = false;
+		return NULL;
+	}
+	registry.insert(std::make_pair(std::type_index(tid), dispatch));
+	*build = true;
+	return dispatch;
+}
+
+int32_t wDispatch::NewHandler(Thunk_t thunk, const char* func) {
+	Handler_t handler;
+	handler.mThunk = thunk;
+	memcpy(handler.mFunc, func, kFuncSize);
+	handler.mNext = -1;
+	handler.mMemo = 0;
+	mHandler.push_back(handler);
+	return static_cast<int32_t>(mHandler.size() - 1);
+}
+
+void wDispatch::Append(int32_t* head, int32_t i) {
+	// 追加至链表尾，保持注册顺序
+	while (*head >= 0) {
+		head = &mHandler[*head].mNext;
+	}
+	*head = i;
+}
+
+int wDispatch::Memo(uint16_t id, uint32_t ttl) {
+	if (mCmd[id] < 0) {
+		return -1;
+	}
+	mHandler[mCmd[id]].mMemo = ttl;
+	return 0;
+}
+
+int wDispatch::Memo(const std::string& name, uint32_t ttl) {
+	const PbSlot_t* slot = FindPb(PbId(name.data(), name.size()));
+	if (slot == NULL || slot->mName != name) {
+		return -1;
+	}
+	mHandler[slot->mHead].mMemo = ttl;
+	return 0;
+}
+
+int wDispatch::Memo(const wSlice& method, const wSlice& path, uint32_t ttl) {
+	int32_t head = mRoute.Lookup(method, path);
+	if (head < 0) {
+		return -1;
+	}
+	mHandler[head].mMemo = ttl;
+	return 0;
+}
+
+const wDispatch::PbSlot_t* wDispatch::FindPb(uint32_t id) const {
+	if (mPbSlot.empty()) {
+		return NULL;
+	}
+	size_t mask = mPbSlot.size() - 1;
+	for (size_t i = id & mask; ; i = (i + 1) & mask) {
+		const PbSlot_t& slot = mPbSlot[i];
+		if (slot.mHead < 0) {
+			return NULL;
+		} else if (slot.mId == id) {
+			return &slot;
+		}
+	}
+}
+
+wDispatch::PbSlot_t* wDispatch::InsertPb(const char* name, size_t len) {
+	uint32_t id = PbId(name, len);
+	PbSlot_t* slot = const_cast<PbSlot_t*>(FindPb(id));
+	if (slot != NULL) {
+		if (slot->mName.size() == len && memcmp(slot->mName.data(), name, len) == 0) {
+			return slot;
+		}
+		// 类型ID冲突
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[%s|%s]", "wDispatch::InsertPb () failed", "protobuf id collision", slot->mName.c_str(), std::string(name, len).c_str());
+		return NULL;
+	}
+
+	// 负载不超过1/2
+	if ((mPbUsed + 1) * 2 > mPbSlot.size()) {
+		RehashPb();
+	}
+	size_t mask = mPbSlot.size() - 1;
+	size_t i = id & mask;
+	while (mPbSlot[i].mHead >= 0) {
+		i = (i + 1) & mask;
+	}
+	mPbSlot[i].mId = id;
+	mPbSlot[i].mName.assign(name, len);
+	mPbUsed++;
+	return &mPbSlot[i];
+}
+
+void wDispatch::RehashPb() {
+	std::vector<PbSlot_t> old;
+	old.swap(mPbSlot);
+	mPbSlot.resize(old.empty() ? 16 : old.size() * 2);
+
+	size_t mask = mPbSlot.size() - 1;
+	for (std::vector<PbSlot_t>::iterator it = old.begin(); it != old.end(); it++) {
+		if (it->mHead < 0) {
+			continue;
+		}
+		size_t i = it->mId & mask;
+		while (mPbSlot[i].mHead >= 0) {
+			i = (i + 1) & mask;
+		}
+		mPbSlot[i].mId = it->mId;
+		mPbSlot[i].mHead = it->mHead;
+		mPbSlot[i].mName.swap(it->mName);
+	}
+}
+
+}	// namespace hnet
@@ -0,0 +1,208 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_DISPATCH_H_
+#define _W_DISPATCH_H_
+
+#include <vector>
+#include <typeinfo>
+#include "wCore.h"
+#include "wNoncopyable.h"
+#include "wCommand.h"
+#include "wHttpRouter.h"
+
+#ifdef _USE_PROTOBUF_
+#include <google/protobuf/arena.h>
+#endif
+
+namespace hnet {
+
+// 消息绑定函数参数类型
+struct Request_t {
+	char* mBuf;
+	uint32_t mLen;
+#ifdef _USE_PROTOBUF_
+	// protobuf消息分发时有效，处理函数返回后重置（其上分配的消息随之失效）
+	google::protobuf::Arena* mArena;
+
+	// 在mArena上解析protobuf消息，失败返回NULL
+	template<typename T>
+	T* Parse() {
+		if (mArena == NULL) {
+			return NULL;
+		}
+		T* msg = google::protobuf::Arena::CreateMessage<T>(mArena);
+		return msg->ParseFromArray(mBuf, mLen)? msg: NULL;
+	}
+
+	Request_t(char buf[], uint32_t len) : mBuf(buf), mLen(len), mArena(NULL) { }
+#else
+	Request_t(char buf[], uint32_t len) : mBuf(buf), mLen(len) { }
+#endif
+};
+
+class wTask;
+class wDispatchNull_t;
+
+// 消息路由表
+// 同一task类的所有实例共享一张表：该类首个实例构造时注册（On），之后只读。派生类的表继承基类表中已注册的路由
+// command消息：CmdId为下标的64K平坦数组，O(1)查找
+// protobuf消息：以类型ID（PbId）为键的开放寻址哈希表，兼容类名（kMpProtobuf）与类型ID（kMpProtobufId）两种协议
+// http路径：方法 + 路径的压缩前缀树（wHttpRouter）
+// 处理函数以成员函数指针保存，分发时绑定task实例（this）
+// 注意：同一task类的首个实例应在单一线程中构造完成
+class wDispatch : private wNoncopyable {
+public:
+	// 分发跳板函数，将成员函数指针还原为T类型并在task上调用
+	typedef int (*Thunk_t)(wTask* task, const char* func, struct Request_t* argv);
+
+	template<typename T>
+	static int Thunk(wTask* task, const char* func, struct Request_t* argv) {
+		int (T::*f)(struct Request_t* argv);
+		memcpy(&f, func, sizeof(f));
+		return (static_cast<T*>(task)->*f)(argv);
+	}
+
+	// 返回类型tid的路由表。不存在则以parent为基础创建，并置*build=true，由调用者（该类首个实例）注册路由
+	// 内存申请失败返回NULL
+	static wDispatch* Entry(const std::type_info& tid, const wDispatch* parent, bool* build);
+
+	// 注册command消息路由（多播：同一消息按注册顺序依次调用）
+	template<typename T>
+	void On(uint16_t id, int (T::*func)(struct Request_t* argv)) {
+		static_assert(sizeof(func) == kFuncSize, "member function pointer size");
+		int32_t i = NewHandler(&Thunk<T>, reinterpret_cast<const char*>(&func));
+		Append(&mCmd[id], i);
+	}
+
+	// 注册protobuf消息路由
+	// 类型ID与已注册的其他类名冲突时返回-1，该路由不生效
+	template<typename T>
+	int On(const std::string& name, int (T::*func)(struct Request_t* argv)) {
+		static_assert(sizeof(func) == kFuncSize, "member function pointer size");
+		PbSlot_t* slot = InsertPb(name.data(), name.size());
+		if (slot == NULL) {
+			return -1;
+		}
+		int32_t i = NewHandler(&Thunk<T>, reinterpret_cast<const char*>(&func));
+		Append(&slot->mHead, i);
+		return 0;
+	}
+
+	// 注册http路径路由（见wHttpRouter）。方法、路径非法或参数名冲突返回-1
+	template<typename T>
+	int On(const wSlice& method, const wSlice& path, int (T::*func)(struct Request_t* argv)) {
+		static_assert(sizeof(func) == kFuncSize, "member function pointer size");
+		int32_t* head = mRoute.Insert(method, path);
+		if (head == NULL) {
+			return -1;
+		}
+		int32_t i = NewHandler(&Thunk<T>, reinterpret_cast<const char*>(&func));
+		Append(head, i);
+		return 0;
+	}
+
+	// command消息分发，无对应路由返回false
+	inline bool Emit(wTask* task, uint16_t id, struct Request_t* argv) const {
+		return Call(task, mCmd[id], argv);
+	}
+
+	// protobuf消息分发（类型ID），无对应路由返回false
+	inline bool EmitPb(wTask* task, uint32_t id, struct Request_t* argv) const {
+		const PbSlot_t* slot = FindPb(id);
+		return slot != NULL && Call(task, slot->mHead, argv);
+	}
+
+	// protobuf消息分发（类名），无对应路由返回false
+	inline bool EmitPb(wTask* task, const char* name, size_t len, struct Request_t* argv) const {
+		const PbSlot_t* slot = FindPb(PbId(name, len));
+		if (slot == NULL || slot->mName.size() != len || memcmp(slot->mName.data(), name, len) != 0) {
+			return false;
+		}
+		return Call(task, slot->mHead, argv);
+	}
+
+	// http路径分发，路径参数写入params
+	// 返回0已分发；-1无匹配路径；-2路径匹配而方法不匹配
+	inline int EmitHttp(wTask* task, const wSlice& method, const wSlice& path, wHttpParams_t* params, struct Request_t* argv) const {
+		int32_t i = mRoute.Find(method, path, params);
+		if (i < 0) {
+			return i;
+		}
+		Call(task, i, argv);
+		return 0;
+	}
+
+	inline const wHttpRouter& Route() const { return mRoute;}
+
+	// 响应缓存（见wResponseCache）：设置已注册路由的缓存有效期（毫秒，0为不缓存），路由不存在返回-1
+	int Memo(uint16_t id, uint32_t ttl);
+	int Memo(const std::string& name, uint32_t ttl);
+	int Memo(const wSlice& method, const wSlice& path, uint32_t ttl);
+
+	inline uint32_t MemoCmd(uint16_t id) const { return MemoTtl(mCmd[id]);}
+	inline uint32_t MemoPb(uint32_t id) const {
+		const PbSlot_t* slot = FindPb(id);
+		return slot == NULL? 0: MemoTtl(slot->mHead);
+	}
+
+	// http路径分步分发（查找缓存有效期后再调用）：FindHttp返回值同EmitHttp，>=0为处理函数链表头
+	inline int32_t FindHttp(const wSlice& method, const wSlice& path, wHttpParams_t* params) const {
+		return mRoute.Find(method, path, params);
+	}
+	inline uint32_t MemoTtl(int32_t i) const { return i < 0? 0: mHandler[i].mMemo;}
+	inline void CallHttp(wTask* task, int32_t i, struct Request_t* argv) const { Call(task, i, argv);}
+
+protected:
+	static const size_t kFuncSize = sizeof(int (wDispatchNull_t::*)(struct Request_t* argv));
+	static const uint32_t kCmdSize = 65536;
+
+	struct Handler_t {
+		Thunk_t mThunk;
+		char mFunc[kFuncSize];
+		int32_t mNext;	// 多播链表下一处理函数，-1结束
+		uint32_t mMemo;	// 响应缓存有效期（毫秒），链表头有效
+	};
+
+	struct PbSlot_t {
+		uint32_t mId;
+		int32_t mHead;	// -1为空槽
+		std::string mName;
+		PbSlot_t() : mId(0), mHead(-1) { }
+	};
+
+	wDispatch();
+	explicit wDispatch(const wDispatch* parent);
+
+	inline bool Call(wTask* task, int32_t i, struct Request_t* argv) const {
+		if (i < 0) {
+			return false;
+		}
+		for (; i >= 0; i = mHandler[i].mNext) {
+			(*mHandler[i].mThunk)(task, mHandler[i].mFunc, argv);
+		}
+		return true;
+	}
+
+	int32_t NewHandler(Thunk_t thunk, const char* func);
+	void Append(int32_t* head, int32_t i);
+
+	// 查找类型ID槽，不存在返回NULL
+	const PbSlot_t* FindPb(uint32_t id) const;
+	// 查找类名槽，不存在则插入。类型ID冲突返回NULL
+	PbSlot_t* InsertPb(const char* name, size_t len);
+	void RehashPb();
+
+	int32_t mCmd[kCmdSize];	// CmdId -> 处理函数链表头，-1为无路由
+	std::vector<Handler_t> mHandler;
+	std::vector<PbSlot_t> mPbSlot;	// 容量为2的幂，负载不超过1/2
+	size_t mPbUsed;
+	wHttpRouter mRoute;
+};
+
+}	// namespace hnet
+
+#endif
@@ -97,6 +97,9 @@ public:
     // 要求：外部保证同步操作
     virtual int Read(uint64_t offset, size_t n, wSlice* result, char* scratch);
 
+    // 文件描述符（sendfile等零拷贝发送）
+    inline int FD() const { return mFD;}
+
 private:
     std::string mFilename;
     int mFD;
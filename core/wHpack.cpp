@@ -0,0 +1,437 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wHpack.h"
+
+namespace hnet {
+
+namespace {
+
+struct StaticEntry_t {
+	const char* mName;
+	const char* mValue;
+};
+
+// 静态表（RFC7541 附录A），下标自1起
+const StaticEntry_t kStaticTable[kHpackStaticNum] = {
+	{":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"}, {":path", "/index.html"},
+	{":scheme", "http"}, {":scheme", "https"}, {":status", "200"}, {":status", "204"}, {":status", "206"},
+	{":status", "304"}, {":status", "400"}, {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""}, {"access-control-allow-origin", ""},
+	{"age", ""}, {"allow", ""}, {"authorization", ""}, {"cache-control", ""}, {"content-disposition", ""},
+	{"content-encoding", ""}, {"content-language", ""}, {"content-length", ""}, {"content-location", ""}, {"content-range", ""},
+	{"content-type", ""}, {"cookie", ""}, {"date", ""}, {"etag", ""}, {"expect", ""},
+	{"expires", ""}, {"from", ""}, {"host", ""}, {"if-match", ""}, {"if-modified-since", ""},
+	{"if-none-match", ""}, {"if-range", ""}, {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""},
+	{"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""}, {"proxy-authorization", ""}, {"range", ""},
+	{"referer", ""}, {"refresh", ""}, {"retry-after", ""}, {"server", ""}, {"set-cookie", ""},
+	{"strict-transport-security", ""}, {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""},
+	{"www-authenticate", ""}
+};
+
+struct HuffmanCode_t {
+	uint32_t mCode;
+	uint8_t mBits;
+};
+
+// Huffman码表（RFC7541 附录B），下标为符号，256为EOS
+const HuffmanCode_t kHuffmanCode[257] = {
+	{0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+	{0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+	{0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+	{0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+	{0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+	{0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+	{0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+	{0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+	{0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+	{0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+	{0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+	{0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+	{0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+	{0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+	{0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+	{0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+	{0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+	{0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+	{0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+	{0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+	{0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+	{0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+	{0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+	{0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+	{0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+	{0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+	{0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+	{0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+	{0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+	{0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+	{0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+	{0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+	{0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+	{0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+	{0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+	{0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+	{0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+	{0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+	{0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+	{0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+	{0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+	{0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+	{0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+// Huffman解码状态机：状态为码树内部节点（共256个，0为根），每次输入4位
+// 码长至少5位，故每4位最多解出一个符号
+struct HuffmanDecoder_t {
+	enum {
+		kEmit = 1,
+		kFail = 2	// 解出EOS
+	};
+
+	struct Entry_t {
+		uint8_t mState;
+		uint8_t mFlag;
+		uint8_t mSym;
+	};
+
+	HuffmanDecoder_t() {
+		// 码树：子节点 >0 为内部节点，<0 为叶子 -(符号 + 1)
+		int16_t child[256][2];
+		memset(child, 0, sizeof(child));
+		int num = 1;
+		for (int sym = 0; sym < 257; sym++) {
+			const HuffmanCode_t& h = kHuffmanCode[sym];
+			int node = 0;
+			for (int b = h.mBits - 1; b > 0; b--) {
+				int bit = (h.mCode >> b) & 1;
+				if (child[node][bit] == 0) {
+					child[node][bit] = static_cast<int16_t>(num++);
+				}
+				node = child[node][bit];
+			}
+			child[node][h.mCode & 1] = static_cast<int16_t>(-(sym + 1));
+		}
+
+		// 可结束状态：自根节点全为1且不超过7位（EOS前缀填充）
+		memset(mAccept, 0, sizeof(mAccept));
+		int node = 0;
+		mAccept[node] = true;
+		for (int i = 0; i < 7; i++) {
+			node = child[node][1];
+			mAccept[node] = true;
+		}
+
+		for (int s = 0; s < 256; s++) {
+			for (int n = 0; n < 16; n++) {
+				Entry_t& e = mEntry[s][n];
+				int cur = s;
+				e.mFlag = 0;
+				e.mSym = 0;
+				for (int i = 3; i >= 0; i--) {
+					int c = child[cur][(n >> i) & 1];
+					if (c == -257) {
+						e.mFlag = kFail;
+						break;
+					} else if (c < 0) {
+						e.mFlag = kEmit;
+						e.mSym = static_cast<uint8_t>(-c - 1);
+						cur = 0;
+					} else {
+						cur = c;
+					}
+				}
+				e.mState = static_cast<uint8_t>(cur);
+			}
+		}
+	}
+
+	Entry_t mEntry[256][16];
+	bool mAccept[256];
+};
+
+bool HuffmanDecode(const uint8_t* p, size_t len, std::string* out) {
+	static const HuffmanDecoder_t decoder;
+	uint8_t state = 0;
+	for (const uint8_t* end = p + len; p < end; p++) {
+		const HuffmanDecoder_t::Entry_t& hi = decoder.mEntry[state][*p >> 4];
+		if (hi.mFlag & HuffmanDecoder_t::kFail) {
+			return false;
+		} else if (hi.mFlag & HuffmanDecoder_t::kEmit) {
+			out->push_back(static_cast<char>(hi.mSym));
+		}
+		const HuffmanDecoder_t::Entry_t& lo = decoder.mEntry[hi.mState][*p & 0xf];
+		if (lo.mFlag & HuffmanDecoder_t::kFail) {
+			return false;
+		} else if (lo.mFlag & HuffmanDecoder_t::kEmit) {
+			out->push_back(static_cast<char>(lo.mSym));
+		}
+		state = lo.mState;
+	}
+	return decoder.mAccept[state];
+}
+
+size_t HuffmanLength(const wSlice& s) {
+	size_t bits = 0;
+	for (size_t i = 0; i < s.size(); i++) {
+		bits += kHuffmanCode[static_cast<uint8_t>(s[i])].mBits;
+	}
+	return (bits + 7) / 8;
+}
+
+void HuffmanEncode(const wSlice& s, std::string* out) {
+	uint64_t acc = 0;
+	int n = 0;
+	for (size_t i = 0; i < s.size(); i++) {
+		const HuffmanCode_t& h = kHuffmanCode[static_cast<uint8_t>(s[i])];
+		acc = (acc << h.mBits) | h.mCode;
+		n += h.mBits;
+		while (n >= 8) {
+			n -= 8;
+			out->push_back(static_cast<char>(acc >> n));
+		}
+		acc &= (1u << n) - 1;
+	}
+	if (n > 0) {
+		// EOS前缀填充
+		out->push_back(static_cast<char>((acc << (8 - n)) | (0xff >> n)));
+	}
+}
+
+// 整数（RFC7541 5.1）：prefix位前缀，first为首字节高位标志
+void EncodeInteger(std::string* out, uint8_t first, int prefix, uint32_t v) {
+	const uint32_t max = (1u << prefix) - 1;
+	if (v < max) {
+		out->push_back(static_cast<char>(first | v));
+		return;
+	}
+	out->push_back(static_cast<char>(first | max));
+	for (v -= max; v >= 128; v >>= 7) {
+		out->push_back(static_cast<char>(0x80 | (v & 0x7f)));
+	}
+	out->push_back(static_cast<char>(v));
+}
+
+bool DecodeInteger(const uint8_t** p, const uint8_t* end, int prefix, uint32_t* v) {
+	const uint32_t max = (1u << prefix) - 1;
+	uint32_t x = *(*p)++ & max;
+	if (x < max) {
+		*v = x;
+		return true;
+	}
+	for (int shift = 0; *p < end && shift <= 21; shift += 7) {
+		uint8_t b = *(*p)++;
+		x += static_cast<uint32_t>(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*v = x;
+			return true;
+		}
+	}
+	return false;
+}
+
+void EncodeString(std::string* out, const wSlice& s) {
+	size_t len = HuffmanLength(s);
+	if (len < s.size()) {
+		EncodeInteger(out, 0x80, 7, static_cast<uint32_t>(len));
+		HuffmanEncode(s, out);
+	} else {
+		EncodeInteger(out, 0, 7, static_cast<uint32_t>(s.size()));
+		out->append(s.data(), s.size());
+	}
+}
+
+bool DecodeString(const uint8_t** p, const uint8_t* end, std::string* out) {
+	if (*p >= end) {
+		return false;
+	}
+	const bool huffman = (**p & 0x80) != 0;
+	uint32_t len;
+	if (!DecodeInteger(p, end, 7, &len) || len > static_cast<size_t>(end - *p)) {
+		return false;
+	}
+	out->clear();
+	if (huffman) {
+		if (!HuffmanDecode(*p, len, out)) {
+			return false;
+		}
+	} else {
+		out->assign(reinterpret_cast<const char*>(*p), len);
+	}
+	*p += len;
+	return true;
+}
+
+inline size_t EntrySize(const wSlice& name, const wSlice& value) {
+	return name.size() + value.size() + 32;
+}
+
+}	// namespace anonymous
+
+bool wHpackTable::Get(uint32_t index, wSlice* name, wSlice* value) const {
+	if (index == 0) {
+		return false;
+	} else if (index <= kHpackStaticNum) {
+		*name = kStaticTable[index - 1].mName;
+		*value = kStaticTable[index - 1].mValue;
+		return true;
+	}
+	index -= kHpackStaticNum + 1;
+	if (index >= mEntry.size()) {
+		return false;
+	}
+	*name = mEntry[index].mName;
+	*value = mEntry[index].mValue;
+	return true;
+}
+
+void wHpackTable::Add(const wSlice& name, const wSlice& value) {
+	const size_t size = EntrySize(name, value);
+	if (size > mMaxSize) {
+		// 大于表容量：清空动态表，不加入
+		Evict(0);
+		return;
+	}
+	Evict(mMaxSize - size);
+	mEntry.push_front(wHpackHeader_t());
+	mEntry.front().mName.assign(name.data(), name.size());
+	mEntry.front().mValue.assign(value.data(), value.size());
+	mSize += size;
+}
+
+void wHpackTable::SetMaxSize(size_t size) {
+	mMaxSize = size;
+	Evict(size);
+}
+
+void wHpackTable::Evict(size_t size) {
+	while (mSize > size && !mEntry.empty()) {
+		mSize -= EntrySize(mEntry.back().mName, mEntry.back().mValue);
+		mEntry.pop_back();
+	}
+}
+
+uint32_t wHpackTable::Find(const wSlice& name, const wSlice& value, bool* exact) const {
+	uint32_t found = 0;
+	*exact = false;
+	for (uint32_t i = 0; i < kHpackStaticNum; i++) {
+		if (name == kStaticTable[i].mName) {
+			if (value == kStaticTable[i].mValue) {
+				*exact = true;
+				return i + 1;
+			} else if (found == 0) {
+				found = i + 1;
+			}
+		}
+	}
+	for (uint32_t i = 0; i < mEntry.size(); i++) {
+		if (name == mEntry[i].mName) {
+			if (value == mEntry[i].mValue) {
+				*exact = true;
+				return kHpackStaticNum + 1 + i;
+			} else if (found == 0) {
+				found = kHpackStaticNum + 1 + i;
+			}
+		}
+	}
+	return found;
+}
+
+int wHpackDecoder::Decode(const char* buf, size_t len, std::vector<wHpackHeader_t>* headers, size_t limit) {
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+	const uint8_t* end = p + len;
+	size_t total = 0;
+	bool first = true;
+	wHpackHeader_t h;
+	while (p < end) {
+		const uint8_t c = *p;
+		if ((c & 0xe0) == 0x20) {
+			// 动态表大小更新，仅在块起始处
+			uint32_t size;
+			if (!first || !DecodeInteger(&p, end, 5, &size) || size > mLimit) {
+				return -1;
+			}
+			mTable.SetMaxSize(size);
+			continue;
+		}
+		first = false;
+
+		if (c & 0x80) {
+			// 下标
+			uint32_t index;
+			wSlice name, value;
+			if (!DecodeInteger(&p, end, 7, &index) || !mTable.Get(index, &name, &value)) {
+				return -1;
+			}
+			h.mName.assign(name.data(), name.size());
+			h.mValue.assign(value.data(), value.size());
+		} else {
+			// 字面量：0x40加入动态表，0x10永不索引，0x00不索引
+			const bool index = (c & 0xc0) == 0x40;
+			uint32_t i;
+			if (!DecodeInteger(&p, end, index? 6: 4, &i)) {
+				return -1;
+			}
+			if (i == 0) {
+				if (!DecodeString(&p, end, &h.mName)) {
+					return -1;
+				}
+			} else {
+				wSlice name, value;
+				if (!mTable.Get(i, &name, &value)) {
+					return -1;
+				}
+				h.mName.assign(name.data(), name.size());
+			}
+			if (!DecodeString(&p, end, &h.mValue)) {
+				return -1;
+			}
+			if (index) {
+				mTable.Add(h.mName, h.mValue);
+			}
+		}
+		// 超过限制后不再保存header，但继续解码整个块以保持动态表同步
+		total += EntrySize(h.mName, h.mValue);
+		if (total <= limit) {
+			headers->push_back(h);
+		}
+	}
+	return total > limit? -2: 0;
+}
+
+void wHpackEncoder::Begin(std::string* out) {
+	if (mUpdate) {
+		EncodeInteger(out, 0x20, 5, static_cast<uint32_t>(mTable.MaxSize()));
+		mUpdate = false;
+	}
+}
+
+void wHpackEncoder::Encode(const wSlice& name, const wSlice& value, std::string* out, bool index) {
+	bool exact;
+	uint32_t i = mTable.Find(name, value, &exact);
+	if (exact) {
+		EncodeInteger(out, 0x80, 7, i);
+		return;
+	}
+	EncodeInteger(out, index? 0x40: 0x00, index? 6: 4, i);
+	if (i == 0) {
+		EncodeString(out, name);
+	}
+	EncodeString(out, value);
+	if (index) {
+		mTable.Add(name, value);
+	}
+}
+
+void wHpackEncoder::SetMaxSize(size_t size) {
+	size = std::min(size, static_cast<size_t>(kHpackTableSize));
+	if (size != mTable.MaxSize()) {
+		mTable.SetMaxSize(size);
+		mUpdate = true;
+	}
+}
+
+}	// namespace hnet
@@ -0,0 +1,83 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HPACK_H_
+#define _W_HPACK_H_
+
+#include <deque>
+#include <vector>
+#include "wCore.h"
+#include "wSlice.h"
+
+namespace hnet {
+
+// 动态表大小（SETTINGS_HEADER_TABLE_SIZE默认值），编码端不超过此值
+const uint32_t	kHpackTableSize = 4096;
+// 静态表条数（RFC7541 附录A）
+const uint32_t	kHpackStaticNum = 61;
+
+struct wHpackHeader_t {
+	std::string mName;
+	std::string mValue;
+};
+
+// HPACK（RFC7541）动态表：新条目下标最小，条目大小为 名称 + 值 + 32，超过上限时淘汰最旧条目
+// 下标自1起，1~61为静态表，之后为动态表
+class wHpackTable {
+public:
+	wHpackTable() : mSize(0), mMaxSize(kHpackTableSize) { }
+
+	bool Get(uint32_t index, wSlice* name, wSlice* value) const;
+	void Add(const wSlice& name, const wSlice& value);
+	void SetMaxSize(size_t size);
+	inline size_t MaxSize() const { return mMaxSize;}
+
+	// 查找header：完全匹配返回下标且exact为true；否则返回名称匹配下标，0为无
+	uint32_t Find(const wSlice& name, const wSlice& value, bool* exact) const;
+
+protected:
+	void Evict(size_t size);
+
+	std::deque<wHpackHeader_t> mEntry;	// 头部为最新条目
+	size_t mSize;
+	size_t mMaxSize;
+};
+
+// header块解码
+class wHpackDecoder {
+public:
+	wHpackDecoder() : mLimit(kHpackTableSize) { }
+
+	// 解码完整header块（HEADERS + CONTINUATION），追加至headers
+	// 返回0成功；-1格式错误（COMPRESSION_ERROR，连接不可再用）；-2 header列表超过limit（名称 + 值 + 32之和，超出后不再追加，动态表已更新）
+	int Decode(const char* p, size_t len, std::vector<wHpackHeader_t>* headers, size_t limit);
+
+protected:
+	wHpackTable mTable;
+	size_t mLimit;	// 本端SETTINGS_HEADER_TABLE_SIZE，动态表大小更新上限
+};
+
+// header块编码：静态表、动态表匹配时为下标，字符串Huffman编码更短时使用Huffman
+class wHpackEncoder {
+public:
+	wHpackEncoder() : mUpdate(false) { }
+
+	// header块开始：写入待定的动态表大小更新
+	void Begin(std::string* out);
+	// 编码一个header（名称须为小写）。index为false时不加入动态表（如date、content-length等每次变化的值）
+	void Encode(const wSlice& name, const wSlice& value, std::string* out, bool index = true);
+
+	// 对端SETTINGS_HEADER_TABLE_SIZE
+	void SetMaxSize(size_t size);
+
+protected:
+	wHpackTable mTable;
+	bool mUpdate;	// 下一header块起始处发送动态表大小更新
+};
+
+}	// namespace hnet
+
+#endif
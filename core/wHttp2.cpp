@@ -0,0 +1,882 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wHttp2.h"
+#include "wTask.h"
+#include "wHttpFile.h"
+#include "wHttpParser.h"
+#include "wFile.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+namespace {
+
+inline uint32_t Get32(const char* p) {
+	const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+	return (static_cast<uint32_t>(u[0]) << 24) | (static_cast<uint32_t>(u[1]) << 16) | (static_cast<uint32_t>(u[2]) << 8) | u[3];
+}
+
+inline uint16_t Get16(const char* p) {
+	const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+	return static_cast<uint16_t>((u[0] << 8) | u[1]);
+}
+
+inline void Put32(char* p, uint32_t v) {
+	p[0] = static_cast<char>(v >> 24);
+	p[1] = static_cast<char>(v >> 16);
+	p[2] = static_cast<char>(v >> 8);
+	p[3] = static_cast<char>(v);
+}
+
+inline void Put16(char* p, uint16_t v) {
+	p[0] = static_cast<char>(v >> 8);
+	p[1] = static_cast<char>(v);
+}
+
+inline void PutHead(char* p, uint32_t len, uint8_t type, uint8_t flags, uint32_t id) {
+	p[0] = static_cast<char>(len >> 16);
+	p[1] = static_cast<char>(len >> 8);
+	p[2] = static_cast<char>(len);
+	p[3] = static_cast<char>(type);
+	p[4] = static_cast<char>(flags);
+	Put32(p + 5, id);
+}
+
+// 连接专用header，HTTP/2中禁止（RFC7540 8.1.2.2）
+inline bool ConnectionHeader(const wSlice& name) {
+	return name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" || name == "upgrade";
+}
+
+// 每次响应都变化的header不加入动态表
+inline bool Volatile(const wSlice& name) {
+	return name == "date" || name == "content-length" || name == "content-range" || name == "last-modified" || name == "etag" || name == "set-cookie";
+}
+
+inline bool ValidValue(const wSlice& value) {
+	for (size_t i = 0; i < value.size(); i++) {
+		if (value[i] == '\r' || value[i] == '\n' || value[i] == '\0') {
+			return false;
+		}
+	}
+	return true;
+}
+
+// 请求行字段（方法、路径）：可见字符
+inline bool ValidToken(const wSlice& token) {
+	for (size_t i = 0; i < token.size(); i++) {
+		if (static_cast<uint8_t>(token[i]) <= ' ' || token[i] == 0x7f) {
+			return false;
+		}
+	}
+	return !token.empty();
+}
+
+// header名称：小写、无空白及控制字符
+inline bool ValidName(const wSlice& name) {
+	for (size_t i = 0; i < name.size(); i++) {
+		const uint8_t c = static_cast<uint8_t>(name[i]);
+		if ((c >= 'A' && c <= 'Z') || c <= ' ' || c == ':' || c >= 0x7f) {
+			return false;
+		}
+	}
+	return !name.empty();
+}
+
+}	// namespace anonymous
+
+wHttp2Session::wHttp2Session(wTask* task) : mTask(task), mPreface(kHttp2PrefaceLen), mLastId(0), mGoaway(false), mPeerGoaway(false),
+mPeerFrameSize(kHttp2FrameSize), mPeerWindow(kHttp2DefaultWindow), mSendWindow(kHttp2DefaultWindow), mRecvWindow(kHttp2DefaultWindow),
+mRecvUnack(0), mBlockId(0), mBlockEnd(false) { }
+
+wHttp2Session::~wHttp2Session() {
+	for (std::map<uint32_t, wHttp2Stream_t*>::iterator it = mStream.begin(); it != mStream.end(); it++) {
+		if (it->second->mFile != NULL) {
+			wHttpFile::Default()->Release(it->second->mFile);
+		}
+		HNET_DELETE(it->second);
+	}
+	Collect();
+}
+
+int wHttp2Session::Start(const wSlice& settings, bool upgrade, bool head) {
+	// 服务端序言：SETTINGS须为首帧
+	char buf[18];
+	Put16(buf, kMaxConcurrentStreams);
+	Put32(buf + 2, kHttp2MaxStreams);
+	Put16(buf + 6, kInitialWindowSize);
+	Put32(buf + 8, kHttp2StreamWindow);
+	Put16(buf + 12, kMaxHeaderListSize);
+	Put32(buf + 14, kHttpHeaderSize);
+	if (WriteFrame(kSettings, 0, 0, buf, sizeof(buf)) == -1 || WindowUpdate(0, kHttp2ConnWindow - kHttp2DefaultWindow) == -1) {
+		return -1;
+	}
+	mRecvWindow = kHttp2ConnWindow;
+
+	// HTTP2-Settings隐含确认（RFC7540 3.2.1）
+	if (!settings.empty() && OnSettings(0, settings.data(), settings.size(), false) == -1) {
+		return -1;
+	}
+	if (upgrade) {
+		wHttp2Stream_t* stream = NewStream(1);
+		if (stream == NULL) {
+			return -1;
+		}
+		stream->mEndRecv = true;
+		stream->mHead = head;
+		mLastId = 1;
+	}
+	return 0;
+}
+
+int wHttp2Session::Parse(const char* buf, size_t len) {
+	Collect();
+
+	size_t used = 0;
+	if (mPreface > 0) {
+		const size_t n = std::min(len, static_cast<size_t>(mPreface));
+		if (memcmp(buf, kHttp2Preface + kHttp2PrefaceLen - mPreface, n) != 0) {
+			return Goaway(kProtocolError);
+		}
+		mPreface -= static_cast<uint32_t>(n);
+		used = n;
+	}
+	while (mPreface == 0 && len - used >= kHttp2FrameHead) {
+		const char* p = buf + used;
+		const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+		const uint32_t flen = (static_cast<uint32_t>(u[0]) << 16) | (static_cast<uint32_t>(u[1]) << 8) | u[2];
+		if (flen > kHttp2FrameSize) {
+			return Goaway(kFrameSizeError);
+		} else if (len - used < kHttp2FrameHead + flen) {
+			break;
+		}
+
+		const uint8_t type = u[3], flags = u[4];
+		const uint32_t id = Get32(p + 5) & 0x7fffffff;
+		if (mBlockId != 0 && (type != kContinuation || id != mBlockId)) {
+			// header块须连续
+			return Goaway(kProtocolError);
+		} else if (Frame(type, flags, id, p + kHttp2FrameHead, flen) == -1) {
+			return -1;
+		}
+		used += kHttp2FrameHead + flen;
+	}
+	return static_cast<int>(used);
+}
+
+int wHttp2Session::Frame(uint8_t type, uint8_t flags, uint32_t id, const char* p, size_t len) {
+	switch (type) {
+	case kData:
+		return OnData(flags, id, p, len);
+
+	case kHeaders:
+		return OnHeaders(flags, id, p, len);
+
+	case kPriority:
+		// 不支持优先级，各stream轮流发送
+		if (id == 0) {
+			return Goaway(kProtocolError);
+		} else if (len != 5) {
+			return Reset(id, kFrameSizeError);
+		}
+		return 0;
+
+	case kRstStream:
+		if (id == 0 || id > mLastId) {
+			return Goaway(kProtocolError);
+		} else if (len != 4) {
+			return Goaway(kFrameSizeError);
+		}
+		CloseStream(id);
+		return 0;
+
+	case kSettings:
+		if (id != 0) {
+			return Goaway(kProtocolError);
+		}
+		return OnSettings(flags, p, len, true);
+
+	case kPushPromise:
+		// 客户端不可推送
+		return Goaway(kProtocolError);
+
+	case kPing:
+		if (id != 0) {
+			return Goaway(kProtocolError);
+		} else if (len != 8) {
+			return Goaway(kFrameSizeError);
+		} else if (!(flags & kFlagAck)) {
+			return WriteFrame(kPing, kFlagAck, 0, p, len);
+		}
+		return 0;
+
+	case kGoaway:
+		if (id != 0) {
+			return Goaway(kProtocolError);
+		} else if (len < 8) {
+			return Goaway(kFrameSizeError);
+		}
+		mPeerGoaway = true;
+		return 0;
+
+	case kWindowUpdate:
+		return OnWindowUpdate(id, p, len);
+
+	case kContinuation:
+		if (mBlockId == 0) {
+			return Goaway(kProtocolError);
+		}
+		mBlock.append(p, len);
+		if (mBlock.size() > kHttp2HeaderBlockMax) {
+			return Goaway(kEnhanceYourCalm);
+		} else if (flags & kFlagEndHeaders) {
+			const uint32_t blockid = mBlockId;
+			mBlockId = 0;
+			return OnHeaderBlock(blockid, mBlockEnd);
+		}
+		return 0;
+	}
+
+	// 未知帧类型忽略
+	return 0;
+}
+
+int wHttp2Session::OnData(uint8_t flags, uint32_t id, const char* p, size_t len) {
+	if (id == 0) {
+		return Goaway(kProtocolError);
+	}
+
+	// 连接窗口（含填充）
+	const size_t flen = len;
+	mRecvWindow -= flen;
+	if (mRecvWindow < 0) {
+		return Goaway(kFlowControlError);
+	}
+	mRecvUnack += static_cast<uint32_t>(flen);
+	if (mRecvUnack >= kHttp2ConnWindow/2) {
+		if (WindowUpdate(0, mRecvUnack) == -1) {
+			return -1;
+		}
+		mRecvWindow += mRecvUnack;
+		mRecvUnack = 0;
+	}
+
+	if (flags & kFlagPadded) {
+		if (len < 1 || static_cast<uint8_t>(p[0]) > len - 1) {
+			return Goaway(kProtocolError);
+		}
+		len -= 1 + static_cast<uint8_t>(p[0]);
+		p++;
+	}
+
+	wHttp2Stream_t* stream = Find(id);
+	if (stream == NULL) {
+		// 已关闭（本端已RST_STREAM）的stream忽略
+		return id > mLastId? Goaway(kProtocolError): 0;
+	} else if (stream->mEndRecv) {
+		Reset(id, kStreamClosed);
+		CloseStream(id);
+		return 0;
+	}
+
+	stream->mRecvWindow -= flen;
+	if (stream->mRecvWindow < 0) {
+		Reset(id, kFlowControlError);
+		CloseStream(id);
+		return 0;
+	}
+
+	if (stream->mError == 0) {
+		if (stream->mReq.size() + stream->mBody.size() + len > kMaxPackageSize) {
+			// 请求过大，立即以413响应，丢弃之后的body
+			stream->mError = 413;
+			std::string().swap(stream->mBody);
+			EndRequest(stream);
+		} else {
+			stream->mBody.append(p, len);
+		}
+	}
+
+	if (flags & kFlagEndStream) {
+		stream->mEndRecv = true;
+		EndRequest(stream);
+	} else {
+		stream->mRecvUnack += static_cast<uint32_t>(flen);
+		if (stream->mRecvUnack >= kHttp2StreamWindow/2) {
+			if (WindowUpdate(id, stream->mRecvUnack) == -1) {
+				return -1;
+			}
+			stream->mRecvWindow += stream->mRecvUnack;
+			stream->mRecvUnack = 0;
+		}
+	}
+	return 0;
+}
+
+int wHttp2Session::OnHeaders(uint8_t flags, uint32_t id, const char* p, size_t len) {
+	if (id == 0 || (id & 1) == 0) {
+		return Goaway(kProtocolError);
+	}
+
+	size_t pad = 0;
+	if (flags & kFlagPadded) {
+		if (len < 1) {
+			return Goaway(kProtocolError);
+		}
+		pad = static_cast<uint8_t>(p[0]);
+		p++;
+		len--;
+	}
+	if (flags & kFlagPriority) {
+		if (len < 5) {
+			return Goaway(kProtocolError);
+		}
+		p += 5;
+		len -= 5;
+	}
+	if (pad > len) {
+		return Goaway(kProtocolError);
+	}
+
+	mBlock.assign(p, len - pad);
+	mBlockEnd = (flags & kFlagEndStream) != 0;
+	if (flags & kFlagEndHeaders) {
+		return OnHeaderBlock(id, mBlockEnd);
+	}
+	mBlockId = id;
+	return 0;
+}
+
+int wHttp2Session::OnHeaderBlock(uint32_t id, bool end) {
+	// header块须解码（动态表状态），即使stream将被拒绝
+	mHeaders.clear();
+	const int ret = mDecoder.Decode(mBlock.data(), mBlock.size(), &mHeaders, kHttpHeaderSize);
+	if (ret == -1) {
+		return Goaway(kCompressionError);
+	}
+
+	wHttp2Stream_t* stream = Find(id);
+	if (stream != NULL) {
+		// trailer：须结束请求，内容忽略
+		if (stream->mEndRecv || !end) {
+			Reset(id, kProtocolError);
+			CloseStream(id);
+			return 0;
+		}
+		stream->mEndRecv = true;
+		EndRequest(stream);
+		return 0;
+	} else if (id <= mLastId) {
+		// 已关闭的stream
+		return 0;
+	}
+
+	mLastId = id;
+	if (mGoaway) {
+		return 0;
+	} else if (mStream.size() >= kHttp2MaxStreams) {
+		return Reset(id, kRefusedStream);
+	}
+
+	stream = NewStream(id);
+	if (stream == NULL) {
+		return Reset(id, kInternalError);
+	}
+	stream->mEndRecv = end;
+	if (ret == -2) {
+		// header过大，以431响应
+		stream->mError = 431;
+		EndRequest(stream);
+	} else if (!BuildRequest(stream)) {
+		Reset(id, kProtocolError);
+		CloseStream(id);
+	} else if (end) {
+		EndRequest(stream);
+	}
+	return 0;
+}
+
+int wHttp2Session::OnSettings(uint8_t flags, const char* p, size_t len, bool ack) {
+	if (flags & kFlagAck) {
+		return len != 0? Goaway(kFrameSizeError): 0;
+	} else if (len % 6 != 0) {
+		return Goaway(kFrameSizeError);
+	}
+
+	for (size_t i = 0; i < len; i += 6) {
+		const uint32_t value = Get32(p + i + 2);
+		switch (Get16(p + i)) {
+		case kHeaderTableSize:
+			mEncoder.SetMaxSize(value);
+			break;
+
+		case kEnablePush:
+			if (value > 1) {
+				return Goaway(kProtocolError);
+			}
+			break;
+
+		case kInitialWindowSize:
+			// 调整各stream发送窗口（RFC7540 6.9.2）
+			if (value > kHttp2WindowMax) {
+				return Goaway(kFlowControlError);
+			}
+			for (std::map<uint32_t, wHttp2Stream_t*>::iterator it = mStream.begin(); it != mStream.end(); it++) {
+				it->second->mSendWindow += static_cast<int64_t>(value) - mPeerWindow;
+				if (it->second->mSendWindow > kHttp2WindowMax) {
+					return Goaway(kFlowControlError);
+				}
+			}
+			mPeerWindow = value;
+			break;
+
+		case kMaxFrameSize:
+			if (value < kHttp2FrameSize || value > 16777215) {
+				return Goaway(kProtocolError);
+			}
+			// 大帧减少帧头开销，但加剧stream间队头阻塞，以4倍默认值为限
+			mPeerFrameSize = std::min(value, kHttp2FrameSize*4);
+			break;
+		}
+	}
+	return ack? WriteFrame(kSettings, kFlagAck, 0, NULL, 0): 0;
+}
+
+int wHttp2Session::OnWindowUpdate(uint32_t id, const char* p, size_t len) {
+	if (len != 4) {
+		return Goaway(kFrameSizeError);
+	}
+
+	const uint32_t inc = Get32(p) & 0x7fffffff;
+	if (id == 0) {
+		if (inc == 0) {
+			return Goaway(kProtocolError);
+		}
+		mSendWindow += inc;
+		return mSendWindow > kHttp2WindowMax? Goaway(kFlowControlError): 0;
+	}
+
+	wHttp2Stream_t* stream = Find(id);
+	if (stream == NULL) {
+		return 0;
+	} else if (inc == 0 || stream->mSendWindow + inc > kHttp2WindowMax) {
+		Reset(id, inc == 0? kProtocolError: kFlowControlError);
+		CloseStream(id);
+		return 0;
+	}
+	stream->mSendWindow += inc;
+	return 0;
+}
+
+bool wHttp2Session::BuildRequest(wHttp2Stream_t* stream) {
+	wSlice method, path, scheme, authority;
+	bool regular = false;
+	for (std::vector<wHpackHeader_t>::iterator it = mHeaders.begin(); it != mHeaders.end(); it++) {
+		const wSlice name(it->mName), value(it->mValue);
+		if (!ValidValue(value)) {
+			return false;
+		} else if (!name.empty() && name[0] == ':') {
+			// 伪header须在普通header之前，且不可重复
+			wSlice* pseudo = NULL;
+			if (name == ":method") {
+				pseudo = &method;
+			} else if (name == ":path") {
+				pseudo = &path;
+			} else if (name == ":scheme") {
+				pseudo = &scheme;
+			} else if (name == ":authority") {
+				pseudo = &authority;
+			}
+			if (regular || pseudo == NULL || !pseudo->empty()) {
+				return false;
+			}
+			*pseudo = value;
+		} else {
+			regular = true;
+			if (!ValidName(name) || ConnectionHeader(name) || (name == "te" && value != "trailers")) {
+				return false;
+			}
+		}
+	}
+	if (!ValidToken(method) || !ValidToken(path) || scheme.empty()) {
+		return false;
+	}
+
+	// 转换为HTTP/1.1请求：Content-Length由body长度确定；cookie可拆分为多个header（RFC7540 8.1.2.5），合并为一个
+	std::string& req = stream->mReq;
+	req.reserve(256);
+	req.append(method.data(), method.size()).append(" ").append(path.data(), path.size()).append(" HTTP/1.1\r\n");
+
+	bool host = false;
+	std::string cookie;
+	for (std::vector<wHpackHeader_t>::iterator it = mHeaders.begin(); it != mHeaders.end(); it++) {
+		if (it->mName[0] == ':' || it->mName == "content-length") {
+			continue;
+		} else if (it->mName == "cookie") {
+			cookie.append(cookie.empty()? "": "; ").append(it->mValue);
+			continue;
+		} else if (it->mName == "host") {
+			host = true;
+		}
+		req.append(it->mName).append(": ").append(it->mValue).append("\r\n");
+	}
+	if (!host && !authority.empty()) {
+		req.append("host: ").append(authority.data(), authority.size()).append("\r\n");
+	}
+	if (!cookie.empty()) {
+		req.append("cookie: ").append(cookie).append("\r\n");
+	}
+	stream->mHead = method == "HEAD";
+	return true;
+}
+
+void wHttp2Session::EndRequest(wHttp2Stream_t* stream) {
+	if (stream->mReady) {
+		return;
+	} else if (stream->mError == 0) {
+		char buf[48];
+		snprintf(buf, sizeof(buf), "Content-Length: %zu\r\n\r\n", stream->mBody.size());
+		stream->mReq.append(buf).append(stream->mBody);
+		std::string().swap(stream->mBody);
+	}
+	stream->mReady = true;
+	mReady.push_back(stream->mId);
+}
+
+uint32_t wHttp2Session::NextReady() {
+	Collect();
+	while (!mReady.empty()) {
+		const uint32_t id = mReady.front();
+		mReady.pop_front();
+		if (Find(id) != NULL) {
+			return id;
+		}
+	}
+	return 0;
+}
+
+wHttp2Stream_t* wHttp2Session::Find(uint32_t id) {
+	std::map<uint32_t, wHttp2Stream_t*>::iterator it = mStream.find(id);
+	return it != mStream.end()? it->second: NULL;
+}
+
+wHttp2Stream_t* wHttp2Session::NewStream(uint32_t id) {
+	wHttp2Stream_t* stream;
+	HNET_NEW(wHttp2Stream_t(), stream);
+	if (stream == NULL) {
+		return NULL;
+	}
+	stream->mId = id;
+	stream->mEndRecv = stream->mEndSend = stream->mReady = stream->mHead = stream->mResponded = stream->mEndPending = false;
+	stream->mError = 0;
+	stream->mSendWindow = mPeerWindow;
+	stream->mRecvWindow = kHttp2StreamWindow;
+	stream->mRecvUnack = 0;
+	stream->mPendingOff = 0;
+	stream->mFile = NULL;
+	stream->mFileOff = stream->mFileLeft = 0;
+	mStream.insert(std::make_pair(id, stream));
+	return stream;
+}
+
+void wHttp2Session::CloseStream(uint32_t id) {
+	std::map<uint32_t, wHttp2Stream_t*>::iterator it = mStream.find(id);
+	if (it == mStream.end()) {
+		return;
+	}
+	wHttp2Stream_t* stream = it->second;
+	if (stream->mFile != NULL) {
+		wHttpFile::Default()->Release(stream->mFile);
+		stream->mFile = NULL;
+	}
+	mStream.erase(it);
+	mRetired.push_back(stream);
+}
+
+void wHttp2Session::Collect() {
+	for (std::vector<wHttp2Stream_t*>::iterator it = mRetired.begin(); it != mRetired.end(); it++) {
+		HNET_DELETE(*it);
+	}
+	mRetired.clear();
+}
+
+int wHttp2Session::EndStream(wHttp2Stream_t* stream) {
+	// 响应已结束而请求未接收完（如413）：通知对端停止发送
+	if (!stream->mEndRecv) {
+		Reset(stream->mId, kNoError);
+	}
+	CloseStream(stream->mId);
+	return 0;
+}
+
+int wHttp2Session::Response(uint32_t id, const wSlice& head, const wSlice& body, bool end) {
+	wHttp2Stream_t* stream = Find(id);
+	if (stream == NULL || stream->mResponded) {
+		return 0;
+	}
+
+	mHeadBlock.clear();
+	mEncoder.Begin(&mHeadBlock);
+
+	// 状态行："HTTP/1.1 200 OK"
+	const char* p = head.data();
+	const char* end_head = p + head.size();
+	const char* sp = static_cast<const char*>(memchr(p, ' ', head.size()));
+	if (sp == NULL || end_head - sp < 4) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttp2Session::Response () failed", "status line illegal");
+		Reset(id, kInternalError);
+		CloseStream(id);
+		return -1;
+	}
+	mEncoder.Encode(":status", wSlice(sp + 1, 3), &mHeadBlock);
+
+	// header名称转小写，去除连接专用header
+	p = static_cast<const char*>(memchr(p, '\n', head.size()));
+	while (p != NULL && ++p < end_head) {
+		const char* eol = static_cast<const char*>(memchr(p, '\n', end_head - p));
+		if (eol == NULL) {
+			eol = end_head;
+		}
+		const char* line_end = eol > p && eol[-1] == '\r'? eol - 1: eol;
+		const char* colon = static_cast<const char*>(memchr(p, ':', line_end - p));
+		if (colon != NULL) {
+			mName.assign(p, colon - p);
+			for (std::string::iterator it = mName.begin(); it != mName.end(); it++) {
+				*it = static_cast<char>(tolower(*it));
+			}
+			const char* value = colon + 1;
+			while (value < line_end && (*value == ' ' || *value == '\t')) {
+				value++;
+			}
+			if (!ConnectionHeader(mName)) {
+				mEncoder.Encode(mName, wSlice(value, line_end - value), &mHeadBlock, !Volatile(mName));
+			}
+		}
+		p = eol < end_head? eol: NULL;
+	}
+
+	const bool fin = end && (body.empty() || stream->mHead);
+	if (WriteHeaders(stream, fin) == -1) {
+		Reset(id, kInternalError);
+		CloseStream(id);
+		return -1;
+	}
+	stream->mResponded = true;
+	if (fin) {
+		stream->mEndSend = true;
+		return EndStream(stream);
+	}
+	return Data(id, body, end);
+}
+
+int wHttp2Session::WriteHeaders(wHttp2Stream_t* stream, bool end) {
+	// header块超过对端帧长度时以CONTINUATION续传，期间不可插入其他帧
+	size_t off = 0;
+	do {
+		const size_t n = std::min(mHeadBlock.size() - off, static_cast<size_t>(mPeerFrameSize));
+		uint8_t flags = off + n == mHeadBlock.size()? kFlagEndHeaders: 0;
+		if (off == 0 && end) {
+			flags |= kFlagEndStream;
+		}
+		if (WriteFrame(off == 0? kHeaders: kContinuation, flags, stream->mId, mHeadBlock.data() + off, n) == -1) {
+			return -1;
+		}
+		off += n;
+	} while (off < mHeadBlock.size());
+	return 0;
+}
+
+int wHttp2Session::Data(uint32_t id, const wSlice& data, bool end) {
+	wHttp2Stream_t* stream = Find(id);
+	if (stream == NULL || !stream->mResponded || stream->mEndSend || stream->mEndPending) {
+		return 0;
+	}
+
+	// HEAD请求丢弃body
+	const char* p = stream->mHead? NULL: data.data();
+	size_t len = stream->mHead? 0: data.size();
+	if (stream->mPendingOff == stream->mPending.size() && stream->mFile == NULL) {
+		// 无积压时直接写入发送缓冲，余下部分待窗口更新后发送
+		stream->mPending.clear();
+		stream->mPendingOff = 0;
+		const size_t sent = WriteBody(stream, p, len, end, false);
+		if (stream->mEndSend) {
+			return EndStream(stream);
+		}
+		p += sent;
+		len -= sent;
+	}
+	stream->mPending.append(p, len);
+	stream->mEndPending = end;
+	return 0;
+}
+
+int wHttp2Session::File(uint32_t id, wHttpFile_t* file, uint64_t off, uint64_t len) {
+	wHttp2Stream_t* stream = Find(id);
+	if (stream == NULL || !stream->mResponded || stream->mEndSend || stream->mEndPending || stream->mHead || len == 0) {
+		wHttpFile::Default()->Release(file);
+		return Data(id, wSlice(), true);
+	}
+	stream->mFile = file;
+	stream->mFileOff = off;
+	stream->mFileLeft = len;
+	stream->mEndPending = true;
+	while (stream->mFile != NULL && WriteFile(stream)) { }
+	if (stream->mEndSend) {
+		return EndStream(stream);
+	}
+	return 0;
+}
+
+int wHttp2Session::Pump() {
+	// 各stream每轮一帧，直至窗口耗尽或发送缓冲积压
+	int frames = 0;
+	bool progress = true;
+	while (progress && mTask->SendLen() < kHttp2SendBacklog) {
+		progress = false;
+		for (std::map<uint32_t, wHttp2Stream_t*>::iterator it = mStream.begin(); it != mStream.end(); ) {
+			wHttp2Stream_t* stream = it->second;
+			it++;
+			if (!stream->mResponded || stream->mEndSend) {
+				continue;
+			} else if (stream->mPendingOff == stream->mPending.size() && stream->mFile == NULL && !stream->mEndPending) {
+				continue;
+			}
+			if (WriteOne(stream)) {
+				progress = true;
+				frames++;
+			}
+			if (stream->mEndSend) {
+				EndStream(stream);
+			}
+		}
+	}
+	return frames;
+}
+
+size_t wHttp2Session::WriteBody(wHttp2Stream_t* stream, const char* p, size_t len, bool end, bool one) {
+	size_t sent = 0;
+	while (mPreface == 0) {
+		// 帧长度：对端帧长度、stream与连接发送窗口中最小者。空的END_STREAM帧不受窗口限制
+		size_t n = std::min(len - sent, static_cast<size_t>(mPeerFrameSize));
+		n = std::min(n, static_cast<size_t>(std::max(std::min(stream->mSendWindow, mSendWindow), static_cast<int64_t>(0))));
+		const bool last = end && sent + n == len;
+		if ((n == 0 && !last) || (mTask->SendLen() >= kHttp2SendBacklog && n > 0)) {
+			break;
+		} else if (WriteFrame(kData, last? kFlagEndStream: 0, stream->mId, p + sent, n) == -1) {
+			break;
+		}
+		sent += n;
+		stream->mSendWindow -= n;
+		mSendWindow -= n;
+		if (last) {
+			stream->mEndSend = true;
+			break;
+		} else if (one || sent == len) {
+			break;
+		}
+	}
+	return sent;
+}
+
+bool wHttp2Session::WriteOne(wHttp2Stream_t* stream) {
+	if (stream->mFile != NULL) {
+		return WriteFile(stream);
+	}
+
+	const size_t sent = WriteBody(stream, stream->mPending.data() + stream->mPendingOff, stream->mPending.size() - stream->mPendingOff, stream->mEndPending, true);
+	stream->mPendingOff += sent;
+	if (stream->mPendingOff == stream->mPending.size()) {
+		stream->mPending.clear();
+		stream->mPendingOff = 0;
+	} else if (stream->mPendingOff >= kHttp2FrameSize*4 && stream->mPendingOff*2 >= stream->mPending.size()) {
+		// 已发送部分过半时回收
+		stream->mPending.erase(0, stream->mPendingOff);
+		stream->mPendingOff = 0;
+	}
+	return sent > 0 || stream->mEndSend;
+}
+
+bool wHttp2Session::WriteFile(wHttp2Stream_t* stream) {
+	size_t n = static_cast<size_t>(std::min(stream->mFileLeft, static_cast<uint64_t>(mPeerFrameSize)));
+	n = std::min(n, static_cast<size_t>(std::max(std::min(stream->mSendWindow, mSendWindow), static_cast<int64_t>(0))));
+	if (n == 0 || mPreface > 0 || mTask->SendLen() >= kHttp2SendBacklog) {
+		return false;
+	}
+
+	// 文件内容直接读入发送缓冲的帧载荷处
+	char* buf = mTask->Reserve(kHttp2FrameHead + n);
+	if (buf == NULL) {
+		return false;
+	}
+	wSlice result;
+	if (stream->mFile->mFile->Read(stream->mFileOff, n, &result, buf + kHttp2FrameHead) == -1 || result.empty()) {
+		// 文件被截断：无法补全已声明的长度，重置stream
+		mTask->Commit(0);
+		Reset(stream->mId, kInternalError);
+		wHttpFile::Default()->Release(stream->mFile);
+		stream->mFile = NULL;
+		stream->mEndRecv = stream->mEndSend = true;
+		return true;
+	}
+	if (result.data() != buf + kHttp2FrameHead) {
+		memmove(buf + kHttp2FrameHead, result.data(), result.size());
+	}
+
+	n = result.size();
+	const bool last = n == stream->mFileLeft;
+	PutHead(buf, static_cast<uint32_t>(n), kData, last? kFlagEndStream: 0, stream->mId);
+	mTask->Commit(kHttp2FrameHead + n);
+	stream->mSendWindow -= n;
+	mSendWindow -= n;
+	stream->mFileOff += n;
+	stream->mFileLeft -= n;
+	if (last) {
+		wHttpFile::Default()->Release(stream->mFile);
+		stream->mFile = NULL;
+		stream->mEndSend = true;
+	}
+	return true;
+}
+
+int wHttp2Session::WriteFrame(uint8_t type, uint8_t flags, uint32_t id, const char* p, size_t len) {
+	char* buf = mTask->Reserve(kHttp2FrameHead + len);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttp2Session::WriteFrame () failed", "left buffer not enough");
+		return -1;
+	}
+	PutHead(buf, static_cast<uint32_t>(len), type, flags, id);
+	if (len > 0) {
+		memcpy(buf + kHttp2FrameHead, p, len);
+	}
+	mTask->Commit(kHttp2FrameHead + len);
+	return 0;
+}
+
+int wHttp2Session::WindowUpdate(uint32_t id, uint32_t inc) {
+	char buf[4];
+	Put32(buf, inc);
+	return WriteFrame(kWindowUpdate, 0, id, buf, sizeof(buf));
+}
+
+int wHttp2Session::Reset(uint32_t id, uint32_t code) {
+	char buf[4];
+	Put32(buf, code);
+	return WriteFrame(kRstStream, 0, id, buf, sizeof(buf));
+}
+
+int wHttp2Session::Goaway(uint32_t code) {
+	if (!mGoaway) {
+		mGoaway = true;
+		char buf[8];
+		Put32(buf, mLastId);
+		Put32(buf + 4, code);
+		WriteFrame(kGoaway, 0, 0, buf, sizeof(buf));
+	}
+	return -1;
+}
+
+}	// namespace hnet
@@ -0,0 +1,212 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP2_H_
+#define _W_HTTP2_H_
+
+#include <map>
+#include <deque>
+#include <vector>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+#include "wHpack.h"
+
+namespace hnet {
+
+// 客户端连接序言
+const char		kHttp2Preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const uint32_t	kHttp2PrefaceLen = 24;
+
+const uint32_t	kHttp2FrameHead = 9;
+const uint32_t	kHttp2FrameSize = 16384;		// 帧载荷上限（SETTINGS_MAX_FRAME_SIZE默认值，本端接收上限）
+const uint32_t	kHttp2DefaultWindow = 65535;	// 流量控制窗口初始值
+const int64_t	kHttp2WindowMax = 2147483647;
+
+// 本端设置：单连接最多并发stream、stream接收窗口、连接接收窗口、header块（含CONTINUATION）最大长度
+const uint32_t	kHttp2MaxStreams = 100;
+const uint32_t	kHttp2StreamWindow = 1048576;
+const uint32_t	kHttp2ConnWindow = 16777216;
+const uint32_t	kHttp2HeaderBlockMax = 65536;
+
+// 发送缓冲积压超过此长度时暂停发送DATA帧（保留控制帧、响应头空间），发送后继续
+const uint32_t	kHttp2SendBacklog = kPackageSize/4;
+
+class wTask;
+struct wHttpFile_t;
+
+// stream（RFC7540 5.1）
+struct wHttp2Stream_t {
+	uint32_t mId;
+	bool mEndRecv;		// 已收到END_STREAM（half-closed remote）
+	bool mEndSend;		// 已发送END_STREAM
+	bool mReady;		// 请求完整，待处理
+	bool mHead;			// HEAD请求，响应无body
+	bool mResponded;	// 已发送响应头
+	bool mEndPending;	// 待发数据发完后发送END_STREAM
+	uint16_t mError;	// 请求错误，以该状态码响应（如413）
+	int64_t mSendWindow;
+	int64_t mRecvWindow;
+	uint32_t mRecvUnack;	// 已接收未WINDOW_UPDATE的字节数
+
+	// 请求转换为HTTP/1.1格式（请求行 + header），请求完整时追加Content-Length与body，由wHttpParser解析
+	std::string mReq;
+	std::string mBody;
+
+	// 待发送数据（受流量控制窗口、发送缓冲限制）
+	std::string mPending;
+	size_t mPendingOff;
+	wHttpFile_t* mFile;
+	uint64_t mFileOff;
+	uint64_t mFileLeft;
+};
+
+// HTTP/2 明文（h2c）连接：帧解析、HPACK、stream状态、流量控制。请求转换为HTTP/1.1格式交由wHttpTask按原处理函数分发，
+// 响应由wHttpTask渲染的HTTP/1.1响应头转换为HEADERS帧，body按流量控制窗口分帧发送（各stream轮流，多路复用）
+// 帧直接写入task发送缓冲（Reserve/Commit），由task负责发送
+class wHttp2Session : private wNoncopyable {
+public:
+	explicit wHttp2Session(wTask* task);
+	~wHttp2Session();
+
+	// 帧类型
+	enum {
+		kData = 0x0,
+		kHeaders = 0x1,
+		kPriority = 0x2,
+		kRstStream = 0x3,
+		kSettings = 0x4,
+		kPushPromise = 0x5,
+		kPing = 0x6,
+		kGoaway = 0x7,
+		kWindowUpdate = 0x8,
+		kContinuation = 0x9
+	};
+
+	// 帧标志
+	enum {
+		kFlagEndStream = 0x1,
+		kFlagAck = 0x1,
+		kFlagEndHeaders = 0x4,
+		kFlagPadded = 0x8,
+		kFlagPriority = 0x20
+	};
+
+	// 错误码
+	enum {
+		kNoError = 0x0,
+		kProtocolError = 0x1,
+		kInternalError = 0x2,
+		kFlowControlError = 0x3,
+		kStreamClosed = 0x5,
+		kFrameSizeError = 0x6,
+		kRefusedStream = 0x7,
+		kCompressionError = 0x9,
+		kEnhanceYourCalm = 0xb
+	};
+
+	// 设置项
+	enum {
+		kHeaderTableSize = 0x1,
+		kEnablePush = 0x2,
+		kMaxConcurrentStreams = 0x3,
+		kInitialWindowSize = 0x4,
+		kMaxFrameSize = 0x5,
+		kMaxHeaderListSize = 0x6
+	};
+
+	// 开始：写入服务端序言（SETTINGS、连接窗口WINDOW_UPDATE）
+	// settings为Upgrade请求HTTP2-Settings（已解码的SETTINGS载荷）；upgrade为true时升级请求为stream 1（已half-closed remote）
+	int Start(const wSlice& settings, bool upgrade, bool head);
+
+	// 解析buf中完整的帧，返回消耗字节数（不完整的帧留待下次）。连接错误返回-1（已写入GOAWAY）
+	int Parse(const char* buf, size_t len);
+
+	// 下一个请求完整的stream，0为无
+	uint32_t NextReady();
+	wHttp2Stream_t* Find(uint32_t id);
+
+	// 响应：head为HTTP/1.1格式响应头（状态行 + header + 空行），转换为HEADERS；body写入DATA。end为响应结束（END_STREAM）
+	// stream已关闭（对端RST_STREAM）时忽略
+	int Response(uint32_t id, const wSlice& head, const wSlice& body, bool end);
+	int Data(uint32_t id, const wSlice& data, bool end);
+	// 文件body（响应结束），引用由session释放
+	int File(uint32_t id, wHttpFile_t* file, uint64_t off, uint64_t len);
+
+	// 按流量控制窗口、发送缓冲余量发送各stream待发数据，返回写入的帧数
+	int Pump();
+
+	// 对端GOAWAY，且已无活动stream
+	inline bool Done() const { return mPeerGoaway && mStream.empty();}
+	// 无活动stream
+	inline bool Idle() const { return mStream.empty();}
+
+protected:
+	int Frame(uint8_t type, uint8_t flags, uint32_t id, const char* p, size_t len);
+	int OnData(uint8_t flags, uint32_t id, const char* p, size_t len);
+	int OnHeaders(uint8_t flags, uint32_t id, const char* p, size_t len);
+	int OnHeaderBlock(uint32_t id, bool end);
+	int OnSettings(uint8_t flags, const char* p, size_t len, bool ack);
+	int OnWindowUpdate(uint32_t id, const char* p, size_t len);
+	// 请求header转换为HTTP/1.1格式，请求非法返回false（stream错误）
+	bool BuildRequest(wHttp2Stream_t* stream);
+	// 已收到END_STREAM：请求完整
+	void EndRequest(wHttp2Stream_t* stream);
+
+	wHttp2Stream_t* NewStream(uint32_t id);
+	void CloseStream(uint32_t id);
+	// 释放已关闭的stream（请求内容可能仍被处理函数引用，延至下次解析、分发时释放）
+	void Collect();
+	// 已发送END_STREAM：对端未结束请求时RST_STREAM(NO_ERROR)，关闭stream
+	int EndStream(wHttp2Stream_t* stream);
+
+	// 写入帧，发送缓冲不足返回-1
+	int WriteFrame(uint8_t type, uint8_t flags, uint32_t id, const char* p, size_t len);
+	int WriteHeaders(wHttp2Stream_t* stream, bool end);
+	// 写入DATA帧[p, p + len)（one为true时至多一帧），返回写入的字节数。全部写入且end为true时最后一帧带END_STREAM
+	// 升级连接收到客户端序言前不发送DATA（101之后仅响应头，部分客户端升级时的读缓冲有限）
+	size_t WriteBody(wHttp2Stream_t* stream, const char* p, size_t len, bool end, bool one);
+	// 写入stream待发数据（缓冲或文件）一帧，无进展返回false
+	bool WriteOne(wHttp2Stream_t* stream);
+	bool WriteFile(wHttp2Stream_t* stream);
+	int WindowUpdate(uint32_t id, uint32_t inc);
+	int Reset(uint32_t id, uint32_t code);
+	// 连接错误：写入GOAWAY，返回-1
+	int Goaway(uint32_t code);
+
+	wTask* mTask;
+	wHpackDecoder mDecoder;
+	wHpackEncoder mEncoder;
+
+	uint32_t mPreface;		// 待接收的客户端序言字节数
+	uint32_t mLastId;		// 已处理的最大客户端stream id
+	bool mGoaway;			// 已发送GOAWAY
+	bool mPeerGoaway;
+
+	// 对端设置
+	uint32_t mPeerFrameSize;
+	uint32_t mPeerWindow;	// SETTINGS_INITIAL_WINDOW_SIZE
+
+	int64_t mSendWindow;	// 连接发送窗口
+	int64_t mRecvWindow;	// 连接接收窗口
+	uint32_t mRecvUnack;
+
+	// 未结束的header块（HEADERS + CONTINUATION）
+	uint32_t mBlockId;		// 0为无
+	bool mBlockEnd;			// HEADERS带END_STREAM
+	std::string mBlock;
+	std::vector<wHpackHeader_t> mHeaders;
+	std::string mHeadBlock;	// 响应header块编码缓冲
+	std::string mName;		// 响应header名称（小写）
+
+	std::map<uint32_t, wHttp2Stream_t*> mStream;
+	std::deque<uint32_t> mReady;
+	std::vector<wHttp2Stream_t*> mRetired;
+};
+
+}	// namespace hnet
+
+#endif
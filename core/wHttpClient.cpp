@@ -0,0 +1,377 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <strings.h>
+#include "wHttpClient.h"
+#include "wTcpSocket.h"
+#include "wHttpTask.h"
+#include "wSignal.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+namespace {
+
+// http://ip[:port][/path]
+bool ParseUrl(const std::string& url, std::string* host, uint16_t* port, std::string* path) {
+	const size_t plen = strlen(kProtocol[1]);
+	if (url.size() <= plen || strncasecmp(url.c_str(), kProtocol[1], plen) != 0) {
+		return false;
+	}
+	size_t slash = url.find('/', plen);
+	std::string authority = url.substr(plen, slash == std::string::npos? std::string::npos: slash - plen);
+	*path = slash == std::string::npos? "/": url.substr(slash);
+
+	size_t colon = authority.find(':');
+	*port = 80;
+	if (colon != std::string::npos) {
+		uint32_t n = 0;
+		for (size_t i = colon + 1; i < authority.size(); i++) {
+			if (!isdigit(authority[i]) || (n = n * 10 + (authority[i] - '0')) > 65535) {
+				return false;
+			}
+		}
+		if (n == 0) {
+			return false;
+		}
+		*port = static_cast<uint16_t>(n);
+		authority.erase(colon);
+	}
+	*host = authority;
+	return !host->empty() && misc::Text2IP(host->c_str()) != INADDR_NONE;
+}
+
+inline bool Legal(const std::string& s) {
+	return s.find('\r') == std::string::npos && s.find('\n') == std::string::npos;
+}
+
+}	// namespace anonymous
+
+wHttpClient::wHttpClient(wConfig* config, wServer* server, bool join, int type) : wMultiClient(config, server, join), mType(type),
+mConnMax(kHttpClientConnMax), mPipeline(kHttpClientPipeline), mOutstanding(0), mCheckTm(soft::TimeUsec()) {
+	assert(mType >= 0 && mType < kClientNumShard);
+	mHeartbeatTurn = false;
+
+	// 服务端关闭持久连接时，已写入的流水线请求会触发SIGPIPE
+	wSignal signal;
+	signal.EmptySet(SIG_IGN);
+	signal.AddSigno(SIGPIPE);
+}
+
+wHttpClient::~wHttpClient() {
+	// 未完成请求不回调；连接（及其上的请求）由wMultiClient回收
+	for (std::map<std::string, Host_t*>::iterator it = mHosts.begin(); it != mHosts.end(); it++) {
+		for (std::deque<wHttpRequest_t*>::iterator r = it->second->mWait.begin(); r != it->second->mWait.end(); r++) {
+			HNET_DELETE(*r);
+		}
+		HNET_DELETE(it->second);
+	}
+}
+
+int wHttpClient::Get(const std::string& url, const wHttpCallback_t& callback, const std::map<std::string, std::string>& header, uint32_t timeout) {
+	return Request(kMethod[0], url, header, wSlice(), callback, timeout);
+}
+
+int wHttpClient::Post(const std::string& url, const wSlice& body, const wHttpCallback_t& callback, const std::map<std::string, std::string>& header, uint32_t timeout) {
+	return Request(kMethod[1], url, header, body, callback, timeout);
+}
+
+int wHttpClient::Request(const wSlice& method, const std::string& url, const std::map<std::string, std::string>& header, const wSlice& body, const wHttpCallback_t& callback, uint32_t timeout) {
+	std::string host, path;
+	uint16_t port;
+	if (method.empty() || !ParseUrl(url, &host, &port, &path) || !Legal(path)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Request () failed", "url illegal");
+		return -1;
+	}
+
+	wHttpRequest_t* req;
+	HNET_NEW(wHttpRequest_t, req);
+	if (req == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Request new() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	req->mIdempotent = method == kMethod[0] || method == kMethod[4];
+	req->mHead = method == kMethod[4];
+	req->mDeadline = soft::TimeUsec() + static_cast<int64_t>(timeout) * 1000;
+	req->mCallback = callback;
+
+	// 请求行、header、body
+	std::string& data = req->mData;
+	data.reserve(method.size() + path.size() + body.size() + kHttpHeadReserve);
+	data.append(method.data(), method.size()).append(" ").append(path).append(" ").append(kProtocol[0]).append(kCRLF);
+	bool hashost = false, haslen = false;
+	for (std::map<std::string, std::string>::const_iterator it = header.begin(); it != header.end(); it++) {
+		if (it->first.empty() || !Legal(it->first) || !Legal(it->second)) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Request () failed", "header illegal");
+			HNET_DELETE(req);
+			return -1;
+		}
+		hashost = hashost || strcasecmp(it->first.c_str(), kHeader[2]) == 0;
+		haslen = haslen || strcasecmp(it->first.c_str(), kHeader[0]) == 0;
+		data.append(it->first).append(kColon).append(it->second).append(kCRLF);
+	}
+	if (!hashost) {
+		data.append(kHeader[2]).append(kColon).append(host).append(":");
+		logging::AppendNumberTo(&data, port);
+		data.append(kCRLF);
+	}
+	if (!haslen && (!body.empty() || !req->mIdempotent)) {
+		data.append(kHeader[0]).append(kColon);
+		logging::AppendNumberTo(&data, body.size());
+		data.append(kCRLF);
+	}
+	data.append(kCRLF).append(body.data(), body.size());
+	if (data.size() > kPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Request () failed", "request too large");
+		HNET_DELETE(req);
+		return -1;
+	}
+
+	return Submit(host, port, req);
+}
+
+int wHttpClient::Send(const std::string& host, uint16_t port, const wSlice& data, bool idempotent, bool head, const wHttpCallback_t& callback, uint32_t timeout) {
+	if (data.empty() || data.size() > kPackageSize || port == 0 || misc::Text2IP(host.c_str()) == INADDR_NONE) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Send () failed", "request illegal");
+		return -1;
+	}
+
+	wHttpRequest_t* req;
+	HNET_NEW(wHttpRequest_t, req);
+	if (req == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Send new() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	req->mData.assign(data.data(), data.size());
+	req->mIdempotent = idempotent;
+	req->mHead = head;
+	req->mDeadline = soft::TimeUsec() + static_cast<int64_t>(timeout) * 1000;
+	req->mCallback = callback;
+	return Submit(host, port, req);
+}
+
+int wHttpClient::Submit(const std::string& host, uint16_t port, wHttpRequest_t* req) {
+	std::string key = host + ":" + logging::NumberToString(port);
+	Host_t*& h = mHosts[key];
+	if (h == NULL) {
+		HNET_NEW(Host_t, h);
+		if (h == NULL) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Submit new() failed", error::Strerror(errno).c_str());
+			mHosts.erase(key);
+			HNET_DELETE(req);
+			return -1;
+		}
+		h->mHost = host;
+		h->mPort = port;
+		h->mKey = key;
+	}
+	h->mWait.push_back(req);
+	mOutstanding++;
+	Dispatch(h);
+	return 0;
+}
+
+void wHttpClient::Poll(int64_t timeout) {
+	soft::TimeUpdate();
+	int64_t t = mTimeout;
+	mTimeout = timeout;
+	Recv();
+	mTimeout = t;
+	Run();
+}
+
+int wHttpClient::Run() {
+	CheckConn();
+	if (soft::TimeUsec() - mCheckTm >= static_cast<int64_t>(kHttpClientCheckTm) * 1000) {
+		mCheckTm = soft::TimeUsec();
+		CheckTimeout();
+	}
+	return 0;
+}
+
+void wHttpClient::Dispatch(Host_t* host) {
+	while (!host->mWait.empty()) {
+		wHttpRequest_t* req = host->mWait.front();
+
+		wHttpClientTask* task = NULL;
+		wHttpClientTask* pipe = NULL;
+		for (std::vector<wHttpClientTask*>::iterator it = host->mConn.begin(); it != host->mConn.end(); it++) {
+			wHttpClientTask* conn = *it;
+			if (!conn->Usable()) {
+				continue;
+			} else if (conn->Pending() == 0) {
+				task = conn;
+				break;
+			} else if (req->mIdempotent && conn->Front()->mIdempotent && conn->Pending() < mPipeline && (pipe == NULL || conn->Pending() < pipe->Pending())) {
+				pipe = conn;
+			}
+		}
+		if (task == NULL && host->mConn.size() < mConnMax) {
+			task = Connect(host);
+			if (task == NULL) {
+				host->mWait.pop_front();
+				Finish(req, kHttpClientErrConnect);
+				continue;
+			}
+		}
+		if (task == NULL) {
+			task = pipe;
+		}
+		if (task == NULL || task->Push(req) == -1) {
+			// 无可用连接（或发送缓冲不足），待请求完成后继续
+			break;
+		}
+		host->mWait.pop_front();
+	}
+}
+
+wHttpClientTask* wHttpClient::Connect(Host_t* host) {
+	wSocket* socket;
+	HNET_NEW(wTcpSocket(kStConnect, kSpHttp), socket);
+	if (socket == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Connect new() failed", error::Strerror(errno).c_str());
+		return NULL;
+	}
+	if (socket->Open() == -1 || socket->SetNonblock() == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Connect Open() failed", "");
+		HNET_DELETE(socket);
+		return NULL;
+	}
+
+	// 非阻塞连接：连接建立后（可写事件）发送请求，失败由事件循环（EPOLLERR）回收
+	if (socket->Connect(host->mHost, host->mPort, 0) == -1 && errno != EINPROGRESS) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Connect Connect() failed", error::Strerror(errno).c_str());
+		HNET_DELETE(socket);
+		return NULL;
+	}
+	socket->SS() = kSsConnected;
+
+	wHttpClientTask* task;
+	HNET_NEW(wHttpClientTask(socket, host->mKey, mType), task);
+	if (task == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Connect new() failed", error::Strerror(errno).c_str());
+		HNET_DELETE(socket);
+		return NULL;
+	}
+	if (AddTask(task, EPOLLIN | EPOLLOUT) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClient::Connect AddTask() failed", "");
+		HNET_DELETE(task);
+		return NULL;
+	}
+	host->mConn.push_back(task);
+	return task;
+}
+
+void wHttpClient::Complete(wHttpClientTask* task, wHttpRequest_t* req) {
+	Finish(req, kHttpClientOk);
+
+	std::map<std::string, Host_t*>::iterator it = mHosts.find(task->Key());
+	if (it != mHosts.end()) {
+		Dispatch(it->second);
+	}
+}
+
+void wHttpClient::Fail(wHttpClientTask* task, int32_t error) {
+	if (task->Broken()) {
+		return;
+	}
+	const bool started = task->Started();
+	std::deque<wHttpRequest_t*> reqs;
+	task->Abort(&reqs);
+
+	std::map<std::string, Host_t*>::iterator it = mHosts.find(task->Key());
+	if (it == mHosts.end()) {
+		return;
+	}
+	Host_t* host = it->second;
+	host->mConn.erase(std::remove(host->mConn.begin(), host->mConn.end(), task), host->mConn.end());
+
+	// 未开始响应的幂等请求重试一次（如持久连接被服务端关闭），按原顺序排在等待队列前部
+	const int64_t now = soft::TimeUsec();
+	std::vector<wHttpRequest_t*> failed;
+	std::vector<wHttpRequest_t*> retry;
+	for (size_t i = 0; i < reqs.size(); i++) {
+		wHttpRequest_t* req = reqs[i];
+		if (req->mDeadline > now && req->mIdempotent && req->mRetry == 0 && !(i == 0 && started)) {
+			req->mRetry++;
+			req->mRes = wHttpResponse_t();
+			retry.push_back(req);
+		} else {
+			failed.push_back(req);
+		}
+	}
+	host->mWait.insert(host->mWait.begin(), retry.begin(), retry.end());
+
+	for (size_t i = 0; i < failed.size(); i++) {
+		Finish(failed[i], failed[i]->mDeadline <= now? kHttpClientErrTimeout: error);
+	}
+	Dispatch(host);
+}
+
+void wHttpClient::Finish(wHttpRequest_t* req, int32_t error) {
+	mOutstanding--;
+	if (error != kHttpClientOk) {
+		req->mRes = wHttpResponse_t();
+		req->mRes.mError = error;
+	}
+	if (req->mCallback) {
+		req->mCallback(req->mRes);
+	}
+	HNET_DELETE(req);
+}
+
+void wHttpClient::CheckConn() {
+	// 事件循环中出错（EPOLLERR、收发失败）的连接：已移出epoll，置为未连接
+	std::vector<wTask*> dead;
+	for (std::vector<wTask*>::iterator it = mTaskPool[mType].begin(); it != mTaskPool[mType].end(); it++) {
+		if ((*it)->Socket()->SS() == kSsUnconnect) {
+			dead.push_back(*it);
+		}
+	}
+	for (size_t i = 0; i < dead.size(); i++) {
+		Fail(static_cast<wHttpClientTask*>(dead[i]), kHttpClientErrConnect);
+		RemoveTaskPool(dead[i]);
+	}
+}
+
+void wHttpClient::CheckTimeout() {
+	const int64_t now = soft::TimeUsec();
+	std::vector<wHttpClientTask*> expired;
+	std::vector<wHttpRequest_t*> timeout;
+	for (std::map<std::string, Host_t*>::iterator it = mHosts.begin(); it != mHosts.end(); it++) {
+		Host_t* host = it->second;
+
+		// 等待连接超时
+		std::deque<wHttpRequest_t*>::iterator r = host->mWait.begin();
+		while (r != host->mWait.end()) {
+			if ((*r)->mDeadline <= now) {
+				timeout.push_back(*r);
+				r = host->mWait.erase(r);
+			} else {
+				r++;
+			}
+		}
+
+		// 响应超时（连接上的后续请求随之重试或失败）；空闲超时
+		for (size_t i = 0; i < host->mConn.size(); i++) {
+			wHttpClientTask* task = host->mConn[i];
+			if (task->Pending() > 0? task->Front()->mDeadline <= now: now - task->ActiveTm() >= static_cast<int64_t>(kHttpClientIdleTm) * 1000000) {
+				expired.push_back(task);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < timeout.size(); i++) {
+		Finish(timeout[i], kHttpClientErrTimeout);
+	}
+	for (size_t i = 0; i < expired.size(); i++) {
+		Fail(expired[i], kHttpClientErrTimeout);
+		RemoveTask(expired[i]);
+	}
+}
+
+}	// namespace hnet
@@ -0,0 +1,98 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_CLIENT_H_
+#define _W_HTTP_CLIENT_H_
+
+#include <map>
+#include <deque>
+#include <vector>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wMultiClient.h"
+#include "wHttpClientTask.h"
+
+namespace hnet {
+
+// 异步http客户端：默认请求超时（毫秒）、每host最多连接数、每连接最多流水线请求数
+const uint32_t	kHttpClientTimeout = 30000;
+const uint32_t	kHttpClientConnMax = 8;
+const uint32_t	kHttpClientPipeline = 4;
+const uint32_t	kHttpClientIdleTm = 15;		// 空闲连接保留时长（秒），小于服务端kHttpKeepAliveTm
+const uint32_t	kHttpClientCheckTm = 100;	// 超时检测周期（毫秒）
+
+// 异步http客户端，基于wMultiClient事件循环
+// 连接非阻塞建立，每host:port维护持久连接池；幂等请求（GET、HEAD）可在同一连接上流水线发送，连接断开时未开始响应的幂等请求重试一次
+// 请求结果（成功、失败、超时）均以callback在事件循环中回调一次
+// 非线程安全：请求与回调均在事件循环线程中（Start所在线程；或嵌入其他事件循环，如在wServer::Run中调用Poll）
+class wHttpClient : public wMultiClient {
+public:
+	// type为连接所在wMultiClient分组（专用）
+	wHttpClient(wConfig* config, wServer* server = NULL, bool join = false, int type = kClientNumShard - 1);
+	virtual ~wHttpClient();
+
+	// 异步请求。url为http://ip[:port]/path?query（不解析域名），timeout为毫秒
+	// 返回-1为参数错误（url非法、请求过大），不回调
+	int Get(const std::string& url, const wHttpCallback_t& callback, const std::map<std::string, std::string>& header = std::map<std::string, std::string>(), uint32_t timeout = kHttpClientTimeout);
+	int Post(const std::string& url, const wSlice& body, const wHttpCallback_t& callback, const std::map<std::string, std::string>& header = std::map<std::string, std::string>(), uint32_t timeout = kHttpClientTimeout);
+	int Request(const wSlice& method, const std::string& url, const std::map<std::string, std::string>& header, const wSlice& body, const wHttpCallback_t& callback, uint32_t timeout = kHttpClientTimeout);
+	// 已序列化的请求（请求行 + header + body，如反向代理转发），原样发送至host:port（ip）
+	// idempotent为可流水线、可重试；head为HEAD请求（响应无body）
+	int Send(const std::string& host, uint16_t port, const wSlice& data, bool idempotent, bool head, const wHttpCallback_t& callback, uint32_t timeout = kHttpClientTimeout);
+
+	// 嵌入其他事件循环：处理就绪事件（最多等待timeout毫秒）、超时检测
+	void Poll(int64_t timeout = 0);
+	// epoll描述符：注册至其他事件循环，可读时调用Poll
+	inline int EpollFD() const { return mEpollFD;}
+
+	// 派生类覆盖时需调用wHttpClient::Run
+	virtual int Run();
+
+	// http连接无心跳，断开后不重连
+	virtual void CheckHeartBeat() { }
+
+	inline void SetConnMax(uint32_t num) { mConnMax = num;}
+	inline void SetPipeline(uint32_t num) { mPipeline = num;}
+
+	// 未完成请求数（含等待连接的请求）
+	inline size_t Outstanding() const { return mOutstanding;}
+
+	// 连接回调：请求完成；连接不可用（未完成请求重试或以error失败）
+	void Complete(wHttpClientTask* task, wHttpRequest_t* req);
+	void Fail(wHttpClientTask* task, int32_t error);
+
+protected:
+	struct Host_t {
+		std::string mHost;
+		uint16_t mPort;
+		std::string mKey;
+		std::vector<wHttpClientTask*> mConn;
+		std::deque<wHttpRequest_t*> mWait;	// 等待可用连接的请求
+	};
+
+	// 请求加入host:port等待队列并分配连接
+	int Submit(const std::string& host, uint16_t port, wHttpRequest_t* req);
+
+	// 等待中的请求分配到连接：空闲连接优先，其次新建连接，最后流水线
+	void Dispatch(Host_t* host);
+	wHttpClientTask* Connect(Host_t* host);
+	void Finish(wHttpRequest_t* req, int32_t error);
+
+	// 回收已断开连接；请求、空闲连接超时
+	void CheckConn();
+	void CheckTimeout();
+
+	int mType;
+	uint32_t mConnMax;
+	uint32_t mPipeline;
+	size_t mOutstanding;
+	int64_t mCheckTm;
+	std::map<std::string, Host_t*> mHosts;
+};
+
+}	// namespace hnet
+
+#endif
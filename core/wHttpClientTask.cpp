@@ -0,0 +1,189 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <strings.h>
+#include "wHttpClientTask.h"
+#include "wHttpClient.h"
+#include "wSocket.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+bool wHttpResponse_t::Header(const wSlice& name, wSlice* value) const {
+	// 跳过状态行，逐行匹配"name:"
+	const char* p = mHead.data();
+	const char* end = p + mHead.size();
+	const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+	while (nl != NULL && nl + 1 < end) {
+		p = nl + 1;
+		nl = static_cast<const char*>(memchr(p, '\n', end - p));
+		const char* le = nl != NULL? nl: end;
+		if (static_cast<size_t>(le - p) > name.size() && p[name.size()] == ':' && strncasecmp(p, name.data(), name.size()) == 0) {
+			const char* v = p + name.size() + 1;
+			while (v < le && (*v == ' ' || *v == '\t')) {
+				v++;
+			}
+			while (le > v && (le[-1] == '\r' || le[-1] == ' ' || le[-1] == '\t')) {
+				le--;
+			}
+			*value = wSlice(v, le - v);
+			return true;
+		}
+	}
+	return false;
+}
+
+wHttpClientTask::~wHttpClientTask() {
+	// 客户端析构时未完成的请求，不回调
+	for (std::deque<wHttpRequest_t*>::iterator it = mPending.begin(); it != mPending.end(); it++) {
+		HNET_DELETE(*it);
+	}
+}
+
+int wHttpClientTask::TaskRecv(ssize_t *size) {
+	const char *buffend = mRecvBuff + kPackageSize;
+	*size = 0;
+	mConnected = true;
+
+	// 线性缓冲：未解析数据位于[mRecvRead, mRecvWrite)，尾部空间不足时整体前移（解析器保存相对偏移，可续）
+	if (mRecvLen == 0) {
+		mRecvRead = mRecvWrite = mRecvBuff;
+	} else if (mRecvRead != mRecvBuff && buffend - mRecvWrite < mRecvRead - mRecvBuff) {
+		memmove(mRecvBuff, mRecvRead, mRecvLen);
+		mRecvRead = mRecvBuff;
+		mRecvWrite = mRecvBuff + mRecvLen;
+	}
+
+	bool eof = false;
+	size_t leftlen = buffend - mRecvWrite;
+	if (leftlen > 0) {
+		int ret = mSocket->RecvBytes(mRecvWrite, leftlen, size);
+		if (ret == -1 && *size != 0) {
+			static_cast<wHttpClient*>(Client())->Fail(this, kHttpClientErrConnect);
+			return -1;
+		}
+		eof = ret == -1;
+
+		if (*size > 0) {
+			mRecvLen += *size;
+			mRecvWrite += *size;
+		}
+	}
+	mActiveTm = soft::TimeUsec();
+
+	if (Parse(eof) == -1 || eof || mBroken) {
+		static_cast<wHttpClient*>(Client())->Fail(this, kHttpClientErrConnect);
+		return -1;
+	}
+	return 0;
+}
+
+int wHttpClientTask::TaskSend(ssize_t *size) {
+	mConnected = true;
+	mActiveTm = soft::TimeUsec();
+	return wTask::TaskSend(size);
+}
+
+int wHttpClientTask::Push(wHttpRequest_t* req) {
+	char* buf = Reserve(req->mData.size());
+	if (buf == NULL) {
+		return -1;
+	}
+	memcpy(buf, req->mData.data(), req->mData.size());
+	Commit(req->mData.size());
+	mPending.push_back(req);
+
+	if (mConnected && mSendLen == req->mData.size()) {
+		// 发送缓冲此前为空：直接发送，发完则无需注册写事件
+		ssize_t size;
+		if (wTask::TaskSend(&size) == 0 && mSendLen == 0) {
+			return 0;
+		}
+	}
+	// 未连接、未发完，或发送失败（由事件循环回收连接）
+	Output();
+	return 0;
+}
+
+void wHttpClientTask::Abort(std::deque<wHttpRequest_t*>* reqs) {
+	mBroken = true;
+	reqs->swap(mPending);
+	mPending.clear();
+}
+
+int wHttpClientTask::Parse(bool eof) {
+	wHttpClient* client = static_cast<wHttpClient*>(Client());
+	while (!mPending.empty() && !mBroken) {
+		wHttpRequest_t* req = mPending.front();
+		if (!mParser.HeadDone()) {
+			if (mRecvLen == 0) {
+				break;
+			}
+			mStarted = true;
+			if (req->mHead) {
+				mParser.SetNoBody();
+			}
+			int len = mParser.ParseHead(mRecvRead, mRecvLen);
+			if (len == 0) {
+				break;
+			} else if (len == -1) {
+				HNET_ERROR(soft::GetLogPath(), "%s : %s[%d]", "wHttpClientTask::Parse ParseHead() failed", "response illegal", mParser.Error());
+				client->Fail(this, kHttpClientErrParse);
+				return -1;
+			}
+
+			if (mParser.Status() / 100 == 1) {
+				// 1xx中间响应，丢弃
+				Consume(len);
+				mParser.Reset();
+				continue;
+			}
+			req->mRes.mStatus = mParser.Status();
+			req->mRes.mHead.assign(mRecvRead, len);
+			mClosing = mClosing || !mParser.KeepAlive();
+			Consume(len);
+		}
+
+		// body：逐段追加（不受接收缓冲大小限制）
+		while (!mParser.Done()) {
+			wSlice data;
+			size_t used = 0;
+			int ret = mParser.ReadBody(mRecvRead, mRecvLen, &data, &used);
+			if (ret == -1) {
+				HNET_ERROR(soft::GetLogPath(), "%s : %s[%d]", "wHttpClientTask::Parse ReadBody() failed", "response illegal", mParser.Error());
+				client->Fail(this, kHttpClientErrParse);
+				return -1;
+			} else if (ret == 0) {
+				break;
+			}
+			req->mRes.mBody.append(data.data(), data.size());
+			Consume(used);
+		}
+		if (!mParser.Done() && !(eof && mParser.UntilClose())) {
+			break;
+		}
+
+		mClosing = mClosing || mParser.UntilClose();
+		mPending.pop_front();
+		mParser.Reset();
+		mStarted = false;
+		client->Complete(this, req);
+		if (mClosing) {
+			// 服务端不再处理后续请求
+			break;
+		}
+	}
+
+	if (mClosing && !mBroken && !mParser.HeadDone()) {
+		// Connection: close的响应已完成，后续请求重试或失败
+		client->Fail(this, kHttpClientErrConnect);
+		return -1;
+	}
+	return 0;
+}
+
+}	// namespace hnet
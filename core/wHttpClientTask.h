@@ -0,0 +1,101 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_CLIENT_TASK_H_
+#define _W_HTTP_CLIENT_TASK_H_
+
+#include <deque>
+#include <functional>
+#include "wCore.h"
+#include "wTask.h"
+#include "wSlice.h"
+#include "wHttpParser.h"
+
+namespace hnet {
+
+// 异步http请求结果
+const int32_t	kHttpClientOk = 0;
+const int32_t	kHttpClientErrConnect = -1;	// 连接失败，或响应完成前连接断开
+const int32_t	kHttpClientErrTimeout = -2;
+const int32_t	kHttpClientErrParse = -3;	// 响应格式错误
+
+// 响应
+struct wHttpResponse_t {
+	int32_t mError;		// kHttpClientOk或错误码，出错时其他字段无效
+	uint16_t mStatus;
+	std::string mHead;	// 状态行 + header
+	std::string mBody;	// chunked已解码
+
+	wHttpResponse_t() : mError(kHttpClientOk), mStatus(0) { }
+
+	// 查找header（名称大小写不敏感），多个同名返回首个
+	bool Header(const wSlice& name, wSlice* value) const;
+};
+
+typedef std::function<void(const wHttpResponse_t& res)> wHttpCallback_t;
+
+// 请求
+struct wHttpRequest_t {
+	std::string mData;	// 请求行 + header + body
+	bool mIdempotent;	// GET、HEAD等：可流水线发送，连接断开时可重试
+	bool mHead;			// HEAD：响应无body
+	uint8_t mRetry;
+	int64_t mDeadline;	// 超时时刻（微秒）
+	wHttpCallback_t mCallback;
+	wHttpResponse_t mRes;
+
+	wHttpRequest_t() : mIdempotent(true), mHead(false), mRetry(0), mDeadline(0) { }
+};
+
+// 异步http客户端连接（见wHttpClient）
+// 请求写入发送缓冲后按序等待响应（流水线），响应header、body（Content-Length、chunked、以关闭连接结束）增量解析
+class wHttpClientTask : public wTask {
+public:
+	wHttpClientTask(wSocket *socket, const std::string& key, int32_t type = 0) : wTask(socket, type), mKey(key), mParser(true),
+	mStarted(false), mConnected(false), mClosing(false), mBroken(false), mActiveTm(soft::TimeUsec()) { }
+	virtual ~wHttpClientTask();
+
+	virtual int TaskRecv(ssize_t *size);
+	virtual int TaskSend(ssize_t *size);
+
+	// 请求写入发送缓冲（已连接时立即发送）。发送缓冲不足返回-1
+	int Push(wHttpRequest_t* req);
+
+	// 连接不再可用：取出未完成请求（按发送顺序），此后不再接受请求
+	void Abort(std::deque<wHttpRequest_t*>* reqs);
+
+	// 可发送新请求
+	inline bool Usable() const { return !mBroken && !mClosing && mSocket->SS() == kSsConnected;}
+	inline bool Broken() const { return mBroken;}
+	// 首个未完成请求已收到响应数据（不可重试）
+	inline bool Started() const { return mStarted;}
+	inline size_t Pending() const { return mPending.size();}
+	inline const wHttpRequest_t* Front() const { return mPending.empty()? NULL: mPending.front();}
+	inline const std::string& Key() const { return mKey;}
+	inline int64_t ActiveTm() const { return mActiveTm;}
+
+protected:
+	// 解析接收缓冲中的响应，完成的请求交由wHttpClient回调。eof为对端已关闭
+	int Parse(bool eof);
+	inline void Consume(size_t len) {
+		mRecvRead += len;
+		mRecvLen -= len;
+	}
+
+	std::string mKey;	// host:port
+	wHttpParser mParser;
+	std::deque<wHttpRequest_t*> mPending;	// 已写入发送缓冲，等待响应
+
+	bool mStarted;
+	bool mConnected;	// 连接已建立（首次可写事件）
+	bool mClosing;		// 服务端响应Connection: close
+	bool mBroken;
+	int64_t mActiveTm;	// 最近收发时刻（微秒）
+};
+
+}	// namespace hnet
+
+#endif
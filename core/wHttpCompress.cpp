@@ -0,0 +1,329 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <strings.h>
+#include "wHttpCompress.h"
+#include "wHttpFile.h"
+#include "wFile.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+#ifdef _USE_ZLIB_
+#include <zlib.h>
+#endif
+
+namespace hnet {
+
+namespace {
+
+// 缓存键：[类型][编码] + key，区分静态文件与热点响应
+const char kKeyBody = 'b';
+const char kKeyFile = 'f';
+
+inline bool IsSpace(char c) {
+	return c == ' ' || c == '\t';
+}
+
+// 去除首尾空白
+wSlice Trim(const char* p, const char* end) {
+	while (p < end && IsSpace(*p)) {
+		p++;
+	}
+	while (end > p && IsSpace(end[-1])) {
+		end--;
+	}
+	return wSlice(p, end - p);
+}
+
+// q值（"q=0.5"）转千分数，无q值为1000，格式错误为0
+int ParseQvalue(const wSlice& param) {
+	if (param.size() < 3 || (param[0] != 'q' && param[0] != 'Q') || param[1] != '=') {
+		return 1000;
+	}
+	const char* p = param.data() + 2;
+	const char* end = param.data() + param.size();
+	if (*p == '1') {
+		return 1000;
+	} else if (*p++ != '0') {
+		return 0;
+	} else if (p == end || *p++ != '.') {
+		return 0;
+	}
+	int q = 0, scale = 100;
+	for (; p < end && scale > 0 && isdigit(*p); p++, scale /= 10) {
+		q += (*p - '0') * scale;
+	}
+	return q;
+}
+
+std::string MakeKey(char kind, const wSlice& key, uint8_t encoding) {
+	std::string k;
+	k.reserve(key.size() + 2);
+	k.push_back(kind);
+	k.push_back(static_cast<char>('0' + encoding));
+	k.append(key.data(), key.size());
+	return k;
+}
+
+inline bool ContainsCase(const wSlice& s, const char* sub) {
+	size_t n = strlen(sub);
+	for (size_t i = 0; i + n <= s.size(); i++) {
+		if (strncasecmp(s.data() + i, sub, n) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+}	// namespace anonymous
+
+wHttpCompress::~wHttpCompress() {
+#ifdef _USE_ZLIB_
+	if (mStream != NULL) {
+		deflateEnd(mStream);
+		HNET_DELETE(mStream);
+	}
+#endif
+}
+
+bool wHttpCompress::Enable() {
+#ifdef _USE_ZLIB_
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint8_t wHttpCompress::Negotiate(const wSlice& accept) {
+	if (!Enable() || accept.empty()) {
+		return kHttpIdentity;
+	}
+	// 未列出的编码取"*"的权重，均未列出为不可接受
+	int gzip = -1, deflate = -1, any = -1;
+	const char* p = accept.data();
+	const char* end = p + accept.size();
+	while (p < end) {
+		const char* comma = static_cast<const char*>(memchr(p, ',', end - p));
+		if (comma == NULL) {
+			comma = end;
+		}
+		const char* semi = static_cast<const char*>(memchr(p, ';', comma - p));
+		const wSlice coding = Trim(p, semi != NULL? semi: comma);
+		const int q = semi != NULL? ParseQvalue(Trim(semi + 1, comma)): 1000;
+		if (coding.size() == 4 && strncasecmp(coding.data(), "gzip", 4) == 0) {
+			gzip = q;
+		} else if (coding.size() == 6 && strncasecmp(coding.data(), "x-gzip", 6) == 0) {
+			gzip = std::max(gzip, q);
+		} else if (coding.size() == 7 && strncasecmp(coding.data(), "deflate", 7) == 0) {
+			deflate = q;
+		} else if (coding == "*") {
+			any = q;
+		}
+		p = comma + 1;
+	}
+	if (gzip == -1) {
+		gzip = std::max(any, 0);
+	}
+	if (deflate == -1) {
+		deflate = std::max(any, 0);
+	}
+	if (gzip > 0 && gzip >= deflate) {
+		return kHttpGzip;
+	} else if (deflate > 0) {
+		return kHttpDeflate;
+	}
+	return kHttpIdentity;
+}
+
+const char* wHttpCompress::Name(uint8_t encoding) {
+	switch (encoding) {
+	case kHttpGzip:
+		return "gzip";
+	case kHttpDeflate:
+		return "deflate";
+	}
+	return "identity";
+}
+
+bool wHttpCompress::Compressible(const wSlice& type) {
+	return (type.size() >= 5 && strncasecmp(type.data(), "text/", 5) == 0) || ContainsCase(type, "json") || ContainsCase(type, "javascript") || ContainsCase(type, "xml");
+}
+
+int wHttpCompress::Begin(uint8_t encoding, int level) {
+#ifdef _USE_ZLIB_
+	if (encoding != kHttpGzip && encoding != kHttpDeflate) {
+		return -1;
+	}
+	if (mStream != NULL && mEncoding == encoding && mLevel == level) {
+		return deflateReset(mStream) == Z_OK? 0: -1;
+	} else if (mStream != NULL) {
+		deflateEnd(mStream);
+		HNET_DELETE(mStream);
+	}
+
+	HNET_NEW(z_stream(), mStream);
+	if (mStream == NULL) {
+		return -1;
+	}
+	// windowBits：15为zlib格式（deflate），+16为gzip格式
+	int ret = deflateInit2(mStream, level, Z_DEFLATED, encoding == kHttpGzip? 15 + 16: 15, 8, Z_DEFAULT_STRATEGY);
+	if (ret != Z_OK) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[%d]", "wHttpCompress::Begin deflateInit2() failed", "zlib error", ret);
+		HNET_DELETE(mStream);
+		return -1;
+	}
+	mEncoding = encoding;
+	mLevel = level;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int wHttpCompress::Update(const wSlice& data, std::string* out, bool finish) {
+#ifdef _USE_ZLIB_
+	if (mStream == NULL) {
+		return -1;
+	}
+	mStream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	mStream->avail_in = static_cast<uInt>(data.size());
+
+	// 输出直接写入out尾部，空间不足时扩展
+	size_t room = deflateBound(mStream, static_cast<uLong>(data.size())) + 16;
+	while (true) {
+		size_t old = out->size();
+		out->resize(old + room);
+		mStream->next_out = reinterpret_cast<Bytef*>(&(*out)[old]);
+		mStream->avail_out = static_cast<uInt>(room);
+		int ret = deflate(mStream, finish? Z_FINISH: Z_SYNC_FLUSH);
+		out->resize(old + room - mStream->avail_out);
+		if (ret == Z_STREAM_ERROR) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s[%d]", "wHttpCompress::Update deflate() failed", "zlib error", ret);
+			return -1;
+		} else if (finish? ret == Z_STREAM_END: mStream->avail_out != 0) {
+			break;
+		}
+		room = std::max(room, static_cast<size_t>(4096));
+	}
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int wHttpCompress::Compress(uint8_t encoding, int level, const wSlice& data, std::string* out) {
+	out->clear();
+	if (Begin(encoding, level) == -1) {
+		return -1;
+	}
+	return Update(data, out, true);
+}
+
+const std::string* wHttpCompressCache::Get(const wSlice& key, uint8_t encoding, const wSlice& version, const wSlice& body) {
+	const std::string k = MakeKey(kKeyBody, key, encoding);
+	const std::string* zbody = Lookup(k, version);
+	if (zbody == NULL) {
+		std::string z;
+		if (mCompress.Compress(encoding, kHttpCompressCacheLevel, body, &z) == -1) {
+			return NULL;
+		} else if (z.size() >= body.size()) {
+			z.clear();
+		}
+		zbody = Insert(k, version, &z);
+	}
+	return zbody->empty()? NULL: zbody;
+}
+
+const std::string* wHttpCompressCache::File(wHttpFile_t* file, uint8_t encoding) {
+	if (file->mSize < kHttpCompressMin || file->mSize > kHttpCompressFileMax) {
+		return NULL;
+	}
+	// 文件版本：inode + mtime + size（与wHttpFile缓存校验一致）
+	char version[24];
+	uint64_t v[3] = {static_cast<uint64_t>(file->mIno), static_cast<uint64_t>(file->mMtime), file->mSize};
+	memcpy(version, v, sizeof(version));
+
+	const std::string k = MakeKey(kKeyFile, file->mName, encoding);
+	const std::string* zbody = Lookup(k, wSlice(version, sizeof(version)));
+	if (zbody == NULL) {
+		std::string body(file->mSize, '\0');
+		size_t off = 0;
+		while (off < body.size()) {
+			wSlice result;
+			if (file->mFile->Read(off, body.size() - off, &result, &body[off]) == -1 || result.empty()) {
+				return NULL;
+			}
+			off += result.size();
+		}
+
+		std::string z;
+		if (mCompress.Compress(encoding, kHttpCompressCacheLevel, body, &z) == -1) {
+			return NULL;
+		} else if (z.size() >= body.size()) {
+			z.clear();
+		}
+		zbody = Insert(k, wSlice(version, sizeof(version)), &z);
+	}
+	return zbody->empty()? NULL: zbody;
+}
+
+void wHttpCompressCache::SetCapacity(size_t capacity) {
+	mCapacity = capacity;
+	while (mSize > mCapacity && !mLru.empty()) {
+		Evict(--mLru.end());
+	}
+}
+
+const std::string* wHttpCompressCache::Lookup(const std::string& key, const wSlice& version) {
+	std::map<std::string, std::list<Entry_t>::iterator>::iterator idx = mIndex.find(key);
+	if (idx == mIndex.end()) {
+		return NULL;
+	}
+	std::list<Entry_t>::iterator it = idx->second;
+	if (version != it->mVersion) {
+		// 原文已变更
+		Evict(it);
+		return NULL;
+	}
+	mLru.splice(mLru.begin(), mLru, it);
+	return &it->mBody;
+}
+
+const std::string* wHttpCompressCache::Insert(const std::string& key, const wSlice& version, std::string* body) {
+	mLru.push_front(Entry_t());
+	Entry_t& entry = mLru.front();
+	entry.mKey = key;
+	entry.mVersion.assign(version.data(), version.size());
+	entry.mBody.swap(*body);
+	mIndex[key] = mLru.begin();
+	mSize += entry.mKey.size() + entry.mVersion.size() + entry.mBody.size();
+
+	// 保留新条目（返回值须有效），超过容量的单个条目在下次插入时淘汰
+	while (mSize > mCapacity && mLru.size() > 1) {
+		Evict(--mLru.end());
+	}
+	return &entry.mBody;
+}
+
+void wHttpCompressCache::Evict(std::list<Entry_t>::iterator it) {
+	mSize -= it->mKey.size() + it->mVersion.size() + it->mBody.size();
+	mIndex.erase(it->mKey);
+	mLru.erase(it);
+}
+
+// 实例化对象
+static pthread_once_t hnet_compressCacheOnce = PTHREAD_ONCE_INIT;
+static wHttpCompressCache* hnet_defaultCompressCache;
+static void InitDefaultCompressCache() {
+	HNET_NEW(wHttpCompressCache(), hnet_defaultCompressCache);
+}
+
+wHttpCompressCache* wHttpCompressCache::Default() {
+	pthread_once(&hnet_compressCacheOnce, InitDefaultCompressCache);
+	return hnet_defaultCompressCache;
+}
+
+}	// namespace hnet
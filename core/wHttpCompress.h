@@ -0,0 +1,106 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_COMPRESS_H_
+#define _W_HTTP_COMPRESS_H_
+
+#include <map>
+#include <list>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+
+struct z_stream_s;
+
+namespace hnet {
+
+// 响应内容编码（Content-Encoding）
+enum {
+	kHttpIdentity = 0,
+	kHttpGzip,
+	kHttpDeflate
+};
+
+// 压缩阈值：body小于此长度不压缩（压缩收益低于gzip头尾开销与CPU成本）
+const uint32_t	kHttpCompressMin = 1024;
+// 压缩级别：实时压缩取速度；缓存的预压缩body仅压缩一次，取压缩率
+const int		kHttpCompressLevel = 1;
+const int		kHttpCompressCacheLevel = 9;
+// 预压缩缓存总字节数；可缓存的静态文件最大长度（更大的文件以sendfile发送原文）
+const size_t	kHttpCompressCacheSize = 64*1024*1024;
+const uint64_t	kHttpCompressFileMax = 4*1024*1024;
+
+struct wHttpFile_t;
+
+// zlib deflate流压缩（gzip、deflate格式）。需 -D_USE_ZLIB_ 及 -lz 编译参数，否则协商结果恒为kHttpIdentity
+// zlib状态（约256KB）首次Begin时分配，之后同编码、同级别的流以deflateReset复用。头文件不依赖zlib.h，应用程序无需同样定义_USE_ZLIB_
+class wHttpCompress : private wNoncopyable {
+public:
+	wHttpCompress() : mStream(NULL), mEncoding(kHttpIdentity), mLevel(0) { }
+	~wHttpCompress();
+
+	// 是否支持压缩（_USE_ZLIB_版本）
+	static bool Enable();
+
+	// 解析Accept-Encoding（q值，"*"），返回可用编码，同权重时gzip优先；无可用编码返回kHttpIdentity
+	static uint8_t Negotiate(const wSlice& accept);
+	// Content-Encoding名称
+	static const char* Name(uint8_t encoding);
+	// 可压缩的Content-Type：text/*、json、javascript、xml（含svg）
+	static bool Compressible(const wSlice& type);
+
+	// 开始一个压缩流
+	int Begin(uint8_t encoding, int level);
+	// 压缩data追加至out：finish为false时Z_SYNC_FLUSH（已输出部分可被对端立即解压，用于流式chunk），true时结束压缩流
+	int Update(const wSlice& data, std::string* out, bool finish);
+	// 一次压缩
+	int Compress(uint8_t encoding, int level, const wSlice& data, std::string* out);
+
+protected:
+	struct z_stream_s* mStream;	// NULL为未初始化
+	uint8_t mEncoding;
+	int mLevel;
+};
+
+// 预压缩body缓存：静态文件、热点响应的压缩结果按LRU缓存，CPU成本只付一次
+// 条目以 key + 编码 索引，version校验有效性（文件为inode、mtime、size；热点响应为原始body，逐字节比较）
+// 非线程安全：每进程（事件循环）一个实例，Default()
+class wHttpCompressCache : private wNoncopyable {
+public:
+	wHttpCompressCache() : mCapacity(kHttpCompressCacheSize), mSize(0) { }
+
+	static wHttpCompressCache* Default();
+
+	// 获取压缩body，无缓存、已失效时压缩并缓存。压缩失败、压缩后不小于原文返回NULL（原文发送）
+	// 返回值在下次调用前有效
+	const std::string* Get(const wSlice& key, uint8_t encoding, const wSlice& version, const wSlice& body);
+	// 静态文件（长度不超过kHttpCompressFileMax），缓存未命中时读取文件压缩
+	const std::string* File(wHttpFile_t* file, uint8_t encoding);
+
+	void SetCapacity(size_t capacity);
+	inline size_t Size() const { return mSize;}
+
+protected:
+	struct Entry_t {
+		std::string mKey;
+		std::string mVersion;
+		std::string mBody;		// 空为不可压缩（压缩后不小于原文），不再重复压缩
+	};
+
+	const std::string* Lookup(const std::string& key, const wSlice& version);
+	const std::string* Insert(const std::string& key, const wSlice& version, std::string* body);
+	void Evict(std::list<Entry_t>::iterator it);
+
+	wHttpCompress mCompress;
+	size_t mCapacity;
+	size_t mSize;	// key + version + body 总字节数
+	std::list<Entry_t> mLru;	// 头部为最近使用
+	std::map<std::string, std::list<Entry_t>::iterator> mIndex;
+};
+
+}	// namespace hnet
+
+#endif
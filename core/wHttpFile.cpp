@@ -0,0 +1,295 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <strings.h>
+#include "wHttpFile.h"
+#include "wEnv.h"
+#include "wFile.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+namespace {
+
+struct MimeType_t {
+	const char* mExt;
+	const char* mType;
+};
+
+const MimeType_t kMimeType[] = {
+	{"html", "text/html; charset=UTF-8"},
+	{"htm", "text/html; charset=UTF-8"},
+	{"css", "text/css; charset=UTF-8"},
+	{"js", "application/javascript; charset=UTF-8"},
+	{"json", "application/json; charset=UTF-8"},
+	{"xml", "text/xml; charset=UTF-8"},
+	{"txt", "text/plain; charset=UTF-8"},
+	{"png", "image/png"},
+	{"jpg", "image/jpeg"},
+	{"jpeg", "image/jpeg"},
+	{"gif", "image/gif"},
+	{"svg", "image/svg+xml"},
+	{"ico", "image/x-icon"},
+	{"webp", "image/webp"},
+	{"woff", "font/woff"},
+	{"woff2", "font/woff2"},
+	{"wasm", "application/wasm"},
+	{"pdf", "application/pdf"},
+	{"zip", "application/zip"},
+	{"gz", "application/gzip"},
+	{"mp4", "video/mp4"},
+	{NULL, "application/octet-stream"}
+};
+
+const char* MimeType(const std::string& fname) {
+	size_t dot = fname.rfind('.');
+	size_t slash = fname.rfind('/');
+	int i = 0;
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+		const char* ext = fname.c_str() + dot + 1;
+		for (; kMimeType[i].mExt != NULL; i++) {
+			if (strcasecmp(ext, kMimeType[i].mExt) == 0) {
+				break;
+			}
+		}
+	} else {
+		while (kMimeType[i].mExt != NULL) {
+			i++;
+		}
+	}
+	return kMimeType[i].mType;
+}
+
+inline int HexValue(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c = static_cast<char>(tolower(c));
+	return c >= 'a' && c <= 'f'? c - 'a' + 10: -1;
+}
+
+// 路径%xx解码（不转换+），并拒绝\0、..段
+bool DecodePath(const char* p, size_t len, std::string* out) {
+	out->clear();
+	out->reserve(len);
+	for (size_t i = 0; i < len; i++) {
+		char c = p[i];
+		if (c == '%') {
+			if (i + 2 >= len) {
+				return false;
+			}
+			int h = HexValue(p[i + 1]), l = HexValue(p[i + 2]);
+			if (h < 0 || l < 0) {
+				return false;
+			}
+			c = static_cast<char>(h * 16 + l);
+			i += 2;
+		}
+		if (c == '\0') {
+			return false;
+		}
+		out->push_back(c);
+	}
+
+	// ..段
+	size_t pos = 0;
+	while (pos <= out->size()) {
+		size_t slash = out->find('/', pos);
+		size_t end = slash == std::string::npos? out->size(): slash;
+		if (end - pos == 2 && (*out)[pos] == '.' && (*out)[pos + 1] == '.') {
+			return false;
+		}
+		pos = end + 1;
+	}
+	return true;
+}
+
+}	// namespace anonymous
+
+wHttpFile::wHttpFile() : mEnv(wEnv::Default()), mCapacity(kHttpFileCacheNum) { }
+
+wHttpFile::~wHttpFile() {
+	for (std::list<wHttpFile_t*>::iterator it = mLru.begin(); it != mLru.end(); it++) {
+		(*it)->mCached = false;
+		if ((*it)->mRef == 0) {
+			Close(*it);
+		}
+	}
+}
+
+int wHttpFile::Mount(const std::string& prefix, const std::string& dir) {
+	if (prefix.empty() || prefix[0] != '/' || dir.empty()) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpFile::Mount () failed", "prefix or dir illegal");
+		return -1;
+	}
+	std::string d = dir;
+	while (d.size() > 1 && d[d.size() - 1] == '/') {
+		d.erase(d.size() - 1);
+	}
+
+	std::vector<std::pair<std::string, std::string> >::iterator it = mMount.begin();
+	while (it != mMount.end() && it->first.size() >= prefix.size()) {
+		it++;
+	}
+	mMount.insert(it, std::make_pair(prefix, d));
+	return 0;
+}
+
+bool wHttpFile::Match(const wSlice& path, std::string* fname) const {
+	for (size_t i = 0; i < mMount.size(); i++) {
+		const std::string& prefix = mMount[i].first;
+		// 前缀须在路径段边界结束：/static 不匹配 /staticfoo
+		if (!path.startsWith(prefix)) {
+			continue;
+		} else if (path.size() != prefix.size() && prefix[prefix.size() - 1] != '/' && path[prefix.size()] != '/') {
+			continue;
+		}
+
+		std::string rest;
+		fname->clear();
+		if (DecodePath(path.data() + prefix.size(), path.size() - prefix.size(), &rest)) {
+			*fname = mMount[i].second;
+			if (rest.empty() || rest[0] != '/') {
+				fname->push_back('/');
+			}
+			fname->append(rest);
+			if ((*fname)[fname->size() - 1] == '/') {
+				fname->append("index.html");
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+wHttpFile_t* wHttpFile::Acquire(const std::string& fname) {
+	int64_t now = soft::TimeUsec();
+	struct stat st;
+	bool stated = false;
+
+	std::map<std::string, std::list<wHttpFile_t*>::iterator>::iterator idx = mIndex.find(fname);
+	if (idx != mIndex.end()) {
+		std::list<wHttpFile_t*>::iterator it = idx->second;
+		wHttpFile_t* file = *it;
+		if (now - file->mCheckTm >= kHttpFileCheckUsec) {
+			// 缓存的stat过期：校验文件是否变更（删除、替换、修改）
+			stated = stat(fname.c_str(), &st) == 0;
+			if (!stated || st.st_ino != file->mIno || st.st_mtime != file->mMtime || static_cast<uint64_t>(st.st_size) != file->mSize) {
+				Evict(it);
+				file = NULL;
+			} else {
+				file->mCheckTm = now;
+			}
+		}
+		if (file != NULL) {
+			mLru.splice(mLru.begin(), mLru, it);
+			file->mRef++;
+			return file;
+		}
+	}
+
+	if (!stated && stat(fname.c_str(), &st) != 0) {
+		return NULL;
+	} else if (!S_ISREG(st.st_mode)) {
+		return NULL;
+	}
+
+	wHttpFile_t* file = Open(fname, st);
+	if (file == NULL) {
+		return NULL;
+	}
+	mLru.push_front(file);
+	mIndex[fname] = mLru.begin();
+	while (mLru.size() > mCapacity) {
+		Evict(--mLru.end());
+	}
+	file->mRef++;
+	return file;
+}
+
+void wHttpFile::Release(wHttpFile_t* file) {
+	if (file != NULL && --file->mRef == 0 && !file->mCached) {
+		Close(file);
+	}
+}
+
+void wHttpFile::SetCapacity(size_t capacity) {
+	mCapacity = capacity;
+	while (mLru.size() > mCapacity) {
+		Evict(--mLru.end());
+	}
+}
+
+wHttpFile_t* wHttpFile::Open(const std::string& fname, const struct stat& st) {
+	int fd;
+	if (mEnv->OpenFile(fname, fd, O_RDONLY | O_CLOEXEC) == -1) {
+		return NULL;
+	}
+
+	// 以打开后的fd为准（stat与open之间文件可能被替换）
+	struct stat fst;
+	if (fstat(fd, &fst) == -1 || !S_ISREG(fst.st_mode)) {
+		mEnv->CloseFD(fd);
+		return NULL;
+	}
+
+	wHttpFile_t* file;
+	HNET_NEW(wHttpFile_t, file);
+	if (file == NULL) {
+		mEnv->CloseFD(fd);
+		return NULL;
+	}
+	HNET_NEW(wPosixRandomAccessFile(fname, fd), file->mFile);
+	if (file->mFile == NULL) {
+		mEnv->CloseFD(fd);
+		HNET_DELETE(file);
+		return NULL;
+	}
+
+	file->mName = fname;
+	file->mSize = fst.st_size;
+	file->mMtime = fst.st_mtime;
+	file->mIno = fst.st_ino;
+	file->mCheckTm = soft::TimeUsec();
+	file->mType = MimeType(fname);
+	file->mRef = 0;
+	file->mCached = true;
+
+	struct tm tm;
+	gmtime_r(&file->mMtime, &tm);
+	strftime(file->mLastModified, sizeof(file->mLastModified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	return file;
+}
+
+void wHttpFile::Evict(std::list<wHttpFile_t*>::iterator it) {
+	wHttpFile_t* file = *it;
+	mIndex.erase(file->mName);
+	mLru.erase(it);
+	file->mCached = false;
+	if (file->mRef == 0) {
+		Close(file);
+	}
+}
+
+void wHttpFile::Close(wHttpFile_t* file) {
+	HNET_DELETE(file->mFile);
+	HNET_DELETE(file);
+}
+
+// 实例化对象
+static pthread_once_t hnet_fileOnce = PTHREAD_ONCE_INIT;
+static wHttpFile* hnet_defaultFile;
+static void InitDefaultFile() {
+	HNET_NEW(wHttpFile(), hnet_defaultFile);
+}
+
+wHttpFile* wHttpFile::Default() {
+	pthread_once(&hnet_fileOnce, InitDefaultFile);
+	return hnet_defaultFile;
+}
+
+}	// namespace hnet
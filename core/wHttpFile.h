@@ -0,0 +1,79 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_FILE_H_
+#define _W_HTTP_FILE_H_
+
+#include <sys/stat.h>
+#include <map>
+#include <list>
+#include <vector>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+
+namespace hnet {
+
+// 打开文件缓存条数；缓存stat结果的有效期（过期后stat校验，文件变更则重新打开）
+const uint32_t	kHttpFileCacheNum = 1024;
+const int64_t	kHttpFileCheckUsec = 1000000;
+
+class wEnv;
+class wPosixRandomAccessFile;
+
+// 已打开文件
+struct wHttpFile_t {
+	std::string mName;
+	wPosixRandomAccessFile* mFile;	// 持有fd，sendfile发送
+	uint64_t mSize;
+	time_t mMtime;
+	ino_t mIno;
+	int64_t mCheckTm;
+	const char* mType;		// Content-Type
+	char mLastModified[32];	// HTTP-date
+	uint32_t mRef;
+	bool mCached;			// 仍在缓存中（淘汰后引用归零时关闭）
+};
+
+// 静态文件：URL前缀映射到目录，文件以sendfile发送（见wHttpTask::SendStatic）
+// 打开文件（fd + stat）按LRU缓存，小文件命中缓存后发送无open/stat/read，不经用户态缓冲
+// 非线程安全：每进程（事件循环）一个实例，Default()
+class wHttpFile : private wNoncopyable {
+public:
+	wHttpFile();
+	~wHttpFile();
+
+	static wHttpFile* Default();
+
+	// 挂载：prefix（如"/static/"）下的请求映射到dir目录。多个前缀匹配时取最长
+	int Mount(const std::string& prefix, const std::string& dir);
+	inline bool Empty() const { return mMount.empty();}
+
+	// 请求路径（未解码）映射为文件名。无匹配前缀返回false；路径非法（含..、\0）时fname为空
+	bool Match(const wSlice& path, std::string* fname) const;
+
+	// 获取文件（引用+1），用毕Release。不存在、非普通文件返回NULL
+	wHttpFile_t* Acquire(const std::string& fname);
+	void Release(wHttpFile_t* file);
+
+	void SetCapacity(size_t capacity);
+
+protected:
+	wHttpFile_t* Open(const std::string& fname, const struct stat& st);
+	void Evict(std::list<wHttpFile_t*>::iterator it);
+	void Close(wHttpFile_t* file);
+
+	wEnv* mEnv;
+	std::vector<std::pair<std::string, std::string> > mMount;	// 前缀长度降序
+
+	size_t mCapacity;
+	std::list<wHttpFile_t*> mLru;	// 头部为最近使用
+	std::map<std::string, std::list<wHttpFile_t*>::iterator> mIndex;
+};
+
+}	// namespace hnet
+
+#endif
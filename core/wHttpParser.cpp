@@ -0,0 +1,442 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <strings.h>
+#include <algorithm>
+#include "wHttpParser.h"
+
+namespace hnet {
+
+namespace {
+
+// RFC7230 token字符
+inline bool IsToken(char c) {
+	return c > 0x20 && c < 0x7f && strchr("()<>@,;:\\\"/[]?={}", c) == NULL;
+}
+
+inline bool IsSpace(char c) {
+	return c == ' ' || c == '\t';
+}
+
+inline bool EqualCase(const wSlice& a, const wSlice& b) {
+	return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+}	// namespace anonymous
+
+void wHttpParser::Reset() {
+	mBuf = NULL;
+	mState = kStateLine;
+	mError = 0;
+	mPos = 0;
+	mBodyOff = 0;
+	mBodyLen = 0;
+	mTotal = 0;
+	mChunkState = kChunkSize;
+	mBodyLeft = 0;
+	mMethod = mUri = mPath = mQuery = mVersion = Span_t();
+	mMajor = mMinor = 0;
+	mStatus = 0;
+	mReason = Span_t();
+	mContentLength = -1;
+	mChunked = mClose = mKeepAlive = mNoBody = mUntilClose = false;
+	mHeaderNum = 0;
+}
+
+int wHttpParser::Parse(char* buf, size_t len) {
+	int ret = ParseHead(buf, len);
+	if (ret <= 0) {
+		return ret;
+	}
+	return ParseBody(buf, len);
+}
+
+int wHttpParser::ParseHead(const char* buf, size_t len) {
+	mBuf = buf;
+	while (mState == kStateLine || mState == kStateHeader) {
+		const char* p = buf + mPos;
+		const char* nl = static_cast<const char*>(memchr(p, '\n', len - mPos));
+		if (nl == NULL) {
+			if (len > kHttpHeaderSize) {
+				return Fail(mState == kStateLine? 414: 431);
+			}
+			return 0;
+		}
+		mPos = nl + 1 - buf;
+		if (mPos > kHttpHeaderSize) {
+			return Fail(mState == kStateLine? 414: 431);
+		}
+
+		// 行尾\r\n（容忍单独\n）
+		const char* end = nl > p && nl[-1] == '\r'? nl - 1: nl;
+		int ret = 0;
+		if (mState == kStateLine) {
+			if (end == p) {
+				// 请求前的空行忽略（RFC7230 3.5）
+				continue;
+			}
+			ret = mResponse? ParseStatus(p, end): ParseLine(p, end);
+			mState = kStateHeader;
+		} else if (end == p) {
+			// header结束
+			mBodyOff = mPos;
+			ret = ParseFraming();
+			mState = kStateBody;
+		} else {
+			ret = ParseHeader(p, end);
+		}
+		if (ret == -1) {
+			return -1;
+		}
+	}
+	return static_cast<int>(mBodyOff);
+}
+
+int wHttpParser::ParseBody(char* buf, size_t len) {
+	mBuf = buf;
+	if (mState == kStateDone) {
+		return static_cast<int>(mTotal);
+	} else if (mState != kStateBody) {
+		return Fail(500);
+	}
+
+	if (mUntilClose) {
+		// 以关闭连接结束的body只能流式读取（ReadBody）
+		return len > mLimit? Fail(413): 0;
+	} else if (!mChunked) {
+		mTotal = mBodyOff + (mContentLength > 0? mContentLength: 0);
+		if (mTotal > mLimit) {
+			return Fail(413);
+		} else if (len < mTotal) {
+			return 0;
+		}
+		mBodyLen = mTotal - mBodyOff;
+		mState = kStateDone;
+		return static_cast<int>(mTotal);
+	}
+
+	// chunked：解出的数据前移，拼接在已解码body之后
+	while (mState != kStateDone) {
+		wSlice data;
+		size_t used = 0;
+		int ret = ReadBody(buf + mPos, len - mPos, &data, &used);
+		if (ret == -1) {
+			return -1;
+		} else if (ret == 0) {
+			return len > mLimit? Fail(413): 0;
+		}
+		if (!data.empty()) {
+			memmove(buf + mBodyOff + mBodyLen, data.data(), data.size());
+			mBodyLen += data.size();
+		}
+		mPos += used;
+	}
+	mTotal = mPos;
+	return mTotal > mLimit? Fail(413): static_cast<int>(mTotal);
+}
+
+int wHttpParser::ReadBody(const char* p, size_t len, wSlice* data, size_t* used) {
+	*data = wSlice();
+	*used = 0;
+	if (mState == kStateDone) {
+		return 1;
+	} else if (mState != kStateBody) {
+		return Fail(500);
+	}
+
+	if (mUntilClose) {
+		*data = wSlice(p, len);
+		*used = len;
+		return len > 0? 1: 0;
+	} else if (!mChunked) {
+		size_t n = static_cast<size_t>(std::min(mBodyLeft, static_cast<uint64_t>(len)));
+		*data = wSlice(p, n);
+		*used = n;
+		mBodyLeft -= n;
+		if (mBodyLeft == 0) {
+			mState = kStateDone;
+		}
+		return n > 0 || mState == kStateDone? 1: 0;
+	}
+
+	switch (mChunkState) {
+	case kChunkSize: {
+		// chunk-size [; chunk-ext] CRLF
+		const char* nl = static_cast<const char*>(memchr(p, '\n', len));
+		if (nl == NULL) {
+			return len > kHttpChunkLine? Fail(400): 0;
+		}
+		uint64_t size = 0;
+		const char* c = p;
+		for (; c < nl && isxdigit(*c); c++) {
+			if (c - p >= 15) {
+				return Fail(413);
+			}
+			size = size * 16 + (isdigit(*c)? *c - '0': (tolower(*c) - 'a' + 10));
+		}
+		if (c == p || (c < nl && *c != ';' && *c != '\r' && !IsSpace(*c))) {
+			return Fail(400);
+		}
+		*used = nl + 1 - p;
+		mBodyLeft = size;
+		mChunkState = size > 0? kChunkData: kChunkTrailer;
+		return 1;
+	}
+
+	case kChunkData: {
+		size_t n = static_cast<size_t>(std::min(mBodyLeft, static_cast<uint64_t>(len)));
+		if (n == 0) {
+			return 0;
+		}
+		*data = wSlice(p, n);
+		*used = n;
+		mBodyLeft -= n;
+		if (mBodyLeft == 0) {
+			mChunkState = kChunkCRLF;
+		}
+		return 1;
+	}
+
+	case kChunkCRLF:
+		if (len == 0 || (p[0] == '\r' && len < 2)) {
+			return 0;
+		} else if (p[0] == '\n') {
+			*used = 1;
+		} else if (p[0] == '\r' && p[1] == '\n') {
+			*used = 2;
+		} else {
+			return Fail(400);
+		}
+		mChunkState = kChunkSize;
+		return 1;
+
+	case kChunkTrailer: {
+		// trailer忽略，空行结束
+		const char* nl = static_cast<const char*>(memchr(p, '\n', len));
+		if (nl == NULL) {
+			return len > kHttpHeaderSize? Fail(431): 0;
+		}
+		*used = nl + 1 - p;
+		if (nl == p || (nl == p + 1 && p[0] == '\r')) {
+			mState = kStateDone;
+		}
+		return 1;
+	}
+	}
+	return Fail(500);
+}
+
+int wHttpParser::ParseLine(const char* p, const char* end) {
+	// method
+	const char* sp = static_cast<const char*>(memchr(p, ' ', end - p));
+	if (sp == NULL || sp == p) {
+		return Fail(400);
+	}
+	for (const char* c = p; c < sp; c++) {
+		if (!IsToken(*c)) {
+			return Fail(400);
+		}
+	}
+	mMethod = Make(p, sp - p);
+
+	// uri
+	p = sp + 1;
+	sp = static_cast<const char*>(memchr(p, ' ', end - p));
+	if (sp == NULL || sp == p) {
+		return Fail(400);
+	}
+	mUri = Make(p, sp - p);
+	const char* q = static_cast<const char*>(memchr(p, '?', sp - p));
+	const char* h = static_cast<const char*>(memchr(p, '#', sp - p));
+	const char* pathend = q != NULL? q: (h != NULL? h: sp);
+	mPath = Make(p, pathend - p);
+	if (q != NULL) {
+		const char* queryend = h != NULL && h > q? h: sp;
+		mQuery = Make(q + 1, queryend - q - 1);
+	}
+
+	// version HTTP/x.y
+	p = sp + 1;
+	if (end - p != 8 || memcmp(p, "HTTP/", 5) != 0 || !isdigit(p[5]) || p[6] != '.' || !isdigit(p[7])) {
+		return Fail(400);
+	}
+	mVersion = Make(p, end - p);
+	mMajor = p[5] - '0';
+	mMinor = p[7] - '0';
+	if (mMajor != 1) {
+		return Fail(505);
+	}
+	return 0;
+}
+
+int wHttpParser::ParseStatus(const char* p, const char* end) {
+	// HTTP/x.y SP 3DIGIT SP [reason]
+	if (end - p < 12 || memcmp(p, "HTTP/", 5) != 0 || !isdigit(p[5]) || p[6] != '.' || !isdigit(p[7]) || p[8] != ' ') {
+		return Fail(502);
+	}
+	mVersion = Make(p, 8);
+	mMajor = p[5] - '0';
+	mMinor = p[7] - '0';
+	if (mMajor != 1) {
+		return Fail(505);
+	}
+
+	p += 9;
+	if (!isdigit(p[0]) || !isdigit(p[1]) || !isdigit(p[2]) || (p + 3 < end && p[3] != ' ')) {
+		return Fail(502);
+	}
+	mStatus = static_cast<uint16_t>((p[0] - '0') * 100 + (p[1] - '0') * 10 + (p[2] - '0'));
+	p += 3;
+	if (p < end) {
+		p++;
+	}
+	mReason = Make(p, end - p);
+	return 0;
+}
+
+int wHttpParser::ParseHeader(const char* p, const char* end) {
+	if (IsSpace(*p)) {
+		// 不支持折行（RFC7230 3.2.4）
+		return Fail(400);
+	} else if (mHeaderNum >= kHttpHeaderMax) {
+		return Fail(431);
+	}
+
+	const char* colon = static_cast<const char*>(memchr(p, ':', end - p));
+	if (colon == NULL || colon == p) {
+		return Fail(400);
+	}
+	for (const char* c = p; c < colon; c++) {
+		if (!IsToken(*c)) {
+			return Fail(400);
+		}
+	}
+
+	// 去掉值两端空白
+	const char* v = colon + 1;
+	while (v < end && IsSpace(*v)) {
+		v++;
+	}
+	const char* ve = end;
+	while (ve > v && IsSpace(ve[-1])) {
+		ve--;
+	}
+	mHeader[mHeaderNum].mName = Make(p, colon - p);
+	mHeader[mHeaderNum].mValue = Make(v, ve - v);
+	mHeaderNum++;
+	return 0;
+}
+
+int wHttpParser::ParseFraming() {
+	for (uint32_t i = 0; i < mHeaderNum; i++) {
+		wSlice name = HeaderName(i), value = HeaderValue(i);
+		if (EqualCase(name, "Content-Length")) {
+			if (value.empty() || value.size() > 18) {
+				return Fail(value.empty()? 400: 413);
+			}
+			int64_t cl = 0;
+			for (size_t j = 0; j < value.size(); j++) {
+				if (!isdigit(value[j])) {
+					return Fail(400);
+				}
+				cl = cl * 10 + (value[j] - '0');
+			}
+			if (mContentLength != -1 && mContentLength != cl) {
+				// 多个不一致的Content-Length
+				return Fail(400);
+			}
+			mContentLength = cl;
+		} else if (EqualCase(name, "Transfer-Encoding")) {
+			// 仅支持以chunked结尾的编码
+			if (value.size() >= 7 && EqualCase(wSlice(value.data() + value.size() - 7, 7), "chunked")) {
+				mChunked = true;
+			} else {
+				return Fail(501);
+			}
+		} else if (EqualCase(name, "Connection")) {
+			mClose = mClose || HasToken(value, "close");
+			mKeepAlive = mKeepAlive || HasToken(value, "keep-alive");
+		}
+	}
+
+	if (mChunked) {
+		// Transfer-Encoding优先于Content-Length（RFC7230 3.3.3）
+		mContentLength = -1;
+	}
+	if (mResponse) {
+		// 无body的响应：HEAD请求、1xx、204、304（RFC7230 3.3.3）
+		if (mNoBody || mStatus / 100 == 1 || mStatus == 204 || mStatus == 304) {
+			mChunked = false;
+			mContentLength = 0;
+		} else if (!mChunked && mContentLength == -1) {
+			mUntilClose = true;
+		}
+	}
+	mBodyLeft = mContentLength > 0? mContentLength: 0;
+	return 0;
+}
+
+bool wHttpParser::Header(const wSlice& name, wSlice* value) const {
+	for (uint32_t i = 0; i < mHeaderNum; i++) {
+		if (EqualCase(HeaderName(i), name)) {
+			*value = HeaderValue(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool wHttpParser::QueryGet(const wSlice& key, wSlice* value) const {
+	return Param(Query(), key, value);
+}
+
+bool wHttpParser::FormGet(const wSlice& key, wSlice* value) const {
+	wSlice type;
+	if (Header("Content-Type", &type) && (type.size() < 33 || strncasecmp(type.data(), "application/x-www-form-urlencoded", 33) != 0)) {
+		return false;
+	}
+	return Param(Body(), key, value);
+}
+
+bool wHttpParser::Param(const wSlice& params, const wSlice& key, wSlice* value) {
+	const char* p = params.data();
+	const char* end = p + params.size();
+	while (p < end) {
+		const char* amp = static_cast<const char*>(memchr(p, '&', end - p));
+		const char* pe = amp != NULL? amp: end;
+		const char* eq = static_cast<const char*>(memchr(p, '=', pe - p));
+		const char* ke = eq != NULL? eq: pe;
+		if (static_cast<size_t>(ke - p) == key.size() && memcmp(p, key.data(), key.size()) == 0) {
+			*value = eq != NULL? wSlice(eq + 1, pe - eq - 1): wSlice();
+			return true;
+		}
+		p = pe + 1;
+	}
+	return false;
+}
+
+bool wHttpParser::HasToken(const wSlice& list, const wSlice& token) {
+	const char* p = list.data();
+	const char* end = p + list.size();
+	while (p < end) {
+		const char* comma = static_cast<const char*>(memchr(p, ',', end - p));
+		const char* te = comma != NULL? comma: end;
+		while (p < te && IsSpace(*p)) {
+			p++;
+		}
+		const char* e = te;
+		while (e > p && IsSpace(e[-1])) {
+			e--;
+		}
+		if (EqualCase(wSlice(p, e - p), token)) {
+			return true;
+		}
+		p = te + 1;
+	}
+	return false;
+}
+
+}	// namespace hnet
@@ -0,0 +1,182 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_PARSER_H_
+#define _W_HTTP_PARSER_H_
+
+#include "wCore.h"
+#include "wNoncopyable.h"
+#include "wSlice.h"
+
+namespace hnet {
+
+// 单条请求最多header数、请求行+header最大长度
+const uint32_t	kHttpHeaderMax = 64;
+const uint32_t	kHttpHeaderSize = 16384;
+const uint32_t	kHttpChunkLine = 1024;	// chunk-size行（含扩展）最大长度
+
+// HTTP/1.x 请求（响应）增量解析器
+// 状态机保存已解析位置，数据未收全时返回0，下次以同一起始地址（可已被移动）、更长的长度继续解析，已解析部分不再扫描
+// 行、分隔符以memchr（glibc向量化实现）查找。方法、路径、参数、header均为指向接收缓冲的视图，不复制
+// 注意：视图只在缓冲未被移动、覆盖前有效（即当前消息处理期间）
+class wHttpParser : private wNoncopyable {
+public:
+	// response为true时解析响应（状态行），供http客户端使用
+	explicit wHttpParser(bool response = false) : mResponse(response), mLimit(kMaxPackageSize) {
+		Reset();
+	}
+
+	// 开始解析新消息
+	void Reset();
+
+	// 解析完整消息buf[0, len)（buf为消息起始地址）：ParseHead + ParseBody
+	// 返回-1格式错误（Error()为建议响应状态码）；0未收全；>0消息完整，值为消息总长度（header + body）
+	int Parse(char* buf, size_t len);
+
+	// 解析请求行、header。返回-1格式错误；0未收全；>0 header长度
+	int ParseHead(const char* buf, size_t len);
+
+	// 缓冲body（header已完整）：Content-Length或chunked，chunked在buf中原地解码为连续body
+	// 返回-1格式错误（超过SetLimit为413）；0未收全；>0消息总长度（原始长度）
+	int ParseBody(char* buf, size_t len);
+
+	// 流式body（header已完整）：p[0, len)为未读body原始数据，解出的body片段为data（可为空，指向p中），used为消耗字节数
+	// 返回-1格式错误；0需更多数据；1已消耗used字节。Done()为body结束。流式body不受SetLimit限制，Body()为空
+	int ReadBody(const char* p, size_t len, wSlice* data, size_t* used);
+
+	// 消息最大长度（header + body），超过返回413
+	inline void SetLimit(size_t limit) { mLimit = limit;}
+
+	// 响应：对应请求为HEAD，无body（Reset后、ParseHead前设置）
+	inline void SetNoBody() { mNoBody = true;}
+
+	inline bool HeadDone() const { return mState >= kStateBody;}
+	inline bool Done() const { return mState == kStateDone;}
+	inline uint16_t Error() const { return mError;}
+
+	// 请求行，path不含query；query不含?
+	inline wSlice Method() const { return Slice(mMethod);}
+	inline wSlice Uri() const { return Slice(mUri);}
+	inline wSlice Path() const { return Slice(mPath);}
+	inline wSlice Query() const { return Slice(mQuery);}
+	inline wSlice Version() const { return Slice(mVersion);}
+	inline uint8_t Major() const { return mMajor;}
+	inline uint8_t Minor() const { return mMinor;}
+
+	// 状态行（响应）
+	inline uint16_t Status() const { return mStatus;}
+	inline wSlice Reason() const { return Slice(mReason);}
+	// 响应body以关闭连接结束（无Content-Length、非chunked），ReadBody交付全部数据，Done()不会为true
+	inline bool UntilClose() const { return mUntilClose;}
+
+	inline size_t HeadLength() const { return mBodyOff;}
+	// 缓冲body（chunked为解码后数据）
+	inline wSlice Body() const { return wSlice(mBuf + mBodyOff, mBodyLen);}
+
+	// -1为无Content-Length
+	inline int64_t ContentLength() const { return mContentLength;}
+	inline bool Chunked() const { return mChunked;}
+
+	// 持久连接：HTTP/1.1默认保持，HTTP/1.0需Connection: keep-alive
+	inline bool KeepAlive() const { return mMinor >= 1? !mClose: mKeepAlive;}
+
+	inline size_t HeaderNum() const { return mHeaderNum;}
+	inline wSlice HeaderName(size_t i) const { return Slice(mHeader[i].mName);}
+	inline wSlice HeaderValue(size_t i) const { return Slice(mHeader[i].mValue);}
+
+	// 查找header（名称大小写不敏感），多个同名返回首个
+	bool Header(const wSlice& name, wSlice* value) const;
+
+	// 查找GET参数、POST表单参数（application/x-www-form-urlencoded或无Content-Type），值未解码
+	bool QueryGet(const wSlice& key, wSlice* value) const;
+	bool FormGet(const wSlice& key, wSlice* value) const;
+
+	// 在 k1=v1&k2=v2 中查找key
+	static bool Param(const wSlice& params, const wSlice& key, wSlice* value);
+
+	// token列表（逗号分隔，大小写不敏感）中是否包含token
+	static bool HasToken(const wSlice& list, const wSlice& token);
+
+protected:
+	enum {
+		kStateLine = 0,
+		kStateHeader,
+		kStateBody,
+		kStateDone
+	};
+
+	// chunked body子状态
+	enum {
+		kChunkSize = 0,
+		kChunkData,
+		kChunkCRLF,
+		kChunkTrailer
+	};
+
+	// 相对消息起始的偏移，缓冲移动后仍有效
+	struct Span_t {
+		uint32_t mOff;
+		uint32_t mLen;
+	};
+
+	struct Header_t {
+		Span_t mName;
+		Span_t mValue;
+	};
+
+	inline wSlice Slice(const Span_t& s) const { return wSlice(mBuf + s.mOff, s.mLen);}
+	inline Span_t Make(const char* p, size_t len) const {
+		Span_t s = {static_cast<uint32_t>(p - mBuf), static_cast<uint32_t>(len)};
+		return s;
+	}
+
+	inline int Fail(uint16_t error) {
+		mError = error;
+		return -1;
+	}
+
+	int ParseLine(const char* p, const char* end);
+	int ParseStatus(const char* p, const char* end);
+	int ParseHeader(const char* p, const char* end);
+	int ParseFraming();	// header结束：Content-Length、chunked、Connection
+
+	const char* mBuf;	// 最近一次Parse的消息起始地址
+	bool mResponse;
+	size_t mLimit;
+	uint8_t mState;
+	uint16_t mError;
+	size_t mPos;		// 下一未解析行偏移（ParseBody时为下一未解析body原始数据偏移）
+	size_t mBodyOff;	// body偏移（即header长度）
+	size_t mBodyLen;	// 缓冲body长度
+	size_t mTotal;		// 缓冲消息总长度
+
+	uint8_t mChunkState;
+	uint64_t mBodyLeft;	// Content-Length剩余 | 当前chunk剩余
+
+	Span_t mMethod;
+	Span_t mUri;
+	Span_t mPath;
+	Span_t mQuery;
+	Span_t mVersion;
+	uint8_t mMajor;
+	uint8_t mMinor;
+	uint16_t mStatus;
+	Span_t mReason;
+
+	int64_t mContentLength;
+	bool mChunked;
+	bool mClose;
+	bool mKeepAlive;
+	bool mNoBody;
+	bool mUntilClose;
+
+	uint32_t mHeaderNum;
+	Header_t mHeader[kHttpHeaderMax];
+};
+
+}	// namespace hnet
+
+#endif
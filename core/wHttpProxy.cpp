@@ -0,0 +1,441 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <strings.h>
+#include <sys/timerfd.h>
+#include "wHttpProxy.h"
+#include "wHttpClient.h"
+#include "wHttp2.h"
+#include "wTcpSocket.h"
+#include "wServer.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+namespace {
+
+// 连接专用（hop-by-hop）header，不转发。Content-Length按转发的body重新计算；Expect由代理处理（100 Continue）
+const char kHopHeader[][24] = {"Connection", "Keep-Alive", "Proxy-Connection", "TE", "Trailer", "Transfer-Encoding", "Upgrade", "HTTP2-Settings", "Expect", "Content-Length"};
+const char kForwardedFor[] = "X-Forwarded-For";
+
+inline bool EqualCase(const wSlice& s, const char* t) {
+	size_t n = strlen(t);
+	return s.size() == n && strncasecmp(s.data(), t, n) == 0;
+}
+
+// 连接专用header：固定列表，或Connection中列出的header
+bool HopHeader(const wSlice& name, const wSlice& connection) {
+	for (size_t i = 0; i < sizeof(kHopHeader)/sizeof(kHopHeader[0]); i++) {
+		if (EqualCase(name, kHopHeader[i])) {
+			return true;
+		}
+	}
+	return !connection.empty() && wHttpParser::HasToken(connection, name);
+}
+
+inline wSlice TrimSpace(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+		end--;
+	}
+	return wSlice(p, end - p);
+}
+
+// 上游客户端事件注册至wServer事件循环：wHttpClient的epoll描述符（上游连接有事件时可读）；
+// 定时器描述符（kHttpClientCheckTm周期，请求、空闲连接超时检测）
+class wHttpProxyPoller : public wTask {
+public:
+	wHttpProxyPoller(wSocket* socket, wHttpClient* client, bool timer) : wTask(socket), mClient(client), mTimer(timer) { }
+
+	virtual int TaskRecv(ssize_t *size) {
+		*size = 0;
+		if (mTimer) {
+			uint64_t expire;
+			if (read(mSocket->FD(), &expire, sizeof(expire)) == -1 && errno != EAGAIN) {
+				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpProxyPoller::TaskRecv read() failed", error::Strerror(errno).c_str());
+			}
+		}
+		mClient->Poll(0);
+		return 0;
+	}
+
+protected:
+	wHttpClient* mClient;
+	bool mTimer;
+};
+
+// fd加入server事件循环（由socket关闭）
+int AddPoller(wServer* server, wHttpClient* client, int fd, bool timer) {
+	wSocket* socket;
+	HNET_NEW(wTcpSocket(kStConnect, kSpUnknown), socket);
+	if (socket == NULL) {
+		close(fd);
+		return -1;
+	}
+	socket->FD() = fd;
+	socket->SS() = kSsConnected;
+
+	wTask* task;
+	HNET_NEW(wHttpProxyPoller(socket, client, timer), task);
+	if (task == NULL) {
+		HNET_DELETE(socket);
+		return -1;
+	} else if (server->AddTask(task, EPOLLIN) == -1) {
+		HNET_DELETE(task);
+		return -1;
+	}
+	return 0;
+}
+
+}	// namespace anonymous
+
+wHttpProxy::~wHttpProxy() {
+	HNET_DELETE(mClient);
+}
+
+int wHttpProxy::AddUpstream(const std::string& list) {
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t comma = list.find(',', pos);
+		if (comma == std::string::npos) {
+			comma = list.size();
+		}
+		const std::string addr = list.substr(pos, comma - pos);
+		const size_t colon = addr.rfind(':');
+		if (colon == std::string::npos || AddUpstream(addr.substr(0, colon), static_cast<uint16_t>(atoi(addr.c_str() + colon + 1))) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s[%s]", "wHttpProxy::AddUpstream () failed", "upstream illegal", addr.c_str());
+			return -1;
+		}
+		pos = comma + 1;
+	}
+	return 0;
+}
+
+int wHttpProxy::AddUpstream(const std::string& host, uint16_t port) {
+	if (port == 0 || misc::Text2IP(host.c_str()) == INADDR_NONE) {
+		return -1;
+	}
+	wHttpUpstream_t upstream;
+	upstream.mHost = host;
+	upstream.mPort = port;
+	upstream.mFails = 0;
+	upstream.mDownTm = 0;
+	mUpstream.push_back(upstream);
+	return 0;
+}
+
+uint64_t wHttpProxy::Register(wHttpProxyTask* task) {
+	mTask[++mTaskId] = task;
+	return mTaskId;
+}
+
+void wHttpProxy::Unregister(uint64_t id) {
+	mTask.erase(id);
+}
+
+wHttpClient* wHttpProxy::Client(wServer* server) {
+	if (mClient != NULL && mPid == getpid()) {
+		return mClient;
+	} else if (server == NULL) {
+		return NULL;
+	}
+
+	// fork前创建的实例属于父进程（描述符已继承，不可共用），不释放
+	mClient = NULL;
+	wHttpClient* client;
+	HNET_NEW(wHttpClient(server->Config(), server), client);
+	if (client == NULL || client->PrepareStart() == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpProxy::Client () failed", "client start failed");
+		HNET_DELETE(client);
+		return NULL;
+	}
+
+	struct itimerspec spec;
+	spec.it_interval.tv_sec = spec.it_value.tv_sec = 0;
+	spec.it_interval.tv_nsec = spec.it_value.tv_nsec = kHttpClientCheckTm * 1000000;
+	const int efd = dup(client->EpollFD());
+	const int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (tfd == -1 || timerfd_settime(tfd, 0, &spec, NULL) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpProxy::Client timerfd() failed", error::Strerror(errno).c_str());
+		if (tfd != -1) {
+			close(tfd);
+		}
+		if (efd != -1) {
+			close(efd);
+		}
+		HNET_DELETE(client);
+		return NULL;
+	} else if (efd == -1 || AddPoller(server, client, efd, false) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpProxy::Client AddPoller() failed", "");
+		close(tfd);
+		HNET_DELETE(client);
+		return NULL;
+	} else if (AddPoller(server, client, tfd, true) == -1) {
+		// epoll描述符已注册，client须保留
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpProxy::Client AddPoller() failed", "timer");
+	}
+	mClient = client;
+	mPid = getpid();
+	return mClient;
+}
+
+size_t wHttpProxy::Select() {
+	const int64_t now = soft::TimeUsec();
+	for (size_t i = 0; i < mUpstream.size(); i++) {
+		const size_t idx = (mNext + i) % mUpstream.size();
+		if (mUpstream[idx].mDownTm <= now) {
+			mNext = idx + 1;
+			return idx;
+		}
+	}
+	// 全部摘除：仍轮询，避免全部不可用期间拒绝所有请求
+	return mNext++ % mUpstream.size();
+}
+
+int wHttpProxy::Forward(wServer* server, wHttpProxyCall_t* call) {
+	wHttpResponse_t res;
+	res.mError = kHttpClientErrConnect;
+
+	wHttpClient* client = Client(server);
+	if (client == NULL || mUpstream.empty()) {
+		Reply(call, res);
+		return -1;
+	}
+
+	call->mUpstream = Select();
+	const wHttpUpstream_t& upstream = mUpstream[call->mUpstream];
+	// 结果可能同步回调（如连接失败），此后call不可再用
+	if (client->Send(upstream.mHost, upstream.mPort, call->mData, call->mIdempotent, call->mHead, std::bind(&wHttpProxy::OnResponse, this, call, std::placeholders::_1), kHttpProxyTimeout) == -1) {
+		Reply(call, res);
+		return -1;
+	}
+	return 0;
+}
+
+void wHttpProxy::OnResponse(wHttpProxyCall_t* call, const wHttpResponse_t& res) {
+	wHttpUpstream_t& upstream = mUpstream[call->mUpstream];
+	if (res.mError == kHttpClientOk) {
+		upstream.mFails = 0;
+		upstream.mDownTm = 0;
+		Reply(call, res);
+		return;
+	}
+
+	if (++upstream.mFails >= kHttpProxyFails) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[%s:%d]", "wHttpProxy::OnResponse () failed", "upstream down", upstream.mHost.c_str(), upstream.mPort);
+		upstream.mFails = 0;
+		upstream.mDownTm = soft::TimeUsec() + static_cast<int64_t>(kHttpProxyDownTm) * 1000000;
+	}
+
+	// 幂等请求换上游重试（超时不重试：上游可能仍在处理，重试使延迟翻倍），下游连接已关闭时不再转发
+	if (res.mError != kHttpClientErrTimeout && call->mIdempotent && call->mRetry < kHttpProxyRetry && mTask.find(call->mTask) != mTask.end()) {
+		call->mRetry++;
+		Forward(NULL, call);
+		return;
+	}
+	Reply(call, res);
+}
+
+void wHttpProxy::Reply(wHttpProxyCall_t* call, const wHttpResponse_t& res) {
+	std::map<uint64_t, wHttpProxyTask*>::iterator it = mTask.find(call->mTask);
+	if (it != mTask.end()) {
+		if (res.mError == kHttpClientOk) {
+			it->second->Relay(call->mStream, call->mHead, res);
+		} else {
+			// 上游不可用（502）、超时（504）
+			wHttpResponse_t err;
+			err.mStatus = res.mError == kHttpClientErrTimeout? 504: 502;
+			const char* text = http::StatusText(err.mStatus);
+			err.mHead.append(kProtocol[0]).append(" ");
+			logging::AppendNumberTo(&err.mHead, err.mStatus);
+			err.mHead.append(" ").append(text).append(kCRLF);
+			err.mHead.append(kHeader[1]).append(kColon).append("text/html; charset=UTF-8").append(kCRLF).append(kCRLF);
+			err.mBody.append("<h1>").append(text).append("</h1>");
+			it->second->Relay(call->mStream, call->mHead, err);
+		}
+	}
+	HNET_DELETE(call);
+}
+
+// 实例化对象
+static pthread_once_t hnet_proxyOnce = PTHREAD_ONCE_INIT;
+static wHttpProxy* hnet_defaultProxy;
+static void InitDefaultProxy() {
+	HNET_NEW(wHttpProxy(), hnet_defaultProxy);
+}
+
+wHttpProxy* wHttpProxy::Default() {
+	pthread_once(&hnet_proxyOnce, InitDefaultProxy);
+	return hnet_defaultProxy;
+}
+
+wHttpProxyTask::wHttpProxyTask(wSocket *socket, int32_t type) : wHttpTask(socket, type) {
+	mProxyId = wHttpProxy::Default()->Register(this);
+}
+
+wHttpProxyTask::~wHttpProxyTask() {
+	wHttpProxy::Default()->Unregister(mProxyId);
+}
+
+int wHttpProxyTask::Handlemsg(char buf[], uint32_t len) {
+	wHttpProxyCall_t* call;
+	HNET_NEW(wHttpProxyCall_t, call);
+	if (call == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpProxyTask::Handlemsg new() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	call->mTask = mProxyId;
+	call->mStream = mH2 != NULL? mH2Stream: 0;
+	call->mIdempotent = Method() == kMethod[0] || Method() == kMethod[4];
+	call->mHead = Method() == kMethod[4];
+	call->mRetry = 0;
+	call->mUpstream = 0;
+	call->mData.reserve(len + kHttpHeadReserve);
+	BuildRequest(&call->mData);
+
+	// HTTP/1.x：上游响应前暂停后续请求（响应须按请求顺序）；HTTP/2：响应以stream发送，不影响其他stream
+	if (mH2 != NULL) {
+		mResStream = kResEnded;
+	} else {
+		Defer();
+	}
+	wHttpProxy::Default()->Forward(mServer, call);
+	if (mResStream == kResEnded) {
+		// 已响应（上游同步失败），或HTTP/2
+		ResponseReset();
+	}
+	return 0;
+}
+
+void wHttpProxyTask::BuildRequest(std::string* data) {
+	const wSlice method = Method();
+	const wSlice uri = mParser.Uri();
+	data->append(method.data(), method.size()).append(" ").append(uri.data(), uri.size()).append(" ").append(kProtocol[0]).append(kCRLF);
+
+	const wSlice connection = RequestGet(kHeader[3]);
+	const wSlice forwarded = RequestGet(kForwardedFor);
+	for (size_t i = 0; i < mParser.HeaderNum(); i++) {
+		const wSlice name = mParser.HeaderName(i);
+		const wSlice value = mParser.HeaderValue(i);
+		if (HopHeader(name, connection) || EqualCase(name, kForwardedFor)) {
+			continue;
+		}
+		data->append(name.data(), name.size()).append(kColon).append(value.data(), value.size()).append(kCRLF);
+	}
+	data->append(kForwardedFor).append(kColon);
+	if (!forwarded.empty()) {
+		data->append(forwarded.data(), forwarded.size()).append(", ");
+	}
+	data->append(mSocket->Host()).append(kCRLF);
+
+	const wSlice body = mParser.Body();
+	if (!body.empty() || (method != kMethod[0] && method != kMethod[4])) {
+		data->append(kHeader[0]).append(kColon);
+		logging::AppendNumberTo(data, body.size());
+		data->append(kCRLF);
+	}
+	data->append(kCRLF).append(body.data(), body.size());
+}
+
+size_t wHttpProxyTask::RenderRelay(char* buf, const wHttpResponse_t& res, bool nobody) {
+	char* p = buf;
+	const char* head = res.mHead.data();
+	const char* end = head + res.mHead.size();
+
+	// 状态行：协议版本为本端版本，状态码、描述原样
+	const char* eol = static_cast<const char*>(memchr(head, '\n', end - head));
+	const char* sp = static_cast<const char*>(memchr(head, ' ', (eol != NULL? eol: end) - head));
+	const wSlice status = sp != NULL? TrimSpace(sp + 1, eol != NULL? eol: end): wSlice("502 Bad Gateway");
+	memcpy(p, kProtocol[0], strlen(kProtocol[0]));
+	p += strlen(kProtocol[0]);
+	*p++ = ' ';
+	memcpy(p, status.data(), status.size());
+	p += status.size();
+	*p++ = '\r';
+	*p++ = '\n';
+
+	// header：去除连接专用header。无body的响应（HEAD、1xx、204、304）保留上游Content-Length
+	wSlice connection;
+	res.Header(kHeader[3], &connection);
+	while (eol != NULL && ++eol < end) {
+		const char* line = eol;
+		eol = static_cast<const char*>(memchr(line, '\n', end - line));
+		const char* line_end = eol != NULL? eol: end;
+		const char* colon = static_cast<const char*>(memchr(line, ':', line_end - line));
+		if (colon == NULL) {
+			continue;
+		}
+		const wSlice name(line, colon - line);
+		if (HopHeader(name, connection) && !(nobody && EqualCase(name, kHeader[0]))) {
+			continue;
+		}
+		const wSlice value = TrimSpace(colon + 1, line_end);
+		memcpy(p, name.data(), name.size());
+		p += name.size();
+		memcpy(p, kColon, 2);
+		p += 2;
+		memcpy(p, value.data(), value.size());
+		p += value.size();
+		*p++ = '\r';
+		*p++ = '\n';
+	}
+
+	std::string extra;
+	if (!nobody) {
+		extra.append(kHeader[0]).append(kColon);
+		logging::AppendNumberTo(&extra, res.mBody.size());
+		extra.append(kCRLF);
+	}
+	if (!mKeepAlive) {
+		extra.append("Connection: close\r\n");
+	} else if (mReqMinor == 0) {
+		extra.append("Connection: keep-alive\r\n");
+	}
+	extra.append(kCRLF);
+	memcpy(p, extra.data(), extra.size());
+	p += extra.size();
+	return p - buf;
+}
+
+int wHttpProxyTask::Relay(uint32_t stream, bool head, const wHttpResponse_t& res) {
+	const bool nobody = head || res.mStatus < 200 || res.mStatus == 204 || res.mStatus == 304;
+	const wSlice body = nobody? wSlice(): wSlice(res.mBody);
+
+	if (mH2 != NULL) {
+		// 响应头由session转换为HEADERS，body按流量控制窗口分帧
+		mH2Head.resize(res.mHead.size() + kHttpHeadReserve);
+		mH2Head.resize(RenderRelay(&mH2Head[0], res, nobody));
+		int ret = mH2->Response(stream, mH2Head, body, true);
+		if (ret != -1 && !mHandling) {
+			ret = Http2Process();
+		}
+		if (ret == -1 && !mHandling) {
+			shutdown(mSocket->FD(), SHUT_WR);
+		}
+		return ret;
+	} else if (mResStream != kResDeferred) {
+		return 0;
+	}
+
+	// 响应头写入发送缓冲，body零拷贝发送（未发完部分进入发送缓冲）
+	int ret = -1;
+	const bool idle = mSendLen == 0;
+	char* buf = Reserve(res.mHead.size() + kHttpHeadReserve);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpProxyTask::Relay () failed", "left buffer not enough");
+	} else {
+		const size_t len = RenderRelay(buf, res, nobody);
+		Commit(len);
+		ret = SendParts(idle, buf, len, &body, 1);
+	}
+	mResStream = kResEnded;
+	return Resume(ret);
+}
+
+}	// namespace hnet
@@ -0,0 +1,117 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_PROXY_H_
+#define _W_HTTP_PROXY_H_
+
+#include <map>
+#include <vector>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+#include "wHttpTask.h"
+#include "wHttpClientTask.h"
+
+namespace hnet {
+
+// 反向代理：上游请求超时（毫秒）、幂等请求失败后换上游重试次数
+const uint32_t	kHttpProxyTimeout = 10000;
+const uint32_t	kHttpProxyRetry = 2;
+// 上游连续失败kHttpProxyFails次后摘除kHttpProxyDownTm秒，期间不再选择（全部摘除时仍轮询）
+const uint32_t	kHttpProxyFails = 3;
+const uint32_t	kHttpProxyDownTm = 10;
+
+class wServer;
+class wHttpClient;
+class wHttpProxyTask;
+
+// 上游服务
+struct wHttpUpstream_t {
+	std::string mHost;
+	uint16_t mPort;
+	uint32_t mFails;	// 连续失败次数
+	int64_t mDownTm;	// 摘除截止时刻（微秒），0为可用
+};
+
+// 转发中的请求
+struct wHttpProxyCall_t {
+	uint64_t mTask;		// 下游连接（wHttpProxyTask::ProxyId）
+	uint32_t mStream;	// HTTP/2 stream，0为HTTP/1.x
+	std::string mData;	// 已序列化的上游请求（重试时原样重发）
+	bool mIdempotent;
+	bool mHead;
+	uint8_t mRetry;
+	size_t mUpstream;	// 本次转发的上游下标
+};
+
+// 反向代理（HTTP）：下游请求经wHttpProxyTask转为上游请求，由每进程一个wHttpClient发往上游（持久连接池、幂等请求流水线），
+// 上游响应头原样转发（去除连接专用header），body零拷贝写入下游连接。上游按轮询选择，连接失败、响应格式错误的幂等请求换上游重试，
+// 最终失败以502（超时504）响应
+// wHttpClient在worker进程首次转发时创建，其epoll描述符注册至wServer事件循环，上游事件与下游事件同一循环处理，无额外轮询延迟
+// 非线程安全：每进程一个实例，Default()
+class wHttpProxy : private wNoncopyable {
+public:
+	wHttpProxy() : mClient(NULL), mPid(0), mNext(0), mTaskId(0) { }
+	~wHttpProxy();
+
+	static wHttpProxy* Default();
+
+	// 上游服务："ip:port"，多个以","分隔（如命令行-u参数）
+	int AddUpstream(const std::string& list);
+	int AddUpstream(const std::string& host, uint16_t port);
+	inline bool Empty() const { return mUpstream.empty();}
+
+	// 转发请求：call所有权转移（失败时亦释放），结果回调下游task的Relay
+	int Forward(wServer* server, wHttpProxyCall_t* call);
+
+	// 下游连接登记，上游响应到达时连接可能已关闭
+	uint64_t Register(wHttpProxyTask* task);
+	void Unregister(uint64_t id);
+
+protected:
+	// 创建上游客户端（每进程一次），注册至server事件循环
+	wHttpClient* Client(wServer* server);
+	// 轮询选择可用上游
+	size_t Select();
+	void OnResponse(wHttpProxyCall_t* call, const wHttpResponse_t& res);
+	// 结果发送至下游（上游失败时为502、504响应），释放call
+	void Reply(wHttpProxyCall_t* call, const wHttpResponse_t& res);
+
+	wHttpClient* mClient;
+	pid_t mPid;		// mClient所在进程（master创建的实例不被worker复用）
+	size_t mNext;
+	std::vector<wHttpUpstream_t> mUpstream;
+
+	uint64_t mTaskId;
+	std::map<uint64_t, wHttpProxyTask*> mTask;
+};
+
+// 反向代理连接：HTTP/1.x请求延迟响应（Defer），上游响应到达后发送，再处理后续流水线请求；
+// HTTP/2各stream独立转发，响应按stream多路复用发送
+class wHttpProxyTask : public wHttpTask {
+public:
+	wHttpProxyTask(wSocket *socket, int32_t type = 0);
+	virtual ~wHttpProxyTask();
+
+	virtual int Handlemsg(char buf[], uint32_t len);
+
+	// 上游响应（或代理生成的错误响应）发送至下游。head为HEAD请求（不发送body）
+	int Relay(uint32_t stream, bool head, const wHttpResponse_t& res);
+
+	inline uint64_t ProxyId() const { return mProxyId;}
+
+protected:
+	// 上游请求：请求行（HTTP/1.1）、去除连接专用header、追加X-Forwarded-For、Content-Length、body
+	void BuildRequest(std::string* data);
+	// 上游响应头：状态行、去除连接专用header，Content-Length按body长度，Connection按下游连接，写入buf（至少head.size() + kHttpHeadReserve）
+	size_t RenderRelay(char* buf, const wHttpResponse_t& res, bool nobody);
+
+	uint64_t mProxyId;
+};
+
+}	// namespace hnet
+
+#endif
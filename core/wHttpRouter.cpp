@@ -0,0 +1,270 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wHttpRouter.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+namespace {
+
+// 与kHttpRouteMethod对应，末项为任意方法
+const char kRouteMethod[][8] = {"GET", "POST", "PUT", "DELETE", "HEAD", "PATCH", "OPTIONS", "*"};
+const int kRouteGet = 0;
+const int kRouteHead = 4;
+const int kRouteAny = kHttpRouteMethod - 1;
+
+}	// namespace anonymous
+
+bool wHttpParams_t::Get(const wSlice& name, wSlice* value) const {
+	for (uint32_t i = 0; i < mNum; i++) {
+		if (mName[i] == name) {
+			*value = mValue[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+wHttpRouter::wHttpRouter() {
+	mNode.push_back(Node_t());
+}
+
+int wHttpRouter::MethodIndex(const wSlice& method) {
+	for (uint32_t i = 0; i < kHttpRouteMethod; i++) {
+		if (method == kRouteMethod[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int32_t wHttpRouter::NewNode(const wSlice& label) {
+	mNode.push_back(Node_t());
+	mNode.back().mLabel = label.ToString();
+	return static_cast<int32_t>(mNode.size() - 1);
+}
+
+int32_t* wHttpRouter::Insert(const wSlice& method, const wSlice& path) {
+	int m = MethodIndex(method);
+	if (m == -1 || path.empty() || path[0] != '/') {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[%s %s]", "wHttpRouter::Insert () failed", "method or path illegal", method.ToString().c_str(), path.ToString().c_str());
+		return NULL;
+	}
+
+	const char* p = path.data();
+	const char* end = p + path.size();
+	uint32_t num = 0;
+	int32_t n = 0;
+	while (p < end) {
+		if (*p != ':' && *p != '*') {
+			// 静态片段：至下一参数
+			const char* q = p;
+			while (q < end && *q != ':' && *q != '*') {
+				q++;
+			}
+			n = InsertStatic(n, p, q - p);
+			p = q;
+			continue;
+		}
+
+		// 参数须为完整路径段，通配须在末尾
+		const bool wild = *p == '*';
+		const char* q = static_cast<const char*>(memchr(p, '/', end - p));
+		if (q == NULL) {
+			q = end;
+		}
+		if (p[-1] != '/' || q - p < 2 || (wild && q != end) || ++num > kHttpRouteParamMax) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s[%s]", "wHttpRouter::Insert () failed", "path param illegal", path.ToString().c_str());
+			return NULL;
+		}
+		const wSlice name(p + 1, q - p - 1);
+		int32_t c = wild? mNode[n].mWild: mNode[n].mParam;
+		if (c == -1) {
+			c = NewNode(name);
+			if (wild) {
+				mNode[n].mWild = c;
+			} else {
+				mNode[n].mParam = c;
+			}
+		} else if (name != mNode[c].mLabel) {
+			// 同一位置参数名须一致
+			HNET_ERROR(soft::GetLogPath(), "%s : %s[%s|%s]", "wHttpRouter::Insert () failed", "path param conflict", mNode[c].mLabel.c_str(), path.ToString().c_str());
+			return NULL;
+		}
+		n = c;
+		p = q;
+	}
+	mNode[n].mRoute = true;
+	return &mNode[n].mHandle[m];
+}
+
+int32_t wHttpRouter::Lookup(const wSlice& method, const wSlice& path) const {
+	int m = MethodIndex(method);
+	if (m == -1 || path.empty() || path[0] != '/') {
+		return -1;
+	}
+
+	const char* p = path.data();
+	const char* end = p + path.size();
+	int32_t n = 0;
+	while (p < end) {
+		const Node_t& node = mNode[n];
+		if (*p != ':' && *p != '*') {
+			// 静态片段：子节点标签须为剩余路径前缀（与Insert拆分方式一致）
+			const char* pos = static_cast<const char*>(memchr(node.mIndices.data(), *p, node.mIndices.size()));
+			if (pos == NULL) {
+				return -1;
+			}
+			int32_t c = node.mChild[pos - node.mIndices.data()];
+			const std::string& label = mNode[c].mLabel;
+			if (static_cast<size_t>(end - p) < label.size() || memcmp(p, label.data(), label.size()) != 0) {
+				return -1;
+			}
+			n = c;
+			p += label.size();
+			continue;
+		}
+
+		const bool wild = *p == '*';
+		const char* q = static_cast<const char*>(memchr(p, '/', end - p));
+		if (q == NULL) {
+			q = end;
+		}
+		int32_t c = wild? node.mWild: node.mParam;
+		if (c == -1 || wSlice(p + 1, q - p - 1) != mNode[c].mLabel) {
+			return -1;
+		}
+		n = c;
+		p = q;
+	}
+	return mNode[n].mRoute? mNode[n].mHandle[m]: -1;
+}
+
+int32_t wHttpRouter::InsertStatic(int32_t n, const char* p, size_t len) {
+	while (len > 0) {
+		size_t pos = mNode[n].mIndices.find(*p);
+		if (pos == std::string::npos) {
+			int32_t c = NewNode(wSlice(p, len));
+			mNode[n].mIndices.push_back(*p);
+			mNode[n].mChild.push_back(c);
+			return c;
+		}
+
+		// 公共前缀
+		int32_t c = mNode[n].mChild[pos];
+		const std::string& label = mNode[c].mLabel;
+		size_t common = 0;
+		while (common < len && common < label.size() && label[common] == p[common]) {
+			common++;
+		}
+		if (common < label.size()) {
+			// 拆分子节点：公共前缀为新的中间节点
+			int32_t mid = NewNode(wSlice(p, common));
+			mNode[c].mLabel.erase(0, common);
+			mNode[mid].mIndices.push_back(mNode[c].mLabel[0]);
+			mNode[mid].mChild.push_back(c);
+			mNode[n].mChild[pos] = mid;
+			c = mid;
+		}
+		p += common;
+		len -= common;
+		n = c;
+	}
+	return n;
+}
+
+int32_t wHttpRouter::Match(int32_t n, const char* p, const char* end, wHttpParams_t* params) const {
+	const Node_t& node = mNode[n];
+	if (p == end) {
+		if (node.mRoute) {
+			return n;
+		}
+	} else {
+		// 静态子节点
+		const char* pos = static_cast<const char*>(memchr(node.mIndices.data(), *p, node.mIndices.size()));
+		if (pos != NULL) {
+			int32_t c = node.mChild[pos - node.mIndices.data()];
+			const std::string& label = mNode[c].mLabel;
+			if (static_cast<size_t>(end - p) >= label.size() && memcmp(p, label.data(), label.size()) == 0) {
+				int32_t r = Match(c, p + label.size(), end, params);
+				if (r >= 0) {
+					return r;
+				}
+			}
+		}
+
+		// 参数子节点：至下一'/'
+		if (node.mParam >= 0 && *p != '/' && params->mNum < kHttpRouteParamMax) {
+			const char* q = static_cast<const char*>(memchr(p, '/', end - p));
+			if (q == NULL) {
+				q = end;
+			}
+			uint32_t i = params->mNum++;
+			params->mName[i] = mNode[node.mParam].mLabel;
+			params->mValue[i] = wSlice(p, q - p);
+			int32_t r = Match(node.mParam, q, end, params);
+			if (r >= 0) {
+				return r;
+			}
+			params->mNum--;
+		}
+	}
+
+	// 通配子节点：剩余路径（可为空）
+	if (node.mWild >= 0 && params->mNum < kHttpRouteParamMax) {
+		uint32_t i = params->mNum++;
+		params->mName[i] = mNode[node.mWild].mLabel;
+		params->mValue[i] = wSlice(p, end - p);
+		return node.mWild;
+	}
+	return -1;
+}
+
+int32_t wHttpRouter::Find(const wSlice& method, const wSlice& path, wHttpParams_t* params) const {
+	params->mNum = 0;
+	if (path.empty()) {
+		return -1;
+	}
+	int32_t n = Match(0, path.data(), path.data() + path.size(), params);
+	if (n < 0) {
+		params->mNum = 0;
+		return -1;
+	}
+
+	const Node_t& node = mNode[n];
+	int m = MethodIndex(method);
+	if (m >= 0 && node.mHandle[m] >= 0) {
+		return node.mHandle[m];
+	} else if (m == kRouteHead && node.mHandle[kRouteGet] >= 0) {
+		return node.mHandle[kRouteGet];
+	} else if (node.mHandle[kRouteAny] >= 0) {
+		return node.mHandle[kRouteAny];
+	}
+	return -2;
+}
+
+std::string wHttpRouter::Allow(const wSlice& path) const {
+	wHttpParams_t params;
+	std::string allow;
+	int32_t n = path.empty()? -1: Match(0, path.data(), path.data() + path.size(), &params);
+	if (n < 0) {
+		return allow;
+	}
+	const Node_t& node = mNode[n];
+	for (int i = 0; i < kRouteAny; i++) {
+		if (node.mHandle[i] >= 0 || (i == kRouteHead && node.mHandle[kRouteGet] >= 0)) {
+			if (!allow.empty()) {
+				allow += ", ";
+			}
+			allow += kRouteMethod[i];
+		}
+	}
+	return allow;
+}
+
+}	// namespace hnet
@@ -0,0 +1,86 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_ROUTER_H_
+#define _W_HTTP_ROUTER_H_
+
+#include <vector>
+#include "wCore.h"
+#include "wSlice.h"
+
+namespace hnet {
+
+// 路由方法：GET、POST、PUT、DELETE、HEAD、PATCH、OPTIONS，及任意方法（"*"）
+const uint32_t	kHttpRouteMethod = 8;
+// 单条路由最多参数数（:name、*name）
+const uint32_t	kHttpRouteParamMax = 8;
+
+// 路由参数。名称指向路由表，值指向请求路径（未解码），仅在处理函数返回前有效
+struct wHttpParams_t {
+	uint32_t mNum;
+	wSlice mName[kHttpRouteParamMax];
+	wSlice mValue[kHttpRouteParamMax];
+
+	wHttpParams_t() : mNum(0) { }
+
+	bool Get(const wSlice& name, wSlice* value) const;
+};
+
+// http路径路由表：压缩前缀树（radix tree），键为 路径 + 方法
+// 路径段支持静态文本、参数":name"（匹配至下一'/'，非空）、通配"*name"（匹配剩余路径，须在末尾）
+// 匹配优先级：静态 > 参数 > 通配（前者无法匹配时回溯），逐段比较路径，不申请内存
+// 节点以下标相互引用，可整体拷贝（派生task类继承基类路由）
+class wHttpRouter {
+public:
+	wHttpRouter();
+
+	// 查找或插入路由，返回其处理函数链表头（-1为空）。路径非法、参数名冲突返回NULL
+	int32_t* Insert(const wSlice& method, const wSlice& path);
+
+	// 按注册时的路由（方法 + 路径模式）查找，不插入节点。返回处理函数链表头，未注册返回-1
+	int32_t Lookup(const wSlice& method, const wSlice& path) const;
+
+	// 匹配路由，返回处理函数链表头，参数写入params
+	// 无匹配路径返回-1；路径匹配而方法不匹配返回-2（405）。HEAD未注册时使用GET路由
+	int32_t Find(const wSlice& method, const wSlice& path, wHttpParams_t* params) const;
+
+	inline bool Empty() const { return mNode.size() == 1;}
+
+	// 路径匹配而方法不匹配时，已注册方法（"GET, POST"），用于响应Allow
+	std::string Allow(const wSlice& path) const;
+
+protected:
+	struct Node_t {
+		std::string mLabel;			// 静态节点：压缩的路径片段；参数、通配节点：参数名
+		std::string mIndices;		// 静态子节点首字符，与mChild一一对应
+		std::vector<int32_t> mChild;
+		int32_t mParam;				// 参数子节点，-1为无
+		int32_t mWild;				// 通配子节点，-1为无
+		bool mRoute;				// 已注册路由
+		int32_t mHandle[kHttpRouteMethod];
+
+		Node_t() : mParam(-1), mWild(-1), mRoute(false) {
+			for (uint32_t i = 0; i < kHttpRouteMethod; i++) {
+				mHandle[i] = -1;
+			}
+		}
+	};
+
+	// 方法下标，不支持的方法返回-1
+	static int MethodIndex(const wSlice& method);
+
+	int32_t NewNode(const wSlice& label);
+	// 自节点n插入静态片段，返回片段终止节点
+	int32_t InsertStatic(int32_t n, const char* p, size_t len);
+	// 节点n（标签已匹配）匹配剩余路径[p, end)，返回路由节点，-1为无匹配
+	int32_t Match(int32_t n, const char* p, const char* end, wHttpParams_t* params) const;
+
+	std::vector<Node_t> mNode;	// mNode[0]为根节点
+};
+
+}	// namespace hnet
+
+#endif
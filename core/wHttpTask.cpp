@@ -4,215 +4,460 @@
  * Copyright (C) Hupu, Inc.
  */
 
+#include <strings.h>
 #include <algorithm>
 #include <vector>
 #include "wHttpTask.h"
+#include "wSocket.h"
+#include "wFile.h"
+#include "wHttpFile.h"
+#include "wHttpCompress.h"
+#include "wHttp2.h"
 #include "wMisc.h"
 #include "wLogger.h"
 
 namespace hnet {
 
+namespace {
+
+// 响应缓存条目：MemoHead_t + 状态描述 + 自定义header + body
+struct MemoHead_t {
+	uint16_t mStatus;
+	uint16_t mReason;	// 状态描述长度
+	uint32_t mFlag;		// mResFlag
+	uint32_t mHeader;	// 自定义header长度
+};
+
+// 十进制数字前缀转整型（视图不以\0结尾，不能atoi）
+int32_t SliceToNumber(const wSlice& s) {
+	int32_t n = 0;
+	for (size_t i = 0; i < s.size() && isdigit(s[i]); i++) {
+		n = n * 10 + (s[i] - '0');
+	}
+	return n;
+}
+
+inline bool EqualCase(const wSlice& a, const wSlice& b) {
+	return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+inline char* Append(char* p, const char* s, size_t n) {
+	memcpy(p, s, n);
+	return p + n;
+}
+
+inline char* Append(char* p, const wSlice& s) {
+	return Append(p, s.data(), s.size());
+}
+
+// 无符号整数写为十进制
+char* AppendDecimal(char* p, uint64_t n) {
+	char tmp[20];
+	size_t len = 0;
+	do {
+		tmp[len++] = static_cast<char>('0' + n % 10);
+		n /= 10;
+	} while (n > 0);
+	while (len > 0) {
+		*p++ = tmp[--len];
+	}
+	return p;
+}
+
+// 十六进制（chunk-size）
+char* AppendHex(char* p, uint64_t n) {
+	char tmp[16];
+	size_t len = 0;
+	do {
+		tmp[len++] = "0123456789abcdef"[n & 0xf];
+		n >>= 4;
+	} while (n > 0);
+	while (len > 0) {
+		*p++ = tmp[--len];
+	}
+	return p;
+}
+
+// 可被ResponseSet覆盖的默认header，下标与wHttpTask::kRes*位对应
+const char kResName[][16] = {"Content-Length", "Content-Type", "Connection", "Date", "X-Powered-By", "Cache-Control", "Pragma", "Host"};
+
+// 固定默认header（X-Powered-By、Cache-Control、Pragma），首次响应时渲染（软件名在配置加载后确定）
+struct StaticHeader_t {
+	StaticHeader_t() {
+		mLine[0] = std::string(kHeader[4]) + kColon + soft::GetSoftName() + "/" + soft::GetSoftVer() + kCRLF;
+		mLine[1] = std::string(kHeader[5]) + kColon + "no-store, no-cache, must-revalidate" + kCRLF;
+		mLine[2] = std::string(kHeader[6]) + kColon + "no-cache" + kCRLF;
+		mBlock = mLine[0] + mLine[1] + mLine[2];
+	}
+	std::string mLine[3];
+	std::string mBlock;
+};
+
+const StaticHeader_t& StaticHeader() {
+	static const StaticHeader_t header;
+	return header;
+}
+
+// Date header，每线程每秒格式化一次
+wSlice DateHeader() {
+	static thread_local time_t tDateTm = -1;
+	static thread_local char tDate[64];
+	static thread_local size_t tDateLen = 0;
+
+	time_t now = soft::TimeUnix();
+	if (now != tDateTm) {
+		struct tm tm;
+		gmtime_r(&now, &tm);
+		tDateLen = strftime(tDate, sizeof(tDate), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+		tDateTm = now;
+	}
+	return wSlice(tDate, tDateLen);
+}
+
+// HTTP-date（IMF-fixdate）转时间戳，失败返回-1
+time_t ParseHttpDate(const wSlice& s) {
+	char buf[64];
+	if (s.empty() || s.size() >= sizeof(buf)) {
+		return -1;
+	}
+	memcpy(buf, s.data(), s.size());
+	buf[s.size()] = '\0';
+
+	struct tm tm;
+	memset(&tm, 0, sizeof(tm));
+	const char* end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	if (end == NULL || *end != '\0') {
+		return -1;
+	}
+	return timegm(&tm);
+}
+
+// 十进制数字串（可为空），超过kRangeDigits位返回false（防溢出）
+const int kRangeDigits = 19;
+bool ParseDigits(const char** p, const char* end, uint64_t* val, bool* has) {
+	int n = 0;
+	for (; *p < end && isdigit(**p); (*p)++) {
+		if (++n > kRangeDigits) {
+			return false;
+		}
+		*val = *val * 10 + (**p - '0');
+		*has = true;
+	}
+	return true;
+}
+
+// Range: bytes=a-b | a- | -n（单区间）
+// 返回1为可满足区间[*off, *off + *len)；0为忽略（语法错误、多区间，按完整响应）；-1为不可满足（416）
+int ParseRange(const wSlice& range, uint64_t size, uint64_t* off, uint64_t* len) {
+	const char kUnit[] = "bytes=";
+	if (range.size() <= sizeof(kUnit) - 1 || strncasecmp(range.data(), kUnit, sizeof(kUnit) - 1) != 0) {
+		return 0;
+	}
+	const char* p = range.data() + sizeof(kUnit) - 1;
+	const char* end = range.data() + range.size();
+
+	uint64_t first = 0, last = 0;
+	bool hasfirst = false, haslast = false;
+	if (!ParseDigits(&p, end, &first, &hasfirst) || p == end || *p++ != '-') {
+		return 0;
+	}
+	if (!ParseDigits(&p, end, &last, &haslast) || p != end || (!hasfirst && !haslast)) {
+		return 0;
+	}
+
+	if (!hasfirst) {
+		// 后缀区间：最后n字节
+		if (last == 0 || size == 0) {
+			return -1;
+		}
+		*len = std::min(last, size);
+		*off = size - *len;
+		return 1;
+	} else if (haslast && last < first) {
+		return 0;
+	} else if (first >= size) {
+		return -1;
+	}
+	*off = first;
+	*len = (haslast? std::min(last, size - 1): size - 1) - first + 1;
+	return 1;
+}
+
+}	// namespace anonymous
+
+bool wHttpTask::Idle() {
+	if (mHandling || ResponsePending() || SendLen() > 0) {
+		return false;
+	}
+	return mH2 == NULL || mH2->Idle();
+}
+
 int wHttpTask::TaskRecv(ssize_t *size) {
 	const char *buffend = mRecvBuff + kPackageSize;
+	*size = 0;
 
-	// 循环队列
-	if (mRecvLen < kPackageSize && mRecvLen == 0) {
+	// 线性缓冲：未处理数据位于[mRecvRead, mRecvWrite)，尾部空间不足时整体前移（解析器保存相对偏移，可续）
+	if (mRecvLen == 0) {
 		mRecvRead = mRecvWrite = mRecvBuff;
-	} else if (mRecvLen < kPackageSize && mRecvRead != mRecvBuff && mRecvWrite == buffend) {
-		mRecvWrite = mRecvBuff;
+	} else if (mRecvRead != mRecvBuff && buffend - mRecvWrite < mRecvRead - mRecvBuff) {
+		memmove(mRecvBuff, mRecvRead, mRecvLen);
+		mRecvRead = mRecvBuff;
+		mRecvWrite = mRecvBuff + mRecvLen;
 	}
-	*size = 0;
 
-	// len >= 0 正向剩余
-	// len < 0 分段，中间剩余
-	ssize_t len =  static_cast<ssize_t>(mRecvWrite - mRecvRead);
-	size_t leftlen = len >= 0? static_cast<size_t>(buffend - mRecvWrite): static_cast<size_t>(abs(len));
-
-	if (mRecvLen < kPackageSize) {
-		if (len >= 0 && leftlen <= 10*sizeof(kProtocol[0])) {
-			// 队列太过靠后，重新调整
-			memmove(mRecvBuff, mRecvRead, len);
-			mRecvRead = mRecvBuff;
-			mRecvWrite= mRecvBuff + len;
-			len =  static_cast<ssize_t>(mRecvWrite - mRecvRead);
-			leftlen = len>=0? static_cast<size_t>(buffend - mRecvWrite): static_cast<size_t>(abs(len));
-		}
-
-		if (leftlen > 0) {
-			// socket接受数据
-			int ret = mSocket->RecvBytes(mRecvWrite, leftlen, size);
-            if (ret == -1 || (ret == 0 && *size < 0)) {
-                return ret;
-            }
+	size_t leftlen = buffend - mRecvWrite;
+	if (leftlen > 0) {
+		// socket接受数据
+		int ret = mSocket->RecvBytes(mRecvWrite, leftlen, size);
+		if (ret == -1 || (ret == 0 && *size < 0)) {
+			return ret;
+		}
 
-			mRecvLen += *size;
-			mRecvWrite += *size;
-		}
-	}
-
-	// 消息解析
-    auto handleFunc = [this] (char* buf, uint32_t len, char* nextbuf) -> int {
-        int ret = this->Handlemsg(buf, len);
-
-        this->mRecvRead = nextbuf;
-        this->mRecvLen -= len;
-        return ret;
-    };
-
-    int ret = 0;
-	while (mRecvLen > strlen(kProtocol[0]) + strlen(kMethod[0]) + strlen(kCRLF)) {
-		// 循环队列
-		if (mRecvRead == buffend && mRecvWrite != mRecvBuff) {
-			mRecvRead = mRecvBuff;
-		}
-		ssize_t len =  static_cast<ssize_t>(mRecvWrite - mRecvRead);
-		
-		uint32_t reallen = 0;
-		if (len > 0) {
-			// 消息字符在正向缓冲中
-			if (misc::Strcmp(std::string(mRecvRead, 0, strlen(kMethod[0])), kMethod[0], strlen(kMethod[0])) == 0) {
-				// GET请求
-				int32_t pos = misc::Strpos(std::string(mRecvRead, 0, len), kEndl);
-				if (pos == -1) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 [GET] recv a part of message");
-					ret = 0;
-					break;
-				}
+		mRecvLen += *size;
+		mRecvWrite += *size;
+	}
 
-				reallen = pos + strlen(kEndl);
-			} else if (misc::Strcmp(std::string(mRecvRead, 0, strlen(kMethod[1])), kMethod[1], strlen(kMethod[1])) == 0) {
-				// POST请求
-				int32_t pos = misc::Strpos(std::string(mRecvRead, 0, len), kEndl);
-				if (pos == -1) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 [POST] recv a part of message");
-					ret = 0;
-					break;
-				}
+	if (mClosing) {
+		// 连接即将关闭，丢弃后续请求
+		mRecvRead = mRecvWrite = mRecvBuff;
+		mRecvLen = 0;
+		return 0;
+	}
+	return Process();
+}
 
-				int32_t pos1 = misc::Strpos(std::string(mRecvRead, 0, len), kHeader[0]);
-				if (pos1 == -1) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 [POST] header error(has no Content-Length)");
-					ret = -1;
-					break;
-				}
+wHttpTask::~wHttpTask() {
+	if (mFile != NULL) {
+		wHttpFile::Default()->Release(mFile);
+	}
+	HNET_DELETE(mH2);
+}
 
-				int32_t contentLength = atoi(mRecvRead + pos1 + strlen(kHeader[0]) + strlen(kColon));
-				if (pos + strlen(kEndl) + contentLength > kMaxPackageSize) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 [POST] header error(Content-Length out range)");
-					ret = -1;
-					break;
-				} else if (pos + strlen(kEndl) + contentLength > static_cast<uint32_t>(len)) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 [POST] recv a part of message");
-					ret = 0;
-					break;
-				}
+int wHttpTask::TaskSend(ssize_t *size) {
+	int ret = wTask::TaskSend(size);
+	if (ret == -1 || mSendLen > 0) {
+		return ret;
+	} else if (mFile != NULL) {
+		// 响应头已发完，sendfile发送文件body
+		if (FileSend() == -1) {
+			return -1;
+		} else if (mFile != NULL) {
+			return 0;
+		}
+		return ResponseDone();
+	} else if (mClosing) {
+		// Connection: close 响应已发完
+		return -1;
+	} else if (mH2 != NULL) {
+		// 继续发送受发送缓冲限制的stream数据，分发暂停的stream
+		return Http2Process();
+	} else if (mRecvLen > 0) {
+		// 继续处理因发送积压暂停的流水线请求
+		return Process();
+	}
+	return 0;
+}
 
-				reallen = pos + strlen(kEndl) + contentLength;
-			} else {
-				// 未知请求
-				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 method error");
-				ret = -1;
-				break;
+int wHttpTask::Process() {
+	if (mH2 != NULL) {
+		return Http2Process();
+	} else if (mRequests == 0 && mReqState == kReqHead && mRecvLen > 0 && Http2Enable()) {
+		// 连接序言：HTTP/2（prior knowledge）
+		const size_t n = std::min(mRecvLen, static_cast<size_t>(kHttp2PrefaceLen));
+		if (memcmp(mRecvRead, kHttp2Preface, n) == 0) {
+			if (n < kHttp2PrefaceLen) {
+				return 0;
+			} else if (Http2Start(wSlice(), false) == -1) {
+				return -1;
 			}
+			return Http2Process();
+		}
+	}
 
-			ret = handleFunc(mRecvRead, reallen, mRecvRead + reallen);
-            if (ret == -1) {
-                break;
-            }
-		} else {
-			leftlen = buffend - mRecvRead;
-			if ((leftlen >= strlen(kMethod[0]) && misc::Strcmp(std::string(mRecvRead, 0, strlen(kMethod[0])), kMethod[0], strlen(kMethod[0])) == 0) ||
-				(leftlen == 0 && misc::Strcmp(std::string(mRecvBuff, 0, strlen(kMethod[0])), kMethod[0], strlen(kMethod[0])) == 0)) {
-				// GET请求
-				int32_t pos = misc::Strpos(std::string(mRecvRead, 0, leftlen), kEndl);
-				if (pos == -1) {
-					memset(mTempBuff, 0, sizeof(mTempBuff));
-					memcpy(mTempBuff, mRecvRead, leftlen);
-					memcpy(mTempBuff + leftlen, mRecvBuff, mRecvLen - leftlen);
-					pos = misc::Strpos(std::string(mTempBuff, 0, mRecvLen), kEndl);
-					if (pos == -1) {
-						HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 [GET] recv a part of message");
-						ret = 0;
-						break;
-					}
-
-					reallen = leftlen + pos + strlen(kEndl);
-				} else {
-					reallen = pos + strlen(kEndl);
-				}
+	int ret = 0;
+	std::string settings;
+	while (mRecvLen > 0 && !mClosing && !ResponsePending()) {
+		if (mSendLen > kHttpPipelineSize) {
+			// 发送积压，待TaskSend发送完后继续
+			break;
+		}
 
-				if (reallen <= leftlen) {
-					ret = handleFunc(mRecvRead, reallen, mRecvRead + reallen);
-				} else {
-					ret = handleFunc(mTempBuff, reallen, mRecvBuff + reallen - leftlen);
-				}
+		int len = 0;
+		if (mReqState == kReqHead) {
+			len = mParser.ParseHead(mRecvRead, mRecvLen);
+			if (len == 0) {
+				HNET_DEBUG_LIMIT(soft::GetLogPath(), "%s : %s", "wHttpTask::Process () failed", "recv a part of message");
+				break;
+			} else if (len == -1) {
+				ret = ParseError();
+				break;
+			}
 
-	            if (ret == -1) {
-	                break;
-	            }
-			} else if ((leftlen >= strlen(kMethod[1]) && misc::Strcmp(std::string(mRecvRead, 0, strlen(kMethod[1])), kMethod[1], strlen(kMethod[1])) == 0) || 
-				(leftlen == 0 && misc::Strcmp(std::string(mRecvBuff, 0, strlen(kMethod[1])), kMethod[1], strlen(kMethod[1])) == 0)) {
-				// POST请求
-				memset(mTempBuff, 0, sizeof(mTempBuff));
-				memcpy(mTempBuff, mRecvRead, leftlen);
-				memcpy(mTempBuff + leftlen, mRecvBuff, mRecvLen - leftlen);
-
-				int32_t pos = misc::Strpos(std::string(mTempBuff, 0, mRecvLen), kEndl);
-				if (pos == -1) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 [POST] recv a part of message");
-					ret = 0;
-					break;
-				}
+			ResponseReset();
+			mRequests++;
+			mKeepAlive = mParser.KeepAlive() && mRequests < kHttpKeepAliveMax;
+			mReqMinor = mParser.Minor();
+			mReqHead = Method() == kMethod[4];
+			mReqEncoding = wHttpCompress::Negotiate(RequestGet(kHeader[10]));
+			mReqState = BodyStream()? kReqStream: kReqBody;
+			mContinue = mParser.Minor() >= 1 && wHttpParser::HasToken(RequestGet("Expect"), "100-continue");
+		}
 
-				int32_t pos1 = misc::Strpos(std::string(mTempBuff, 0, mRecvLen), kHeader[0]);
-				if (pos1 == -1) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 [POST] header error(has no Content-Length)");
-					ret = -1;
-					break;
+		if (mReqState == kReqBody) {
+			len = mParser.ParseBody(mRecvRead, mRecvLen);
+			if (len == -1) {
+				ret = ParseError();
+				break;
+			} else if (len == 0) {
+				// 客户端等待100 Continue后才发送body（超过限制时已413）
+				if (mContinue) {
+					ret = SendContinue();
 				}
-				int32_t contentLength = atoi(mTempBuff + pos1 + strlen(kHeader[0]) + strlen(kColon));
-				if (pos + strlen(kEndl) + contentLength > kMaxPackageSize) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 [POST] header error(Content-Length out range)");
-					ret = -1;
-					break;
-				} else if (pos + strlen(kEndl) + contentLength > static_cast<uint32_t>(mRecvLen)) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 [POST] recv a part of message");
-					ret = 0;
+				break;
+			} else if (Http2Upgradable(&settings) && (ret = Http2Upgrade(settings)) == -1) {
+				break;
+			}
+		} else {
+			if (mContinue && (ret = SendContinue()) == -1) {
+				break;
+			}
+			// 流式body：逐段交付HandleBody，已交付数据从接收缓冲移除（保留header）
+			len = static_cast<int>(mParser.HeadLength());
+			char* p = mRecvRead + len;
+			size_t left = mRecvLen - len;
+			mHandling = true;
+			while (!mParser.Done()) {
+				wSlice data;
+				size_t used = 0;
+				int r = mParser.ReadBody(p, left, &data, &used);
+				if (r == -1 || r == 0) {
+					ret = r;
 					break;
 				}
-
-				reallen = pos + strlen(kEndl) + contentLength;
-				if (reallen <= leftlen) {
-					ret = handleFunc(mTempBuff, reallen, mRecvRead + reallen);
-				} else {
-					ret = handleFunc(mTempBuff, reallen, mRecvBuff + reallen - leftlen);
+				p += used;
+				left -= used;
+				if (!data.empty() && (ret = HandleBody(data)) == -1) {
+					break;
 				}
-	            if (ret == -1) {
-	                break;
-	            }
-			} else {
-				// 未知请求
-				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 method error");
-				ret = -1;
+			}
+			mHandling = false;
+			memmove(mRecvRead + len, p, left);
+			mRecvLen = len + left;
+			mRecvWrite = mRecvRead + mRecvLen;
+			if (ret == -1) {
+				ret = mParser.Error() != 0? ParseError(): -1;
+				break;
+			} else if (!mParser.Done()) {
 				break;
 			}
 		}
+
+		mHandling = true;
+		ret = Handlemsg(mRecvRead, len);
+		mHandling = false;
+		mRecvRead += len;
+		mRecvLen -= len;
+		mParser.Reset();
+		mReqState = kReqHead;
+		if (ret == -1) {
+			break;
+		} else if (mH2 != NULL) {
+			// 已升级：后续数据为HTTP/2帧
+			return Http2Process();
+		} else if (ResponsePending()) {
+			// 流式、延迟响应未结束，后续请求待End后处理
+			break;
+		} else if (!mKeepAlive) {
+			mClosing = true;
+		}
+	}
+
+	if (mClosing) {
+		mRecvRead = mRecvWrite = mRecvBuff;
+		mRecvLen = 0;
+		// 响应已发完，关闭连接；否则待TaskSend发送完后关闭
+		return mSendLen > 0? ret: -1;
 	}
 	return ret;
 }
 
+int wHttpTask::ParseError() {
+	HNET_ERROR(soft::GetLogPath(), "%s : %s[%d]", "wHttpTask::Process Parse() failed", "request illegal", mParser.Error());
+	ResponseReset();
+	mKeepAlive = false;
+	mClosing = true;
+	mReqHead = false;
+	SetStatus(mParser.Error());
+	return Respond();
+}
+
+int wHttpTask::SendContinue() {
+	mContinue = false;
+	const bool idle = mSendLen == 0;
+	char* buf = Reserve(sizeof(kContinue) - 1);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::SendContinue () failed", "left buffer not enough");
+		return -1;
+	}
+	memcpy(buf, kContinue, sizeof(kContinue) - 1);
+	Commit(sizeof(kContinue) - 1);
+	return SendParts(idle, buf, sizeof(kContinue) - 1, NULL, 0);
+}
+
 int wHttpTask::Handlemsg(char buf[], uint32_t len) {
-	mReq.clear(); mRes.clear(); mGet.clear(); mPost.clear();
+	// 静态文件
+	wHttpFile* file = wHttpFile::Default();
+	std::string fname;
+	if (!file->Empty() && file->Match(Pathinfo(), &fname)) {
+		if (fname.empty()) {
+			Error("Bad Request(path illegal)", "400");
+		} else if (SendStatic(fname) == -1) {
+			return -1;
+		}
+		return AsyncResponse();
+	}
+
+	// 路径路由
+	struct Request_t request(buf, len);
+	mParams.mNum = 0;
+	const bool route = mDispatch != NULL && !mDispatch->Route().Empty();
+	if (route) {
+		int32_t i = mDispatch->FindHttp(Method(), Pathinfo(), &mParams);
+		if (i >= 0) {
+			uint32_t ttl = mDispatch->MemoTtl(i);
+			if (ttl == 0 || !MemoGet()) {
+				mDispatch->CallHttp(this, i, &request);
+				if (ttl > 0) {
+					MemoPut(ttl);
+				}
+			}
+		}
+		mParams.mNum = 0;
+		if (i >= 0) {
+			return AsyncResponse();
+		} else if (i == -2) {
+			ResponseSet("Allow", mDispatch->Route().Allow(Pathinfo()));
+			SetStatus(405);
+			return AsyncResponse();
+		}
+	}
 
-	ParseRequest(buf, len);
-	std::string cmd = QueryGet(kCmd[0]);
-	std::string para = QueryGet(kCmd[1]);
+	// cmd、para路由
+	wSlice cmd = QueryGet(kCmd[0]);
+	wSlice para = QueryGet(kCmd[1]);
 	if (!cmd.empty() && !para.empty()) {
-		struct Request_t request(buf, len);
-		if (mEventCmd(CmdId(atoi(cmd.c_str()), atoi(para.c_str())), &request) == false) {
+		uint16_t id = CmdId(SliceToNumber(cmd), SliceToNumber(para));
+		uint32_t ttl = mDispatch != NULL? mDispatch->MemoCmd(id): 0;
+		if (ttl > 0 && MemoGet()) {
+			// 缓存响应
+		} else if (mDispatch == NULL || mDispatch->Emit(this, id, &request) == false) {
 			ResponseSet(kHeader[3], "close");
 			Error("Not Found(cmd,para illegal)", "404");
+		} else if (ttl > 0) {
+			MemoPut(ttl);
 		}
+	} else if (route) {
+		SetStatus(404);
 	} else {
 		ResponseSet(kHeader[3], "close");
 		Error("Bad Request(cmd,para must)", "400");
@@ -220,122 +465,625 @@ int wHttpTask::Handlemsg(char buf[], uint32_t len) {
 	return AsyncResponse();
 }
 
-int wHttpTask::ParseRequest(char buf[], uint32_t len) {
-	std::vector<std::string> req = misc::SplitString(std::string(buf, 0, len), kCRLF);
-	if (!req.empty()) {	// 请求行
-		std::vector<std::string> line = misc::SplitString(req.front(), " ");
-		if (line.size() == 3) {
-			mReq.insert(std::make_pair(kLine[0], line[0]));
-			mReq.insert(std::make_pair(kLine[1], line[1]));
-			mReq.insert(std::make_pair(kLine[2], line[2]));
-			// 请求参数
-			std::vector<std::string> line1 = misc::SplitString(line[1], "?");
-			if (line1.size() == 1) {
-				mReq.insert(std::make_pair(kLine[3], line1[0]));
-			} else if (line1.size() > 1) {
-				mReq.insert(std::make_pair(kLine[3], line1[0]));
-				mReq.insert(std::make_pair(kLine[4], "?"+line1.back()));
-				mReq.insert(std::make_pair(kLine[5], line1.back()));
-				// get
-				std::vector<std::string> line2 = misc::SplitString(mReq[kLine[5]], "&");
-				if (!line2.empty()) {
-					for (std::vector<std::string>::iterator it2 = line2.begin(); it2 != line2.end(); it2++) {
-						std::vector<std::string> v = misc::SplitString(*it2, "=");
-						if (v.size() == 2) {
-							mGet[v[0]] = v[1];
-						} else if (v.size() == 1) {
-							mGet[v[0]] = "";
-						}
-					}
-				}
+bool wHttpTask::MemoGet() {
+	// 键：路由表（task类） + 方法 + uri（+ body）
+	mMemoKey.assign(reinterpret_cast<const char*>(&mDispatch), sizeof(mDispatch));
+	mMemoKey.append(Method().data(), Method().size());
+	mMemoKey.push_back(' ');
+	mMemoKey.append(mParser.Uri().data(), mParser.Uri().size());
+	if (!mParser.Body().empty()) {
+		mMemoKey.push_back('\n');
+		mMemoKey.append(mParser.Body().data(), mParser.Body().size());
+	}
+
+	const std::string* data = wResponseCache::Default()->Get(mMemoKey);
+	if (data == NULL) {
+		return false;
+	}
+	MemoHead_t head;
+	memcpy(&head, data->data(), sizeof(head));
+	const char* p = data->data() + sizeof(head);
+	mStatus = head.mStatus;
+	mResFlag = head.mFlag;
+	mReason.assign(p, head.mReason);
+	p += head.mReason;
+	memcpy(mResHeader, p, head.mHeader);
+	mResHeaderLen = head.mHeader;
+	p += head.mHeader;
+	// body引用缓存条目（发送前条目不会失效），压缩结果同样缓存
+	WriteCached(mMemoKey, wSlice(p, data->data() + data->size() - p));
+	return true;
+}
+
+void wHttpTask::MemoPut(uint32_t ttl) {
+	if (mResStream != kResNone || mFile != NULL || mStatus < 200 || mStatus >= 300) {
+		return;
+	}
+	MemoHead_t head;
+	head.mStatus = mStatus;
+	head.mReason = static_cast<uint16_t>(mReason.size());
+	head.mFlag = mResFlag;
+	head.mHeader = static_cast<uint32_t>(mResHeaderLen);
+
+	wSlice body = mResBodyRef.empty()? wSlice(mResBody): mResBodyRef;
+	mMemoData.clear();
+	mMemoData.reserve(sizeof(head) + mReason.size() + mResHeaderLen + body.size());
+	mMemoData.append(reinterpret_cast<const char*>(&head), sizeof(head));
+	mMemoData.append(mReason);
+	mMemoData.append(mResHeader, mResHeaderLen);
+	mMemoData.append(body.data(), body.size());
+	wResponseCache::Default()->Put(mMemoKey, wResponseCache::HttpTag(Pathinfo()), &mMemoData, ttl);
+}
+
+size_t wHttpTask::MemoInvalidatePath(const wSlice& path) {
+	return wResponseCache::Default()->Invalidate(wResponseCache::HttpTag(path));
+}
+
+int wHttpTask::AsyncResponse() {
+	if (ResponsePending()) {
+		// 流式、延迟响应由WriteChunk、End发送
+		return 0;
+	} else if (mResStream == kResEnded) {
+		ResponseReset();
+		return 0;
+	}
+	return Respond();
+}
+
+int wHttpTask::Respond() {
+	// WriteBuffer写入的body未设置视图
+	wSlice body = mResBodyRef.empty()? wSlice(mResBody): mResBodyRef;
+	CompressBody(&body, ResponseEncoding(body.size(), false));
+	if (mH2 != NULL) {
+		int ret = mH2->Response(mH2Stream, Http2Head(body.size()), body, true);
+		ResponseReset();
+		return ret;
+	}
+	const bool idle = mSendLen == 0;
+
+	// 状态行、header直接写入发送缓冲
+	char* head = Reserve(kHttpHeadReserve + mResHeaderLen + mReason.size());
+	if (head == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::Respond () failed", "left buffer not enough");
+		ResponseReset();
+		return -1;
+	}
+	size_t headlen = RenderHead(head, body.size());
+	Commit(headlen);
+
+	// HEAD请求保留Content-Length，不发送body
+	int ret = SendParts(idle, head, headlen, &body, NoBody()? 0: 1);
+	ResponseReset();
+	return ret;
+}
+
+int wHttpTask::SendParts(bool idle, char* head, size_t headlen, const wSlice* parts, int num) {
+	// 发送缓冲无积压：head与parts一次writev发出，parts不拷贝。未发完部分进入发送缓冲，等待TaskSend
+	size_t sent = 0;
+	if (idle) {
+		struct iovec iov[kIovMax];
+		int iovcnt = 1;
+		iov[0].iov_base = head;
+		iov[0].iov_len = headlen;
+		for (int i = 0; i < num && iovcnt < static_cast<int>(kIovMax); i++) {
+			if (!parts[i].empty()) {
+				iov[iovcnt].iov_base = const_cast<char*>(parts[i].data());
+				iov[iovcnt].iov_len = parts[i].size();
+				iovcnt++;
 			}
 		}
-		req.erase(req.begin());
+
+		ssize_t size = 0;
+		if (mSocket->SendvBytes(iov, iovcnt, &size) == -1) {
+			return -1;
+		}
+		size_t n = std::min(static_cast<size_t>(size), headlen);
+		mSendRead += n;
+		mSendLen -= n;
+		sent = size - n;
 	}
 
-	int8_t p = 0;
-	for (std::vector<std::string>::iterator it = req.begin(); it != req.end(); it++) {	// header + 参数
-		if (it->size() == 0) {	// header与body分隔
-			p = 1;
+	for (int i = 0; i < num; i++) {
+		if (sent >= parts[i].size()) {
+			sent -= parts[i].size();
 			continue;
 		}
-		if (p == 0) {
-			std::vector<std::string> header = misc::SplitString(*it, kColon);
-			if (header.size() == 2) {
-				mReq.insert(std::make_pair(header[0], header[1]));
+		size_t left = parts[i].size() - sent;
+		char* buf = Reserve(left);
+		if (buf == NULL) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::SendParts () failed", "left buffer not enough");
+			return -1;
+		}
+		memcpy(buf, parts[i].data() + sent, left);
+		Commit(left);
+		sent = 0;
+	}
+	return mSendLen > 0? Output(): 0;
+}
+
+int wHttpTask::WriteChunk(const wSlice& data) {
+	if (data.empty()) {
+		// 空chunk为结束标记，由End发送
+		return 0;
+	} else if (mResStream == kResEnded) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::WriteChunk () failed", "response ended");
+		return -1;
+	} else if (mResStream == kResDeferred) {
+		mResStream = kResNone;
+	}
+	if (mResStream == kResNone) {
+		// 首个chunk前协商压缩编码（响应头随首个chunk发送）
+		mResEncoding = ResponseEncoding(0, true);
+		if (mResEncoding != kHttpIdentity && mCompress.Begin(mResEncoding, kHttpCompressLevel) == 0) {
+			ResponseSet("Content-Encoding", wHttpCompress::Name(mResEncoding));
+		} else {
+			mResEncoding = kHttpIdentity;
+		}
+	}
+	if (mResEncoding == kHttpIdentity) {
+		return SendChunk(data);
+	}
+
+	// 每个chunk同步刷新，对端收到即可解压
+	mResZip.clear();
+	if (mCompress.Update(data, &mResZip, false) == -1) {
+		return -1;
+	}
+	return SendChunk(mResZip);
+}
+
+int wHttpTask::SendChunk(const wSlice& chunk) {
+	if (mH2 != NULL) {
+		// 响应头随首个DATA前的HEADERS发送，无chunked编码
+		int ret;
+		if (mResStream == kResNone) {
+			mResStream = kResStreaming;
+			ret = mH2->Response(mH2Stream, Http2Head(0), chunk, false);
+		} else {
+			ret = mH2->Data(mH2Stream, chunk, false);
+		}
+		return ret == -1? -1: Http2Flush();
+	}
+
+	const bool idle = mSendLen == 0;
+	const bool start = mResStream == kResNone;
+	const bool nobody = NoBody();
+	if (!start && nobody) {
+		return 0;
+	}
+
+	char* head = Reserve(kHttpChunkHead + (start? kHttpHeadReserve + mResHeaderLen + mReason.size(): 0));
+	if (head == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::SendChunk () failed", "left buffer not enough");
+		return -1;
+	}
+	char* p = head;
+	if (start) {
+		// 首个chunk前发送响应头。HTTP/1.0不支持chunked，以关闭连接结束body
+		mResStream = kResStreaming;
+		if (mReqMinor == 0 && !nobody) {
+			mKeepAlive = false;
+		}
+		p += RenderHead(p, 0);
+	}
+	if (nobody) {
+		// 仅响应头
+		Commit(p - head);
+		return SendParts(idle, head, p - head, NULL, 0);
+	} else if (mReqMinor >= 1) {
+		p = AppendHex(p, chunk.size());
+		p = Append(p, kCRLF, 2);
+	}
+	Commit(p - head);
+
+	const wSlice parts[2] = {chunk, wSlice(kCRLF, 2)};
+	return SendParts(idle, head, p - head, parts, mReqMinor >= 1? 2: 1);
+}
+
+int wHttpTask::End() {
+	int ret = 0;
+	if (mResStream == kResNone || mResStream == kResDeferred) {
+		// 未WriteChunk，普通响应
+		ret = Respond();
+	} else if (mResStream == kResStreaming) {
+		// 结束压缩流：剩余压缩数据为最后一个chunk
+		if (mResEncoding != kHttpIdentity) {
+			mResZip.clear();
+			if (mCompress.Update(wSlice(), &mResZip, true) == -1 || SendChunk(mResZip) == -1) {
+				return -1;
 			}
+		}
+	}
+	if (mResStream == kResStreaming && mH2 != NULL) {
+		// END_STREAM
+		ret = mH2->Data(mH2Stream, wSlice(), true);
+	} else if (mResStream == kResStreaming && mReqMinor >= 1 && !NoBody()) {
+		const bool idle = mSendLen == 0;
+		char* buf = Reserve(sizeof(kChunkEnd) - 1);
+		if (buf == NULL) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::End () failed", "left buffer not enough");
+			return -1;
+		}
+		memcpy(buf, kChunkEnd, sizeof(kChunkEnd) - 1);
+		Commit(sizeof(kChunkEnd) - 1);
+		ret = SendParts(idle, buf, sizeof(kChunkEnd) - 1, NULL, 0);
+	}
+	mResStream = kResEnded;
+	return Resume(ret);
+}
+
+int wHttpTask::Resume(int ret) {
+	if (!mHandling) {
+		// 处理函数返回后结束的响应：继续处理流水线请求，或关闭连接
+		if (ret == 0) {
+			ret = ResponseDone();
 		} else {
-			mReq.insert(std::make_pair(kLine[6], *it));
-			// POST数据
-			std::vector<std::string> line2 = misc::SplitString(mReq[kLine[6]], "&");
-			if (!line2.empty()) {
-				for (std::vector<std::string>::iterator it2 = line2.begin(); it2 != line2.end(); it2++) {
-					std::vector<std::string> v = misc::SplitString(*it2, "=");
-					if (v.size() == 2) {
-						mPost[v[0]] = v[1];
-					} else if (v.size() == 1) {
-						mPost[v[0]] = "";
-					}
-				}
+			ResponseReset();
+		}
+		if (ret == -1) {
+			// 不在事件回调中，无法移除task：关闭写端，对端关闭后由事件循环回收
+			shutdown(mSocket->FD(), SHUT_WR);
+		}
+	}
+	return ret;
+}
+
+int wHttpTask::ResponseDone() {
+	ResponseReset();
+	// HTTP/2中Connection header无效，连接由GOAWAY结束
+	mClosing = mClosing || (!mKeepAlive && mH2 == NULL);
+	return Process();
+}
+
+int wHttpTask::SendStatic(const std::string& fname) {
+	const wSlice method = Method();
+	const bool head = method == kMethod[4];
+	if (!head && method != kMethod[0]) {
+		ResponseSet("Allow", "GET, HEAD");
+		SetStatus(405);
+		return 0;
+	}
+
+	wHttpFile_t* file = wHttpFile::Default()->Acquire(fname);
+	if (file == NULL) {
+		SetStatus(404);
+		return 0;
+	}
+	ResponseSet("Last-Modified", file->mLastModified);
+	ResponseSet("Accept-Ranges", "bytes");
+	ResponseSet(kHeader[5], "no-cache");
+	if (!(mResFlag & kResContentType)) {
+		ResponseSet(kHeader[1], file->mType);
+	}
+
+	// 条件请求：文件未修改
+	const wSlice range = RequestGet("Range");
+	const time_t since = ParseHttpDate(RequestGet("If-Modified-Since"));
+	if (range.empty() && since != -1 && file->mMtime <= since) {
+		ResponseSet(kHeader[0], logging::NumberToString(file->mSize));
+		SetStatus(304);
+		wHttpFile::Default()->Release(file);
+		return 0;
+	}
+
+	// 区间请求。If-Range（仅支持HTTP-date）与Last-Modified不一致时返回完整文件
+	uint64_t off = 0, len = file->mSize;
+	const wSlice ifrange = RequestGet("If-Range");
+	if (!range.empty() && (ifrange.empty() || ifrange == file->mLastModified)) {
+		int ret = ParseRange(range, file->mSize, &off, &len);
+		if (ret == -1) {
+			ResponseSet("Content-Range", "bytes */" + logging::NumberToString(file->mSize));
+			SetStatus(416);
+			wHttpFile::Default()->Release(file);
+			return 0;
+		} else if (ret == 1) {
+			ResponseSet("Content-Range", "bytes " + logging::NumberToString(off) + "-" + logging::NumberToString(off + len - 1) + "/" + logging::NumberToString(file->mSize));
+			SetStatus(206);
+		}
+	}
+
+	// 压缩：完整文件且可压缩，压缩结果缓存（文件变更后失效），body由处理函数返回后响应
+	if (mStatus == 200) {
+		const uint8_t encoding = ResponseEncoding(file->mSize, false);
+		const std::string* zbody = encoding != kHttpIdentity? wHttpCompressCache::Default()->File(file, encoding): NULL;
+		if (zbody != NULL) {
+			ResponseSet("Content-Encoding", wHttpCompress::Name(encoding));
+			if (head) {
+				ResponseSet(kHeader[0], logging::NumberToString(zbody->size()));
+			} else {
+				mResBodyRef = *zbody;
 			}
+			wHttpFile::Default()->Release(file);
+			return 0;
+		}
+	}
+	if (head) {
+		ResponseSet(kHeader[0], logging::NumberToString(len));
+		wHttpFile::Default()->Release(file);
+		return 0;
+	}
+
+	if (mH2 != NULL) {
+		// HTTP/2：文件body按流量控制窗口分帧读取发送（DATA帧无法sendfile），文件引用由session释放
+		if (mH2->Response(mH2Stream, Http2Head(len), wSlice(), false) == -1) {
+			wHttpFile::Default()->Release(file);
+			return -1;
 		}
+		mResStream = kResEnded;
+		return mH2->File(mH2Stream, file, off, len);
+	}
+
+	// 响应头写入发送缓冲，body由sendfile从文件直接发送
+	const bool idle = mSendLen == 0;
+	char* buf = Reserve(kHttpHeadReserve + mResHeaderLen + mReason.size());
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::SendStatic () failed", "left buffer not enough");
+		wHttpFile::Default()->Release(file);
+		return -1;
+	}
+	size_t headlen = RenderHead(buf, len);
+	Commit(headlen);
+
+	mFile = file;
+	mFileOff = off;
+	mFileLeft = len;
+	mResStream = kResStreaming;
+	if (SendParts(idle, buf, headlen, NULL, 0) == -1) {
+		return -1;
+	} else if (mSendLen == 0 && FileSend() == -1) {
+		return -1;
+	}
+	// 未发完：注册写事件，由TaskSend继续发送，结束后处理后续流水线请求
+	return mFile != NULL? Output(): 0;
+}
+
+int wHttpTask::FileSend() {
+	off_t off = static_cast<off_t>(mFileOff);
+	ssize_t size = 0;
+	int ret = mSocket->SendFile(mFile->mFile->FD(), &off, mFileLeft, &size);
+	if (size > 0) {
+		mFileOff += size;
+		mFileLeft -= size;
+	}
+	if (ret == -1 || mFileLeft == 0) {
+		wHttpFile::Default()->Release(mFile);
+		mFile = NULL;
+		mFileLeft = 0;
+		mResStream = kResEnded;
+	}
+	return ret;
+}
+
+bool wHttpTask::Http2Upgradable(std::string* settings) {
+	// 仅连接首个请求可升级；请求body已完整（升级后响应以stream 1发送）
+	if (mRequests != 1 || mParser.Minor() < 1 || !Http2Enable() || BodyStream()) {
+		return false;
+	} else if (!EqualCase(RequestGet("Upgrade"), "h2c") || !wHttpParser::HasToken(RequestGet(kHeader[3]), "HTTP2-Settings")) {
+		return false;
+	}
+	settings->clear();
+	return coding::Base64Decode(RequestGet("HTTP2-Settings"), settings);
+}
+
+int wHttpTask::Http2Upgrade(const std::string& settings) {
+	const char kSwitching[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+	char* buf = Reserve(sizeof(kSwitching) - 1);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::Http2Upgrade () failed", "left buffer not enough");
+		return -1;
+	}
+	memcpy(buf, kSwitching, sizeof(kSwitching) - 1);
+	Commit(sizeof(kSwitching) - 1);
+	if (Http2Start(settings, true) == -1) {
+		return -1;
 	}
+	mH2Stream = 1;
+	mKeepAlive = true;
 	return 0;
 }
 
-int wHttpTask::AsyncResponse() {
-    const char *buffend = mSendBuff + kPackageSize;
-    ssize_t writelen =  mSendWrite - mSendRead;
-    ssize_t leftlen = buffend - mSendWrite;
-    ssize_t len = 0;
-    std::string tmp;
+int wHttpTask::Http2Start(const wSlice& settings, bool upgrade) {
+	HNET_NEW(wHttp2Session(this), mH2);
+	if (mH2 == NULL) {
+		return -1;
+	}
+	return mH2->Start(settings, upgrade, upgrade && Method() == kMethod[4]);
+}
 
-    // 填写默认头
-    FillResponse();
+int wHttpTask::Http2Process() {
+	int ret = 0;
+	if (mRecvLen > 0 && !mClosing) {
+		int used = mH2->Parse(mRecvRead, mRecvLen);
+		if (used == -1) {
+			// 连接错误，GOAWAY发完后关闭
+			mClosing = true;
+		} else {
+			mRecvRead += used;
+			mRecvLen -= used;
+		}
+	}
 
-    // 响应行
-    memset(mTempBuff, 0, sizeof(mTempBuff));
-    tmp = mRes[kLine[2]] + " " + mRes[kLine[7]] + " " + mRes[kLine[8]] + kCRLF;
-	memcpy(mTempBuff, tmp.c_str(), tmp.size());
-	len = tmp.size();
+	while (ret != -1) {
+		// 分发请求完整的stream：流式响应未结束时暂停（当前响应状态属于一个stream），发送积压时暂停
+		int handled = 0;
+		while (!mClosing && !ResponsePending() && mSendLen <= kHttpPipelineSize) {
+			const uint32_t id = mH2->NextReady();
+			if (id == 0) {
+				break;
+			} else if ((ret = Http2Handle(id)) == -1) {
+				break;
+			}
+			handled++;
+		}
+		const int frames = mH2->Pump();
+		if (Http2Flush() == -1) {
+			return -1;
+		} else if (mSendLen > 0 || (frames == 0 && handled == 0)) {
+			break;
+		}
+	}
+	if (mH2->Done()) {
+		mClosing = true;
+	}
 
-	// header
-	for (std::map<std::string, std::string>::iterator it = mRes.begin(); it != mRes.end(); it++) {
-		if (it->first == kLine[2] || it->first == kLine[7] || it->first == kLine[8] || it->first == kLine[9]) {
-			continue;
+	if (ret == -1 || mClosing) {
+		mClosing = true;
+		mRecvRead = mRecvWrite = mRecvBuff;
+		mRecvLen = 0;
+		return mSendLen > 0? 0: -1;
+	}
+	return 0;
+}
+
+int wHttpTask::Http2Handle(uint32_t id) {
+	wHttp2Stream_t* stream = mH2->Find(id);
+	ResponseReset();
+	mRequests++;
+	mKeepAlive = true;
+	mReqMinor = 1;
+	mH2Stream = id;
+
+	// stream请求已转换为完整的HTTP/1.1消息
+	int ret = 0;
+	mParser.Reset();
+	const int len = stream->mError == 0? mParser.Parse(&stream->mReq[0], stream->mReq.size()): -1;
+	if (len <= 0) {
+		SetStatus(stream->mError != 0? stream->mError: (mParser.Error() != 0? mParser.Error(): 400));
+		ret = Respond();
+	} else {
+		mReqEncoding = wHttpCompress::Negotiate(RequestGet(kHeader[10]));
+		mHandling = true;
+		if (BodyStream() && !mParser.Body().empty()) {
+			ret = HandleBody(mParser.Body());
 		}
-		tmp = it->first + kColon + it->second + kCRLF;
-		memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-		len += tmp.size();
-	}
-	tmp = kCRLF;
-	memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-	len += tmp.size();
-	
-	// 响应body
-	if (!mRes[kLine[9]].empty()) {
-		tmp = mRes[kLine[9]];
-		memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-		len += tmp.size();
-	}
-
-	// 异步缓冲
-    if ((writelen >= 0 && leftlen >= static_cast<ssize_t>(len)) || (writelen < 0 && abs(writelen) >= static_cast<ssize_t>(len))) {
-    	// 单向剩余足够（右边剩余 || 中间剩余）
-    	memcpy(mSendWrite, mTempBuff, len);
-    	mSendWrite += len;
-    } else if (writelen >= 0 && leftlen < static_cast<ssize_t>(len + sizeof(uint32_t))) {
-    	// 分段剩余足够（两边剩余）
-    	memcpy(mSendWrite, mTempBuff, leftlen);
-    	memcpy(mSendBuff, mTempBuff + leftlen, len - leftlen);
-    	mSendWrite = mSendBuff + len - leftlen;
-    } else {
-    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::ParseResponse () failed", "left buffer not enough");
-    	return -1;
-    }
-    mSendLen += len;
+		if (ret != -1) {
+			ret = Handlemsg(&stream->mReq[0], len);
+		}
+		mHandling = false;
+	}
+	mParser.Reset();
+	return ret;
+}
 
-	return Output();
+wSlice wHttpTask::Http2Head(size_t bodylen) {
+	mH2Head.resize(kHttpHeadReserve + mResHeaderLen + mReason.size());
+	mH2Head.resize(RenderHead(&mH2Head[0], bodylen));
+	return mH2Head;
+}
+
+int wHttpTask::Http2Flush() {
+	if (mHandling || mSendLen == 0) {
+		// 处理函数中的响应由Http2Process批量发送
+		return 0;
+	}
+	ssize_t size = 0;
+	if (wTask::TaskSend(&size) == -1) {
+		return -1;
+	}
+	return mSendLen > 0? Output(): 0;
+}
+
+uint8_t wHttpTask::ResponseEncoding(size_t bodylen, bool stream) {
+	if (!wHttpCompress::Enable() || (!stream && bodylen < kHttpCompressMin) || mStatus < 200 || mStatus == 204 || mStatus == 206 || mStatus == 304) {
+		return kHttpIdentity;
+	} else if (!ResponseGet("Content-Encoding").empty()) {
+		// 处理函数自行编码
+		return kHttpIdentity;
+	}
+	const wSlice type = (mResFlag & kResContentType)? ResponseGet(kHeader[1]): wSlice("text/html");
+	if (!wHttpCompress::Compressible(type)) {
+		return kHttpIdentity;
+	}
+	// 响应随Accept-Encoding变化，共享缓存须区分
+	if (ResponseGet("Vary").empty()) {
+		ResponseSet("Vary", kHeader[10]);
+	}
+	return mReqEncoding;
+}
+
+bool wHttpTask::CompressBody(wSlice* body, uint8_t encoding) {
+	if (encoding == kHttpIdentity) {
+		return false;
+	}
+	const std::string* zbody = NULL;
+	if (!mResCacheKey.empty()) {
+		// 热点响应：以原始body校验缓存
+		zbody = wHttpCompressCache::Default()->Get(mResCacheKey, encoding, *body, *body);
+	} else if (mCompress.Compress(encoding, kHttpCompressLevel, *body, &mResZip) == 0 && mResZip.size() < body->size()) {
+		zbody = &mResZip;
+	}
+	if (zbody == NULL) {
+		return false;
+	}
+	ResponseSet("Content-Encoding", wHttpCompress::Name(encoding));
+	*body = *zbody;
+	return true;
+}
+
+size_t wHttpTask::RenderHead(char* buf, size_t bodylen) {
+	char* p = buf;
+
+	// 状态行
+	p = Append(p, kProtocol[0], strlen(kProtocol[0]));
+	*p++ = ' ';
+	p = AppendDecimal(p, mStatus);
+	*p++ = ' ';
+	if (!mReason.empty()) {
+		p = Append(p, mReason);
+	} else if (http::StatusText(mStatus) != NULL) {
+		p = Append(p, http::StatusText(mStatus), strlen(http::StatusText(mStatus)));
+	}
+	p = Append(p, kCRLF, 2);
+
+	// 自定义header
+	p = Append(p, mResHeader, mResHeaderLen);
+
+	// 默认header
+	if (!(mResFlag & kResConnection)) {
+		if (!mKeepAlive) {
+			p = Append(p, "Connection: close\r\n", 19);
+		} else {
+			if (mReqMinor == 0) {	// HTTP/1.0需显式声明
+				p = Append(p, "Connection: keep-alive\r\n", 24);
+			}
+			p = Append(p, "Keep-Alive: timeout=", 20);
+			p = AppendDecimal(p, kHttpKeepAliveTm);
+			p = Append(p, ", max=", 6);
+			p = AppendDecimal(p, kHttpKeepAliveMax - mRequests);
+			p = Append(p, kCRLF, 2);
+		}
+	}
+	if (mResStream == kResStreaming) {
+		if (mReqMinor >= 1 && !StatusNoBody()) {
+			p = Append(p, "Transfer-Encoding: chunked\r\n", 28);
+		}
+	} else if (!(mResFlag & kResContentLength) && mStatus >= 200 && mStatus != 204) {
+		p = Append(p, "Content-Length: ", 16);
+		p = AppendDecimal(p, bodylen);
+		p = Append(p, kCRLF, 2);
+	}
+	if (!(mResFlag & kResContentType)) {
+		p = Append(p, "Content-Type: text/html; charset=UTF-8\r\n", 40);
+	}
+	if (!(mResFlag & kResDate)) {
+		p = Append(p, DateHeader());
+	}
+	const StaticHeader_t& header = StaticHeader();
+	if (!(mResFlag & (kResPoweredBy | kResCacheControl | kResPragma))) {
+		p = Append(p, header.mBlock);
+	} else {
+		if (!(mResFlag & kResPoweredBy)) {
+			p = Append(p, header.mLine[0]);
+		}
+		if (!(mResFlag & kResCacheControl)) {
+			p = Append(p, header.mLine[1]);
+		}
+		if (!(mResFlag & kResPragma)) {
+			p = Append(p, header.mLine[2]);
+		}
+	}
+	p = Append(p, kCRLF, 2);
+	return p - buf;
 }
 
 int wHttpTask::SyncResponse(char buf[], ssize_t* size, uint32_t timeout) {
@@ -415,159 +1163,147 @@ int wHttpTask::SyncResponse(char buf[], ssize_t* size, uint32_t timeout) {
     return 0;
 }
 
-int wHttpTask::AsyncRequest() {
-    const char *buffend = mSendBuff + kPackageSize;
-    ssize_t writelen =  mSendWrite - mSendRead;
-    ssize_t leftlen = buffend - mSendWrite;
-    ssize_t len = 0;
-    std::string tmp;
+int wHttpTask::SyncRequest(const wSlice& method, const wSlice& url, ssize_t* size) {
+	if (method.size() + url.size() + mResHeaderLen + mResBodyRef.size() + kHttpHeadReserve > kPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::SyncRequest () failed", "request too large");
+		return -1;
+	}
+	char* p = mTempBuff;
 
-    // 填写默认头
-    FillResponse();
-    
-    // 请求行
-    memset(mTempBuff, 0, sizeof(mTempBuff));
-    tmp = mRes[kLine[0]] + " " + mRes[kLine[1]] + " " + mRes[kLine[2]] + kCRLF;
-	memcpy(mTempBuff, tmp.c_str(), tmp.size());
-	len = tmp.size();
+	// 请求行
+	p = Append(p, method);
+	*p++ = ' ';
+	p = Append(p, url);
+	*p++ = ' ';
+	p = Append(p, kProtocol[0], strlen(kProtocol[0]));
+	p = Append(p, kCRLF, 2);
 
 	// header
-	for (std::map<std::string, std::string>::iterator it = mRes.begin(); it != mRes.end(); it++) {
-		if (it->first == kLine[2] || it->first == kLine[7] || it->first == kLine[8] || it->first == kLine[9]) {
-			continue;
-		}
-		tmp = it->first + kColon + it->second + kCRLF;
-		memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-		len += tmp.size();
-	}
-	tmp = kCRLF;
-	memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-	len += tmp.size();
-	
-	// 响应body
-	if (!mRes[kLine[9]].empty()) {
-		tmp = mRes[kLine[9]];
-		memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-		len += tmp.size();
-	}
-
-	// 异步缓冲
-    if ((writelen >= 0 && leftlen >= static_cast<ssize_t>(len)) || (writelen < 0 && abs(writelen) >= static_cast<ssize_t>(len))) {
-    	// 单向剩余足够（右边剩余 || 中间剩余）
-    	memcpy(mSendWrite, mTempBuff, len);
-    	mSendWrite += len;
-    } else if (writelen >= 0 && leftlen < static_cast<ssize_t>(len + sizeof(uint32_t))) {
-    	// 分段剩余足够（两边剩余）
-    	memcpy(mSendWrite, mTempBuff, leftlen);
-    	memcpy(mSendBuff, mTempBuff + leftlen, len - leftlen);
-    	mSendWrite = mSendBuff + len - leftlen;
-    } else {
-    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::AsyncRequest () failed", "left buffer not enough");
-    	return -1;
-    }
-    mSendLen += len;
+	p = Append(p, mResHeader, mResHeaderLen);
+	if (!(mResFlag & kResHost)) {
+		p = Append(p, "Host: ", 6);
+		p = Append(p, Socket()->Host());
+		*p++ = ':';
+		p = AppendDecimal(p, Socket()->Port());
+		p = Append(p, kCRLF, 2);
+	}
+	if (!(mResFlag & kResConnection)) {
+		p = Append(p, "Connection: close\r\n", 19);
+	}
+	if (!(mResFlag & kResContentLength)) {
+		p = Append(p, "Content-Length: ", 16);
+		p = AppendDecimal(p, mResBodyRef.size());
+		p = Append(p, kCRLF, 2);
+	}
+	p = Append(p, kCRLF, 2);
 
-    return Output();
+	// body
+	p = Append(p, mResBodyRef);
+	return mSocket->SendBytes(mTempBuff, p - mTempBuff, size);
 }
 
-int wHttpTask::SyncRequest(ssize_t* size) {
-    ssize_t len = 0;
-    std::string tmp;
-
-    // 填写默认头
-    FillResponse();
-    
-    // 请求行
-    tmp = mRes[kLine[0]] + " " + mRes[kLine[1]] + " " + mRes[kLine[2]] + kCRLF;
-	memcpy(mTempBuff, tmp.c_str(), tmp.size());
-	len = tmp.size();
+void wHttpTask::ResponseReset() {
+	mStatus = 200;
+	mReason.clear();
+	mResFlag = 0;
+	mResBody.clear();
+	mResBodyRef = wSlice();
+	mResCacheKey.clear();
+	mResEncoding = kHttpIdentity;
+	mResHeaderLen = 0;
+	mResStream = kResNone;
+}
 
-	// header
-	for (std::map<std::string, std::string>::iterator it = mRes.begin(); it != mRes.end(); it++) {
-		if (it->first == kLine[2] || it->first == kLine[7] || it->first == kLine[8] || it->first == kLine[9]) {
-			continue;
+wSlice wHttpTask::ResponseGet(const wSlice& key) const {
+	const char* p = mResHeader;
+	const char* end = mResHeader + mResHeaderLen;
+	while (p < end) {
+		const char* next = static_cast<const char*>(memchr(p, '\n', end - p)) + 1;
+		if (static_cast<size_t>(next - p) > key.size() + 3 && p[key.size()] == ':' && strncasecmp(p, key.data(), key.size()) == 0) {
+			// "k: v\r\n"
+			return wSlice(p + key.size() + 2, next - p - key.size() - 4);
 		}
-		tmp = it->first + kColon + it->second + kCRLF;
-		memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-		len += tmp.size();
+		p = next;
 	}
-	tmp = kCRLF;
-	memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-	len += tmp.size();
-	
-	// 响应body
-	if (!mRes[kLine[9]].empty()) {
-		tmp = mRes[kLine[9]];
-		memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-		len += tmp.size();
-	}
-	return mSocket->SendBytes(mTempBuff, len, size);
+	return wSlice();
 }
 
-void wHttpTask::FillResponse() {
-	if (mRes[kHeader[3]].empty() && !mReq[kHeader[3]].empty()) {	// keep-alive
-		ResponseSet(kHeader[3], mReq[kHeader[3]]);
-		ResponseSet(kHeader[7], "timeout=30, max=120");
-	} else if (mRes[kHeader[3]].empty()) {
-		ResponseSet(kHeader[3], "close");
-	}
-    if (mRes[kLine[2]].empty()) {	// HTTP/1.1
-    	ResponseSet(kLine[2], kProtocol[0]);
-    }
-    if (mRes[kLine[7]].empty()) {	// code
-    	ResponseSet(kLine[7], "200");
-    }
-    if (mRes[kLine[8]].empty()) {	// status
-    	ResponseSet(kLine[8], "Ok");
-    }
-	if (!mRes[kLine[9]].empty()) {	// Content-Length
-		ResponseSet(kHeader[0], logging::NumberToString(static_cast<uint64_t>(mRes[kLine[9]].size())));
-	} else {
-		ResponseSet(kHeader[0], "0");
+void wHttpTask::ResponseSet(const wSlice& key, const wSlice& value) {
+	if (key.empty() || memchr(value.data(), '\n', value.size()) != NULL || memchr(value.data(), '\r', value.size()) != NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::ResponseSet () failed", "header illegal");
+		return;
 	}
-	if (mRes[kHeader[1]].empty()) {	// Content-Type
-		ResponseSet(kHeader[1], "text/html; charset=UTF-8");
+
+	for (uint32_t i = 0; i < sizeof(kResName)/sizeof(kResName[0]); i++) {
+		if (EqualCase(key, kResName[i])) {
+			mResFlag |= 1 << i;
+			break;
+		}
 	}
-	if (mRes[kHeader[4]].empty()) {	// X-Powered-By
-		ResponseSet(kHeader[4], soft::GetSoftName() + "/" + soft::GetSoftVer());
+	if ((mResFlag & kResConnection) && EqualCase(key, kResName[2])) {
+		mKeepAlive = mKeepAlive && !wHttpParser::HasToken(value, "close");
 	}
-	if (mRes[kHeader[5]].empty()) {	// Cache-Control
-		ResponseSet(kHeader[5], "no-store, no-cache, must-revalidate");
+
+	// 删除同名header
+	char* p = mResHeader;
+	char* end = mResHeader + mResHeaderLen;
+	while (p < end) {
+		char* next = static_cast<char*>(memchr(p, '\n', end - p)) + 1;
+		if (static_cast<size_t>(next - p) > key.size() && p[key.size()] == ':' && strncasecmp(p, key.data(), key.size()) == 0) {
+			memmove(p, next, end - next);
+			mResHeaderLen -= next - p;
+			break;
+		}
+		p = next;
 	}
-	if (mRes[kHeader[6]].empty()) {	// Pragma
-		ResponseSet(kHeader[6], "no-cache");
+
+	size_t len = key.size() + value.size() + 4;
+	if (mResHeaderLen + len > kHttpResHeaderSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::ResponseSet () failed", "header too large");
+		return;
 	}
-	return;
+	p = mResHeader + mResHeaderLen;
+	p = Append(p, key);
+	p = Append(p, kColon, 2);
+	p = Append(p, value);
+	p = Append(p, kCRLF, 2);
+	mResHeaderLen += len;
 }
 
 void wHttpTask::Error(const std::string& status, const std::string& code) {
 	if (!code.empty()) {
-		if (status.empty()) {
-			const std::string s = http::Status(code);
-			if (s.empty()) {
-				ResponseSet(kLine[7], "500");
-				ResponseSet(kLine[8], http::Status("500"));
-			}
-			ResponseSet(kLine[7], code);
-			ResponseSet(kLine[8], s);
-		} else {
-			ResponseSet(kLine[7], code);
-			ResponseSet(kLine[8], status);
-		}
+		SetStatus(static_cast<uint16_t>(SliceToNumber(code)), status);
+	}
+}
+
+void wHttpTask::SetStatus(uint16_t code, const wSlice& status) {
+	if (status.empty() && http::StatusText(code) == NULL) {
+		code = 500;
 	}
+	mStatus = code;
+	mReason.assign(status.data(), status.size());
+}
+
+void wHttpTask::Write(const wSlice& body) {
+	mResBody.assign(body.data(), body.size());
+	mResBodyRef = mResBody;
 }
 
-void wHttpTask::Write(const std::string& body) {
-	ResponseSet(kLine[9], body);
+void wHttpTask::WriteCached(const wSlice& key, const wSlice& body) {
+	mResBody.clear();
+	mResBodyRef = body;
+	mResCacheKey.assign(key.data(), key.size());
 }
 
 int wHttpTask::HttpGet(const std::string& url, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout) {
-	ResponseSet(kLine[0], kMethod[0]);
-	ResponseSet(kLine[1], url);
-    ResponseSet(kHeader[2], Socket()->Host() + ":" + logging::NumberToString(static_cast<uint64_t>(Socket()->Port())));
+	ResponseReset();
+	for (std::map<std::string, std::string>::const_iterator it = header.begin(); it != header.end(); it++) {
+		ResponseSet(it->first, it->second);
+	}
 
     ssize_t size;
-    int ret = SyncRequest(&size);
+    int ret = SyncRequest(kMethod[0], url, &size);
+    ResponseReset();
     if (ret == -1) {
     	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::HttpGet SyncRequest() failed", "");
     	return -1;
@@ -584,6 +1320,39 @@ int wHttpTask::HttpGet(const std::string& url, const std::map<std::string, std::
 }
 
 int wHttpTask::HttpPost(const std::string& url, const std::map<std::string, std::string>& data, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout) {
+	ResponseReset();
+	for (std::map<std::string, std::string>::const_iterator it = header.begin(); it != header.end(); it++) {
+		ResponseSet(it->first, it->second);
+	}
+	if (!(mResFlag & kResContentType)) {
+		ResponseSet(kHeader[1], "application/x-www-form-urlencoded");
+	}
+
+	// 表单body
+	std::string body;
+	for (std::map<std::string, std::string>::const_iterator it = data.begin(); it != data.end(); it++) {
+		if (!body.empty()) {
+			body += "&";
+		}
+		body += http::UrlEncode(it->first) + "=" + http::UrlEncode(it->second);
+	}
+	mResBodyRef = body;
+
+    ssize_t size;
+    int ret = SyncRequest(kMethod[1], url, &size);
+    ResponseReset();
+    if (ret == -1) {
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::HttpPost SyncRequest() failed", "");
+    	return -1;
+    }
+    memset(mTempBuff, 0, sizeof(mTempBuff));
+
+    ret = SyncResponse(mTempBuff, &size, timeout);
+    if (ret == -1) {
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::HttpPost SyncResponse() failed", "");
+    	return ret;
+    }
+    res = mTempBuff;
     return 0;
 }
 
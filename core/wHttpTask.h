@@ -11,6 +11,10 @@
 #include "wCore.h"
 #include "wCommand.h"
 #include "wTask.h"
+#include "wHttpParser.h"
+#include "wHttpRouter.h"
+#include "wHttpCompress.h"
+#include "wResponseCache.h"
 
 namespace hnet {
 
@@ -22,43 +26,247 @@ const char  kHeader[][32]	= {"Content-Length", "Content-Type", "Host", "Connecti
 const char	kColon[]		= ": ";
 const char	kEndl[]			= "\r\n\r\n";
 
+// 响应：ResponseSet自定义header缓冲大小、状态行及默认header预留长度
+const uint32_t	kHttpResHeaderSize = 4096;
+const uint32_t	kHttpHeadReserve = 1024;
+
+// 流式响应：chunk-size行预留长度；100 Continue、结束chunk
+const uint32_t	kHttpChunkHead = 32;
+const char	kContinue[]		= "HTTP/1.1 100 Continue\r\n\r\n";
+const char	kChunkEnd[]		= "0\r\n\r\n";
+
+// 持久连接：空闲超时（秒）、单连接最多请求数（达到后响应Connection: close并关闭）
+const uint32_t	kHttpKeepAliveTm = 30;
+const uint32_t	kHttpKeepAliveMax = 120;
+const uint32_t	kHttpCheckTm = 1000;	// 空闲检测周期（毫秒）
+
+// 流水线请求：发送缓冲积压超过此长度时暂停处理后续请求，发送完后继续（响应按请求顺序写入）
+const uint32_t	kHttpPipelineSize = kPackageSize/4;
+
 class wSocket;
+class wHttp2Session;
+struct wHttpFile_t;
 
 class wHttpTask : public wTask {
 public:
-    wHttpTask(wSocket *socket, int32_t type = 0) : wTask(socket, type) { }
-    virtual ~wHttpTask() { }
+    wHttpTask(wSocket *socket, int32_t type = 0) : wTask(socket, type), mReqState(kReqHead), mReqMinor(1), mReqEncoding(kHttpIdentity), mReqHead(false), mContinue(false), mHandling(false),
+    mRequests(0), mKeepAlive(false), mClosing(false), mFile(NULL), mFileOff(0), mFileLeft(0), mH2(NULL), mH2Stream(0) {
+    	ResponseReset();
+    }
+    virtual ~wHttpTask();
 
     virtual int TaskRecv(ssize_t *size);
+    virtual int TaskSend(ssize_t *size);
     virtual int Handlemsg(char buf[], uint32_t len);
+    virtual size_t SendLen() { return mSendLen + mFileLeft;}
+    // 请求处理中、延迟（Defer）或流式响应未结束、h2有活动stream时非空闲，不按keep-alive超时关闭
+    virtual bool Idle();
 
-    inline std::map<std::string, std::string>& Req() { return mReq;}
-    inline std::map<std::string, std::string>& Res() { return mRes;}
-    
-    inline std::string Url() { return kProtocol[1] + RequestGet(kHeader[2]) + mReq[kLine[1]];}
-    inline std::string Method() { return mReq[kLine[0]];}
-    inline std::string Pathinfo() { return mReq[kLine[3]];}
-    inline std::string QueryString() { return mReq[kLine[4]];}
-    inline std::string QueryGet(const std::string& key) { return mGet[key];}
-    inline std::string FormGet(const std::string& key) { return mPost[key];}
-    inline std::string RequestGet(const std::string& key) { return mReq[key];}
-
-    void ResponseSet(const std::string& key, const std::string& value) { mRes[key] = value;}
+    // 流式请求body：header完整后调用，返回true则body分段交付HandleBody（不缓冲，不受kMaxPackageSize限制，支持chunked），
+    // body结束后再调用Handlemsg（Request().Body()为空）。默认false：完整缓冲后调用Handlemsg
+    virtual bool BodyStream() { return false;}
+    virtual int HandleBody(const wSlice& data) { return 0;}
+
+    // HTTP/2明文（h2c）：连接序言（prior knowledge）或 Upgrade: h2c 升级。各stream转换为HTTP/1.1请求，按同样的处理函数分发，
+    // 响应API不变（WriteChunk、End、SendStatic均可用），由连接多路复用发送。流式请求body在h2中完整缓冲后一次交付HandleBody
+    // 默认开启，返回false则仅HTTP/1.x
+    virtual bool Http2Enable() { return true;}
+    inline bool Http2() const { return mH2 != NULL;}
+
+    // 当前请求。方法、路径、参数、header均为接收缓冲中的视图，仅在处理函数返回前有效
+    inline const wHttpParser& Request() const { return mParser;}
+    // 已设置的自定义响应header（"k: v\r\n"...）
+    inline wSlice ResponseHeader() const { return wSlice(mResHeader, mResHeaderLen);}
+    inline uint16_t ResponseStatus() const { return mStatus;}
+    // 已设置的自定义响应header值，名称大小写不敏感
+    wSlice ResponseGet(const wSlice& key) const;
+
+    // 本连接已处理请求数；当前响应后是否保持连接
+    inline uint32_t Requests() const { return mRequests;}
+    inline bool KeepAlive() const { return mKeepAlive;}
+
+    inline std::string Url() { return kProtocol[1] + RequestGet(kHeader[2]).ToString() + mParser.Uri().ToString();}
+    inline wSlice Method() { return mParser.Method();}
+    inline wSlice Pathinfo() { return mParser.Path();}
+    inline wSlice QueryString() { return mParser.Query();}
+    inline wSlice QueryGet(const wSlice& key) { wSlice v; mParser.QueryGet(key, &v); return v;}
+    inline wSlice FormGet(const wSlice& key) { wSlice v; mParser.FormGet(key, &v); return v;}
+    // header，名称大小写不敏感
+    inline wSlice RequestGet(const wSlice& key) { wSlice v; mParser.Header(key, &v); return v;}
+    // 请求body（可写，如wJson原地解析），仅在处理函数返回前有效
+    inline char* MutableBody() { return const_cast<char*>(mParser.Body().data());}
+    // 路径路由参数（:name、*name），未解码
+    inline wSlice Param(const wSlice& name) { wSlice v; mParams.Get(name, &v); return v;}
+
+    // 设置响应header，同名（大小写不敏感）覆盖。Content-Type、Connection、Date等默认header被设置后不再自动填写
+    // 设置Connection: close则响应后关闭连接
+    void ResponseSet(const wSlice& key, const wSlice& value);
     void Error(const std::string& status, const std::string& code);
-    void Write(const std::string& body);
+    void SetStatus(uint16_t code, const wSlice& status = wSlice());
+    // 响应body：Write拷贝；WriteRef仅引用（零拷贝），数据需在处理函数返回前有效
+    void Write(const wSlice& body);
+    inline void WriteRef(const wSlice& body) { mResBody.clear(); mResBodyRef = body;}
+    // 响应body缓冲：直接写入（如wJsonWriter），处理函数返回后以writev发送，无需再拷贝
+    inline std::string* WriteBuffer() { mResBody.clear(); mResBodyRef = wSlice(); return &mResBody;}
+    // 热点响应body（同WriteRef）：压缩结果以key缓存（wHttpCompressCache），body不变时不再重复压缩
+    void WriteCached(const wSlice& key, const wSlice& body);
+
+    // 响应压缩：Content-Type可压缩（text/*、json、javascript、xml）、未设置Content-Encoding时，按请求Accept-Encoding以gzip、deflate压缩
+    // 普通响应body不小于kHttpCompressMin时压缩；流式响应每个chunk压缩后立即发送（Z_SYNC_FLUSH）；静态文件压缩结果缓存
+    // 需 -D_USE_ZLIB_ 编译，否则均为原文
+
+    // 流式响应：WriteChunk立即发送一段body（首次先发送响应头，Transfer-Encoding: chunked；HTTP/1.0以关闭连接结束），End结束响应
+    // 可在处理函数返回后继续调用（异步产生数据），End前暂停处理后续流水线请求
+    int WriteChunk(const wSlice& data);
+    int End();
 
+    // 延迟响应：处理函数返回后不发送响应（如等待上游服务的异步结果），暂停处理后续请求，之后设置状态、body并调用End发送
+    inline void Defer() { mResStream = kResDeferred;}
+
+    // 静态文件响应（GET、HEAD），支持Range、If-Modified-Since，body以sendfile发送。文件见wHttpFile::Match
+    // 错误（404、405、416）及304、HEAD仅设置状态，由处理函数返回后响应
+    int SendStatic(const std::string& fname);
+
+    // 响应缓存失效（本进程）：路径（未解码，不含查询串）的全部方法、查询串的缓存响应，返回失效条目数
+    static size_t MemoInvalidatePath(const wSlice& path);
+
+    // 同步请求（阻塞等待响应，如wSingleClient）。事件循环中请使用异步客户端wHttpClient
     virtual int HttpGet(const std::string& url, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout = 30);
     virtual int HttpPost(const std::string& url, const std::map<std::string, std::string>& data, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout = 30);
 
 protected:
-	std::map<std::string, std::string> mReq;
-	std::map<std::string, std::string> mRes;
+	using wTask::On;
+
+	// http路径路由器：method为"GET"、"POST"等，或"*"（任意方法）；path如"/user/:id"、"/file/*path"
+	// 与wTask::On相同，仅该类首个实例注册生效。先于cmd、para路由匹配，无匹配路径时仍按cmd、para分发
+	template<typename T = wTask>
+	void On(const char* method, const char* path, int (T::*func)(struct Request_t *argv), T* target) {
+		if (DispatchEntry() && mDispatch->On(method, path, func) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s[%s %s]", "wHttpTask::On () failed", "route illegal", method, path);
+		}
+	}
+
+	// http路径响应缓存（见wResponseCache）：相同方法、路径、查询串、body的请求在ttl毫秒内以缓存响应应答。须在对应路由On之后调用
+	// 缓存2xx的普通响应（非流式、延迟、文件）；cmd、para路由以wTask::Memo开启，键同样为http请求
+	using wTask::Memo;
+	void Memo(const char* method, const char* path, uint32_t ttl) {
+		if (DispatchEntry() && mDispatch->Memo(method, path, ttl) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s[%s %s]", "wHttpTask::Memo () failed", "route not found", method, path);
+		}
+	}
+
+	enum {
+		kReqHead = 0,
+		kReqBody,
+		kReqStream
+	};
+
+	enum {
+		kResNone = 0,
+		kResStreaming,
+		kResEnded,
+		kResDeferred
+	};
+
+	enum {
+		kResContentLength = 1 << 0,
+		kResContentType = 1 << 1,
+		kResConnection = 1 << 2,
+		kResDate = 1 << 3,
+		kResPoweredBy = 1 << 4,
+		kResCacheControl = 1 << 5,
+		kResPragma = 1 << 6,
+		kResHost = 1 << 7
+	};
+
+	// 响应缓存：命中时恢复响应（状态、header、body引用缓存）返回true；缓存处理函数的响应
+	bool MemoGet();
+	void MemoPut(uint32_t ttl);
+
+	// 依次处理接收缓冲中完整的请求（流水线）
+	int Process();
+	int ParseError();
+	int SendContinue();
+
+	// 发送：head已Commit至发送缓冲（headlen字节，idle为此前发送缓冲为空），后接零拷贝数据parts
+	int SendParts(bool idle, char* head, size_t headlen, const wSlice* parts, int num);
+	int Respond();
+	// 发送一个chunk（首次先发送响应头），chunk已编码
+	int SendChunk(const wSlice& chunk);
+	// 响应编码：可压缩时设置Vary，并按请求Accept-Encoding协商（body为流式响应或不小于kHttpCompressMin）
+	uint8_t ResponseEncoding(size_t bodylen, bool stream);
+	// body替换为压缩结果（mResZip或缓存），设置Content-Encoding。压缩失败、不小于原文时返回false（原文发送）
+	bool CompressBody(wSlice* body, uint8_t encoding);
+	// sendfile发送文件body
+	int FileSend();
+	// 处理函数返回后结束的响应：继续处理流水线请求，或关闭连接
+	int ResponseDone();
+	// 异步结束的响应（End等，ret为发送结果）：处理函数外调用时ResponseDone，出错关闭写端
+	int Resume(int ret);
+	// 响应未结束（流式、延迟），暂停处理后续请求
+	inline bool ResponsePending() const { return mResStream == kResStreaming || mResStream == kResDeferred;}
+
+	// HTTP/2：Upgrade: h2c请求（header已完整，HTTP2-Settings可解码）；升级（101后当前请求为stream 1）
+	bool Http2Upgradable(std::string* settings);
+	int Http2Upgrade(const std::string& settings);
+	int Http2Start(const wSlice& settings, bool upgrade);
+	// 解析帧，分发请求完整的stream，按窗口发送各stream数据
+	int Http2Process();
+	int Http2Handle(uint32_t id);
+	// 响应头（HTTP/1.1格式）渲染至mH2Head，由session转换为HEADERS
+	wSlice Http2Head(size_t bodylen);
+	// 处理函数外（异步响应）立即发送
+	int Http2Flush();
+
+	void ResponseReset();
+	// 状态行 + header + 空行写入buf（至少kHttpHeadReserve + mResHeaderLen + mReason.size()字节），返回长度
+	size_t RenderHead(char* buf, size_t bodylen);
+	// 状态码不允许body（1xx、204、304），不发送Content-Length（304除外）、Transfer-Encoding
+	inline bool StatusNoBody() const { return mStatus < 200 || mStatus == 204 || mStatus == 304;}
+	// 响应不发送body：HEAD请求（header同GET），或状态码不允许body
+	inline bool NoBody() const { return mReqHead || StatusNoBody();}
+
+	wHttpParser mParser;
+	uint8_t mReqState;
+	uint8_t mReqMinor;	// 当前请求HTTP/1.x（响应可能在解析器重置后发送）
+	uint8_t mReqEncoding;	// 当前请求Accept-Encoding协商的压缩编码
+	bool mReqHead;		// 当前请求为HEAD（HTTP/1.x，HTTP/2由wHttp2Session处理）
+	bool mContinue;		// 待发送100 Continue
+	bool mHandling;		// 处理函数执行中
+	wHttpParams_t mParams;	// 当前请求路由参数
+
+	uint32_t mRequests;
+	bool mKeepAlive;	// 当前请求：客户端要求持久连接（HTTP/1.1默认，HTTP/1.0需keep-alive）且未达请求数上限
+	bool mClosing;		// 已响应Connection: close，不再处理后续请求，发送完后关闭
+
+	// 响应。状态行、header在AsyncResponse中直接写入发送缓冲，body以writev发送
+	uint16_t mStatus;
+	std::string mReason;	// 自定义状态描述，空为http::StatusText()
+	uint32_t mResFlag;		// 已自定义的默认header
+	uint8_t mResStream;
+	std::string mResBody;
+	wSlice mResBodyRef;
+	std::string mResCacheKey;	// WriteCached缓存键
+	uint8_t mResEncoding;		// 流式响应压缩编码
+	std::string mResZip;		// 压缩后的body（chunk）
+	wHttpCompress mCompress;	// 实时压缩流（普通响应、流式响应）
+	size_t mResHeaderLen;
+	char mResHeader[kHttpResHeaderSize];
+
+	// 待发送文件body（发送缓冲中响应头发完后sendfile）
+	wHttpFile_t* mFile;
+	uint64_t mFileOff;
+	uint64_t mFileLeft;
+
+	// HTTP/2连接（NULL为HTTP/1.x），mH2Stream为当前处理的stream
+	wHttp2Session* mH2;
+	uint32_t mH2Stream;
+	std::string mH2Head;
 
 private:
-    int AsyncRequest();  // 异步接受请求
     int AsyncResponse(); // 异步发送响应
     
-    int SyncRequest(ssize_t* size);  // 同步发送请求
+    int SyncRequest(const wSlice& method, const wSlice& url, ssize_t* size);  // 同步发送请求（header为ResponseSet所设）
     
     // 同步接受一条合法的消息（该消息必须为一条即将接受的消息）
     // 调用者：保证此sock未加入epoll中，否则出现事件竞争；且该sock需为阻塞的fd；另外也要确保buf有足够长的空间接受自此同步消息
@@ -67,12 +275,7 @@ private:
     // size > 0  接受字符
     int SyncResponse(char buf[], ssize_t* size, uint32_t timeout = 30);  // 同步接受响应
 
-	int ParseRequest(char buf[], uint32_t len);
     int ParseResponse(char buf[], uint32_t len);
-    void FillResponse();
-
-	std::map<std::string, std::string> mGet;
-	std::map<std::string, std::string> mPost;
 };
 
 }	// namespace hnet
@@ -0,0 +1,604 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <math.h>
+#include "wJson.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace hnet {
+
+namespace {
+
+inline bool IsSpace(char c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// 跳过空白。值之间多为无空白或单个空格，先逐字节判断；缩进等较长空白以16字节为单位比较
+inline char* SkipSpace(char* p, const char* end) {
+	if (p == end || !IsSpace(*p) || (++p < end && !IsSpace(*p))) {
+		return p;
+	}
+#if defined(__SSE2__)
+	const __m128i sp = _mm_set1_epi8(' '), nl = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r'), tab = _mm_set1_epi8('\t');
+	while (end - p >= 16) {
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		const __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, sp), _mm_cmpeq_epi8(x, nl)), _mm_or_si128(_mm_cmpeq_epi8(x, cr), _mm_cmpeq_epi8(x, tab)));
+		const int mask = _mm_movemask_epi8(m) ^ 0xffff;
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 16;
+	}
+#endif
+	while (p < end && IsSpace(*p)) {
+		p++;
+	}
+	return p;
+}
+
+// 字符串中第一个需特殊处理的字符：'"'、'\\'、控制字符（< 0x20），无则返回end
+inline const char* ScanString(const char* p, const char* end) {
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"'), slash = _mm_set1_epi8('\\'), ctrl = _mm_set1_epi8(0x1f);
+	while (end - p >= 16) {
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		// 无符号 x <= 0x1f 即 max(x, 0x1f) == 0x1f
+		const __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, slash)), _mm_cmpeq_epi8(_mm_max_epu8(x, ctrl), ctrl));
+		const int mask = _mm_movemask_epi8(m);
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '"' && *p != '\\' && static_cast<uint8_t>(*p) >= 0x20) {
+		p++;
+	}
+	return p;
+}
+
+inline int HexValue(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	} else if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// "\uXXXX"的XXXX，非法返回-1
+inline int32_t Hex4(const char* p, const char* end) {
+	if (end - p < 4) {
+		return -1;
+	}
+	int32_t v = 0;
+	for (int i = 0; i < 4; i++) {
+		int h = HexValue(p[i]);
+		if (h == -1) {
+			return -1;
+		}
+		v = (v << 4) | h;
+	}
+	return v;
+}
+
+inline char* EncodeUtf8(char* w, uint32_t cp) {
+	if (cp < 0x80) {
+		*w++ = static_cast<char>(cp);
+	} else if (cp < 0x800) {
+		*w++ = static_cast<char>(0xc0 | (cp >> 6));
+		*w++ = static_cast<char>(0x80 | (cp & 0x3f));
+	} else if (cp < 0x10000) {
+		*w++ = static_cast<char>(0xe0 | (cp >> 12));
+		*w++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+		*w++ = static_cast<char>(0x80 | (cp & 0x3f));
+	} else {
+		*w++ = static_cast<char>(0xf0 | (cp >> 18));
+		*w++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+		*w++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+		*w++ = static_cast<char>(0x80 | (cp & 0x3f));
+	}
+	return w;
+}
+
+inline bool IsDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+// 无符号整数写入buf尾部，返回起始位置
+inline char* FormatUint(char* end, uint64_t v) {
+	do {
+		*--end = static_cast<char>('0' + v % 10);
+		v /= 10;
+	} while (v != 0);
+	return end;
+}
+
+}	// namespace anonymous
+
+int wJson::Fail(const char* buf, const char* p) {
+	mError = p - buf;
+	mNode.clear();
+	mStack.clear();
+	return -1;
+}
+
+int wJson::Parse(char* buf, size_t len) {
+	mNode.clear();
+	mStack.clear();
+	mError = 0;
+	char* p = SkipSpace(buf, buf + len);
+	char* end = buf + len;
+
+	// 非递归：mStack为未结束的容器，值结束后回到所在容器，处理','或结束符
+	while (true) {
+		// 值
+		if (p == end) {
+			return Fail(buf, p);
+		}
+		bool done = true;
+		switch (*p) {
+		case '{':
+		case '[': {
+			if (mStack.size() >= kJsonDepthMax) {
+				return Fail(buf, p);
+			}
+			const bool object = *p == '{';
+			const uint32_t idx = static_cast<uint32_t>(mNode.size());
+			NewNode(object? kJsonObject: kJsonArray, NULL, 0);
+			p = SkipSpace(p + 1, end);
+			if (p < end && *p == (object? '}': ']')) {
+				p++;
+				break;
+			}
+			mStack.push_back(idx);
+			if (object) {
+				// 首个成员名称
+				char* q;
+				if (p == end || *p != '"' || (q = ParseString(p, end)) == NULL) {
+					return Fail(buf, p);
+				}
+				p = SkipSpace(q, end);
+				if (p == end || *p != ':') {
+					return Fail(buf, p);
+				}
+				p = SkipSpace(p + 1, end);
+			}
+			done = false;
+			break;
+		}
+		case '"': {
+			char* q = ParseString(p, end);
+			if (q == NULL) {
+				return Fail(buf, p);
+			}
+			p = q;
+			break;
+		}
+		case 't':
+			if (end - p < 4 || memcmp(p, "true", 4) != 0) {
+				return Fail(buf, p);
+			}
+			NewNode(kJsonTrue, p, 4);
+			p += 4;
+			break;
+		case 'f':
+			if (end - p < 5 || memcmp(p, "false", 5) != 0) {
+				return Fail(buf, p);
+			}
+			NewNode(kJsonFalse, p, 5);
+			p += 5;
+			break;
+		case 'n':
+			if (end - p < 4 || memcmp(p, "null", 4) != 0) {
+				return Fail(buf, p);
+			}
+			NewNode(kJsonNull, p, 4);
+			p += 4;
+			break;
+		default: {
+			char* q = ParseNumber(p, end);
+			if (q == NULL) {
+				return Fail(buf, p);
+			}
+			p = q;
+			break;
+		}
+		}
+		if (!done) {
+			// 容器首个元素
+			continue;
+		}
+
+		// 值结束：所在容器计数，','后继续下一元素，结束符则容器结束（容器本身为上一层的值）
+		while (true) {
+			p = SkipSpace(p, end);
+			if (mStack.empty()) {
+				return p == end? 0: Fail(buf, p);
+			} else if (p == end) {
+				return Fail(buf, p);
+			}
+			const uint32_t top = mStack.back();
+			const bool object = mNode[top].mType == kJsonObject;
+			mNode[top].mSize++;
+			if (*p == ',') {
+				p = SkipSpace(p + 1, end);
+				if (object) {
+					char* q;
+					if (p == end || *p != '"' || (q = ParseString(p, end)) == NULL) {
+						return Fail(buf, p);
+					}
+					p = SkipSpace(q, end);
+					if (p == end || *p != ':') {
+						return Fail(buf, p);
+					}
+					p = SkipSpace(p + 1, end);
+				}
+				break;
+			} else if (*p == (object? '}': ']')) {
+				mNode[top].mEnd = static_cast<uint32_t>(mNode.size());
+				mStack.pop_back();
+				p++;
+			} else {
+				return Fail(buf, p);
+			}
+		}
+	}
+	return 0;
+}
+
+char* wJson::ParseString(char* p, char* end) {
+	char* s = ++p;
+	p = const_cast<char*>(ScanString(p, end));
+	if (p < end && *p == '"') {
+		// 无转义：直接引用
+		NewNode(kJsonString, s, p - s);
+		return p + 1;
+	}
+
+	// 转义：在缓冲内解码（解码结果不长于原文），w为写入位置
+	char* w = p;
+	while (p < end) {
+		if (*p == '"') {
+			NewNode(kJsonString, s, w - s);
+			return p + 1;
+		} else if (*p != '\\') {
+			if (static_cast<uint8_t>(*p) < 0x20) {
+				return NULL;
+			}
+			char* q = const_cast<char*>(ScanString(p, end));
+			memmove(w, p, q - p);
+			w += q - p;
+			p = q;
+			continue;
+		} else if (end - p < 2) {
+			return NULL;
+		}
+		switch (p[1]) {
+		case '"': *w++ = '"'; break;
+		case '\\': *w++ = '\\'; break;
+		case '/': *w++ = '/'; break;
+		case 'b': *w++ = '\b'; break;
+		case 'f': *w++ = '\f'; break;
+		case 'n': *w++ = '\n'; break;
+		case 'r': *w++ = '\r'; break;
+		case 't': *w++ = '\t'; break;
+		case 'u': {
+			int32_t cp = Hex4(p + 2, end);
+			if (cp == -1 || (cp >= 0xdc00 && cp <= 0xdfff)) {
+				return NULL;
+			} else if (cp >= 0xd800 && cp <= 0xdbff) {
+				// 代理对
+				if (end - p < 12 || p[6] != '\\' || p[7] != 'u') {
+					return NULL;
+				}
+				int32_t low = Hex4(p + 8, end);
+				if (low < 0xdc00 || low > 0xdfff) {
+					return NULL;
+				}
+				cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+				p += 6;
+			}
+			w = EncodeUtf8(w, static_cast<uint32_t>(cp));
+			p += 4;
+			break;
+		}
+		default:
+			return NULL;
+		}
+		p += 2;
+	}
+	return NULL;
+}
+
+char* wJson::ParseNumber(char* p, char* end) {
+	// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+	char* s = p;
+	if (p < end && *p == '-') {
+		p++;
+	}
+	if (p == end || !IsDigit(*p)) {
+		return NULL;
+	} else if (*p == '0') {
+		p++;
+	} else {
+		while (p < end && IsDigit(*p)) {
+			p++;
+		}
+	}
+	if (p < end && *p == '.') {
+		if (++p == end || !IsDigit(*p)) {
+			return NULL;
+		}
+		while (p < end && IsDigit(*p)) {
+			p++;
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		if (++p < end && (*p == '+' || *p == '-')) {
+			p++;
+		}
+		if (p == end || !IsDigit(*p)) {
+			return NULL;
+		}
+		while (p < end && IsDigit(*p)) {
+			p++;
+		}
+	}
+	NewNode(kJsonNumber, s, p - s);
+	return p;
+}
+
+const wJsonNode_t* wJsonValue::Node() const {
+	return mDoc != NULL? &mDoc->Node(mIdx): NULL;
+}
+
+uint8_t wJsonValue::Type() const {
+	return mDoc != NULL? Node()->mType: static_cast<uint8_t>(kJsonNull);
+}
+
+bool wJsonValue::Bool(bool def) const {
+	const uint8_t type = Type();
+	return type == kJsonTrue? true: (type == kJsonFalse? false: def);
+}
+
+int64_t wJsonValue::Int(int64_t def) const {
+	if (!IsNumber()) {
+		return def;
+	}
+	const wJsonNode_t* node = Node();
+	const char* p = node->mPtr;
+	const char* end = p + node->mLen;
+	const bool neg = *p == '-';
+	if (neg) {
+		p++;
+	}
+	uint64_t v = 0;
+	for (; p < end && IsDigit(*p); p++) {
+		if (v > (static_cast<uint64_t>(INT64_MAX) - (*p - '0')) / 10) {
+			break;
+		}
+		v = v * 10 + (*p - '0');
+	}
+	if (p != end) {
+		// 小数、指数、超出范围
+		const double d = Double(static_cast<double>(def));
+		return d >= 9223372036854775807.0? INT64_MAX: (d <= -9223372036854775808.0? INT64_MIN: static_cast<int64_t>(d));
+	}
+	return neg? -static_cast<int64_t>(v): static_cast<int64_t>(v);
+}
+
+double wJsonValue::Double(double def) const {
+	if (!IsNumber()) {
+		return def;
+	}
+	// 数字之后不一定有结束符，拷贝后转换
+	const wJsonNode_t* node = Node();
+	char buf[64];
+	if (node->mLen < sizeof(buf)) {
+		memcpy(buf, node->mPtr, node->mLen);
+		buf[node->mLen] = '\0';
+		return strtod(buf, NULL);
+	}
+	return strtod(std::string(node->mPtr, node->mLen).c_str(), NULL);
+}
+
+wSlice wJsonValue::String() const {
+	return IsString()? wSlice(Node()->mPtr, Node()->mLen): wSlice();
+}
+
+wSlice wJsonValue::Raw() const {
+	return IsNumber()? wSlice(Node()->mPtr, Node()->mLen): wSlice();
+}
+
+uint32_t wJsonValue::Size() const {
+	return IsArray() || IsObject()? Node()->mSize: 0;
+}
+
+wJsonValue wJsonValue::operator[](size_t i) const {
+	if (!IsArray() || i >= Node()->mSize) {
+		return wJsonValue();
+	}
+	wJsonValue v = Child();
+	for (; i > 0; i--) {
+		v = v.Next();
+	}
+	return v;
+}
+
+wJsonValue wJsonValue::operator[](const wSlice& key) const {
+	if (!IsObject()) {
+		return wJsonValue();
+	}
+	for (wJsonValue v = Child(); v.Valid(); v = v.Next()) {
+		if (v.Key() == key) {
+			return v;
+		}
+	}
+	return wJsonValue();
+}
+
+wJsonValue wJsonValue::Child() const {
+	if (Size() == 0) {
+		return wJsonValue();
+	}
+	const bool object = IsObject();
+	return wJsonValue(mDoc, mIdx + (object? 2: 1), Node()->mEnd, object);
+}
+
+wJsonValue wJsonValue::Next() const {
+	if (mDoc == NULL || Node()->mEnd >= mParentEnd) {
+		return wJsonValue();
+	}
+	return wJsonValue(mDoc, Node()->mEnd + (mMember? 1: 0), mParentEnd, mMember);
+}
+
+wSlice wJsonValue::Key() const {
+	if (!mMember) {
+		return wSlice();
+	}
+	const wJsonNode_t& key = mDoc->Node(mIdx - 1);
+	return wSlice(key.mPtr, key.mLen);
+}
+
+void wJsonWriter::BeginObject() {
+	Prefix();
+	mOut->push_back('{');
+	mComma = false;
+}
+
+void wJsonWriter::EndObject() {
+	mOut->push_back('}');
+	mComma = true;
+}
+
+void wJsonWriter::BeginArray() {
+	Prefix();
+	mOut->push_back('[');
+	mComma = false;
+}
+
+void wJsonWriter::EndArray() {
+	mOut->push_back(']');
+	mComma = true;
+}
+
+void wJsonWriter::Key(const wSlice& key) {
+	Prefix();
+	mOut->push_back('"');
+	Escape(key, mOut);
+	mOut->append("\":", 2);
+	mComma = false;
+}
+
+void wJsonWriter::String(const wSlice& s) {
+	Prefix();
+	mOut->push_back('"');
+	Escape(s, mOut);
+	mOut->push_back('"');
+	mComma = true;
+}
+
+void wJsonWriter::Int(int64_t v) {
+	Prefix();
+	char buf[24];
+	char* end = buf + sizeof(buf);
+	char* p = FormatUint(end, v < 0? 0 - static_cast<uint64_t>(v): static_cast<uint64_t>(v));
+	if (v < 0) {
+		*--p = '-';
+	}
+	mOut->append(p, end - p);
+	mComma = true;
+}
+
+void wJsonWriter::Uint(uint64_t v) {
+	Prefix();
+	char buf[24];
+	char* end = buf + sizeof(buf);
+	char* p = FormatUint(end, v);
+	mOut->append(p, end - p);
+	mComma = true;
+}
+
+void wJsonWriter::Double(double v) {
+	if (v > -1e15 && v < 1e15 && v == static_cast<double>(static_cast<int64_t>(v)) && !(v == 0 && signbit(v))) {
+		// 整数值按整数格式化
+		Int(static_cast<int64_t>(v));
+		return;
+	}
+
+	Prefix();
+	if (!isfinite(v)) {
+		mOut->append("null", 4);
+	} else {
+		// 优先15位有效数字（较短，如0.1），不能精确还原时17位
+		char buf[32];
+		int n = snprintf(buf, sizeof(buf), "%.15g", v);
+		if (strtod(buf, NULL) != v) {
+			n = snprintf(buf, sizeof(buf), "%.17g", v);
+		}
+		mOut->append(buf, n);
+	}
+	mComma = true;
+}
+
+void wJsonWriter::Bool(bool v) {
+	Prefix();
+	if (v) {
+		mOut->append("true", 4);
+	} else {
+		mOut->append("false", 5);
+	}
+	mComma = true;
+}
+
+void wJsonWriter::Null() {
+	Prefix();
+	mOut->append("null", 4);
+	mComma = true;
+}
+
+void wJsonWriter::Raw(const wSlice& json) {
+	Prefix();
+	mOut->append(json.data(), json.size());
+	mComma = true;
+}
+
+void wJsonWriter::Escape(const wSlice& s, std::string* out) {
+	static const char kHex[] = "0123456789abcdef";
+	const char* p = s.data();
+	const char* end = p + s.size();
+	while (p < end) {
+		// 无需转义的部分整段追加
+		const char* q = ScanString(p, end);
+		out->append(p, q - p);
+		if (q == end) {
+			break;
+		}
+		switch (*q) {
+		case '"': out->append("\\\"", 2); break;
+		case '\\': out->append("\\\\", 2); break;
+		case '\b': out->append("\\b", 2); break;
+		case '\f': out->append("\\f", 2); break;
+		case '\n': out->append("\\n", 2); break;
+		case '\r': out->append("\\r", 2); break;
+		case '\t': out->append("\\t", 2); break;
+		default: {
+			char u[6] = {'\\', 'u', '0', '0', kHex[(*q >> 4) & 0xf], kHex[*q & 0xf]};
+			out->append(u, sizeof(u));
+			break;
+		}
+		}
+		p = q + 1;
+	}
+}
+
+}	// namespace hnet
@@ -0,0 +1,160 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_JSON_H_
+#define _W_JSON_H_
+
+#include <vector>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+
+namespace hnet {
+
+// 解析：容器最大嵌套深度
+const uint32_t	kJsonDepthMax = 512;
+
+// 值类型
+enum {
+	kJsonNull = 0,
+	kJsonFalse,
+	kJsonTrue,
+	kJsonNumber,
+	kJsonString,
+	kJsonArray,
+	kJsonObject
+};
+
+// 解析结果节点（先序排列）：容器后依次为其元素，对象元素为 名称（字符串节点）+ 值
+struct wJsonNode_t {
+	const char* mPtr;	// 字符串（已解码）、数字原文，指向解析缓冲
+	uint32_t mLen;
+	uint32_t mSize;		// 容器元素数（对象为成员数）
+	uint32_t mEnd;		// 子树之后的节点下标
+	uint8_t mType;
+};
+
+class wJson;
+
+// 值视图：文档中的节点，仅在文档下次Parse前有效（字符串、数字亦引用解析缓冲）
+// 无效值（不存在的下标、成员）类型为kJsonNull，取值返回默认值
+class wJsonValue {
+public:
+	wJsonValue() : mDoc(NULL), mIdx(0), mParentEnd(0), mMember(false) { }
+	wJsonValue(const wJson* doc, uint32_t idx, uint32_t parentend, bool member) : mDoc(doc), mIdx(idx), mParentEnd(parentend), mMember(member) { }
+
+	inline bool Valid() const { return mDoc != NULL;}
+	uint8_t Type() const;
+	inline bool IsNull() const { return Type() == kJsonNull;}
+	inline bool IsBool() const { return Type() == kJsonTrue || Type() == kJsonFalse;}
+	inline bool IsNumber() const { return Type() == kJsonNumber;}
+	inline bool IsString() const { return Type() == kJsonString;}
+	inline bool IsArray() const { return Type() == kJsonArray;}
+	inline bool IsObject() const { return Type() == kJsonObject;}
+
+	bool Bool(bool def = false) const;
+	// 数字：整数超出范围、含小数或指数时按double转换
+	int64_t Int(int64_t def = 0) const;
+	double Double(double def = 0) const;
+	// 字符串（已解码，可含'\0'），非字符串为空
+	wSlice String() const;
+	// 数字原文
+	wSlice Raw() const;
+	// 数组元素数、对象成员数
+	uint32_t Size() const;
+
+	// 数组元素、对象成员（名称逐个比较）。不存在返回无效值
+	wJsonValue operator[](size_t i) const;
+	wJsonValue operator[](const wSlice& key) const;
+
+	// 遍历：首个元素（对象为首个成员值），下一元素，无则返回无效值；Key()为对象成员名称
+	wJsonValue Child() const;
+	wJsonValue Next() const;
+	wSlice Key() const;
+
+protected:
+	const wJsonNode_t* Node() const;
+
+	const wJson* mDoc;
+	uint32_t mIdx;
+	uint32_t mParentEnd;	// 所在容器子树之后的节点下标
+	bool mMember;			// 对象成员值（前一节点为名称）
+};
+
+// JSON解析（RFC8259）：原地解析，字符串转义在解析缓冲内解码，值为缓冲的视图，无逐值分配。
+// 节点数组跨次复用（同一文档对象解析多个请求时无分配）。字符串、空白以SSE2每次扫描16字节
+// 解析缓冲被修改，且须在值使用期间有效（如处理函数中的请求body，wHttpTask::MutableBody）
+class wJson : private wNoncopyable {
+public:
+	wJson() : mError(0) { }
+
+	// 返回0成功，-1格式错误（Error()为出错偏移）
+	int Parse(char* buf, size_t len);
+
+	inline wJsonValue Root() const { return mNode.empty()? wJsonValue(): wJsonValue(this, 0, static_cast<uint32_t>(mNode.size()), false);}
+	inline size_t Error() const { return mError;}
+	inline const wJsonNode_t& Node(uint32_t idx) const { return mNode[idx];}
+	inline size_t NodeNum() const { return mNode.size();}
+
+protected:
+	char* ParseString(char* p, char* end);
+	char* ParseNumber(char* p, char* end);
+	int Fail(const char* buf, const char* p);
+
+	inline void NewNode(uint8_t type, const char* ptr, size_t len) {
+		wJsonNode_t node;
+		node.mPtr = ptr;
+		node.mLen = static_cast<uint32_t>(len);
+		node.mSize = 0;
+		node.mEnd = static_cast<uint32_t>(mNode.size() + 1);
+		node.mType = type;
+		mNode.push_back(node);
+	}
+
+	std::vector<wJsonNode_t> mNode;
+	std::vector<uint32_t> mStack;	// 未结束的容器
+	size_t mError;
+};
+
+// JSON生成：直接追加至out（如wHttpTask::WriteBuffer，响应body以writev发送，无需再拷贝），无中间对象
+// 分隔符自动插入；结构（Key与值交替、Begin/End配对）由调用者保证
+class wJsonWriter : private wNoncopyable {
+public:
+	explicit wJsonWriter(std::string* out) : mOut(out), mComma(false) { }
+
+	void BeginObject();
+	void EndObject();
+	void BeginArray();
+	void EndArray();
+	void Key(const wSlice& key);
+
+	void String(const wSlice& s);
+	void Int(int64_t v);
+	void Uint(uint64_t v);
+	// 非有限值（inf、nan）为null
+	void Double(double v);
+	void Bool(bool v);
+	void Null();
+	// 已序列化的JSON值
+	void Raw(const wSlice& json);
+
+	// 转义字符串追加至out（不含引号）
+	static void Escape(const wSlice& s, std::string* out);
+
+protected:
+	inline void Prefix() {
+		if (mComma) {
+			mOut->push_back(',');
+		}
+	}
+
+	std::string* mOut;
+	bool mComma;	// 下一值前需要','
+};
+
+}	// namespace hnet
+
+#endif
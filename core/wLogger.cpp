@@ -4,25 +4,34 @@
  * Copyright (C) Hupu, Inc.
  */
 
+#include <algorithm>
+#include <vector>
+#include <set>
+#include <pthread.h>
+#include <signal.h>
 #include "wLogger.h"
 #include "wEnv.h"
 #include "wMisc.h"
 #include "wMutex.h"
+#include "wAtomic.h"
 
 namespace hnet {
 
-wPosixLogger::wPosixLogger(const std::string& fname, uint64_t (*getpid)(), off_t maxsize) : mMaxsize(maxsize), mGetpid(getpid) {
+wPosixLogger::wPosixLogger(const std::string& fname, uint64_t (*getpid)(), off_t maxsize) : mMaxsize(maxsize), mSize(0), mGetpid(getpid) {
 	char resolved_path[PATH_MAX];
 	realpath(fname.c_str(), resolved_path);
 	mFname = resolved_path;
 	mFile = OpenCreatLog(mFname, "a+");
+	if (mFile != NULL && fseeko(mFile, 0, SEEK_END) == 0) {
+		mSize = ftello(mFile);
+	}
 }
 
 void wPosixLogger::ArchiveLog() {
 	wEnv* env = wEnv::Default();
-	uint64_t filesize = 0;
-	if (env->GetFileSize(mFname, &filesize) == 0 && filesize >= static_cast<uint64_t>(mMaxsize)) {
-		// 日志大小操作限制
+	if (mSize >= mMaxsize) {
+		// 日志大小操作限制（缓冲记录写入原文件）
+		Flush();
 		CloseLog(mFile);
 
 		std::string realpath, dir;
@@ -71,111 +80,715 @@ void wPosixLogger::ArchiveLog() {
 		env->FileExists(target) && env->DeleteFile(target);
 		env->FileExists(mFname) && env->RenameFile(mFname, target);
 		mFile = OpenCreatLog(mFname, "a+");
+		mSize = 0;
+	}
+}
+
+size_t wLogger::FormatHead(char buf[], size_t size, uint64_t pid, int64_t usec) {
+	struct tm t;
+	const time_t seconds = usec / 1000000;
+	misc::FastUnixSec2Tm(seconds, &t);
+	int n = snprintf(buf, size, "%04d/%02d/%02d-%02d:%02d:%02d.%06d [%lld] ",
+			t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
+			static_cast<int>(usec % 1000000), static_cast<unsigned long long>(pid));
+	return n > 0? std::min(static_cast<size_t>(n), size - 1): 0;
+}
+
+size_t wLogger::Format(char buf[], size_t size, uint64_t pid, const char* format, va_list ap) {
+	char* p = buf;
+	char* limit = buf + size - 1;	// 保留\n位置
+
+	p += FormatHead(p, limit - p, pid, misc::GetTimeofday());
+	if (p < limit - 1) {
+		va_list backup_ap;
+		va_copy(backup_ap, ap);
+		int n = vsnprintf(p, limit - p, format, backup_ap);
+		va_end(backup_ap);
+		p += n > 0? std::min(static_cast<ptrdiff_t>(n), limit - p - 1): 0;
 	}
+
+	// 结尾非\n
+	if (p == buf || p[-1] != '\n') {
+		*p++ = '\n';
+	}
+	return p - buf;
 }
 
 void wPosixLogger::Logv(const char* format, va_list ap) {
+	char buffer[kLoggerLineSize];
+	size_t len = Format(buffer, sizeof(buffer), (*mGetpid)(), format, ap);
+	Append(buffer, len);
+	if (!kFFlushPerLog) {
+		Flush();
+	}
+}
+
+void wPosixLogger::Append(const char* buf, size_t len) {
 	// 检测文件大小，归档日志
 	ArchiveLog();
-	// 线程id
-	const uint64_t pid_id = (*mGetpid)();
-	// 尝试两种缓冲方式 字符串整理
-	char buffer[500];
-	for (int iter = 0; iter < 2; iter++) {
-		char* base;   // 缓冲地址
-		int bufsize;  // 缓冲长度
-		if (iter == 0) {
-			bufsize = sizeof(buffer);
-			base = buffer;
+	if (mFile != NULL) {
+		mBuffer.append(buf, len);
+		mSize += len;
+		if (mBuffer.size() >= kLoggerWriteSize) {
+			Flush();
+		}
+	}
+}
+
+void wPosixLogger::Flush() {
+	const char* p = mBuffer.data();
+	size_t left = mBuffer.size();
+	while (mFile != NULL && left > 0) {
+		ssize_t n = write(fileno(mFile), p, left);
+		if (n > 0) {
+			p += n;
+			left -= n;
+		} else if (n == -1 && errno == EINTR) {
+			continue;
 		} else {
-			bufsize = 30000;
-			HNET_NEW_VEC(bufsize, char, base);
-		}
-		char* p = base;
-		char* limit = base + bufsize;
-
-		struct tm t;
-		struct timeval tv;
-		misc::GetTimeofday(&tv);
-		const time_t seconds = tv.tv_sec;
-		misc::FastUnixSec2Tm(seconds, &t);
-		p += snprintf(p, limit - p, "%04d/%02d/%02d-%02d:%02d:%02d.%06d [%lld] ",
-				t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
-				static_cast<int>(tv.tv_usec), static_cast<unsigned long long>(pid_id));
-
-		if (p < limit) {
-			va_list backup_ap;
-			va_copy(backup_ap, ap);
-			p += vsnprintf(p, limit - p, format, backup_ap);
-			va_end(backup_ap);
-		}
-
-		if (p >= limit) {
-			if (iter == 0) {
-				continue;
+			break;
+		}
+	}
+	mBuffer.clear();
+}
+
+namespace {
+
+// 线程环形缓冲中的记录头，记录8字节对齐
+struct LogRecord_t {
+	uint32_t mLen;		// 记录总长度（含头、对齐）
+	uint32_t mLogger;	// 日志对象id（kLogBinary位为二进制记录），kLogPad为缓冲尾部填充
+};
+
+const uint32_t kLogPad = 0xffffffff;
+const uint32_t kLogBinary = 0x80000000;
+const char kLogDropFormat[] = "[hnet logger] %llu log records dropped, ring buffer full";
+const uint32_t kLogRecordSize = (sizeof(LogRecord_t) + kLoggerLineSize + 7) & ~7;
+
+// 单生产者（所属线程）单消费者（后台线程）无锁环形缓冲
+struct LogRing_t {
+	char mBuf[kLoggerRingSize];
+	wAtomic<uint64_t> mHead;	// 写位置（单调递增）
+	wAtomic<uint64_t> mTail;	// 读位置（单调递增）
+	wAtomic<uint64_t> mDropped;	// 丢弃条数
+	wAtomic<uint32_t> mDropLogger;	// 最近一次丢弃日志对象id
+	wAtomic<bool> mRetired;		// 所属线程已退出
+
+	LogRing_t() : mHead(0), mTail(0), mDropped(0), mDropLogger(0), mRetired(false) { }
+};
+
+// 日志上下文，进程内常驻（不析构，避免退出时与静态对象析构次序冲突）
+// 锁次序：mFlushMutex -> mMutex
+struct LogContext_t {
+	wMutex mMutex;		// 保护以下容器，仅短暂持有（不在锁内写文件）
+	wCond mCond;
+	std::map<std::string, uint32_t> mLoggerId;
+	std::vector<wLogger*> mLogger;
+	std::vector<LogRing_t*> mRing;
+
+	wMutex mFlushMutex;	// 刷盘（后台线程、Logd）互斥，保护以下刷盘快照
+	std::vector<LogRing_t*> mFlushRing;
+	std::vector<uint64_t> mFlushHead;	// 快照时ring写位置，之前的记录所属日志对象均在mFlushLogger中
+	std::vector<wLogger*> mFlushLogger;
+	std::vector<std::set<const wLogFormat*> > mDescribed;	// 日志对象当前文件中已写入的二进制格式描述符
+
+	pthread_t mThread;
+	wAtomic<bool> mRunning;
+	bool mStop;
+	wAtomic<int8_t> mPolicy;
+	uint64_t mPid;
+
+	LogContext_t() : mRunning(false), mStop(false), mPolicy(kLoggerDrop), mPid(::getpid()) { }
+};
+
+LogContext_t* Context();
+
+// 线程本地：环形缓冲 + 最近使用日志对象
+struct LogLocal_t {
+	LogRing_t* mRing;
+	std::string mPath;
+	uint32_t mId;
+	bool mBinary;	// mId是否为二进制日志对象
+	bool mBusy;		// 持有日志锁期间（含后台线程）产生的日志直接丢弃，避免重入死锁
+	LogRecord_t* mRecord;	// 未提交的二进制记录
+
+	LogLocal_t() : mRing(NULL), mId(kLogPad), mBinary(false), mBusy(false), mRecord(NULL) { }
+	~LogLocal_t() {
+		if (mRing != NULL) {
+			mRing->mRetired.ReleaseStore(true);
+		}
+	}
+};
+
+thread_local LogLocal_t tLocal;
+
+// ring中二进制记录：写入描述符指针、文件记录头，返回参数写入位置
+char* BinaryHead(char* p, const wLogFormat* format, uint64_t pid) {
+	memcpy(p, &format, sizeof(format));
+	p += sizeof(format);
+	coding::EncodeFixed8(p, kLogBinRecord);
+	coding::EncodeFixed64(p + kLogBinHeadLen, static_cast<uint64_t>(misc::GetTimeofday()));
+	coding::EncodeFixed32(p + kLogBinHeadLen + sizeof(uint64_t), static_cast<uint32_t>(pid));
+	coding::EncodeFixed32(p + kLogBinHeadLen + sizeof(uint64_t) + sizeof(uint32_t), format->mId);
+	return p + kLogBinRecordLen;
+}
+
+// 参数写入完成：回填文件记录长度、ring记录长度
+void BinaryEnd(LogRecord_t* r, char* end) {
+	char* record = reinterpret_cast<char*>(r + 1) + sizeof(const wLogFormat*);
+	coding::EncodeFixed32(record + sizeof(uint8_t), static_cast<uint32_t>(end - record));
+	r->mLen = static_cast<uint32_t>((end - reinterpret_cast<char*>(r) + 7) & ~7);
+}
+
+// 写入一条二进制记录，文件中首次出现的格式描述符先于记录写入。持mFlushMutex调用
+// ring中记录：LogRecord_t + wLogFormat* + 文件记录
+void AppendBinary(LogContext_t* ctx, const LogRecord_t* r) {
+	uint32_t id = r->mLogger & ~kLogBinary;
+	if (id >= ctx->mFlushLogger.size()) {
+		return;
+	}
+	const wLogFormat* format;
+	memcpy(&format, r + 1, sizeof(format));
+	const char* record = reinterpret_cast<const char*>(r + 1) + sizeof(format);
+	uint32_t len = coding::DecodeFixed32(record + sizeof(uint8_t));
+
+	wLogger* l = ctx->mFlushLogger[id];
+	std::set<const wLogFormat*>& described = ctx->mDescribed[id];
+	if (l->Fresh()) {
+		described.clear();
+	}
+	if (described.insert(format).second) {
+		// 描述符与记录一次写入，保证位于同一文件
+		size_t flen = strlen(format->mFile), slen = strlen(format->mFormat);
+		std::string buf(kLogBinHeadLen + sizeof(uint32_t) * 2 + sizeof(uint16_t), '\0');
+		char* p = &buf[0];
+		coding::EncodeFixed8(p, kLogBinFormat);
+		coding::EncodeFixed32(p + sizeof(uint8_t), static_cast<uint32_t>(buf.size() + flen + slen));
+		p += kLogBinHeadLen;
+		coding::EncodeFixed32(p, format->mId);
+		coding::EncodeFixed32(p + sizeof(uint32_t), format->mLine);
+		coding::EncodeFixed16(p + sizeof(uint32_t) * 2, static_cast<uint16_t>(flen));
+		buf.append(format->mFile, flen).append(format->mFormat, slen).append(record, len);
+		l->Append(buf.data(), buf.size());
+	} else {
+		l->Append(record, len);
+	}
+}
+
+// 取出ring中head之前的记录写入日志对象。持mFlushMutex调用
+bool DrainRing(LogContext_t* ctx, LogRing_t* ring, uint64_t head) {
+	uint64_t tail = ring->mTail.NoBarrierLoad();
+	bool drained = head != tail;
+	while (tail < head) {
+		const LogRecord_t* r = reinterpret_cast<const LogRecord_t*>(ring->mBuf + tail % kLoggerRingSize);
+		if (r->mLogger != kLogPad && (r->mLogger & kLogBinary)) {
+			AppendBinary(ctx, r);
+		} else if (r->mLogger != kLogPad && r->mLogger < ctx->mFlushLogger.size()) {
+			const char* text = reinterpret_cast<const char*>(r + 1);
+			ctx->mFlushLogger[r->mLogger]->Append(text, strnlen(text, r->mLen - sizeof(LogRecord_t)));
+		}
+		tail += r->mLen;
+	}
+	ring->mTail.ReleaseStore(tail);
+
+	// 日志对象不在快照中时，丢弃计数留待下次
+	uint32_t id = ring->mDropLogger.AcquireLoad();
+	uint64_t dropped = (id & ~kLogBinary) < ctx->mFlushLogger.size()? ring->mDropped.Exchange(0): 0;
+	if (dropped > 0) {
+		if (id & kLogBinary) {
+			union {
+				LogRecord_t mRecord;
+				char mBuf[sizeof(LogRecord_t) + sizeof(const wLogFormat*) + kLogBinRecordLen + 16];
+			} drop;
+			static const wLogFormat format(kLogDropFormat, __FILE__, __LINE__);
+			char* p = BinaryHead(reinterpret_cast<char*>(&drop.mRecord + 1), &format, ctx->mPid);
+			BinaryEnd(&drop.mRecord, wLogArg::Encode(p, drop.mBuf + sizeof(drop.mBuf), static_cast<unsigned long long>(dropped)));
+			drop.mRecord.mLogger = id;
+			AppendBinary(ctx, &drop.mRecord);
+		} else {
+			char buf[128];
+			int n = snprintf(buf, sizeof(buf) - 1, kLogDropFormat, static_cast<unsigned long long>(dropped));
+			buf[n++] = '\n';
+			ctx->mFlushLogger[id]->Append(buf, n);
+		}
+		drained = true;
+	}
+	return drained;
+}
+
+// 取出全部ring并刷盘，回收已退出线程的空ring。持mFlushMutex调用
+// mMutex内只复制ring、日志对象列表，写文件、滚动在锁外进行
+bool DrainAll(LogContext_t* ctx) {
+	ctx->mMutex.Lock();
+	ctx->mFlushRing = ctx->mRing;
+	ctx->mFlushLogger = ctx->mLogger;
+	ctx->mFlushHead.resize(ctx->mFlushRing.size());
+	for (size_t i = 0; i < ctx->mFlushRing.size(); i++) {
+		ctx->mFlushHead[i] = ctx->mFlushRing[i]->mHead.AcquireLoad();
+	}
+	ctx->mMutex.Unlock();
+
+	if (ctx->mDescribed.size() < ctx->mFlushLogger.size()) {
+		ctx->mDescribed.resize(ctx->mFlushLogger.size());
+	}
+	bool drained = false, retired = false;
+	for (size_t i = 0; i < ctx->mFlushRing.size(); i++) {
+		drained = DrainRing(ctx, ctx->mFlushRing[i], ctx->mFlushHead[i]) || drained;
+		retired = retired || ctx->mFlushRing[i]->mRetired.AcquireLoad();
+	}
+	if (drained) {
+		for (std::vector<wLogger*>::iterator it = ctx->mFlushLogger.begin(); it != ctx->mFlushLogger.end(); it++) {
+			(*it)->Flush();
+		}
+	}
+
+	if (retired) {
+		// 已退出线程的ring无生产者，取空后回收
+		ctx->mMutex.Lock();
+		for (std::vector<LogRing_t*>::iterator it = ctx->mRing.begin(); it != ctx->mRing.end(); ) {
+			if ((*it)->mRetired.AcquireLoad() && (*it)->mHead.AcquireLoad() == (*it)->mTail.NoBarrierLoad()) {
+				HNET_DELETE(*it);
+				it = ctx->mRing.erase(it);
 			} else {
-				p = limit - 1;
+				it++;
 			}
 		}
+		ctx->mMutex.Unlock();
+	}
+	ctx->mFlushRing.clear();
+	return drained;
+}
+
+void* FlushThread(void* arg) {
+	LogContext_t* ctx = reinterpret_cast<LogContext_t*>(arg);
+	tLocal.mBusy = true;
+	bool drained = true;
+	ctx->mMutex.Lock();
+	while (!ctx->mStop) {
+		if (!drained) {
+			// 空闲等待
+			struct timespec ts;
+			struct timeval tv;
+			misc::GetTimeofday(&tv);
+			uint64_t usec = static_cast<uint64_t>(tv.tv_usec) + kLoggerFlushUsec;
+			ts.tv_sec = tv.tv_sec + usec / 1000000;
+			ts.tv_nsec = (usec % 1000000) * 1000;
+			ctx->mCond.TimedWait(ctx->mMutex, &ts);
+		}
+		ctx->mMutex.Unlock();
+		ctx->mFlushMutex.Lock();
+		drained = DrainAll(ctx);
+		ctx->mFlushMutex.Unlock();
+		ctx->mMutex.Lock();
+	}
+	ctx->mMutex.Unlock();
+
+	wMutexWrapper lock(&ctx->mFlushMutex);
+	DrainAll(ctx);
+	return NULL;
+}
+
+// fork时保证后台线程不在刷盘中（日志对象状态完整、文件缓冲已刷盘）
+void AtforkPrepare() {
+	Context()->mFlushMutex.Lock();
+	Context()->mMutex.Lock();
+}
+
+void AtforkParent() {
+	Context()->mMutex.Unlock();
+	Context()->mFlushMutex.Unlock();
+}
+
+// 子进程：无后台线程，丢弃继承的未刷盘日志（由父进程写入），其他线程的ring已无生产者
+void AtforkChild() {
+	LogContext_t* ctx = Context();
+	for (std::vector<LogRing_t*>::iterator it = ctx->mRing.begin(); it != ctx->mRing.end(); it++) {
+		(*it)->mTail.ReleaseStore((*it)->mHead.NoBarrierLoad());
+		(*it)->mDropped.ReleaseStore(0);
+		if (*it != tLocal.mRing) {
+			(*it)->mRetired.ReleaseStore(true);
+		}
+	}
+	ctx->mRunning.ReleaseStore(false);
+	ctx->mStop = false;
+	ctx->mPid = ::getpid();
+	ctx->mMutex.Unlock();
+	ctx->mFlushMutex.Unlock();
+}
+
+void AtExit() {
+	Logd();
+}
+
+LogContext_t* Context() {
+	static LogContext_t* ctx = NULL;
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	struct Init {
+		static void Run() {
+			HNET_NEW(LogContext_t(), ctx);
+			pthread_atfork(&AtforkPrepare, &AtforkParent, &AtforkChild);
+			atexit(&AtExit);
+		}
+	};
+	pthread_once(&once, &Init::Run);
+	return ctx;
+}
 
-		// 结尾非\n
-		if (p == base || p[-1] != '\n') {
-			*p++ = '\n';
+// 启动后台线程。持锁调用
+void StartFlush(LogContext_t* ctx) {
+	if (!ctx->mRunning.NoBarrierLoad()) {
+		ctx->mStop = false;
+		// 后台线程屏蔽全部信号（继承创建时信号掩码），信号仍由进程原有线程处理
+		sigset_t all, old;
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+		int ret = pthread_create(&ctx->mThread, NULL, &FlushThread, ctx);
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		if (ret == 0) {
+			ctx->mRunning.ReleaseStore(true);
 		}
+	}
+}
+
+bool LoggerRegister(LogContext_t* ctx, const std::string& logpath);
+
+// 日志对象id、本线程ring。二进制日志对象写入logpath + kLoggerBinSuffix
+bool LoggerEntry(LogContext_t* ctx, const std::string& logpath, bool binary) {
+	if (tLocal.mRing != NULL && tLocal.mId != kLogPad && tLocal.mBinary == binary && tLocal.mPath == logpath && ctx->mRunning.AcquireLoad()) {
+		return true;
+	}
+
+	wMutexWrapper lock(&ctx->mMutex);
+	tLocal.mBusy = true;
+	bool ret = LoggerRegister(ctx, binary? logpath + kLoggerBinSuffix: logpath);
+	if (ret) {
+		tLocal.mPath = logpath;
+		tLocal.mBinary = binary;
+	} else {
+		tLocal.mId = kLogPad;
+	}
+	tLocal.mBusy = false;
+	return ret;
+}
 
-		assert(p <= limit);
-		fwrite(base, 1, p - base, mFile);
-		if (!kFFlushPerLog) {
-			fflush(mFile);
+// 在本线程ring中预留一条最大长度记录，缓冲满时按策略丢弃（返回NULL）或等待
+LogRecord_t* Reserve(LogContext_t* ctx) {
+	LogRing_t* ring = tLocal.mRing;
+	uint64_t head = ring->mHead.NoBarrierLoad();
+	while (true) {
+		uint64_t used = head - ring->mTail.AcquireLoad();
+		size_t offset = head % kLoggerRingSize;
+		size_t contig = kLoggerRingSize - offset;
+		if (contig < kLogRecordSize && kLoggerRingSize - used >= contig) {
+			// 尾部空间不足一条记录，填充后回绕
+			LogRecord_t* r = reinterpret_cast<LogRecord_t*>(ring->mBuf + offset);
+			r->mLen = static_cast<uint32_t>(contig);
+			r->mLogger = kLogPad;
+			head += contig;
+			ring->mHead.ReleaseStore(head);
+			continue;
+		} else if (contig >= kLogRecordSize && kLoggerRingSize - used >= kLogRecordSize) {
+			return reinterpret_cast<LogRecord_t*>(ring->mBuf + offset);
 		}
 
-		// 如果是new申请的缓冲地址，则它不会等于buffer的栈地址
-		if (base != buffer) {
-			HNET_DELETE_VEC(base);
+		// 缓冲满
+		if (ctx->mPolicy.NoBarrierLoad() == kLoggerDrop) {
+			ring->mDropLogger.ReleaseStore(tLocal.mBinary? tLocal.mId | kLogBinary: tLocal.mId);
+			ring->mDropped.FetchAdd(1);
+			return NULL;
 		}
-		break;
+		ctx->mCond.Signal();
+		usleep(100);
 	}
 }
 
-// 日志对象
-static std::map<std::string, wLogger*> gLogger;
-static wLogger* LoggerEntry(const std::string& logpath) {
-	std::map<std::string, wLogger*>::iterator it = gLogger.find(logpath);
-	if (it == gLogger.end()) {
+// 注册本线程ring、日志对象。持锁调用
+bool LoggerRegister(LogContext_t* ctx, const std::string& logpath) {
+	if (tLocal.mRing == NULL) {
+		HNET_NEW(LogRing_t(), tLocal.mRing);
+		if (tLocal.mRing == NULL) {
+			return false;
+		}
+		ctx->mRing.push_back(tLocal.mRing);
+	}
+	std::map<std::string, uint32_t>::iterator it = ctx->mLoggerId.find(logpath);
+	if (it == ctx->mLoggerId.end()) {
 		wLogger* l = NULL;
-		if (wEnv::Default()->NewLogger(logpath, &l) == 0) {
-			gLogger.insert(std::pair<std::string, wLogger*>(logpath, l));
-			return l;
+		if (wEnv::Default()->NewLogger(logpath, &l) != 0) {
+			return false;
 		}
-	} else {
-		return it->second;
+		ctx->mLogger.push_back(l);
+		it = ctx->mLoggerId.insert(std::make_pair(logpath, static_cast<uint32_t>(ctx->mLogger.size() - 1))).first;
 	}
-	return NULL;
+	tLocal.mId = it->second;
+	StartFlush(ctx);
+	return ctx->mRunning.NoBarrierLoad();
+}
+
+}	// namespace anonymous
+
+volatile int8_t hnet_loglevel = kLogDebug;
+
+void SetLogLevel(int8_t level) {
+	hnet_loglevel = level;
 }
-static void LoggerFree() {
-	for (std::map<std::string, wLogger*>::iterator it = gLogger.begin(); it != gLogger.end(); it++) {
-		HNET_DELETE(it->second);
+
+bool wLogLimit::Allow(uint64_t* suppressed) {
+	int64_t now = misc::GetTimeofday();
+	int64_t start = mStart.AcquireLoad();
+	if (now - start >= kLoggerLimitUsec && mStart.CompareExchangeStrong(start, now)) {
+		// 新周期
+		mCount.ReleaseStore(0);
+	}
+	if (mCount.FetchAdd(1) < kLoggerLimitNum) {
+		*suppressed = mSuppressed.Exchange(0);
+		return true;
 	}
-	gLogger.clear();
+	mSuppressed.FetchAdd(1);
+	return false;
 }
 
 // 写日志函数接口
-static wMutex hnet_logger_mutex;
 void Logv(const std::string& logpath, const char* format, ...) {
-	hnet_logger_mutex.Lock();
-	wLogger* l = LoggerEntry(logpath);
-	if (l != NULL) {
-		va_list ap;
-		va_start(ap, format);
-		l->Logv(format, ap);
-		va_end(ap);
+	if (tLocal.mBusy) {
+		return;
+	}
+	LogContext_t* ctx = Context();
+	if (ctx == NULL || !LoggerEntry(ctx, logpath, false)) {
+		return;
+	}
+
+	LogRecord_t* r = Reserve(ctx);
+	if (r == NULL) {
+		return;
+	}
+	va_list ap;
+	va_start(ap, format);
+	size_t len = wLogger::Format(reinterpret_cast<char*>(r + 1), kLoggerLineSize, ctx->mPid, format, ap);
+	va_end(ap);
+	if (len < kLoggerLineSize) {
+		reinterpret_cast<char*>(r + 1)[len] = '\0';
+	}
+	r->mLen = static_cast<uint32_t>((sizeof(LogRecord_t) + len + 1 + 7) & ~7);
+	r->mLogger = tLocal.mId;
+	tLocal.mRing->mHead.ReleaseStore(tLocal.mRing->mHead.NoBarrierLoad() + r->mLen);
+}
+
+wLogFormat::wLogFormat(const char* format, const char* file, uint32_t line) : mFormat(format), mFile(file), mLine(line) {
+	mId = misc::Hash(format, strlen(format), misc::Hash(file, strlen(file), line));
+}
+
+char* LogbBegin(const std::string& logpath, const wLogFormat& format, char** limit) {
+	if (tLocal.mBusy) {
+		return NULL;
+	}
+	LogContext_t* ctx = Context();
+	if (ctx == NULL || !LoggerEntry(ctx, logpath, true)) {
+		return NULL;
+	}
+
+	LogRecord_t* r = Reserve(ctx);
+	if (r == NULL) {
+		return NULL;
+	}
+	char* p = BinaryHead(reinterpret_cast<char*>(r + 1), &format, ctx->mPid);
+	r->mLogger = tLocal.mId | kLogBinary;
+	tLocal.mRecord = r;
+	*limit = reinterpret_cast<char*>(r + 1) + kLoggerLineSize;
+	return p;
+}
+
+void LogbEnd(char* end) {
+	LogRecord_t* r = tLocal.mRecord;
+	BinaryEnd(r, end);
+	tLocal.mRecord = NULL;
+	tLocal.mRing->mHead.ReleaseStore(tLocal.mRing->mHead.NoBarrierLoad() + r->mLen);
+}
+
+void SetLogPolicy(int8_t policy) {
+	LogContext_t* ctx = Context();
+	if (ctx != NULL) {
+		ctx->mPolicy.ReleaseStore(policy);
 	}
-	hnet_logger_mutex.Unlock();
 }
+
 void Logd() {
-	hnet_logger_mutex.Lock();
-	LoggerFree();
-	hnet_logger_mutex.Unlock();
+	LogContext_t* ctx = Context();
+	if (ctx == NULL) {
+		return;
+	}
+	ctx->mMutex.Lock();
+	bool running = ctx->mRunning.NoBarrierLoad();
+	ctx->mStop = true;
+	ctx->mCond.Signal();
+	ctx->mMutex.Unlock();
+	if (running) {
+		pthread_join(ctx->mThread, NULL);
+		ctx->mRunning.ReleaseStore(false);
+	}
+
+	// 释放日志对象，之后Logv将重新创建
+	wMutexWrapper flush(&ctx->mFlushMutex);
+	tLocal.mBusy = true;
+	DrainAll(ctx);
+	wMutexWrapper lock(&ctx->mMutex);
+	for (std::vector<wLogger*>::iterator it = ctx->mLogger.begin(); it != ctx->mLogger.end(); it++) {
+		HNET_DELETE(*it);
+	}
+	ctx->mLogger.clear();
+	ctx->mLoggerId.clear();
+	ctx->mFlushLogger.clear();
+	ctx->mDescribed.clear();
+	tLocal.mId = kLogPad;
+	tLocal.mBusy = false;
+}
+
+ssize_t wLogDecoder::Decode(const char* buf, size_t len, std::string* out) {
+	size_t pos = 0;
+	while (len - pos >= kLogBinHeadLen) {
+		const char* p = buf + pos;
+		uint8_t type = coding::DecodeFixed8(p);
+		uint32_t size = coding::DecodeFixed32(p + sizeof(uint8_t));
+		if (size < kLogBinHeadLen) {
+			return -1;
+		} else if (len - pos < size) {
+			break;
+		}
+
+		const char* end = p + size;
+		p += kLogBinHeadLen;
+		if (type == kLogBinFormat) {
+			if (size < kLogBinHeadLen + sizeof(uint32_t) * 2 + sizeof(uint16_t)) {
+				return -1;
+			}
+			uint32_t id = coding::DecodeFixed32(p);
+			uint16_t flen = coding::DecodeFixed16(p + sizeof(uint32_t) * 2);
+			p += sizeof(uint32_t) * 2 + sizeof(uint16_t) + flen;
+			if (p > end) {
+				return -1;
+			}
+			mFormat[id].assign(p, end - p);
+		} else if (type == kLogBinRecord) {
+			if (size < kLogBinRecordLen) {
+				return -1;
+			}
+			int64_t usec = static_cast<int64_t>(coding::DecodeFixed64(p));
+			uint32_t pid = coding::DecodeFixed32(p + sizeof(uint64_t));
+			uint32_t id = coding::DecodeFixed32(p + sizeof(uint64_t) + sizeof(uint32_t));
+			p += kLogBinRecordLen - kLogBinHeadLen;
+
+			char head[128];
+			out->append(head, wLogger::FormatHead(head, sizeof(head), pid, usec));
+			std::map<uint32_t, std::string>::iterator it = mFormat.find(id);
+			if (it != mFormat.end()) {
+				Print(it->second, p, end, out);
+			} else {
+				char unknown[64];
+				out->append(unknown, snprintf(unknown, sizeof(unknown), "[hnet logger] unknown log format %u", id));
+			}
+			if (out->empty() || (*out)[out->size() - 1] != '\n') {
+				out->push_back('\n');
+			}
+		} else {
+			return -1;
+		}
+		pos += size;
+	}
+	return pos;
+}
+
+void wLogDecoder::Print(const std::string& format, const char* arg, const char* end, std::string* out) {
+	char buf[kLoggerLineSize];
+	std::string spec;
+	for (size_t i = 0; i < format.size(); i++) {
+		if (format[i] != '%') {
+			out->push_back(format[i]);
+			continue;
+		} else if (i + 1 < format.size() && format[i + 1] == '%') {
+			out->push_back('%');
+			i++;
+			continue;
+		}
+
+		// 转换说明：%[flags][width][.precision][length]conversion，去掉length后按参数类型重新组装
+		size_t start = i++;
+		spec.assign("%");
+		while (i < format.size() && strchr("-+ #0", format[i]) != NULL) {
+			spec.push_back(format[i++]);
+		}
+		while (i < format.size() && (isdigit(format[i]) || format[i] == '.' || format[i] == '*')) {
+			if (format[i] == '*') {
+				// 宽度、精度参数
+				int64_t v = 0;
+				if (end - arg >= static_cast<ptrdiff_t>(sizeof(uint8_t) + sizeof(uint64_t)) && coding::DecodeFixed8(arg) != kLogArgStr) {
+					v = static_cast<int64_t>(coding::DecodeFixed64(arg + sizeof(uint8_t)));
+					arg += sizeof(uint8_t) + sizeof(uint64_t);
+				}
+				logging::AppendNumberTo(&spec, static_cast<uint64_t>(v < 0? 0: v));
+				i++;
+			} else {
+				spec.push_back(format[i++]);
+			}
+		}
+		while (i < format.size() && strchr("hlLqjzt", format[i]) != NULL) {
+			i++;
+		}
+		if (i >= format.size()) {
+			out->append(format, start, std::string::npos);
+			break;
+		}
+
+		char conv = format[i];
+		if (end - arg < static_cast<ptrdiff_t>(sizeof(uint8_t))) {
+			// 参数缺失（记录截断）
+			out->append(format, start, i - start + 1);
+			continue;
+		}
+		uint8_t type = coding::DecodeFixed8(arg);
+		const char* value = arg + sizeof(uint8_t);
+		int n = 0;
+		if (type == kLogArgStr) {
+			uint32_t len = end - value >= static_cast<ptrdiff_t>(sizeof(uint32_t))? coding::DecodeFixed32(value): 0;
+			len = std::min(len, static_cast<uint32_t>(std::max(end - value - static_cast<ptrdiff_t>(sizeof(uint32_t)), static_cast<ptrdiff_t>(0))));
+			std::string str(value + sizeof(uint32_t), len);
+			arg = value + sizeof(uint32_t) + len;
+			spec.push_back('s');
+			n = snprintf(buf, sizeof(buf), spec.c_str(), str.c_str());
+		} else {
+			if (end - value < static_cast<ptrdiff_t>(sizeof(uint64_t))) {
+				out->append(format, start, i - start + 1);
+				arg = end;
+				continue;
+			}
+			uint64_t v = coding::DecodeFixed64(value);
+			arg = value + sizeof(uint64_t);
+			double d;
+			memcpy(&d, &v, sizeof(d));
+			if (strchr("di", conv) != NULL) {
+				spec.append("ll").push_back(conv);
+				n = snprintf(buf, sizeof(buf), spec.c_str(), type == kLogArgDouble? static_cast<long long>(d): static_cast<long long>(v));
+			} else if (strchr("uoxX", conv) != NULL) {
+				spec.append("ll").push_back(conv);
+				n = snprintf(buf, sizeof(buf), spec.c_str(), type == kLogArgDouble? static_cast<unsigned long long>(d): static_cast<unsigned long long>(v));
+			} else if (strchr("eEfFgGaA", conv) != NULL) {
+				spec.push_back(conv);
+				n = snprintf(buf, sizeof(buf), spec.c_str(), type == kLogArgDouble? d: static_cast<double>(static_cast<int64_t>(v)));
+			} else if (conv == 'c') {
+				spec.push_back(conv);
+				n = snprintf(buf, sizeof(buf), spec.c_str(), static_cast<int>(v));
+			} else if (conv == 'p') {
+				spec.push_back(conv);
+				n = snprintf(buf, sizeof(buf), spec.c_str(), reinterpret_cast<void*>(static_cast<uintptr_t>(v)));
+			} else {
+				// 不支持的转换（含%n），原样输出
+				out->append(format, start, i - start + 1);
+				continue;
+			}
+		}
+		if (n > 0) {
+			out->append(buf, std::min(static_cast<size_t>(n), sizeof(buf) - 1));
+		}
+	}
 }
 
 }	// namespace hnet
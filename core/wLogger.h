@@ -8,20 +8,65 @@
 #define _W_LOGGER_H_
 
 #include <map>
+#include <algorithm>
 #include <cstdarg>
+#include <type_traits>
 #include "wCore.h"
 #include "wNoncopyable.h"
+#include "wAtomic.h"
+#include "wMisc.h"
 
 #ifdef _USE_LOGGER_
-#	define  HNET_ERROR(logpath, fmt, ...) hnet::Logv(logpath, fmt, ##__VA_ARGS__)
+// 二进制日志：调用点静态注册格式描述符，每条记录只保存时间戳、描述符id、原始参数
+#	ifdef _USE_BINLOG_
+#		define  HNET_LOGV(logpath, fmt, ...) \
+		do { \
+			static const hnet::wLogFormat hnet_logformat(fmt, __FILE__, __LINE__); \
+			hnet::Logb(logpath, hnet_logformat, ##__VA_ARGS__); \
+		} while (0)
+#	else
+#		define  HNET_LOGV(logpath, fmt, ...) hnet::Logv(logpath, fmt, ##__VA_ARGS__)
+#	endif
+// 级别判断在格式化之前
+#	define  HNET_LOG(level, logpath, fmt, ...) \
+	do { \
+		if (hnet::hnet_loglevel <= (level)) { \
+			HNET_LOGV(logpath, fmt, ##__VA_ARGS__); \
+		} \
+	} while (0)
+// 限流版本：每调用点每kLoggerLimitUsec最多kLoggerLimitNum条，被抑制条数附加在下一条输出中
+#	define  HNET_LOG_LIMIT(level, logpath, fmt, ...) \
+	do { \
+		static hnet::wLogLimit hnet_loglimit; \
+		uint64_t hnet_logsuppressed = 0; \
+		if (hnet::hnet_loglevel <= (level) && hnet_loglimit.Allow(&hnet_logsuppressed)) { \
+			if (hnet_logsuppressed > 0) { \
+				HNET_LOGV(logpath, fmt " [suppressed %llu]", ##__VA_ARGS__, static_cast<unsigned long long>(hnet_logsuppressed)); \
+			} else { \
+				HNET_LOGV(logpath, fmt, ##__VA_ARGS__); \
+			} \
+		} \
+	} while (0)
+#	define  HNET_ERROR(logpath, fmt, ...) HNET_LOG(hnet::kLogError, logpath, fmt, ##__VA_ARGS__)
+#	define  HNET_ERROR_LIMIT(logpath, fmt, ...) HNET_LOG_LIMIT(hnet::kLogError, logpath, fmt, ##__VA_ARGS__)
+#	define  HNET_WARN(logpath, fmt, ...) HNET_LOG(hnet::kLogWarn, logpath, fmt, ##__VA_ARGS__)
+#	define  HNET_WARN_LIMIT(logpath, fmt, ...) HNET_LOG_LIMIT(hnet::kLogWarn, logpath, fmt, ##__VA_ARGS__)
+#	define  HNET_INFO(logpath, fmt, ...) HNET_LOG(hnet::kLogInfo, logpath, fmt, ##__VA_ARGS__)
 #	ifndef _DEBUG_
 #		define  HNET_DEBUG(logpath, fmt, ...)
+#		define  HNET_DEBUG_LIMIT(logpath, fmt, ...)
 #	else
-#		define  HNET_DEBUG(logpath, fmt, ...) hnet::Logv(logpath, fmt, ##__VA_ARGS__)
+#		define  HNET_DEBUG(logpath, fmt, ...) HNET_LOG(hnet::kLogDebug, logpath, fmt, ##__VA_ARGS__)
+#		define  HNET_DEBUG_LIMIT(logpath, fmt, ...) HNET_LOG_LIMIT(hnet::kLogDebug, logpath, fmt, ##__VA_ARGS__)
 #	endif
 #else
 #	define  HNET_ERROR(logpath, fmt, ...)
+#	define  HNET_ERROR_LIMIT(logpath, fmt, ...)
+#	define  HNET_WARN(logpath, fmt, ...)
+#	define  HNET_WARN_LIMIT(logpath, fmt, ...)
+#	define  HNET_INFO(logpath, fmt, ...)
 #	define  HNET_DEBUG(logpath, fmt, ...)
+#	define  HNET_DEBUG_LIMIT(logpath, fmt, ...)
 #endif
 
 namespace hnet {
@@ -35,6 +80,21 @@ public:
 
     // 写一条指定格式的日志到文件中
     virtual void Logv(const char* format, va_list ap) = 0;
+
+    // 写入已格式化的日志（异步日志后台线程调用）
+    virtual void Append(const char* buf, size_t len) = 0;
+
+    // 刷新文件缓冲
+    virtual void Flush() = 0;
+
+    // 下一次写入是否位于新文件开头（首次打开或即将归档）
+    virtual bool Fresh() const = 0;
+
+    // 格式化一条日志至buf：时间 [pid] 内容\n，超长截断。返回写入长度
+    static size_t Format(char buf[], size_t size, uint64_t pid, const char* format, va_list ap);
+
+    // 格式化日志头：时间 [pid] ，usec为unix微秒时间。返回写入长度
+    static size_t FormatHead(char buf[], size_t size, uint64_t pid, int64_t usec);
 };
 
 // 实现类
@@ -44,12 +104,24 @@ public:
 	wPosixLogger(const std::string& fname, uint64_t (*getpid)(), off_t maxsize = kMaxLoggerSize);
 
 	virtual ~wPosixLogger() {
+		Flush();
 		CloseLog(mFile);
 	}
 
 	// 写日志。最大3000字节，多的截断
 	virtual void Logv(const char* format, va_list ap);
 
+	// 文件大小在内存中累计，超过mMaxsize时归档，不再每条stat
+	// 记录追加至本对象缓冲（不经stdio），超过kLoggerWriteSize时写入
+	virtual void Append(const char* buf, size_t len);
+
+	// 缓冲中整批记录一次write（O_APPEND），master、worker共用日志文件时记录不交错
+	virtual void Flush();
+
+	virtual bool Fresh() const {
+		return mSize == 0 || mSize >= mMaxsize;
+	}
+
 private:
 	void ArchiveLog();
 
@@ -62,17 +134,168 @@ private:
 	}
 
 	FILE* mFile;
+	std::string mBuffer;	// 未写入记录（仅含完整记录）
 	std::string mFname;
 	off_t mMaxsize;
+	off_t mSize;	// 当前文件大小
 	uint64_t (*mGetpid)();	// 获取当前进程id函数指针
 };
 
+// 当前日志级别
+extern volatile int8_t hnet_loglevel;
+
+// 设置日志级别 kLogDebug|kLogInfo|kLogWarn|kLogError|kLogOff（worker进程可经channel由master调整，见wMaster::LogLevelWorker）
+void SetLogLevel(int8_t level);
+
+// 日志限流计数（每调用点一个静态对象）
+class wLogLimit : private wNoncopyable {
+public:
+	wLogLimit() : mStart(0), mCount(0), mSuppressed(0) { }
+
+	// 是否输出。输出时suppressed返回此前被抑制的条数
+	bool Allow(uint64_t* suppressed);
+
+private:
+	wAtomic<int64_t> mStart;	// 当前周期开始时间
+	wAtomic<uint32_t> mCount;	// 当前周期已输出条数
+	wAtomic<uint64_t> mSuppressed;
+};
+
 // 写log接口
+// 异步实现：调用线程将日志格式化至本线程无锁环形缓冲，后台线程批量写盘、按大小归档。fork后子进程自动重启后台线程
 void Logv(const std::string& logpath, const char* format, ...);
 
-// 释放log接口
+// 设置缓冲满时策略 kLoggerDrop|kLoggerBlock，默认kLoggerDrop
+void SetLogPolicy(int8_t policy);
+
+// 刷盘并释放log接口（进程正常退出时自动调用）
 void Logd();
 
+// 二进制日志文件格式（小端），由记录顺序组成：
+// 记录头：uint8 类型 + uint32 记录总长度（含头）
+// kLogBinFormat：uint32 描述符id + uint32 行号 + uint16 源文件名长度 + 源文件名 + 格式串。每个文件中描述符先于引用它的日志记录出现
+// kLogBinRecord：uint64 unix微秒时间 + uint32 pid + uint32 描述符id + 参数（uint8 类型 + 值）...
+const uint8_t	kLogBinFormat = 1;
+const uint8_t	kLogBinRecord = 2;
+const size_t	kLogBinHeadLen = sizeof(uint8_t) + sizeof(uint32_t);
+const size_t	kLogBinRecordLen = kLogBinHeadLen + sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t);
+
+// 参数类型：整型、浮点均以8字节保存，字符串为uint32 长度 + 内容
+const uint8_t	kLogArgInt = 1;
+const uint8_t	kLogArgUint = 2;
+const uint8_t	kLogArgDouble = 3;
+const uint8_t	kLogArgStr = 4;
+const uint8_t	kLogArgPtr = 5;
+
+// 二进制日志格式描述符（每调用点一个静态对象），id由格式串、源文件、行号哈希得到，跨进程稳定
+struct wLogFormat {
+	const char* mFormat;
+	const char* mFile;
+	uint32_t mLine;
+	uint32_t mId;
+
+	wLogFormat(const char* format, const char* file, uint32_t line);
+};
+
+// 二进制日志参数编码。超出缓冲的参数被截断（字符串）或丢弃
+class wLogArg {
+public:
+	static inline char* Encode(char* p, const char* limit) {
+		return p;
+	}
+
+	template<typename T, typename... Args>
+	static inline char* Encode(char* p, const char* limit, T v, Args... args) {
+		return Encode(Put(p, limit, v), limit, args...);
+	}
+
+private:
+	static inline char* Fixed(char* p, const char* limit, uint8_t type, uint64_t v) {
+		if (limit - p < static_cast<ptrdiff_t>(sizeof(uint8_t) + sizeof(uint64_t))) {
+			return p;
+		}
+		coding::EncodeFixed8(p, type);
+		coding::EncodeFixed64(p + sizeof(uint8_t), v);
+		return p + sizeof(uint8_t) + sizeof(uint64_t);
+	}
+
+	static inline char* Str(char* p, const char* limit, const char* s, size_t len) {
+		if (limit - p < static_cast<ptrdiff_t>(sizeof(uint8_t) + sizeof(uint32_t))) {
+			return p;
+		}
+		len = std::min(len, static_cast<size_t>(limit - p - sizeof(uint8_t) - sizeof(uint32_t)));
+		coding::EncodeFixed8(p, kLogArgStr);
+		coding::EncodeFixed32(p + sizeof(uint8_t), static_cast<uint32_t>(len));
+		memcpy(p + sizeof(uint8_t) + sizeof(uint32_t), s, len);
+		return p + sizeof(uint8_t) + sizeof(uint32_t) + len;
+	}
+
+	template<typename T>
+	static inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, char*>::type Put(char* p, const char* limit, T v) {
+		return Fixed(p, limit, kLogArgInt, static_cast<uint64_t>(static_cast<int64_t>(v)));
+	}
+
+	template<typename T>
+	static inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, char*>::type Put(char* p, const char* limit, T v) {
+		return Fixed(p, limit, kLogArgUint, static_cast<uint64_t>(v));
+	}
+
+	template<typename T>
+	static inline typename std::enable_if<std::is_enum<T>::value, char*>::type Put(char* p, const char* limit, T v) {
+		return Fixed(p, limit, kLogArgInt, static_cast<uint64_t>(static_cast<int64_t>(v)));
+	}
+
+	static inline char* Put(char* p, const char* limit, double v) {
+		uint64_t u;
+		memcpy(&u, &v, sizeof(u));
+		return Fixed(p, limit, kLogArgDouble, u);
+	}
+
+	static inline char* Put(char* p, const char* limit, const char* v) {
+		return v != NULL? Str(p, limit, v, strlen(v)): Str(p, limit, "(null)", 6);
+	}
+
+	static inline char* Put(char* p, const char* limit, char* v) {
+		return Put(p, limit, const_cast<const char*>(v));
+	}
+
+	static inline char* Put(char* p, const char* limit, const std::string& v) {
+		return Str(p, limit, v.data(), v.size());
+	}
+
+	template<typename T>
+	static inline char* Put(char* p, const char* limit, T* v) {
+		return Fixed(p, limit, kLogArgPtr, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(v)));
+	}
+};
+
+// 二进制日志写入：LogbBegin在本线程缓冲中预留一条记录，返回参数写入位置（limit为上限），失败返回NULL；LogbEnd提交
+char* LogbBegin(const std::string& logpath, const wLogFormat& format, char** limit);
+void LogbEnd(char* end);
+
+// 写二进制日志接口，写入logpath + kLoggerBinSuffix文件。格式化推迟到离线解码（example/logdecode）
+template<typename... Args>
+void Logb(const std::string& logpath, const wLogFormat& format, Args... args) {
+	char* limit;
+	char* p = LogbBegin(logpath, format, &limit);
+	if (p != NULL) {
+		LogbEnd(wLogArg::Encode(p, limit, args...));
+	}
+}
+
+// 二进制日志解码
+class wLogDecoder : private wNoncopyable {
+public:
+	// 解码buf中的完整记录，文本（与Logv格式一致）追加至out。返回消费字节数（尾部不完整记录留待下次），格式错误返回-1
+	ssize_t Decode(const char* buf, size_t len, std::string* out);
+
+private:
+	// 按格式串printf参数，追加至out
+	void Print(const std::string& format, const char* arg, const char* end, std::string* out);
+
+	std::map<uint32_t, std::string> mFormat;	// 描述符id -> 格式串
+};
+
 }	// namespace hnet
 
 #endif
@@ -12,12 +12,13 @@
 #include "wSigSet.h"
 #include "wSignal.h"
 #include "wWorker.h"
+#include "wShm.h"
 #include "wTask.h"
 #include "wChannelCmd.h"
 
 namespace hnet {
 
-wMaster::wMaster(const std::string& title, wServer* server) : mPid(getpid()), mTitle(title), mSlot(kMaxProcess), mDelay(0), mSigio(0),
+wMaster::wMaster(const std::string& title, wServer* server) : mPid(getpid()), mTitle(title), mSlot(kMaxProcess), mSlotMax(0), mChannelShm(NULL), mDelay(0), mSigio(0),
 mLive(1), mServer(server), mWorker(NULL), mEnv(wEnv::Default()) {
 	assert(mServer != NULL);
 	mPidPath = soft::GetPidPath();
@@ -31,6 +32,7 @@ wMaster::~wMaster() {
     for (uint32_t i = 0; i < kMaxProcess; ++i) {
 		HNET_DELETE(mWorkerPool[i]);
     }
+    HNET_DELETE(mChannelShm);
 }
 
 int wMaster::PrepareStart() {
@@ -160,6 +162,17 @@ int wMaster::MasterStart() {
 		}
 	}
 
+	// 各worker消息环（memfd稀疏分配，未使用的环不占内存）。创建失败时进程间消息均经channel socket发送
+	HNET_NEW(wMemShm("hnet-channel", misc::Align(sizeof(struct Shmhead_t), 64) + kMaxProcess * wMpscRing::Space(kChannelRingSize)), mChannelShm);
+	if (mChannelShm && mChannelShm->CreateShm() == 0) {
+		for (uint32_t i = 0; i < kMaxProcess; i++) {
+			mWorkerPool[i]->Ring()->Init(mChannelShm->AllocShm(wMpscRing::Space(kChannelRingSize)), kChannelRingSize);
+		}
+	} else {
+		HNET_WARN(soft::GetLogPath(), "%s : %s", "wMaster::MasterStart CreateShm() failed", "channel ring disabled");
+		HNET_DELETE(mChannelShm);
+	}
+
     // 启动worker工作进程
     ret = WorkerStart(mWorkerNum, kProcessRespawn);
     if (ret == -1) {
@@ -197,6 +210,7 @@ int wMaster::WorkerStart(uint32_t n, int32_t type) {
 		open.set_slot(mSlot);
 		open.set_pid(mWorkerPool[mSlot]->mPid);
 		open.set_fd(mWorkerPool[mSlot]->ChannelFD(0));
+		open.set_event(mWorkerPool[mSlot]->Channel()->Event());
         std::vector<uint32_t> blackslot(1, mSlot);
         mServer->SyncWorker(reinterpret_cast<char*>(&open), sizeof(open), kMaxProcess, &blackslot);
 	}
@@ -234,6 +248,10 @@ int wMaster::SpawnWorker(int64_t type) {
 
 	mWorker->Channel()->SS() = kSsConnected;
 
+	// 清空该槽位消息环（退出worker遗留消息丢弃，同channel关闭）
+	mWorker->Ring()->Reset();
+	mSlotMax = std::max(mSlotMax, mSlot + 1);
+
     pid_t pid = fork();
     switch (pid) {
     case -1:
@@ -457,6 +475,7 @@ int wMaster::ReapChildren() {
 				open.set_slot(i);
 				open.set_pid(mWorkerPool[i]->mPid);
 				open.set_fd(mWorkerPool[i]->ChannelFD(0));
+				open.set_event(mWorkerPool[i]->Channel()->Event());
 				std::vector<uint32_t> blackslot(1, i);
 				mServer->SyncWorker(reinterpret_cast<char*>(&open), sizeof(open), kMaxProcess, &blackslot);
 				mLive = 1;
@@ -525,6 +544,21 @@ void wMaster::SignalWorker(int signo) {
     }
 }
 
+int wMaster::LogLevelWorker(int8_t level, uint32_t slot) {
+	if (level < kLogDebug || level > kLogOff) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::LogLevelWorker () failed", "level invalid");
+		return -1;
+	}
+	wChannelReqLogLevel_t loglevel;
+	loglevel.set_pid(mPid);
+	loglevel.set_level(level);
+	if (mServer->SyncWorker(reinterpret_cast<char*>(&loglevel), sizeof(loglevel), slot) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::LogLevelWorker SyncWorker() failed", "");
+		return -1;
+	}
+	return 0;
+}
+
 int wMaster::CreatePidFile() {
 	std::string pidstr = logging::NumberToString(mPid);
 	return WriteStringToFile(mEnv, pidstr, mPidPath);
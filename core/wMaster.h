@@ -20,6 +20,7 @@ const char  kMasterTitle[] = " - master process";
 
 class wServer;
 class wWorker;
+class wMemShm;
 
 class wMaster : private wNoncopyable {
 public:
@@ -38,6 +39,9 @@ public:
     // 发送命令行信号
     int SignalProcess(const std::string& signal);
 
+    // 调整worker进程日志级别（经channel下发，slot为kMaxProcess时所有worker）
+    int LogLevelWorker(int8_t level, uint32_t slot = kMaxProcess);
+
     // 修改pid文件名（默认hnet.pid）
     // 修改启动worker个数（默认cpu个数）
     // 修改自定义信号处理（默认定义在wSignal.cpp文件中）
@@ -56,6 +60,7 @@ public:
     virtual void ProcessExit();
 
     inline uint32_t& WorkerNum() { return mWorkerNum;}
+    inline uint32_t& SlotMax() { return mSlotMax;}
     inline pid_t& Pid() { return mPid;}
     inline std::string& Title() { return mTitle;}
 
@@ -106,8 +111,12 @@ protected:
     // 进程表
     uint32_t mSlot;
     uint32_t mWorkerNum;
+    uint32_t mSlotMax;	// 已启动worker最大索引+1（广播仅遍历至此）
     wWorker* mWorkerPool[kMaxProcess];
 
+    // 各worker消息环所在共享内存（fork前创建，worker继承映射）
+    wMemShm* mChannelShm;
+
     int32_t mDelay;
     int32_t mSigio;
     int32_t mLive;
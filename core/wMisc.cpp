@@ -67,6 +67,73 @@ void PutFixed64(std::string* dst, uint64_t value) {
     dst->append(buf, sizeof(buf));
 }
 
+std::string Base64Encode(const wSlice& src) {
+    static const char kTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(src.data());
+    size_t n = src.size();
+    std::string dst;
+    dst.reserve((n + 2) / 3 * 4);
+    for (; n >= 3; n -= 3, p += 3) {
+        uint32_t v = (p[0] << 16) | (p[1] << 8) | p[2];
+        dst += kTable[v >> 18];
+        dst += kTable[(v >> 12) & 0x3f];
+        dst += kTable[(v >> 6) & 0x3f];
+        dst += kTable[v & 0x3f];
+    }
+    if (n > 0) {
+        uint32_t v = (p[0] << 16) | (n == 2? p[1] << 8: 0);
+        dst += kTable[v >> 18];
+        dst += kTable[(v >> 12) & 0x3f];
+        dst += n == 2? kTable[(v >> 6) & 0x3f]: '=';
+        dst += '=';
+    }
+    return dst;
+}
+
+bool Base64Decode(const wSlice& src, std::string* dst) {
+    size_t n = src.size();
+    while (n > 0 && src[n - 1] == '=') {
+        n--;
+    }
+    if (n % 4 == 1 || src.size() - n > 2) {
+        return false;
+    }
+    dst->clear();
+    dst->reserve(n * 3 / 4);
+    uint32_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        char c = src[i];
+        uint32_t d;
+        if (c >= 'A' && c <= 'Z') {
+            d = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            d = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            d = c - '0' + 52;
+        } else if (c == '+' || c == '-') {
+            d = 62;
+        } else if (c == '/' || c == '_') {
+            d = 63;
+        } else {
+            return false;
+        }
+        v = (v << 6) | d;
+        if ((i & 3) == 3) {
+            *dst += static_cast<char>(v >> 16);
+            *dst += static_cast<char>(v >> 8);
+            *dst += static_cast<char>(v);
+            v = 0;
+        }
+    }
+    if ((n & 3) == 2) {
+        *dst += static_cast<char>(v >> 4);
+    } else if ((n & 3) == 3) {
+        *dst += static_cast<char>(v >> 10);
+        *dst += static_cast<char>(v >> 2);
+    }
+    return true;
+}
+
 }	// namespace coding
 
 namespace logging {
@@ -223,6 +290,79 @@ std::vector<std::string> SplitString(const std::string& src, const std::string&
     return dst;
 }
 
+static inline uint32_t Rotl32(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static void Sha1Block(uint32_t h[5], const unsigned char* p) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (p[4*i] << 24) | (p[4*i + 1] << 16) | (p[4*i + 2] << 8) | p[4*i + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = Rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        uint32_t t = Rotl32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = Rotl32(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+void Sha1(const char* data, size_t n, uint8_t digest[20]) {
+    uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    size_t left = n;
+    for (; left >= 64; left -= 64, p += 64) {
+        Sha1Block(h, p);
+    }
+
+    // 尾块：0x80填充，末8字节为消息位长（大端）
+    unsigned char block[128] = {0};
+    memcpy(block, p, left);
+    block[left] = 0x80;
+    size_t total = left + 9 <= 64? 64: 128;
+    uint64_t bits = static_cast<uint64_t>(n) * 8;
+    for (int i = 0; i < 8; i++) {
+        block[total - 1 - i] = static_cast<unsigned char>(bits >> (8*i));
+    }
+    Sha1Block(h, block);
+    if (total == 128) {
+        Sha1Block(h, block + 64);
+    }
+
+    for (int i = 0; i < 5; i++) {
+        digest[4*i] = static_cast<uint8_t>(h[i] >> 24);
+        digest[4*i + 1] = static_cast<uint8_t>(h[i] >> 16);
+        digest[4*i + 2] = static_cast<uint8_t>(h[i] >> 8);
+        digest[4*i + 3] = static_cast<uint8_t>(h[i]);
+    }
+}
+
 static uint64_t Gcd(uint64_t a, uint64_t b) {
     if (a < b) std::swap(a, b);
     if (b == 0) return a;
@@ -401,8 +541,10 @@ static struct StatusCode_t statusCodes[] = {
     {"413", "Request Entity Too Large"},
     {"414", "Request-url Too Long"},
     {"415", "Unsupported Media Type"},
-    {"416", ""},
+    {"416", "Requested Range Not Satisfiable"},
     {"417", "Expectation Failed"},
+    {"426", "Upgrade Required"},
+    {"431", "Request Header Fields Too Large"},
 
     {"500", "Internal Server Error"},
     {"501", "Not Implemented"},
@@ -415,13 +557,19 @@ static struct StatusCode_t statusCodes[] = {
 };
 
 std::map<const std::string, const std::string> gStatusCode;
+const char* gStatusText[600] = {NULL};
 
 void StatusCodeInit() {
     for (int i = 0; strlen(statusCodes[i].code); i++) {
         gStatusCode.insert(std::make_pair(statusCodes[i].code, statusCodes[i].status));
+        gStatusText[atoi(statusCodes[i].code) % 600] = statusCodes[i].status;
     }
 }
 
+const char* StatusText(uint16_t code) {
+    return code < 600? gStatusText[code]: NULL;
+}
+
 const std::string& Status(const std::string& code) {
     return gStatusCode[code];
 }
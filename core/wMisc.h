@@ -30,6 +30,11 @@ void EncodeFixed64(char* dst, uint64_t value);
 void PutFixed32(std::string* dst, uint32_t value);
 void PutFixed64(std::string* dst, uint64_t value);
 
+// base64编码（RFC 4648，含填充）
+std::string Base64Encode(const wSlice& src);
+// base64解码，兼容URL安全字母表（-_），填充可省略。格式错误返回false
+bool Base64Decode(const wSlice& src, std::string* dst);
+
 inline uint8_t DecodeFixed8(const char* ptr) {
     if (kLittleEndian) {
         uint8_t result;
@@ -102,6 +107,9 @@ namespace misc {
 // 哈希值 murmur hash类似算法
 uint32_t Hash(const char* data, size_t n, uint32_t seed);
 
+// SHA-1摘要（20字节）
+void Sha1(const char* data, size_t n, uint8_t digest[20]);
+
 // 最大公约数
 uint64_t Ngcd(uint64_t arr[], size_t n);
 
@@ -190,6 +198,9 @@ void StatusCodeInit();
 
 const std::string& Status(const std::string& code);
 
+// 状态码描述，未知状态码返回NULL（无查找开销，响应热路径使用）
+const char* StatusText(uint16_t code);
+
 std::string UrlEncode(const std::string& str);
 std::string UrlDecode(const std::string& str);
 
@@ -274,18 +274,20 @@ int wMultiClient::Broadcast(char *cmd, size_t len, int type) {
 
 #ifdef _USE_PROTOBUF_
 int wMultiClient::Broadcast(const google::protobuf::Message* msg, int type) {
+    // 消息长度仅计算一次
+    msg->ByteSizeLong();
     if (type == kClientNumShard) {
         for (int i = 0; i < kClientNumShard; i++) {
             if (mTaskPool[i].size() > 0) {
                 for (std::vector<wTask*>::iterator it = mTaskPool[i].begin(); it != mTaskPool[i].end(); it++) {
-                    Send(*it, msg);
+                    Send(*it, msg, true);
                 }
             }
         }
     } else {
         if (mTaskPool[type].size() > 0) {
             for (std::vector<wTask*>::iterator it = mTaskPool[type].begin(); it != mTaskPool[type].end(); it++) {
-                Send(*it, msg);
+                Send(*it, msg, true);
             }
         }
     }
@@ -306,11 +308,11 @@ int wMultiClient::Send(wTask *task, char *cmd, size_t len) {
 }
 
 #ifdef _USE_PROTOBUF_
-int wMultiClient::Send(wTask *task, const google::protobuf::Message* msg) {
+int wMultiClient::Send(wTask *task, const google::protobuf::Message* msg, bool cached) {
     int ret = 0;
     if (task && task->Socket()->ST() == kStConnect && task->Socket()->SS() == kSsConnected 
         && (task->Socket()->SF() == kSfSend || task->Socket()->SF() == kSfRvsd)) {
-        ret = task->Send2Buf(msg);
+        ret = task->Send2Buf(msg, cached);
         if (ret == 0) {
         	ret = AddTask(task, EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD, false);
         }
@@ -56,7 +56,8 @@ public:
 
     int Send(wTask *task, char *cmd, size_t len);
 #ifdef _USE_PROTOBUF_
-    int Send(wTask *task, const google::protobuf::Message* msg);
+    // cached同wTask::Send2Buf
+    int Send(wTask *task, const google::protobuf::Message* msg, bool cached = false);
 #endif
 
     int PrepareStart();
@@ -12,7 +12,7 @@ extern char** environ;
 
 namespace hnet {
 
-wProcTitle::wProcTitle() {
+wProcTitle::wProcTitle() : mOsEnvc(0), mOsArgc(0) {
     while (environ[mOsEnvc]) {
         mOsEnvc++;
     }
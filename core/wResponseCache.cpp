@@ -0,0 +1,119 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wResponseCache.h"
+#include "wMisc.h"
+
+namespace hnet {
+
+const std::string* wResponseCache::Get(const std::string& key) {
+	std::map<std::string, Iterator_t>::iterator idx = mIndex.find(key);
+	if (idx == mIndex.end()) {
+		mMisses++;
+		return NULL;
+	}
+	Iterator_t it = idx->second;
+	if (it->mExpire <= misc::GetTimeofday()) {
+		Evict(it);
+		mMisses++;
+		return NULL;
+	}
+	mLru.splice(mLru.begin(), mLru, it);
+	mHits++;
+	return &it->mData;
+}
+
+void wResponseCache::Put(const std::string& key, const std::string& tag, std::string* data, uint32_t ttl) {
+	std::map<std::string, Iterator_t>::iterator idx = mIndex.find(key);
+	if (idx != mIndex.end()) {
+		Evict(idx->second);
+	}
+
+	mLru.push_front(Entry_t());
+	Entry_t& entry = mLru.front();
+	entry.mKey = key;
+	entry.mData.swap(*data);
+	entry.mExpire = misc::GetTimeofday() + static_cast<int64_t>(ttl) * 1000;
+	entry.mTag = mTagIndex.insert(std::make_pair(tag, mLru.begin()));
+	mIndex.insert(std::make_pair(key, mLru.begin()));
+	mSize += key.size() + tag.size() + entry.mData.size();
+
+	// 超过容量时淘汰最久未使用条目（超过容量的单个条目亦被淘汰）
+	while (mSize > mCapacity && !mLru.empty()) {
+		Evict(--mLru.end());
+	}
+}
+
+void wResponseCache::Erase(const std::string& key) {
+	std::map<std::string, Iterator_t>::iterator idx = mIndex.find(key);
+	if (idx != mIndex.end()) {
+		Evict(idx->second);
+	}
+}
+
+size_t wResponseCache::Invalidate(const std::string& tag) {
+	size_t num = 0;
+	std::pair<std::multimap<std::string, Iterator_t>::iterator, std::multimap<std::string, Iterator_t>::iterator> range = mTagIndex.equal_range(tag);
+	while (range.first != range.second) {
+		Iterator_t it = (range.first++)->second;
+		Evict(it);
+		num++;
+	}
+	return num;
+}
+
+void wResponseCache::Clear() {
+	mLru.clear();
+	mIndex.clear();
+	mTagIndex.clear();
+	mSize = 0;
+}
+
+void wResponseCache::SetCapacity(size_t capacity) {
+	mCapacity = capacity;
+	while (mSize > mCapacity && !mLru.empty()) {
+		Evict(--mLru.end());
+	}
+}
+
+std::string wResponseCache::CmdTag(uint16_t id) {
+	std::string tag("C");
+	logging::AppendNumberTo(&tag, id);
+	return tag;
+}
+
+std::string wResponseCache::PbTag(uint32_t id) {
+	std::string tag("P");
+	logging::AppendNumberTo(&tag, id);
+	return tag;
+}
+
+std::string wResponseCache::HttpTag(const wSlice& path) {
+	std::string tag("H");
+	tag.append(path.data(), path.size());
+	return tag;
+}
+
+void wResponseCache::Evict(Iterator_t it) {
+	mSize -= it->mKey.size() + it->mTag->first.size() + it->mData.size();
+	mTagIndex.erase(it->mTag);
+	mIndex.erase(it->mKey);
+	mLru.erase(it);
+}
+
+// 实例化对象
+static pthread_once_t hnet_responseCacheOnce = PTHREAD_ONCE_INIT;
+static wResponseCache* hnet_defaultResponseCache;
+static void InitDefaultResponseCache() {
+	HNET_NEW(wResponseCache(), hnet_defaultResponseCache);
+}
+
+wResponseCache* wResponseCache::Default() {
+	pthread_once(&hnet_responseCacheOnce, InitDefaultResponseCache);
+	return hnet_defaultResponseCache;
+}
+
+}	// namespace hnet
@@ -0,0 +1,81 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_RESPONSE_CACHE_H_
+#define _W_RESPONSE_CACHE_H_
+
+#include <map>
+#include <list>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+
+namespace hnet {
+
+// 响应缓存总字节数（key + tag + 响应）
+const size_t	kResponseCacheSize = 32*1024*1024;
+
+// 响应缓存（memoization）：幂等处理函数（配置查询、目录读取等）的响应以请求为键按LRU缓存，有效期内相同请求直接以缓存响应应答，
+// 不再解析请求、调用处理函数、序列化响应
+// 开启：task构造函数中On注册路由后调用Memo(路由, ttl)；键由task生成：
+//   tcp、unix消息：消息字节（数据协议 + cmd/protobuf类型 + 消息体），值为处理函数写入发送缓冲的完整消息（含长度头），命中时一次拷贝至发送缓冲
+//   http请求：方法 + 路径 + 查询串（+ body），值为状态、自定义header、body，命中时按当前连接渲染状态行及默认header（keep-alive、Date等）
+// 失效：有效期、容量淘汰，或按tag（路由：cmd、protobuf类型、http路径）显式失效（如写操作处理函数中，见wTask::MemoInvalidate）
+// 每进程（worker）独立缓存，不在worker间同步：其他worker需失效时请广播（AsyncWorker），或以ttl限定不一致时长
+// 处理函数有其他副作用（写数据、向其他连接发送）时不应开启
+// 非线程安全：每进程（事件循环）一个实例，Default()
+class wResponseCache : private wNoncopyable {
+public:
+	wResponseCache() : mCapacity(kResponseCacheSize), mSize(0), mHits(0), mMisses(0) { }
+
+	static wResponseCache* Default();
+
+	// 查找响应，未命中、已过期返回NULL。返回值在下次Put、Erase、Invalidate前有效
+	const std::string* Get(const std::string& key);
+	// 缓存响应（覆盖同key条目），data内容被转移。ttl为有效期（毫秒），tag为失效分组
+	void Put(const std::string& key, const std::string& tag, std::string* data, uint32_t ttl);
+
+	void Erase(const std::string& key);
+	// tag分组的全部条目失效，返回失效条目数
+	size_t Invalidate(const std::string& tag);
+	void Clear();
+
+	void SetCapacity(size_t capacity);
+	inline size_t Size() const { return mSize;}
+	inline size_t Num() const { return mIndex.size();}
+	inline uint64_t Hits() const { return mHits;}
+	inline uint64_t Misses() const { return mMisses;}
+
+	// 失效分组：command消息（CmdId）、protobuf消息（类型ID，kMpProtobuf与kMpProtobufId协议相同）、http路径
+	static std::string CmdTag(uint16_t id);
+	static std::string PbTag(uint32_t id);
+	static std::string HttpTag(const wSlice& path);
+
+protected:
+	struct Entry_t;
+	typedef std::list<Entry_t>::iterator Iterator_t;
+
+	struct Entry_t {
+		std::string mKey;
+		std::string mData;
+		int64_t mExpire;	// 过期时刻（微秒）
+		std::multimap<std::string, Iterator_t>::iterator mTag;
+	};
+
+	void Evict(Iterator_t it);
+
+	size_t mCapacity;
+	size_t mSize;
+	uint64_t mHits;
+	uint64_t mMisses;
+	std::list<Entry_t> mLru;	// 头部为最近使用
+	std::map<std::string, Iterator_t> mIndex;
+	std::multimap<std::string, Iterator_t> mTagIndex;
+};
+
+}	// namespace hnet
+
+#endif
@@ -5,6 +5,8 @@
  */
 
 #include <sys/un.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -24,16 +26,20 @@
 #include "wUdpTask.h"
 #include "wUnixTask.h"
 #include "wChannelTask.h"
+#include "wChannelCmd.h"
 #include "wHttpTask.h"
+#include "wWebSocketTask.h"
+#include "wArqTask.h"
 
 namespace hnet {
 
 wServer::wServer(wConfig* config): mExiting(false), mTick(0), mHeartbeatTurn(kHeartbeatTurn), mEpollFD(kFDUnknown), mTimeout(10), 
-mShm(NULL), mAcceptAtomic(NULL), mAcceptFL(NULL), mUseAcceptTurn(kAcceptTurn), mAcceptHeld(false), mAcceptDisabled(0), 
+mShmPoller(NULL), mShm(NULL), mAcceptAtomic(NULL), mAcceptFL(NULL), mUseAcceptTurn(kAcceptTurn), mAcceptHeld(false), mAcceptDisabled(0), 
 mMaster(NULL), mConfig(config), mEnv(wEnv::Default()) {
 	assert(mConfig != NULL);
     mLatestTm = soft::TimeUsec();
     mHeartbeatTimer = wTimer(kKeepAliveTm);
+    mHttpTimer = wTimer(kHttpCheckTm);
 }
 
 wServer::~wServer() {
@@ -203,6 +209,24 @@ int wServer::NewHttpTask(wSocket* sock, wTask** ptr) {
     return 0;
 }
 
+int wServer::NewWebSocketTask(wSocket* sock, wTask** ptr) {
+    HNET_NEW(wWebSocketTask(sock), *ptr);
+    if (!*ptr) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::NewWebSocketTask new() failed", "");
+		return -1;
+    }
+    return 0;
+}
+
+int wServer::NewArqTask(wSocket* sock, wTask** ptr) {
+    HNET_NEW(wArqTask(sock), *ptr);
+    if (!*ptr) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::NewArqTask new() failed", "");
+		return -1;
+    }
+    return 0;
+}
+
 int wServer::InitAcceptMutex() {
 	if (mUseAcceptTurn == true && mMaster->WorkerNum() > 1) {
 		if (kAcceptStuff == 0) {
@@ -261,7 +285,7 @@ int wServer::Recv() {
 		wTask* task = reinterpret_cast<wTask*>(evt[i].data.ptr);
 
 		if (task->Socket()->FD() == kFDUnknown || evt[i].events & (EPOLLERR | EPOLLPRI)) {
-			if (task->Socket()->SP() != kSpUdp && task->Socket()->SP() != kSpChannel) {	// udp无需删除task
+			if (task->Socket()->SP() != kSpUdp && task->Socket()->SP() != kSpArq && task->Socket()->SP() != kSpChannel) {	// udp无需删除task
 				task->DisConnect();
 				RemoveTask(task);
 			}
@@ -277,7 +301,7 @@ int wServer::Recv() {
 			if (evt[i].events & EPOLLIN) {	// 套接口准备好了读取操作
 				ssize_t size;
 				if (task->TaskRecv(&size) == -1) {
-					if (task->Socket()->SP() != kSpUdp && task->Socket()->SP() != kSpChannel) {	// udp无需删除task
+					if (task->Socket()->SP() != kSpUdp && task->Socket()->SP() != kSpArq && task->Socket()->SP() != kSpChannel) {	// udp无需删除task
 						task->DisConnect();
 						RemoveTask(task);
 					}
@@ -290,7 +314,7 @@ int wServer::Recv() {
 					// 写入失败，半连接，对端读关闭（udp无需删除task）
 					ssize_t size;
 					if (task->TaskSend(&size) == -1) {
-						if (task->Socket()->SP() != kSpUdp && task->Socket()->SP() != kSpChannel) {
+						if (task->Socket()->SP() != kSpUdp && task->Socket()->SP() != kSpArq && task->Socket()->SP() != kSpChannel) {
 							task->DisConnect();
 							RemoveTask(task);
 						}
@@ -394,7 +418,7 @@ int wServer::AcceptConn(wTask *task) {
 			return ret;
 		}
 
-	} else if (task->Socket()->SP() == kSpHttp) {
+	} else if (task->Socket()->SP() == kSpHttp || task->Socket()->SP() == kSpWebSocket) {
 		struct sockaddr_in sockAddr;
 		socklen_t sockAddrSize = sizeof(sockAddr);	
 		ret = task->Socket()->Accept(&fd, reinterpret_cast<struct sockaddr*>(&sockAddr), &sockAddrSize);
@@ -406,9 +430,9 @@ int wServer::AcceptConn(wTask *task) {
 			return -1;
 		}
 
-		// http socket
+		// http|websocket socket
 		wTcpSocket *socket = NULL;
-		HNET_NEW(wTcpSocket(kStConnect, kSpHttp), socket);
+		HNET_NEW(wTcpSocket(kStConnect, task->Socket()->SP()), socket);
 		if (!socket) {
 			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AcceptConn new() failed", error::Strerror(errno).c_str());
 			return -1;
@@ -426,7 +450,11 @@ int wServer::AcceptConn(wTask *task) {
 		    return ret;
 		}
 
-		ret = NewHttpTask(socket, &ctask);
+		if (socket->SP() == kSpHttp) {
+			ret = NewHttpTask(socket, &ctask);
+		} else {
+			ret = NewWebSocketTask(socket, &ctask);
+		}
 		if (ret == -1) {
 			HNET_DELETE(socket);
 			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AcceptConn NewHttpTask() failed", "");
@@ -454,7 +482,7 @@ int wServer::AcceptConn(wTask *task) {
 
 int wServer::Broadcast(char *cmd, int len) {
 	for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end(); it++) {
-		if ((*it)->Socket()->ST() == kStConnect && (*it)->Socket()->SS() == kSsConnected && (*it)->Socket()->SP() == kSpTcp && 
+		if ((*it)->Socket()->ST() == kStConnect && (*it)->Socket()->SS() == kSsConnected && ((*it)->Socket()->SP() == kSpTcp || (*it)->Socket()->SP() == kSpWebSocket) && 
 			((*it)->Socket()->SF() == kSfSend || (*it)->Socket()->SF() == kSfRvsd)) {
 			Send(*it, cmd, len);
 		}
@@ -464,10 +492,12 @@ int wServer::Broadcast(char *cmd, int len) {
 
 #ifdef _USE_PROTOBUF_
 int wServer::Broadcast(const google::protobuf::Message* msg) {
+	// 消息长度仅计算一次
+	msg->ByteSizeLong();
 	for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end(); it++) {
-		if ((*it)->Socket()->ST() == kStConnect && (*it)->Socket()->SS() == kSsConnected && (*it)->Socket()->SP() == kSpTcp && 
+		if ((*it)->Socket()->ST() == kStConnect && (*it)->Socket()->SS() == kSsConnected && ((*it)->Socket()->SP() == kSpTcp || (*it)->Socket()->SP() == kSpWebSocket) && 
 			((*it)->Socket()->SF() == kSfSend || (*it)->Socket()->SF() == kSfRvsd)) {
-			Send(*it, msg);
+			Send(*it, msg, true);
 		}
 	}
     return 0;
@@ -476,16 +506,16 @@ int wServer::Broadcast(const google::protobuf::Message* msg) {
 
 int wServer::Send(wTask *task, char *cmd, size_t len) {
 	int ret = task->Send2Buf(cmd, len);
-	if (ret == 0) {
+	if (ret == 0 && task->SendLen() > 0 && task->Socket()->SP() != kSpUdp && task->Socket()->SP() != kSpArq) {	// udp由task批量发送，发送缓冲满时自行注册写事件；unix共享内存传输不经发送缓冲
 	    ret = AddTask(task, EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD, false);
 	}
     return ret;
 }
 
 #ifdef _USE_PROTOBUF_
-int wServer::Send(wTask *task, const google::protobuf::Message* msg) {
-	int ret = task->Send2Buf(msg);
-	if (ret == 0) {
+int wServer::Send(wTask *task, const google::protobuf::Message* msg, bool cached) {
+	int ret = task->Send2Buf(msg, cached);
+	if (ret == 0 && task->SendLen() > 0 && task->Socket()->SP() != kSpUdp && task->Socket()->SP() != kSpArq) {
 	    ret = AddTask(task, EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD, false);
 	}
     return ret;
@@ -508,28 +538,77 @@ int wServer::FindTaskBySocket(wTask** task, const wSocket* sock) {
 	return -1;
 }
 
+int wServer::PushWorker(uint32_t slot, char buf[], size_t len) {
+	wWorker* worker = mMaster->Worker(slot);
+	if (!worker->Ring()->Valid() || worker->Channel()->Event() == kFDUnknown) {
+		return -1;
+	}
+
+	// 通道打开、关闭消息须与描述符同经channel socket，保持先后顺序
+	if (static_cast<uint8_t>(coding::DecodeFixed8(buf + sizeof(uint32_t))) == kMpCommand) {
+		struct wCommand *cmd = reinterpret_cast<struct wCommand*>(buf + sizeof(uint32_t) + sizeof(uint8_t));
+		if (cmd->GetId() == CmdId(CMD_CHANNEL_REQ, CHANNEL_REQ_OPEN) || cmd->GetId() == CmdId(CMD_CHANNEL_REQ, CHANNEL_REQ_CLOSE)) {
+			worker->RingFallback() = true;
+			return -1;
+		}
+	}
+
+	// 已改经channel socket：socket数据全部被对端读取（已分发）后才回到环，两条路径不交错
+	if (worker->RingFallback()) {
+		if (ChannelPending(slot)) {
+			return -1;
+		}
+		worker->RingFallback() = false;
+	}
+
+	int ret = worker->Ring()->Push(buf, len);
+	if (ret == -1) {
+		worker->RingFallback() = true;
+	} else if (ret == 1) {
+		uint64_t one = 1;
+		if (write(worker->Channel()->Event(), &one, sizeof(one)) == -1 && errno != EAGAIN) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::PushWorker write() failed", error::Strerror(errno).c_str());
+		}
+	}
+	return ret == -1? -1: 0;
+}
+
+bool wServer::ChannelPending(uint32_t slot) {
+	wWorker* worker = mMaster->Worker(slot);
+	if (worker->ChannelTask() != NULL && worker->ChannelTask()->SendLen() > 0) {
+		return true;
+	}
+
+	// 写入描述符内核发送队列中对端未读取的字节。查询失败视为未读完（不回到环）
+	int queued = 0;
+	return ioctl(worker->ChannelFD(0), SIOCOUTQ, &queued) == -1 || queued > 0;
+}
+
 int wServer::AsyncWorker(char *cmd, int len, uint32_t solt, const std::vector<uint32_t>* blackslot) {
 	if (Master()->WorkerNum() <= 1) {
 		return 0;
 	}
+	char buf[kPackageSize];
+	wTask::Assertbuf(buf, cmd, len);
+	size_t size = sizeof(uint32_t) + sizeof(uint8_t) + len;
 	if (solt == kMaxProcess) {	// 广播消息
-		for (uint32_t i = 0; i < kMaxProcess; i++) {
+		for (uint32_t i = 0; i < mMaster->SlotMax(); i++) {
 			if (mMaster->Worker(i)->mPid == -1 || mMaster->Worker(i)->ChannelFD(0) == kFDUnknown) {
 				continue;
 			} else if (blackslot && std::find(blackslot->begin(), blackslot->end(), i) != blackslot->end()) {
 				continue;
 			}
 
-			wTask *task = NULL;
-			if (FindTaskBySocket(&task, mMaster->Worker(i)->Channel()) == 0) {
+			wTask *task = mMaster->Worker(i)->ChannelTask();
+			if (PushWorker(i, buf, size) == -1 && task != NULL) {
 				Send(task, cmd, len);
 			}
 	    }
 	} else {
 		if (mMaster->Worker(solt)->mPid != -1 && mMaster->Worker(solt)->ChannelFD(0) != kFDUnknown) {
 
-			wTask *task = NULL;
-			if (FindTaskBySocket(&task, mMaster->Worker(solt)->Channel()) == 0) {
+			wTask *task = mMaster->Worker(solt)->ChannelTask();
+			if (PushWorker(solt, buf, size) == -1 && task != NULL) {
 				Send(task, cmd, len);
 			}
 		}
@@ -542,25 +621,29 @@ int wServer::AsyncWorker(const google::protobuf::Message* msg, uint32_t solt, co
 	if (Master()->WorkerNum() <= 1) {
 		return 0;
 	}
+	char buf[kPackageSize];
+	// 消息长度仅计算一次
+	size_t size = sizeof(uint32_t) + wTask::PbPackLen(msg);
+	wTask::Assertbuf(buf, msg, true);
 	if (solt == kMaxProcess) {	// 广播消息
-		for (uint32_t i = 0; i < kMaxProcess; i++) {
+		for (uint32_t i = 0; i < mMaster->SlotMax(); i++) {
 			if (mMaster->Worker(i)->mPid == -1 || mMaster->Worker(i)->ChannelFD(0) == kFDUnknown) {
 				continue;
 			} else if (blackslot && std::find(blackslot->begin(), blackslot->end(), i) != blackslot->end()) {
 				continue;
 			}
 
-			wTask *task = NULL;
-			if (FindTaskBySocket(&task, mMaster->Worker(i)->Channel()) == 0) {
-				Send(task, msg);
+			wTask *task = mMaster->Worker(i)->ChannelTask();
+			if (PushWorker(i, buf, size) == -1 && task != NULL) {
+				Send(task, msg, true);
 			}
 	    }
 	} else {
 		if (mMaster->Worker(solt)->mPid != -1 && mMaster->Worker(solt)->ChannelFD(0) != kFDUnknown) {
 			
-			wTask *task = NULL;
-			if (FindTaskBySocket(&task, mMaster->Worker(solt)->Channel()) == 0) {
-				Send(task, msg);
+			wTask *task = mMaster->Worker(solt)->ChannelTask();
+			if (PushWorker(solt, buf, size) == -1 && task != NULL) {
+				Send(task, msg, true);
 			}
 		}
 	}
@@ -574,8 +657,10 @@ int wServer::SyncWorker(char *cmd, int len, uint32_t solt, const std::vector<uin
 	}
 	ssize_t ret;
 	char buf[kPackageSize];
+	wTask::Assertbuf(buf, cmd, len);
+	size_t size = sizeof(uint32_t) + sizeof(uint8_t) + len;
 	if (solt == kMaxProcess) {	// 广播消息
-		for (uint32_t i = 0; i < kMaxProcess; i++) {
+		for (uint32_t i = 0; i < mMaster->SlotMax(); i++) {
 			if (mMaster->Worker(i)->mPid == -1 || mMaster->Worker(i)->ChannelFD(0) == kFDUnknown) {
 				continue;
 			} else if (blackslot && std::find(blackslot->begin(), blackslot->end(), i) != blackslot->end()) {
@@ -583,15 +668,17 @@ int wServer::SyncWorker(char *cmd, int len, uint32_t solt, const std::vector<uin
 			}
 
 			/* TODO: EAGAIN */
-			wTask::Assertbuf(buf, cmd, len);
-			mMaster->Worker(i)->Channel()->SendBytes(buf, sizeof(uint32_t) + sizeof(uint8_t) + len, &ret);
+			if (PushWorker(i, buf, size) == -1) {
+				mMaster->Worker(i)->Channel()->SendBytes(buf, size, &ret);
+			}
 	    }
 	} else {
 		if (mMaster->Worker(solt)->mPid != -1 && mMaster->Worker(solt)->ChannelFD(0) != kFDUnknown) {
 
 			/* TODO: EAGAIN */
-			wTask::Assertbuf(buf, cmd, len);
-			mMaster->Worker(solt)->Channel()->SendBytes(buf, sizeof(uint32_t) + sizeof(uint8_t) + len, &ret);
+			if (PushWorker(solt, buf, size) == -1) {
+				mMaster->Worker(solt)->Channel()->SendBytes(buf, size, &ret);
+			}
 		}
 	}
     return 0;
@@ -604,9 +691,10 @@ int wServer::SyncWorker(const google::protobuf::Message* msg, uint32_t solt, con
 	}
 	ssize_t ret;
 	char buf[kPackageSize];
-	uint32_t len = sizeof(uint8_t) + sizeof(uint16_t) + msg->GetTypeName().size() + msg->ByteSize();
+	size_t size = sizeof(uint32_t) + wTask::PbPackLen(msg);
+	wTask::Assertbuf(buf, msg, true);
 	if (solt == kMaxProcess) {	// 广播消息
-		for (uint32_t i = 0; i < kMaxProcess; i++) {
+		for (uint32_t i = 0; i < mMaster->SlotMax(); i++) {
 			if (mMaster->Worker(i)->mPid == -1 || mMaster->Worker(i)->ChannelFD(0) == kFDUnknown) {
 				continue;
 			} else if (blackslot && std::find(blackslot->begin(), blackslot->end(), i) != blackslot->end()) {
@@ -614,15 +702,17 @@ int wServer::SyncWorker(const google::protobuf::Message* msg, uint32_t solt, con
 			}
 
 			/* TODO: EAGAIN */
-			wTask::Assertbuf(buf, msg);
-			mMaster->Worker(i)->Channel()->SendBytes(buf, sizeof(uint32_t) + len, &ret);
+			if (PushWorker(i, buf, size) == -1) {
+				mMaster->Worker(i)->Channel()->SendBytes(buf, size, &ret);
+			}
 	    }
 	} else {
 		if (mMaster->Worker(solt)->mPid != -1 && mMaster->Worker(solt)->ChannelFD(0) != kFDUnknown) {
 
 			/* TODO: EAGAIN */
-			wTask::Assertbuf(buf, msg);
-			mMaster->Worker(solt)->Channel()->SendBytes(buf, sizeof(uint32_t) + len, &ret);
+			if (PushWorker(solt, buf, size) == -1) {
+				mMaster->Worker(solt)->Channel()->SendBytes(buf, size, &ret);
+			}
 		}
 	}
     return 0;
@@ -633,12 +723,16 @@ int wServer::AddListener(const std::string& ipaddr, uint16_t port, const std::st
     wSocket *socket = NULL;
     if (protocol == "UDP") {
 		HNET_NEW(wUdpSocket(kStConnect), socket);	// udp无 listen socket
+	} else if (protocol == "ARQ") {
+		HNET_NEW(wUdpSocket(kStConnect, kSpArq), socket);
 	} else if (protocol == "UNIX") {
 		HNET_NEW(wUnixSocket(kStListen), socket);
     } else if(protocol == "TCP") {
     	HNET_NEW(wTcpSocket(kStListen), socket);
     } else if (protocol == "HTTP") {
     	HNET_NEW(wTcpSocket(kStListen, kSpHttp), socket);
+    } else if (protocol == "WEBSOCKET") {
+    	HNET_NEW(wTcpSocket(kStListen, kSpWebSocket), socket);
     }
     
     if (!socket) {
@@ -660,7 +754,7 @@ int wServer::AddListener(const std::string& ipaddr, uint16_t port, const std::st
 	    return ret;
 	}
 
-	if (socket->SP() == kSpUdp) {	// udp无listen socket
+	if (socket->SP() == kSpUdp || socket->SP() == kSpArq) {	// udp无listen socket
 		socket->SS() = kSsConnected;
 	} else {
 		socket->SS() = kSsListened;
@@ -725,6 +819,18 @@ int wServer::Listener2Epoll(bool addpool) {
 		    	return -1;
 		    }
 		    break;
+		case kSpWebSocket:
+		    if (NewWebSocketTask(*it, &ctask) == -1) {
+		    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::Listener2Epoll NewWebSocketTask() failed", "");
+		    	return -1;
+		    }
+		    break;
+		case kSpArq:
+		    if (NewArqTask(*it, &ctask) == -1) {
+		    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::Listener2Epoll NewArqTask() failed", "");
+		    	return -1;
+		    }
+		    break;
 		default:
 			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::Listener2Epoll () failed", "unknown sp");
 			return -1;
@@ -772,6 +878,32 @@ int wServer::Channel2Epoll(bool addpool) {
 
 			if (AddTask(ctask) == -1) {
 				RemoveTask(ctask);
+			} else {
+				mMaster->Worker(i)->ChannelTask() = ctask;
+			}
+
+			// 本worker消息环门铃
+			if (i == mMaster->mSlot && mMaster->Worker(i)->Ring()->Valid() && socket->Event() != kFDUnknown) {
+				wChannelSocket *event = NULL;
+				HNET_NEW(wChannelSocket(kStConnect), event);	// 析构不关闭FD（门铃由channel socket持有）
+				if (event == NULL) {
+					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::Channel2Epoll new() failed", "");
+					return -1;
+				}
+				event->FD() = socket->Event();
+				event->SS() = kSsConnected;
+
+				wTask *rtask = NULL;
+				HNET_NEW(wChannelRingTask(event, static_cast<wChannelTask*>(ctask)), rtask);
+				if (rtask == NULL) {
+					HNET_DELETE(event);
+					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::Channel2Epoll new() failed", "");
+					return -1;
+				} else if (AddTask(rtask) == -1) {
+					RemoveTask(rtask);
+				} else {
+					static_cast<wChannelTask*>(ctask)->RingEnable() = true;
+				}
 			}
 		}
 	}
@@ -816,6 +948,14 @@ int wServer::RemoveTask(wTask* task, std::vector<wTask*>::iterator* iter, bool d
 }
 
 int wServer::CleanTask() {
+    // 共享内存连接析构时不再访问内部epoll任务（同在任务池中释放）
+    mShmTask.clear();
+    mShmPoller = NULL;
+    if (mMaster != NULL) {
+    	for (uint32_t i = 0; i < kMaxProcess; i++) {
+    		mMaster->Worker(i)->ChannelTask() = NULL;
+    	}
+    }
     CleanTaskPool(mTaskPool);
 
     int ret = close(mEpollFD);
@@ -835,6 +975,14 @@ int wServer::AddToTaskPool(wTask* task) {
 std::vector<wTask*>::iterator wServer::RemoveTaskPool(wTask* task) {
     std::vector<wTask*>::iterator it = std::find(mTaskPool.begin(), mTaskPool.end(), task);
     if (it != mTaskPool.end()) {
+    	// channel task释放时清除worker引用
+    	if (mMaster != NULL && task->Socket()->SP() == kSpChannel) {
+    		for (uint32_t i = 0; i < mMaster->SlotMax(); i++) {
+    			if (mMaster->Worker(i)->ChannelTask() == task) {
+    				mMaster->Worker(i)->ChannelTask() = NULL;
+    			}
+    		}
+    	}
     	HNET_DELETE(task);
         it = mTaskPool.erase(it);
     }
@@ -874,11 +1022,14 @@ void wServer::CheckTick() {
 	if (mHeartbeatTurn && mHeartbeatTimer.CheckTimer(mTick/1000)) {
 		CheckHeartBeat();
 	}
+	if (mHttpTimer.CheckTimer(mTick/1000)) {
+		CheckHttpIdle();
+	}
 }
 
 void wServer::CheckHeartBeat() {
 	for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end();) {
-		if ((*it)->Socket()->ST() == kStConnect && ((*it)->Socket()->SP() == kSpTcp || (*it)->Socket()->SP() == kSpUnix)) {
+		if ((*it)->Socket()->ST() == kStConnect && ((*it)->Socket()->SP() == kSpTcp || (*it)->Socket()->SP() == kSpUnix || (*it)->Socket()->SP() == kSpWebSocket)) {
 			if ((*it)->Socket()->SS() == kSsUnconnect) {	// 断线连接
 				(*it)->DisConnect();
 				RemoveTask(*it, &it);
@@ -897,4 +1048,20 @@ void wServer::CheckHeartBeat() {
 	}
 }
 
+void wServer::CheckHttpIdle() {
+	uint64_t now = soft::TimeUsec();
+	for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end();) {
+		wSocket* socket = (*it)->Socket();
+		if (socket->ST() == kStConnect && socket->SP() == kSpHttp) {
+			uint64_t last = std::max(socket->MakeTm(), std::max(socket->RecvTm(), socket->SendTm()));
+			if (now > last + static_cast<uint64_t>(kHttpKeepAliveTm)*1000000 && (*it)->Idle()) {
+				(*it)->DisConnect();
+				RemoveTask(*it, &it);
+				continue;
+			}
+		}
+		it++;
+	}
+}
+
 }	// namespace hnet
@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <vector>
+#include <set>
 #include <sys/epoll.h>
 #include "wCore.h"
 #include "wNoncopyable.h"
@@ -55,19 +56,22 @@ public:
     // 释放惊群锁（master调用）
     int ReleaseAcceptMutex(int pid);
 
-    // 异步广播消息
+    // 异步广播消息（tcp连接，及已握手的websocket连接：二进制帧）
     int Broadcast(char *cmd, int len);
 #ifdef _USE_PROTOBUF_
     int Broadcast(const google::protobuf::Message* msg);
 #endif
 
     // 同步广播消息至worker进程   blacksolt为黑名单
+    // 消息写入各worker消息环（共享内存），接收进程空闲时经eventfd唤醒；通道打开、关闭消息（传递描述符），及环不可用、空间不足时经channel socket发送
+    // 经环发送不保证送达：写入中途退出、或被挂起超过kMpscStallTm（1秒）的发送进程，其已写入消息可能被接收进程丢弃（记录错误日志）
     int SyncWorker(char *cmd, int len, uint32_t solt = kMaxProcess, const std::vector<uint32_t>* blackslot = NULL);
 #ifdef _USE_PROTOBUF_
     int SyncWorker(const google::protobuf::Message* msg, uint32_t solt = kMaxProcess, const std::vector<uint32_t>* blackslot = NULL);
 #endif
 
-    // 同步广播消息至worker进程   blacksolt为黑名单
+    // 异步广播消息至worker进程   blacksolt为黑名单
+    // 同SyncWorker写入消息环，环不可用、空间不足时写入channel task发送缓冲
     int AsyncWorker(char *cmd, int len, uint32_t solt = kMaxProcess, const std::vector<uint32_t>* blackslot = NULL);
 #ifdef _USE_PROTOBUF_
     int AsyncWorker(const google::protobuf::Message* msg, uint32_t solt = kMaxProcess, const std::vector<uint32_t>* blackslot = NULL);
@@ -76,7 +80,8 @@ public:
     // 异步发送消息
     int Send(wTask *task, char *cmd, size_t len);
 #ifdef _USE_PROTOBUF_
-    int Send(wTask *task, const google::protobuf::Message* msg);
+    // cached同wTask::Send2Buf
+    int Send(wTask *task, const google::protobuf::Message* msg, bool cached = false);
 #endif
 
     // 检查时钟周期tick
@@ -88,6 +93,8 @@ public:
     virtual int NewUnixTask(wSocket* sock, wTask** ptr);
     virtual int NewChannelTask(wSocket* sock, wTask** ptr);
     virtual int NewHttpTask(wSocket* sock, wTask** ptr);
+    virtual int NewWebSocketTask(wSocket* sock, wTask** ptr);
+    virtual int NewArqTask(wSocket* sock, wTask** ptr);
 
     virtual int PrepareRun() {
         return 0;
@@ -102,6 +109,9 @@ public:
 
     // 连接检测（心跳）
     virtual void CheckHeartBeat();
+
+    // http空闲连接检测（超过kHttpKeepAliveTm无收发则关闭）
+    virtual void CheckHttpIdle();
     
     // single|worker进程退出函数
     virtual void ProcessExit() { }
@@ -117,6 +127,10 @@ public:
     template<typename T = wWorker*>
     inline T Worker() { return mMaster->Worker<T>();}
 
+    // unix共享内存连接（wUnixTask）：内部epoll任务（首个连接建立时创建，随任务池释放）、已注册连接
+    inline wTask*& ShmPoller() { return mShmPoller;}
+    inline std::set<wTask*>& ShmTask() { return mShmTask;}
+
     int AddTask(wTask* task, int ev = EPOLLIN, int op = EPOLL_CTL_ADD, bool addpool = true);
     int RemoveTask(wTask* task, std::vector<wTask*>::iterator* iter = NULL, bool delpool = true);
     int FindTaskBySocket(wTask** task, const wSocket* sock);
@@ -136,6 +150,12 @@ protected:
     // 添加本进程channel socket到epoll侦听读事件队列
     int Channel2Epoll(bool addpool = true);
 
+    // 消息buf（tcp格式，len字节）写入slot进程消息环，需要时唤醒。环不可用、空间不足，及通道打开、关闭消息返回-1（由调用者经channel socket发送）
+    // 写入失败后该slot改经channel socket，直至socket数据全部被对端读取（保持消息先后顺序）
+    int PushWorker(uint32_t slot, char buf[], size_t len);
+    // slot进程channel socket尚有对端未读取的数据（本进程发送缓冲、内核发送队列）
+    bool ChannelPending(uint32_t slot);
+
     // 添加listen socket到epoll侦听事件队列
     int Listener2Epoll(bool addpool = true);
     int RemoveListener(bool delpool = true);
@@ -158,6 +178,8 @@ protected:
     bool mHeartbeatTurn;
     // 心跳定时器
     wTimer mHeartbeatTimer;
+    // http空闲检测定时器
+    wTimer mHttpTimer;
 
     // 多listen socket监听服务描述符
     std::vector<wSocket*> mListenSock;
@@ -167,6 +189,10 @@ protected:
 
     // task|pool
     std::vector<wTask*> mTaskPool;
+
+    // unix共享内存连接
+    wTask* mShmPoller;
+    std::set<wTask*> mShmTask;
     
     // 惊群锁
     wShm *mShm;
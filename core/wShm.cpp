@@ -4,6 +4,10 @@
  * Copyright (C) Hupu, Inc.
  */
  
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
 #include "wShm.h"
 #include "wMisc.h"
 #include "wLogger.h"
@@ -130,4 +134,117 @@ void wPosixShm::Remove() {
     }
 }
 
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC	0x0001U
+
+static inline int memfd_create(const char* name, unsigned int flags) {
+	return static_cast<int>(syscall(__NR_memfd_create, name, flags));
+}
+#endif
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING	0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS		1033
+#define F_GET_SEALS		1034
+#define F_SEAL_SEAL		0x0001
+#define F_SEAL_SHRINK	0x0002
+#define F_SEAL_GROW		0x0004
+#endif
+
+wMemShm::wMemShm(const std::string& name, size_t size, int fd) : mFD(fd), mShmhead(NULL), mName(name) {
+	mSize = misc::Align(size + sizeof(struct Shmhead_t), kPageSize);
+}
+
+wMemShm::~wMemShm() {
+	Remove();
+	Destroy();
+}
+
+int wMemShm::CreateShm(int pipeid) {
+	mFD = memfd_create(mName.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (mFD == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::CreateShm memfd_create() failed", error::Strerror(errno).c_str());
+		return -1;
+	} else if (ftruncate(mFD, static_cast<off_t>(mSize)) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::CreateShm ftruncate() failed", error::Strerror(errno).c_str());
+		return -1;
+	} else if (fcntl(mFD, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+		// 固定大小：描述符可传给其他进程，对端ftruncate缩小会使本进程访问映射时SIGBUS
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::CreateShm fcntl(F_ADD_SEALS) failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+
+	void* addr = mmap(NULL, mSize, PROT_READ|PROT_WRITE, MAP_SHARED, mFD, 0);
+	if (addr == MAP_FAILED) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::CreateShm mmap() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+
+	// 存储头信息（偏移）
+	mShmhead = reinterpret_cast<struct Shmhead_t*>(addr);
+	mShmhead->mStart = 0;
+	mShmhead->mUsedOff = misc::Align(sizeof(struct Shmhead_t), 64);
+	mShmhead->mEnd = static_cast<uintptr_t>(mSize);
+	return 0;
+}
+
+int wMemShm::AttachShm(int pipeid) {
+	struct stat st;
+	if (mFD == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::AttachShm () failed", "fd is invalid");
+		return -1;
+	} else if (fstat(mFD, &st) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::AttachShm fstat() failed", error::Strerror(errno).c_str());
+		return -1;
+	} else if (static_cast<size_t>(st.st_size) < sizeof(struct Shmhead_t)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::AttachShm () failed", "shm too small");
+		return -1;
+	}
+
+	// 须已封印大小，否则创建方可随时缩小（本进程访问映射时SIGBUS）
+	int seals = fcntl(mFD, F_GET_SEALS);
+	if (seals == -1 || (seals & (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) != (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::AttachShm () failed", "shm size not sealed");
+		return -1;
+	}
+	mSize = static_cast<size_t>(st.st_size);
+
+	void* addr = mmap(NULL, mSize, PROT_READ|PROT_WRITE, MAP_SHARED, mFD, 0);
+	if (addr == MAP_FAILED) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::AttachShm mmap() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	mShmhead = reinterpret_cast<struct Shmhead_t*>(addr);
+	return 0;
+}
+
+void* wMemShm::AllocShm(size_t size) {
+	// 64字节对齐（cache line）
+	uintptr_t off = misc::Align(static_cast<uint32_t>(mShmhead->mUsedOff), 64);
+	if (off + static_cast<uintptr_t>(size) <= mShmhead->mEnd) {
+		mShmhead->mUsedOff = off + static_cast<uintptr_t>(size);
+		return reinterpret_cast<char*>(mShmhead) + off;
+	}
+	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::AllocShm failed, shm space not enough", "");
+	return NULL;
+}
+
+void wMemShm::Remove() {
+	// 解除本进程映射
+	if (mShmhead && munmap(reinterpret_cast<void*>(mShmhead), mSize) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemShm::Remove munmap() failed", error::Strerror(errno).c_str());
+	}
+	mShmhead = NULL;
+}
+
+void wMemShm::Destroy() {
+	// 关闭描述符，全部进程解除映射后释放
+	if (mFD != -1) {
+		close(mFD);
+		mFD = -1;
+	}
+}
+
 }	// namespace hnet
@@ -69,6 +69,41 @@ protected:
 	std::string mFilename;
 };
 
+// 匿名共享内存（memfd）：无文件名、键，仅持有描述符的进程可映射（描述符经unix socket SCM_RIGHTS传递给对端）
+// Shmhead_t中地址为相对映射起始的偏移（各进程映射地址不同），AllocShm返回本进程地址，Offset换算为偏移传给对端
+// 创建时封印大小（F_SEAL_SHRINK、F_SEAL_GROW、F_SEAL_SEAL），AttachShm拒绝未封印的描述符
+class wMemShm : public wShm {
+public:
+	// fd为对端传来的memfd（AttachShm），创建时为-1
+	wMemShm(const std::string& name, size_t size = kMsgQueueLen, int fd = -1);
+	virtual ~wMemShm();
+
+	virtual int CreateShm(int pipeid = 'i');
+	virtual int AttachShm(int pipeid = 'i');
+	virtual void* AllocShm(size_t size = 0);
+	virtual void Remove();
+	virtual void Destroy();
+	virtual struct Shmhead_t* ShmHead() { return mShmhead;}
+
+	// 本进程地址ptr的偏移，偏移off的本进程地址（越界返回NULL）
+	inline uintptr_t Offset(const void* ptr) const {
+		return reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(mShmhead);
+	}
+	inline void* Address(uintptr_t off, size_t size) const {
+		if (mShmhead == NULL || off > mSize || size > mSize - off) {
+			return NULL;
+		}
+		return reinterpret_cast<char*>(mShmhead) + off;
+	}
+	inline int FD() const { return mFD;}
+
+protected:
+	int mFD;
+	size_t mSize;
+	struct Shmhead_t* mShmhead;
+	std::string mName;
+};
+
 }	// namespace hnet
 
 #endif
@@ -0,0 +1,297 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wShmRing.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+int wShmRing::Init(void* ptr, size_t size, bool create) {
+	if (ptr == NULL || (reinterpret_cast<uintptr_t>(ptr) & 63) != 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmRing::Init () failed", "ring address illegal");
+		return -1;
+	} else if (size < 2 * kPackageSize || size > kShmRingSizeMax || (size & (size - 1)) != 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmRing::Init () failed", "ring size illegal");
+		return -1;
+	}
+
+	if (create) {
+		HNET_NEW((ptr)wShmRingHead_t, mRing);
+		mRing->mHead.NoBarrierStore(0);
+		mRing->mTail.NoBarrierStore(0);
+		mRing->mPushWait.NoBarrierStore(0);
+		mRing->mPopWait.NoBarrierStore(0);
+		mRing->mSize = size;
+	} else {
+		mRing = reinterpret_cast<wShmRingHead_t*>(ptr);
+		if (mRing->mSize != size) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmRing::Init () failed", "ring size mismatch");
+			mRing = NULL;
+			return -1;
+		}
+	}
+	mData = reinterpret_cast<char*>(ptr) + sizeof(wShmRingHead_t);
+	mSize = size;
+	mPos = mPad = 0;
+	return 0;
+}
+
+bool wShmRing::Fit(uint64_t need, uint64_t* pad) const {
+	uint64_t used = mPos - mRing->mTail.AcquireLoad();
+	if (used > mSize) {
+		return false;
+	}
+	uint64_t room = mSize - (mPos & (mSize - 1));
+	*pad = need <= room? 0: room;
+	return used + *pad + need <= mSize;
+}
+
+char* wShmRing::Reserve(size_t len) {
+	uint64_t pad;
+	if (!Fit(RecordLen(len), &pad)) {
+		return NULL;
+	}
+	if (pad > 0) {
+		coding::EncodeFixed32(mData + (mPos & (mSize - 1)), kShmRingWrap);
+	}
+	mPad = pad;
+	return mData + ((mPos + pad) & (mSize - 1));
+}
+
+bool wShmRing::Commit(size_t len) {
+	mPos += mPad + RecordLen(len);
+	mPad = 0;
+	mRing->mHead.ReleaseStore(mPos);
+
+	// 与读端Sleep配对：写位置先于空闲标记可见，或读端再次检查时看到新记录
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	return mRing->mPopWait.NoBarrierLoad() != 0 && mRing->mPopWait.Exchange(0) != 0;
+}
+
+bool wShmRing::PushSleep(size_t len) {
+	mRing->mPushWait.NoBarrierStore(1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	uint64_t pad;
+	if (Fit(RecordLen(len), &pad)) {
+		mRing->mPushWait.Exchange(0);
+		return false;
+	}
+	return true;
+}
+
+int wShmRing::Front(char** msg, uint32_t* len) {
+	uint64_t head = mRing->mHead.AcquireLoad();
+	while (mPos != head) {
+		uint64_t avail = head - mPos;
+		uint64_t off = mPos & (mSize - 1);
+		if (avail > mSize) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmRing::Front () failed", "ring position illegal");
+			return -1;
+		}
+
+		uint32_t reallen = coding::DecodeFixed32(mData + off);
+		if (reallen == kShmRingWrap) {
+			// 跳至环首
+			if (mSize - off > avail) {
+				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmRing::Front () failed", "ring wrap illegal");
+				return -1;
+			}
+			mPos += mSize - off;
+			mRing->mTail.ReleaseStore(mPos);
+			continue;
+		} else if (reallen < kMinPackageSize || reallen > kMaxPackageSize ||
+			RecordLen(sizeof(uint32_t) + reallen) > avail || off + sizeof(uint32_t) + reallen > mSize) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmRing::Front () failed", "message length error");
+			return -1;
+		}
+
+		*msg = mData + off + sizeof(uint32_t);
+		*len = reallen;
+		mPad = RecordLen(sizeof(uint32_t) + reallen);
+		return 1;
+	}
+	return 0;
+}
+
+void wShmRing::Pop() {
+	mPos += mPad;
+	mPad = 0;
+	mRing->mTail.ReleaseStore(mPos);
+}
+
+bool wShmRing::Released() {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	return mRing->mPushWait.NoBarrierLoad() != 0 && mRing->mPushWait.Exchange(0) != 0;
+}
+
+bool wShmRing::Sleep() {
+	mRing->mPopWait.NoBarrierStore(1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (mRing->mHead.AcquireLoad() != mPos) {
+		mRing->mPopWait.Exchange(0);
+		return false;
+	}
+	return true;
+}
+
+int wMpscRing::Init(void* ptr, size_t size) {
+	if (ptr == NULL || (reinterpret_cast<uintptr_t>(ptr) & 63) != 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMpscRing::Init () failed", "ring address illegal");
+		return -1;
+	} else if (size < kPageSize || size > kShmRingSizeMax || (size & (size - 1)) != 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMpscRing::Init () failed", "ring size illegal");
+		return -1;
+	}
+	mRing = reinterpret_cast<wMpscRingHead_t*>(ptr);
+	mData = reinterpret_cast<char*>(ptr) + sizeof(wMpscRingHead_t);
+	mSize = size;
+	mPos = mLen = mEpoch = 0;
+	mStallTm = 0;
+	return 0;
+}
+
+void wMpscRing::Reset() {
+	if (mRing == NULL) {
+		return;
+	}
+	Skip();
+	mRing->mPopWait.ReleaseStore(1);
+}
+
+void wMpscRing::Skip() {
+	// 新纪元自已预留位置继续：旧纪元写端的迟到写入位于其后新纪元记录之前
+	uint64_t head, next;
+	do {
+		head = mRing->mHead.AcquireLoad();
+		next = (((head >> kMpscEpochShift) + 1) << kMpscEpochShift) | (head & kMpscPosMask);
+	} while (!mRing->mHead.CompareExchangeWeak(head, next));
+
+	mEpoch = (next >> kMpscEpochShift) & 0xffff;
+	mPos = next & kMpscPosMask;
+	mLen = 0;
+	mStallTm = 0;
+	mRing->mTail.ReleaseStore(mPos);
+	mRing->mTailTm.NoBarrierStore(soft::TimeUsec());
+}
+
+int wMpscRing::Push(const char msg[], size_t len) {
+	if (mRing == NULL || len <= sizeof(uint32_t) || RecordLen(sizeof(uint64_t) + len - sizeof(uint32_t)) > mSize) {
+		return -1;
+	}
+
+	// 预留记录空间（环尾放不下时连同回绕空间）。CAS比较值含纪元：Reset、读端丢弃后旧预留失败重试
+	uint64_t need = RecordLen(sizeof(uint64_t) + len - sizeof(uint32_t)), head, pos, pad;
+	while (true) {
+		head = mRing->mHead.NoBarrierLoad();
+		pos = head & kMpscPosMask;
+		uint64_t tail = mRing->mTail.AcquireLoad();
+		uint64_t used = (pos - tail) & kMpscPosMask;
+		if (used > mSize) {	// head已过时，重试
+			continue;
+		} else if (used == 0) {
+			// 空环：本条记录自此刻起计未提交时长（CAS失败无影响）
+			mRing->mTailTm.NoBarrierStore(soft::TimeUsec());
+		} else if (soft::TimeUsec() - mRing->mTailTm.NoBarrierLoad() > kMpscStallTm && Stuck(tail)) {
+			// 读端阻塞于超时未提交的记录
+			return -1;
+		}
+		uint64_t room = mSize - (pos & (mSize - 1));
+		pad = need <= room? 0: room;
+		if (used + pad + need > mSize) {
+			return -1;
+		} else if (mRing->mHead.CompareExchangeWeak(head, (head & ~kMpscPosMask) | ((pos + pad + need) & kMpscPosMask))) {
+			break;
+		}
+	}
+
+	if (pad > 0) {
+		Word(pos)->ReleaseStore(Tag(head, kShmRingWrap));
+	}
+	char* rec = mData + ((pos + pad) & (mSize - 1));
+	memcpy(rec + sizeof(uint64_t), msg + sizeof(uint32_t), len - sizeof(uint32_t));
+	Word(pos + pad)->ReleaseStore(Tag(head, static_cast<uint32_t>(len - sizeof(uint32_t))));
+
+	// 与读端Sleep配对
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	return mRing->mPopWait.NoBarrierLoad() != 0 && mRing->mPopWait.Exchange(0) != 0? 1: 0;
+}
+
+bool wMpscRing::Stuck(uint64_t tail) {
+	// 与空环预留时的时刻写入同步（CAS），重新检查
+	uint64_t head = mRing->mHead.AcquireLoad();
+	if (mRing->mTail.AcquireLoad() != tail || soft::TimeUsec() - mRing->mTailTm.NoBarrierLoad() <= kMpscStallTm) {
+		return false;
+	}
+	return !Committed(Word(tail)->AcquireLoad(), head >> kMpscEpochShift);
+}
+
+bool wMpscRing::Stalled() {
+	if ((mRing->mHead.AcquireLoad() & kMpscPosMask) == mPos) {	// 空
+		mStallTm = 0;
+		return false;
+	} else if (mStallTm == 0 || mStallPos != mPos) {
+		mStallPos = mPos;
+		mStallTm = soft::TimeUsec();
+		return false;
+	}
+	return soft::TimeUsec() - mStallTm > kMpscStallTm;
+}
+
+int wMpscRing::Front(char** msg, uint32_t* len) {
+	while (mRing != NULL) {
+		uint64_t off = mPos & (mSize - 1);
+		uint64_t word = Word(mPos)->AcquireLoad();
+		uint32_t reallen = static_cast<uint32_t>(word);
+		if (!Committed(word, mEpoch)) {	// 空，或首条记录未提交
+			if (Stalled()) {
+				HNET_ERROR(soft::GetLogPath(), "%s : %s[%llu bytes]", "wMpscRing::Front () failed", "record uncommitted, producer exited, records dropped",
+					static_cast<unsigned long long>((mRing->mHead.AcquireLoad() - mPos) & kMpscPosMask));
+				Skip();
+				continue;
+			}
+			return 0;
+		} else if (reallen == kShmRingWrap) {
+			Word(mPos)->NoBarrierStore(0);
+			mPos = (mPos + mSize - off) & kMpscPosMask;
+			mRing->mTail.ReleaseStore(mPos);
+			continue;
+		} else if (reallen < kMinPackageSize || reallen > kMaxPackageSize || off + RecordLen(sizeof(uint64_t) + reallen) > mSize) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMpscRing::Front () failed", "message length error");
+			return -1;
+		}
+
+		*msg = mData + off + sizeof(uint64_t);
+		*len = reallen;
+		mLen = RecordLen(sizeof(uint64_t) + reallen);
+		return 1;
+	}
+	return 0;
+}
+
+void wMpscRing::Pop() {
+	// 清零后写端才可复用（同纪元内记录字为0即未提交）
+	memset(mData + (mPos & (mSize - 1)), 0, mLen);
+	mPos = (mPos + mLen) & kMpscPosMask;
+	mLen = 0;
+	mRing->mTailTm.NoBarrierStore(soft::TimeUsec());
+	mRing->mTail.ReleaseStore(mPos);
+}
+
+bool wMpscRing::Sleep() {
+	mRing->mPopWait.NoBarrierStore(1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (Committed(Word(mPos)->AcquireLoad(), mEpoch)) {
+		mRing->mPopWait.Exchange(0);
+		return false;
+	}
+	return true;
+}
+
+}	// namespace hnet
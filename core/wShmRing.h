@@ -0,0 +1,156 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_SHM_RING_H_
+#define _W_SHM_RING_H_
+
+#include "wCore.h"
+#include "wAtomic.h"
+#include "wNoncopyable.h"
+
+namespace hnet {
+
+const uint32_t	kShmRingSize = 1048576;		// 默认环容量（字节，2的幂，不小于2倍kPackageSize）
+const uint32_t	kShmRingSizeMax = 67108864;
+const uint32_t	kShmRingAlign = 8;			// 记录按8字节对齐
+const uint32_t	kShmRingWrap = 0xffffffff;	// 回绕标记：环尾剩余空间不足一条记录，读端跳至环首
+
+// 环头（位于共享内存），读写位置各占一个cache line，避免两端伪共享
+struct wShmRingHead_t {
+	alignas(64) wAtomic<uint64_t> mHead;	// 写入位置（累计字节）
+	wAtomic<uint32_t> mPushWait;			// 写端等待空间（环满）
+	alignas(64) wAtomic<uint64_t> mTail;	// 读取位置（累计字节）
+	wAtomic<uint32_t> mPopWait;				// 读端空闲，等待唤醒
+	alignas(64) uint64_t mSize;				// 容量
+};
+
+// 共享内存单生产者、单消费者消息环（两个进程各持一端）
+// 记录即tcp格式消息（[uint32长度][uint8数据协议][消息]），按kShmRingAlign对齐；环尾放不下时写入回绕标记，记录在环内始终连续，读端可原地解析
+// 读写位置各端本地保存，对端位置读取后校验（对端写坏共享内存时Front返回-1，不越界）
+// 唤醒：读端处理完后以Sleep标记空闲（再次检查无新记录），写端Commit返回是否需唤醒（读端空闲），仅此时经eventfd通知，连续收发不产生系统调用
+class wShmRing : private wNoncopyable {
+public:
+	wShmRing() : mRing(NULL), mData(NULL), mSize(0), mPos(0), mPad(0) { }
+
+	// 容量为size的环所需共享内存长度
+	static inline size_t Space(size_t size) {
+		return sizeof(wShmRingHead_t) + size;
+	}
+
+	// ptr为共享内存中环地址（64字节对齐），create为true时初始化环头。size须为2的幂且不小于2倍kPackageSize
+	int Init(void* ptr, size_t size, bool create);
+
+	// 写端：预留len字节（完整消息）连续空间，空间不足返回NULL
+	char* Reserve(size_t len);
+	// 写端：提交预留的记录，返回读端是否空闲（需唤醒）
+	bool Commit(size_t len);
+	// 写端：环满时标记等待（再次检查空间，已有len字节空间返回false）
+	bool PushSleep(size_t len);
+
+	// 读端：首条记录（msg为数据协议起始，len同Handlemsg），有记录返回1，空返回0，环损坏返回-1
+	int Front(char** msg, uint32_t* len);
+	// 读端：释放首条记录
+	void Pop();
+	// 读端：释放记录后调用，返回写端是否等待空间（需唤醒）
+	bool Released();
+	// 读端：标记空闲（再次检查有新记录返回false）
+	bool Sleep();
+
+	inline size_t Size() const { return mSize;}
+
+protected:
+	static inline uint64_t RecordLen(uint64_t len) {
+		return (len + kShmRingAlign - 1) & ~static_cast<uint64_t>(kShmRingAlign - 1);
+	}
+
+	// 写端：need字节记录可否写入（pad为环尾跳过长度）
+	bool Fit(uint64_t need, uint64_t* pad) const;
+
+	wShmRingHead_t* mRing;
+	char* mData;
+	uint64_t mSize;
+	uint64_t mPos;	// 本端位置（写端写入位置，读端读取位置）
+	uint64_t mPad;	// 写端：预留时环尾跳过长度；读端：首条记录长度
+};
+
+const uint32_t	kMpscEpochShift = 48;					// 环头高16位为纪元，低48位为位置
+const uint64_t	kMpscPosMask = (1ULL << kMpscEpochShift) - 1;
+const int64_t	kMpscStallTm = 1000000;					// 记录预留后超过此时长（微秒）仍未提交，视为写端已退出
+
+// 共享内存多生产者、单消费者消息环（master、worker进程间消息，每个worker一个环，见wServer::SyncWorker）
+// 记录为[uint32长度][uint32纪元][uint8数据协议][消息]，按kShmRingAlign对齐。写端以CAS竞争预留空间（CAS比较值含纪元），写入消息后最后以
+// 单次8字节写入提交长度及预留时的纪元；读端按序读取，仅接受本纪元的已提交记录（其他均视为未提交），处理后清零记录再推进读取位置
+// 写端在预留后、提交前退出时，读端在首条记录超过kMpscStallTm仍未提交后进入新纪元，丢弃已预留的全部记录（含其后已提交的记录）并记录错误；
+// 此期间写端Push返回-1（不报告成功）。仅被抢占（未退出）超过kMpscStallTm的写端，其记录同样被丢弃（Push已返回0），仅记录错误日志。旧纪元写端的迟到提交被读端忽略，但其数据仍可能写入环中，新纪元自原位置继续，须环回绕一圈后才会覆盖
+// 唤醒同wShmRing：读端Sleep标记空闲，写端Push返回是否需唤醒
+// 环头、数据均位于fork前创建的共享内存（各进程地址相同），Init不访问共享内存，Reset由master在worker启动前调用
+struct wMpscRingHead_t {
+	alignas(64) wAtomic<uint64_t> mHead;	// 纪元 + 已预留位置（累计字节，写端竞争）
+	alignas(64) wAtomic<uint64_t> mTail;	// 读取位置（累计字节，低48位）
+	wAtomic<uint32_t> mPopWait;				// 读端空闲，等待唤醒
+	wAtomic<int64_t> mTailTm;				// 首条记录开始等待的时刻（微秒）：读取位置推进，或空环时预留
+};
+
+class wMpscRing : private wNoncopyable {
+public:
+	wMpscRing() : mRing(NULL), mData(NULL), mSize(0), mPos(0), mLen(0), mEpoch(0), mStallPos(0), mStallTm(0) { }
+
+	static inline size_t Space(size_t size) {
+		return sizeof(wMpscRingHead_t) + size;
+	}
+
+	// ptr为共享内存中环地址（64字节对齐），size须为2的幂
+	int Init(void* ptr, size_t size);
+	// 进入新纪元并丢弃环中全部记录，读端视为空闲（首条消息即唤醒）。不清零数据，不等待正在写入的写端
+	void Reset();
+
+	// 写端：写入msg（tcp格式完整消息，len字节）。未初始化、空间不足、环阻塞于未提交记录返回-1，成功返回0，读端空闲（需唤醒）返回1
+	int Push(const char msg[], size_t len);
+
+	// 读端：同wShmRing。首条记录超时未提交时丢弃并进入新纪元
+	int Front(char** msg, uint32_t* len);
+	void Pop();
+	bool Sleep();
+
+	inline bool Valid() const { return mRing != NULL;}
+
+protected:
+	static inline uint64_t RecordLen(uint64_t len) {
+		return (len + kShmRingAlign - 1) & ~static_cast<uint64_t>(kShmRingAlign - 1);
+	}
+	// 记录字：低32位长度，高32位纪元（0为空）
+	static inline uint64_t Tag(uint64_t head, uint32_t len) {
+		return (head >> kMpscEpochShift) << 32 | len;
+	}
+
+	// 记录字（写端提交、读端清零）
+	inline wAtomic<uint64_t>* Word(uint64_t pos) const {
+		return reinterpret_cast<wAtomic<uint64_t>*>(mData + (pos & (mSize - 1)));
+	}
+	inline bool Committed(uint64_t word, uint64_t epoch) const {
+		return word != 0 && (word >> 32) == epoch;
+	}
+
+	// 写端：读取位置tail处记录成为首条记录后已超过kMpscStallTm仍未提交
+	bool Stuck(uint64_t tail);
+	// 读端：首条记录超时未提交
+	bool Stalled();
+	// 进入新纪元，读取位置移至已预留位置
+	void Skip();
+
+	wMpscRingHead_t* mRing;
+	char* mData;
+	uint64_t mSize;
+	uint64_t mPos;	// 读端读取位置（低48位）
+	uint64_t mLen;	// 读端首条记录长度
+	uint64_t mEpoch;	// 读端纪元
+	uint64_t mStallPos;	// 读端首条记录未提交的位置、起始时刻
+	int64_t mStallTm;
+};
+
+}	// namespace hnet
+
+#endif
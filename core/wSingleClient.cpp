@@ -24,7 +24,7 @@ int wSingleClient::Connect(const std::string& ipaddr, uint16_t port, const std::
        HNET_NEW(wTcpSocket(kStConnect), socket);
     } else if (protocol == "HTTP") {
         HNET_NEW(wTcpSocket(kStConnect, kSpHttp), socket);
-    } else if (protocol == "UNIX") {
+    } else if (protocol == "UNIX" || protocol == "SHM") {
        HNET_NEW(wUnixSocket(kStConnect), socket);
     }
 
@@ -54,7 +54,7 @@ int wSingleClient::Connect(const std::string& ipaddr, uint16_t port, const std::
         HNET_NEW(wTcpTask(socket), mTask);
     } else if (protocol == "HTTP") {
         HNET_NEW(wHttpTask(socket), mTask);
-    } else if (protocol == "UNIX") {
+    } else if (protocol == "UNIX" || protocol == "SHM") {
         HNET_NEW(wUnixTask(socket), mTask);
     } else {
         HNET_DELETE(socket);
@@ -66,6 +66,11 @@ int wSingleClient::Connect(const std::string& ipaddr, uint16_t port, const std::
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wSingleClient::Connect new() failed", error::Strerror(errno).c_str());
         return -1;
     }
+
+    // 协商共享内存传输，失败时继续使用unix socket
+    if (protocol == "SHM" && static_cast<wUnixTask*>(mTask)->ShmConnect() == -1) {
+        HNET_WARN(soft::GetLogPath(), "%s : %s", "wSingleClient::Connect ShmConnect() failed", "fallback to unix socket");
+    }
     return 0;
 }
 
@@ -24,6 +24,7 @@ public:
     wSingleClient() : mTask(NULL) { }
     ~wSingleClient();
 
+    // protocol：TCP、HTTP、UNIX；SHM为unix socket协商共享内存传输（见wUnixTask），服务端不支持时同UNIX
     int Connect(const std::string& ipaddr, uint16_t port, const std::string& protocol = "TCP");
 
     inline int SyncSend(char cmd[], size_t len, ssize_t *size) {
@@ -44,6 +45,8 @@ public:
     }
 #endif
 
+    inline wTask* Task() { return mTask;}
+
     int HttpGet(const std::string& url, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout = 30);
     int HttpPost(const std::string& url, const std::map<std::string, std::string>& data, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout = 30);
 
@@ -76,6 +76,10 @@ inline bool operator!=(const wSlice& x, const wSlice& y) {
     return !(x == y);
 }
 
+inline std::ostream& operator<<(std::ostream& os, const wSlice& x) {
+    return os.write(x.data(), x.size());
+}
+
 inline int wSlice::compare(const wSlice& b) const {
     const size_t minLen = (mSize < b.mSize) ? mSize : b.mSize;
     int r = memcmp(mData, b.mData, minLen);
@@ -4,6 +4,8 @@
  * Copyright (C) Hupu, Inc.
  */
 
+#include <sys/sendfile.h>
+#include <algorithm>
 #include "wSocket.h"
 
 namespace hnet {
@@ -76,6 +78,75 @@ int wSocket::SendBytes(char buf[], size_t len, ssize_t *size) {
     return ret;
 }
 
+int wSocket::SendvBytes(const struct iovec* iov, int iovcnt, ssize_t *size) {
+    mSendTm = soft::TimeUsec();
+
+    // 部分发送时调整本地iov副本
+    struct iovec vec[kIovMax];
+    iovcnt = std::min(iovcnt, static_cast<int>(kIovMax));
+    memcpy(vec, iov, sizeof(struct iovec) * iovcnt);
+
+    int ret = 0, i = 0;
+    *size = 0;
+    while (i < iovcnt) {
+        ssize_t n = writev(mFD, vec + i, iovcnt - i);
+        if (n >= 0) {
+            *size += n;
+            // 跳过已发送段
+            while (i < iovcnt && static_cast<size_t>(n) >= vec[i].iov_len) {
+                n -= vec[i].iov_len;
+                i++;
+            }
+            if (i < iovcnt) {
+                vec[i].iov_base = reinterpret_cast<char*>(vec[i].iov_base) + n;
+                vec[i].iov_len -= n;
+            }
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EPIPE) {
+            ret = -1;
+            break;
+        } else {
+            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wSocket::SendvBytes writev() failed", error::Strerror(errno).c_str());
+            ret = -1;
+            break;
+        }
+    }
+    return ret;
+}
+
+int wSocket::SendFile(int fd, off_t* offset, size_t count, ssize_t *size) {
+    mSendTm = soft::TimeUsec();
+
+    int ret = 0;
+    *size = 0;
+    while (static_cast<size_t>(*size) < count) {
+        ssize_t n = sendfile(mFD, fd, offset, count - *size);
+        if (n > 0) {
+            *size += n;
+        } else if (n == 0) {
+            // 文件被截断
+            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wSocket::SendFile sendfile() failed", "unexpected end of file");
+            ret = -1;
+            break;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EPIPE) {
+            ret = -1;
+            break;
+        } else {
+            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wSocket::SendFile sendfile() failed", error::Strerror(errno).c_str());
+            ret = -1;
+            break;
+        }
+    }
+    return ret;
+}
+
 int wSocket::Close() {
     int ret = close(mFD);
     if (ret == -1) {
@@ -8,6 +8,7 @@
 #define _W_SOCKET_H_
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include "wCore.h"
 #include "wMisc.h"
 #include "wNoncopyable.h"
@@ -35,7 +36,7 @@ enum SockStatus {
     kSsConnected    // 已连接
 };
 
-enum SockProto  { kSpUnknown = 0, kSpTcp, kSpUdp, kSpUnix, kSpChannel, kSpHttp};
+enum SockProto  { kSpUnknown = 0, kSpTcp, kSpUdp, kSpUnix, kSpChannel, kSpHttp, kSpWebSocket, kSpArq};
 enum SockFlag   { kSfUnknown = 0, kSfRvsd, kSfRecv, kSfSend};
 
 class wSocket : private wNoncopyable {
@@ -63,6 +64,16 @@ public:
     // size>= 0 发送字符
     // 返回 =-1 表示需要关闭该连接，并清理内存
     virtual int SendBytes(char buf[], size_t len, ssize_t *size);
+
+    // 聚集发送（writev），多段数据一次系统调用发出，无需先拷贝至连续缓冲
+    // size>= 0 已发送字符（可能小于总长度：写缓冲满，稍后重试）
+    // 返回 =-1 表示需要关闭该连接，并清理内存
+    virtual int SendvBytes(const struct iovec* iov, int iovcnt, ssize_t *size);
+
+    // 零拷贝发送文件（sendfile），自文件offset处发送至多count字节，offset随之前移
+    // size>= 0 已发送字符（可能小于count：写缓冲满，稍后重试）
+    // 返回 =-1 表示需要关闭该连接，并清理内存
+    virtual int SendFile(int fd, off_t* offset, size_t count, ssize_t *size);
     
     // 从客户端接收连接
     // fd   =-1 发生错误|稍后重试
@@ -11,20 +11,104 @@
 #include "wSocket.h"
 #include "wMaster.h"
 #include "wWorker.h"
+#include "wResponseCache.h"
 
 namespace hnet {
 
-wTask::wTask(wSocket* socket, int32_t type) : mType(type), mSocket(socket), mHeartbeat(0), mServer(NULL), mClient(NULL), mSCType(-1) {
+wTask::wTask(wSocket* socket, int32_t type) : mDispatch(NULL), mDispatchType(NULL), mDispatchBuild(false), mType(type), mSocket(socket), mHeartbeat(0), mServer(NULL), mClient(NULL), mSCType(-1), mMemoCapture(false) {
 	ResetBuffer();
+#ifdef _USE_PROTOBUF_
+	google::protobuf::ArenaOptions options;
+	options.initial_block = mArenaBuff;
+	options.initial_block_size = sizeof(mArenaBuff);
+	HNET_NEW(google::protobuf::Arena(options), mArena);
+	if (mArena == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::wTask new() failed", "arena");
+	}
+#endif
+}
+
+bool wTask::DispatchEntry() {
+	// 构造期间typeid(*this)为当前构造类
+	const std::type_info& tid = typeid(*this);
+	if (mDispatchType == NULL || *mDispatchType != tid) {
+		wDispatch* dispatch = wDispatch::Entry(tid, mDispatch, &mDispatchBuild);
+		if (dispatch == NULL) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::DispatchEntry new() failed", "");
+			return false;
+		}
+		mDispatch = dispatch;
+		mDispatchType = &tid;
+	}
+	return mDispatchBuild;
+}
+
+void wTask::Memo(int8_t cmd, int8_t para, uint32_t ttl) {
+	if (DispatchEntry() && mDispatch->Memo(CmdId(cmd, para), ttl) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[cmd=%d, para=%d]", "wTask::Memo () failed", "route not found", cmd, para);
+	}
+}
+
+void wTask::Memo(const std::string& pbname, uint32_t ttl) {
+	if (DispatchEntry() && mDispatch->Memo(pbname, ttl) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[name=%s]", "wTask::Memo () failed", "route not found", pbname.c_str());
+	}
+}
+
+size_t wTask::MemoInvalidate(uint8_t cmd, uint8_t para) {
+	return wResponseCache::Default()->Invalidate(wResponseCache::CmdTag(CmdId(cmd, para)));
+}
+
+size_t wTask::MemoInvalidate(const std::string& pbname) {
+	return wResponseCache::Default()->Invalidate(wResponseCache::PbTag(PbId(pbname.data(), pbname.size())));
+}
+
+bool wTask::MemoBegin(const char* msg, size_t len) {
+	// 键：路由表（task类） + 消息
+	mMemoKey.assign(reinterpret_cast<const char*>(&mDispatch), sizeof(mDispatch));
+	mMemoKey.append(msg, len);
+	const std::string* data = wResponseCache::Default()->Get(mMemoKey);
+	if (data != NULL && MemoSend(*data) == 0) {
+		return true;
+	}
+	mMemoCapture = true;
+	mMemoData.clear();
+	return false;
+}
+
+int wTask::MemoSend(const std::string& data) {
+	char* buf = Reserve(data.size());
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::MemoSend () failed", "left buffer not enough");
+		return -1;
+	}
+	memcpy(buf, data.data(), data.size());
+	Commit(data.size());
+	Output();
+	return 0;
+}
+
+void wTask::MemoEnd(const std::string& tag, uint32_t ttl) {
+	if (mMemoCapture) {
+		mMemoCapture = false;
+		if (!mMemoData.empty()) {
+			wResponseCache::Default()->Put(mMemoKey, tag, &mMemoData, ttl);
+		}
+	}
 }
 
 void wTask::ResetBuffer() {
 	mRecvLen = mSendLen = 0;
 	mRecvRead = mRecvWrite = mRecvBuff;
 	mSendRead = mSendWrite = mSendBuff;
+	mSendReserve = NULL;
+	mSendReserveLen = 0;
 }
 
 wTask::~wTask() {
+#ifdef _USE_PROTOBUF_
+    HNET_DELETE(mArena);
+#endif
     HNET_DELETE(mSocket);
 }
 
@@ -118,7 +202,7 @@ int wTask::TaskRecv(ssize_t *size) {
 
             } else if (reallen > static_cast<uint32_t>(len - sizeof(uint32_t))) {
                 ret = 0;
-                HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::TaskRecv () failed", ">0 recv a part of message");
+                HNET_DEBUG_LIMIT(soft::GetLogPath(), "%s : %s", "wTask::TaskRecv () failed", ">0 recv a part of message");
                 break;
             }
 
@@ -150,7 +234,7 @@ int wTask::TaskRecv(ssize_t *size) {
 
             } else if (reallen > static_cast<uint32_t>(kPackageSize - abs(len) - sizeof(uint32_t))) {
                 ret = 0;
-                HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::TaskRecv () failed", "<=0 recv a part of message");
+                HNET_DEBUG_LIMIT(soft::GetLogPath(), "%s : %s", "wTask::TaskRecv () failed", "<=0 recv a part of message");
                 break;
             }
             
@@ -211,23 +295,30 @@ int wTask::TaskSend(ssize_t *size) {
 
 #ifdef _USE_PROTOBUF_
 // 整理protobuf消息至buf
-void wTask::Assertbuf(char buf[], const google::protobuf::Message* msg) {
+void wTask::Assertbuf(char buf[], const google::protobuf::Message* msg, bool cached) {
 	// 类名 && 长度
-	const std::string& pbName = msg->GetTypeName();
-	uint16_t nameLen = static_cast<uint16_t>(pbName.size());
-	// 消息体总长度
-	uint32_t len = sizeof(uint8_t) + sizeof(uint16_t) + nameLen + msg->ByteSize();
+	const std::string& pbName = msg->GetDescriptor()->full_name();
+	size_t headLen = PbHeadLen(pbName);
+	// 消息体总长度（仅计算一次，序列化使用缓存长度）
+	uint32_t len = static_cast<uint32_t>(PbPackLen(msg, cached));
 
 	// 消息长度
 	coding::EncodeFixed32(buf, len);
-    // protobuf消息类型
-	coding::EncodeFixed8(buf + sizeof(uint32_t), static_cast<uint8_t>(kMpProtobuf));
-	// 类名长度
-	coding::EncodeFixed16(buf + sizeof(uint32_t) + sizeof(uint8_t), nameLen);
-	// 类名
-	memcpy(buf + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint16_t), pbName.data(), nameLen);
+	if (kPbIdTurn) {
+		// protobuf消息类型
+		coding::EncodeFixed8(buf + sizeof(uint32_t), static_cast<uint8_t>(kMpProtobufId));
+		// 类型ID
+		coding::EncodeFixed32(buf + sizeof(uint32_t) + sizeof(uint8_t), PbId(pbName.data(), pbName.size()));
+	} else {
+		// protobuf消息类型
+		coding::EncodeFixed8(buf + sizeof(uint32_t), static_cast<uint8_t>(kMpProtobuf));
+		// 类名长度
+		coding::EncodeFixed16(buf + sizeof(uint32_t) + sizeof(uint8_t), static_cast<uint16_t>(pbName.size()));
+		// 类名
+		memcpy(buf + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint16_t), pbName.data(), pbName.size());
+	}
     // 消息体
-	msg->SerializeToArray(reinterpret_cast<void*>(buf+sizeof(uint32_t)+sizeof(uint8_t)+sizeof(uint16_t)+nameLen), msg->ByteSize());
+	msg->SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(buf + sizeof(uint32_t) + sizeof(uint8_t) + headLen));
 }
 #endif
 
@@ -241,72 +332,97 @@ void wTask::Assertbuf(char buf[], const char cmd[], size_t len) {
 	memcpy(buf + sizeof(uint32_t) + sizeof(uint8_t), cmd, len);
 }
 
+char* wTask::Reserve(size_t len) {
+    if (len > static_cast<size_t>(kPackageSize - mSendLen)) {
+        return NULL;
+    } else if (mSendLen == 0) {
+    	// 缓冲已空，从头写入
+    	mSendRead = mSendWrite = mSendBuff;
+    }
+
+    const char *buffend = mSendBuff + kPackageSize;
+    ssize_t writelen =  mSendWrite - mSendRead;
+    ssize_t leftlen = buffend - mSendWrite;
+    if ((writelen >= 0 && leftlen >= static_cast<ssize_t>(len)) || (writelen < 0 && abs(writelen) >= static_cast<ssize_t>(len))) {
+    	// 单向剩余足够（右边剩余 || 中间剩余），直接写入
+    	mSendReserve = mSendWrite;
+    } else if (writelen >= 0 && leftlen < static_cast<ssize_t>(len)) {
+    	// 分段剩余足够（两边剩余），写入临时缓冲，Commit时分段拷贝
+    	mSendReserve = mTempBuff;
+    } else {
+    	return NULL;
+    }
+    mSendReserveLen = len;
+    return mSendReserve;
+}
+
+int wTask::Commit(size_t len) {
+    if (mSendReserve == NULL) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Commit () failed", "no reserve");
+        return -1;
+    } else if (len > mSendReserveLen) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Commit () failed", "commit length exceeds reserve");
+        mSendReserve = NULL;
+        mSendReserveLen = 0;
+        return -1;
+    }
+    if (mMemoCapture) {
+    	mMemoData.append(mSendReserve, len);
+    }
+    if (mSendReserve == mSendWrite) {
+    	mSendWrite += len;
+    } else if (mSendReserve == mTempBuff) {
+        size_t leftlen = mSendBuff + kPackageSize - mSendWrite;
+        if (len <= leftlen) {
+        	// 实际提交长度小于预留长度，尾部已够
+        	memcpy(mSendWrite, mTempBuff, len);
+        	mSendWrite += len;
+        } else {
+        	memcpy(mSendWrite, mTempBuff, leftlen);
+        	memcpy(mSendBuff, mTempBuff + leftlen, len - leftlen);
+        	mSendWrite = mSendBuff + len - leftlen;
+        }
+    }
+    mSendReserve = NULL;
+    mSendReserveLen = 0;
+    mSendLen += len;
+    return 0;
+}
+
 int wTask::Send2Buf(char cmd[], size_t len) {
 	// 消息体总长度
 	len += sizeof(uint8_t);
     if (len < kMinPackageSize || len > kMaxPackageSize) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "message too large");
         return -1;
-
-    } else if (len > static_cast<size_t>(kPackageSize - mSendLen - sizeof(uint32_t))) {
-        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "left buffer not enough");
-        return -1;
     }
 
-    const char *buffend = mSendBuff + kPackageSize;
-    ssize_t writelen =  mSendWrite - mSendRead;
-    ssize_t leftlen = buffend - mSendWrite;
-    if ((writelen >= 0 && leftlen >= static_cast<ssize_t>(len + sizeof(uint32_t))) || (writelen < 0 && abs(writelen) >= static_cast<ssize_t>(len + sizeof(uint32_t)))) {
-    	// 单向剩余足够（右边剩余 || 中间剩余）
-    	Assertbuf(mSendWrite, cmd, len - sizeof(uint8_t));
-    	mSendWrite += sizeof(uint32_t) + len;
-
-    } else if (writelen >= 0 && leftlen < static_cast<ssize_t>(len + sizeof(uint32_t))) {
-    	// 分段剩余足够（两边剩余）
-    	Assertbuf(mTempBuff, cmd, len - sizeof(uint8_t));
-    	memcpy(mSendWrite, mTempBuff, leftlen);
-    	mSendWrite = mSendBuff;
-    	memcpy(mSendWrite, mTempBuff + leftlen, sizeof(uint32_t) + len - leftlen);
-    	mSendWrite += sizeof(uint32_t)+ len - leftlen;
-
-    } else {
+    char* buf = Reserve(sizeof(uint32_t) + len);
+    if (buf == NULL) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "left buffer not enough");
         return -1;
     }
-    mSendLen += sizeof(uint32_t) + len;
+    Assertbuf(buf, cmd, len - sizeof(uint8_t));
+    Commit(sizeof(uint32_t) + len);
     return 0;
 }
 
 #ifdef _USE_PROTOBUF_
-int wTask::Send2Buf(const google::protobuf::Message* msg) {
+int wTask::Send2Buf(const google::protobuf::Message* msg, bool cached) {
 	// 消息体总长度
-	uint32_t len = sizeof(uint8_t) + sizeof(uint16_t) + msg->GetTypeName().size() + msg->ByteSize();
+	size_t len = PbPackLen(msg, cached);
     if (len < kMinPackageSize || len > kMaxPackageSize) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "message too large");
         return -1;
-    } else if (len > static_cast<uint32_t>(kPackageSize - mSendLen - sizeof(uint32_t))) {
-        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "left buffer not enough");
-        return -1;
     }
 
-    const char *buffend = mSendBuff + kPackageSize;
-    ssize_t writelen =  mSendWrite - mSendRead;
-    ssize_t leftlen = buffend - mSendWrite;
-    if ((writelen >= 0 && leftlen >= static_cast<ssize_t>(len + sizeof(uint32_t))) || (writelen < 0 && abs(writelen) >= static_cast<ssize_t>(len + sizeof(uint32_t)))) {
-    	// 单向剩余足够（右边剩余 || 中间剩余）
-    	Assertbuf(mSendWrite, msg);
-    	mSendWrite += sizeof(uint32_t) + len;
-    } else if (writelen >= 0 && leftlen < static_cast<ssize_t>(len + sizeof(uint32_t))) {
-    	// 分段剩余足够（两边剩余）
-    	Assertbuf(mTempBuff, msg);
-    	memcpy(mSendWrite, mTempBuff, leftlen);
-    	memcpy(mSendWrite = mSendBuff, mTempBuff + leftlen, sizeof(uint32_t) + len - leftlen);
-    	mSendWrite += sizeof(uint32_t)+ len - leftlen;
-    } else {
+    char* buf = Reserve(sizeof(uint32_t) + len);
+    if (buf == NULL) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "left buffer not enough");
         return -1;
     }
-    mSendLen += sizeof(uint32_t) + len;
+    Assertbuf(buf, msg, true);
+    Commit(sizeof(uint32_t) + len);
     return 0;
 }
 #endif
@@ -424,13 +540,13 @@ int wTask::SyncSend(char cmd[], size_t len, ssize_t *size) {
 #ifdef _USE_PROTOBUF_
 int wTask::SyncSend(const google::protobuf::Message* msg, ssize_t *size) {
 	// 消息体总长度
-	uint32_t len = sizeof(uint8_t) + sizeof(uint16_t) + msg->GetTypeName().size() + msg->ByteSize();
+	size_t len = PbPackLen(msg);
 	if (len < kMinPackageSize || len > kMaxPackageSize) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::SyncSend () failed", "message length error");
         return -1;
     }
 
-	Assertbuf(mTempBuff, msg);
+	Assertbuf(mTempBuff, msg, true);
     return mSocket->SendBytes(mTempBuff, len + sizeof(uint32_t), size);
 }
 #endif
@@ -525,7 +641,7 @@ int wTask::SyncRecv(google::protobuf::Message* msg, ssize_t *size, size_t msglen
     size_t recvheadlen = 0, recvbodylen = 0, headlen = 0;
     int64_t now = soft::TimeUsec();
     if (msglen > 0) {
-        headlen = kCmdHeadLen + msglen + sizeof(uint16_t) + msg->GetTypeName().size();  // 类名协议
+        headlen = kCmdHeadLen + msglen + PbHeadLen(msg->GetDescriptor()->full_name());  // 类型协议（与本端发送协议一致）
     } else {
         headlen = kCmdHeadLen + sizeof(uint16_t);  // 至少有一条消息
     }
@@ -591,7 +707,21 @@ int wTask::SyncRecv(google::protobuf::Message* msg, ssize_t *size, size_t msglen
         return -1;
     }
 
-    uint32_t n = sizeof(uint16_t) + coding::DecodeFixed16(mTempBuff + kCmdHeadLen); // 类名长度
+    // 类型头长度
+    uint32_t n = 0;
+    uint8_t sp = static_cast<uint8_t>(coding::DecodeFixed8(mTempBuff + sizeof(uint32_t)));
+    if (sp == kMpProtobufId) {
+        n = sizeof(uint32_t);
+    } else if (sp == kMpProtobuf) {
+        n = sizeof(uint16_t) + coding::DecodeFixed16(mTempBuff + kCmdHeadLen);
+    } else {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s[sp=%d]", "wTask::SyncRecv () failed", "protobuf invalid", sp);
+        return -1;
+    }
+    if (len < sizeof(uint8_t) + n) {	// 类型头不完整
+        HNET_ERROR(soft::GetLogPath(), "%s : %s[sp=%d]", "wTask::SyncRecv () failed", "protobuf invalid", sp);
+        return -1;
+    }
     *size = len - sizeof(uint8_t) - n;
     if (msglen > 0 && msglen != static_cast<size_t>(*size)) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::SyncRecv () failed", "message length error,error message");
@@ -615,7 +745,10 @@ int wTask::Handlemsg(char cmd[], uint32_t len) {
 			mHeartbeat = 0;
 		} else {
 			struct Request_t request(cmd, len);
-			if (mEventCmd(basecmd->GetId(), &request) == false) {
+			uint32_t ttl = mDispatch != NULL? mDispatch->MemoCmd(basecmd->GetId()): 0;
+			if (ttl > 0 && MemoBegin(cmd - sizeof(uint8_t), len + sizeof(uint8_t))) {
+				// 缓存响应
+			} else if (mDispatch == NULL || mDispatch->Emit(this, basecmd->GetId(), &request) == false) {
 				std::string id = "id:";
 				logging::AppendNumberTo(&id, static_cast<uint64_t>(basecmd->GetId()));
 				id += ", cmd:";
@@ -626,16 +759,56 @@ int wTask::Handlemsg(char cmd[], uint32_t len) {
                 HNET_ERROR(soft::GetLogPath(), "%s : %s[id=%s]", "wTask::Handlemsg () failed", "request invalid", id.c_str());
                 ret = -1;
 			}
+			if (ttl > 0) {
+				MemoEnd(wResponseCache::CmdTag(basecmd->GetId()), ttl);
+			}
 		}
 	} else if (sp == kMpProtobuf) {
 #ifdef _USE_PROTOBUF_
 		uint16_t l = coding::DecodeFixed16(cmd);
-		std::string name(cmd + sizeof(uint16_t), l);
+		const char* name = cmd + sizeof(uint16_t);
 		struct Request_t request(cmd + sizeof(uint16_t) + l, len - sizeof(uint16_t) - l);
-		if (mEventPb(name, &request) == false) {
-            HNET_ERROR(soft::GetLogPath(), "%s : %s[name=%s]", "wTask::Handlemsg () failed", "request invalid", name.c_str());
+		request.mArena = mArena;
+		uint32_t id = PbId(name, static_cast<size_t>(l));
+		uint32_t ttl = mDispatch != NULL? mDispatch->MemoPb(id): 0;
+		if (ttl > 0 && MemoBegin(cmd - sizeof(uint8_t), len + sizeof(uint8_t))) {
+			// 缓存响应
+		} else if (mDispatch == NULL || mDispatch->EmitPb(this, name, l, &request) == false) {
+            HNET_ERROR(soft::GetLogPath(), "%s : %s[name=%s]", "wTask::Handlemsg () failed", "request invalid", std::string(name, l).c_str());
             ret = -1;
 		}
+		if (ttl > 0) {
+			MemoEnd(wResponseCache::PbTag(id), ttl);
+		}
+		if (mArena != NULL) {
+			mArena->Reset();
+		}
+#else
+        HNET_ERROR(soft::GetLogPath(), "%s : %s[sp=%d]", "wTask::Handlemsg () failed", "protobuf invalid", sp);
+        ret = -1;
+#endif
+	} else if (sp == kMpProtobufId) {
+#ifdef _USE_PROTOBUF_
+		if (len < sizeof(uint32_t)) {	// 类型ID不完整
+            HNET_ERROR(soft::GetLogPath(), "%s : %s[sp=%d]", "wTask::Handlemsg () failed", "protobuf invalid", sp);
+            return -1;
+		}
+		uint32_t id = coding::DecodeFixed32(cmd);
+		struct Request_t request(cmd + sizeof(uint32_t), len - sizeof(uint32_t));
+		request.mArena = mArena;
+		uint32_t ttl = mDispatch != NULL? mDispatch->MemoPb(id): 0;
+		if (ttl > 0 && MemoBegin(cmd - sizeof(uint8_t), len + sizeof(uint8_t))) {
+			// 缓存响应
+		} else if (mDispatch == NULL || mDispatch->EmitPb(this, id, &request) == false) {
+            HNET_ERROR(soft::GetLogPath(), "%s : %s[id=%u]", "wTask::Handlemsg () failed", "request invalid", id);
+            ret = -1;
+		}
+		if (ttl > 0) {
+			MemoEnd(wResponseCache::PbTag(id), ttl);
+		}
+		if (mArena != NULL) {
+			mArena->Reset();
+		}
 #else
         HNET_ERROR(soft::GetLogPath(), "%s : %s[sp=%d]", "wTask::Handlemsg () failed", "protobuf invalid", sp);
         ret = -1;
@@ -9,7 +9,8 @@
 
 #include "wCore.h"
 #include "wNoncopyable.h"
-#include "wEvent.h"
+#include "wCommand.h"
+#include "wDispatch.h"
 #include "wServer.h"
 #include "wMultiClient.h"
 #include "wLogger.h"
@@ -20,13 +21,6 @@
 
 namespace hnet {
 
-// 消息绑定函数参数类型
-struct Request_t {
-	char* mBuf;
-	uint32_t mLen;
-	Request_t(char buf[], uint32_t len) : mBuf(buf), mLen(len) { }
-};
-
 class wSocket;
 
 class wTask : private wNoncopyable {
@@ -61,18 +55,25 @@ public:
     // 解析消息
     virtual int Handlemsg(char cmd[], uint32_t len);
 
-    // 异步发送：将待发送客户端消息写入buf，等待TaskSend发送
-    int Send2Buf(char cmd[], size_t len);
+    // 异步发送：将待发送客户端消息写入buf，等待TaskSend发送（派生类可覆盖消息封装，如websocket帧）
+    virtual int Send2Buf(char cmd[], size_t len);
 #ifdef _USE_PROTOBUF_
-    int Send2Buf(const google::protobuf::Message* msg);
+    // cached为true时直接使用msg->GetCachedSize()（调用者已调用ByteSizeLong()且消息未再修改，如广播）
+    virtual int Send2Buf(const google::protobuf::Message* msg, bool cached = false);
 #endif
 
-    // 同步发送确切长度消息
+    // 预留发送缓冲中len字节连续空间，消息直接编码至该地址后调用Commit(len)提交
+    // 空间不足返回NULL。Reserve与Commit之间不可有其他发送操作；提交长度可小于预留长度
+    // 无预留或提交长度超过预留长度时返回-1，不提交
+    char* Reserve(size_t len);
+    int Commit(size_t len);
+
+    // 同步发送确切长度消息（派生类可覆盖传输，如unix共享内存环）
     // size = -1 对端发生错误|稍后重试|对端关闭
     // size >= 0 发送字符
-    int SyncSend(char cmd[], size_t len, ssize_t *size);
+    virtual int SyncSend(char cmd[], size_t len, ssize_t *size);
 #ifdef _USE_PROTOBUF_
-    int SyncSend(const google::protobuf::Message* msg, ssize_t *size);
+    virtual int SyncSend(const google::protobuf::Message* msg, ssize_t *size);
 #endif
 
     // SyncSend的异步发送版本
@@ -86,9 +87,9 @@ public:
     // size = -1 对端发生错误|稍后重试
     // size = 0  对端关闭
     // size > 0  接受字符
-    int SyncRecv(char cmd[], ssize_t *size, size_t msglen = 0, uint32_t timeout = 30);
+    virtual int SyncRecv(char cmd[], ssize_t *size, size_t msglen = 0, uint32_t timeout = 30);
 #ifdef _USE_PROTOBUF_
-    int SyncRecv(google::protobuf::Message* msg, ssize_t *size, size_t msglen = 0, uint32_t timeout = 30);
+    virtual int SyncRecv(google::protobuf::Message* msg, ssize_t *size, size_t msglen = 0, uint32_t timeout = 30);
 #endif
 
     // 同步广播其他worker进程
@@ -115,10 +116,26 @@ public:
 
     static void Assertbuf(char buf[], const char cmd[], size_t len);
 #ifdef _USE_PROTOBUF_
-    static void Assertbuf(char buf[], const google::protobuf::Message* msg);
+    // cached同Send2Buf
+    static void Assertbuf(char buf[], const google::protobuf::Message* msg, bool cached = false);
+
+    // protobuf消息类型头长度：kMpProtobufId为类型ID，kMpProtobuf为类名长度+类名
+    static inline size_t PbHeadLen(const std::string& pbname) {
+        return kPbIdTurn? sizeof(uint32_t): sizeof(uint16_t) + pbname.size();
+    }
+
+    // protobuf消息体总长度（数据协议 + 类型头 + 消息体），cached为false时计算并缓存消息长度
+    static inline size_t PbPackLen(const google::protobuf::Message* msg, bool cached = false) {
+        size_t size = cached? static_cast<size_t>(msg->GetCachedSize()): msg->ByteSizeLong();
+        return sizeof(uint8_t) + PbHeadLen(msg->GetDescriptor()->full_name()) + size;
+    }
 #endif
 
-    int HeartbeatSend();
+    // 响应缓存失效（本进程，见wResponseCache），返回失效条目数
+    static size_t MemoInvalidate(uint8_t cmd, uint8_t para);
+    static size_t MemoInvalidate(const std::string& pbname);
+
+    virtual int HeartbeatSend();
 
     inline bool HeartbeatOut() {
         return mHeartbeat > kHeartbeat;
@@ -158,24 +175,49 @@ public:
     	return config;
     }
 
-    inline size_t SendLen() { return mSendLen;}
+    // 待发送数据长度（派生类可含发送缓冲之外的数据，如待发送文件）
+    virtual size_t SendLen() { return mSendLen;}
+    // 空闲（无处理中的请求、未完成的响应），空闲检测仅关闭空闲连接
+    virtual bool Idle() { return SendLen() == 0;}
     inline int32_t Type() { return mType;}
     inline wSocket* Socket() { return mSocket;}
     
 protected:
     // command消息路由器
+    // 路由表按task类共享，仅该类首个实例注册生效，故应在构造函数中调用。target保留兼容，分发时绑定this
     template<typename T = wTask>
     void On(int8_t cmd, int8_t para, int (T::*func)(struct Request_t *argv), T* target) {
-    	mEventCmd.On(CmdId(cmd, para), std::bind(func, target, std::placeholders::_1));
+    	if (DispatchEntry()) {
+    		mDispatch->On(CmdId(cmd, para), func);
+    	}
     }
-    wEvent<uint16_t, std::function<int(struct Request_t *argv)>, struct Request_t*> mEventCmd;
 
     // protobuf消息路由器
     template<typename T = wTask>
     void On(const std::string& pbname, int (T::*func)(struct Request_t *argv), T* target) {
-    	mEventPb.On(pbname, std::bind(func, target, std::placeholders::_1));
+    	if (DispatchEntry() && mDispatch->On(pbname, func) == -1) {
+    		HNET_ERROR(soft::GetLogPath(), "%s : %s[name=%s]", "wTask::On () failed", "protobuf id collision", pbname.c_str());
+    	}
     }
-    wEvent<std::string, std::function<int(struct Request_t *argv)>, struct Request_t*> mEventPb;
+
+    // 响应缓存（见wResponseCache）：相同请求消息在ttl毫秒内以缓存响应应答，不再调用处理函数
+    // 须在构造函数中对应路由On之后调用
+    void Memo(int8_t cmd, int8_t para, uint32_t ttl);
+    void Memo(const std::string& pbname, uint32_t ttl);
+
+    // 切换至当前构造类的路由表，返回是否需注册路由
+    bool DispatchEntry();
+
+    // 响应缓存查找（msg为完整消息），命中时缓存响应写入发送缓冲返回true；未命中时开始记录处理函数响应（Commit）
+    bool MemoBegin(const char* msg, size_t len);
+    // 缓存记录的响应
+    void MemoEnd(const std::string& tag, uint32_t ttl);
+    // 缓存响应（一个或多个完整消息）写入发送缓冲，空间不足返回-1（派生类可覆盖，如udp按消息分为数据报）
+    virtual int MemoSend(const std::string& data);
+
+    wDispatch* mDispatch;
+    const std::type_info* mDispatchType;
+    bool mDispatchBuild;
 
     int32_t mType;
     wSocket *mSocket;
@@ -185,6 +227,12 @@ protected:
     char mTempBuff[kPackageSize];    // 同步发送、接受消息缓冲
     char mRecvBuff[kPackageSize];    // 异步接受消息缓冲
     char mSendBuff[kPackageSize];    // 异步发送消息缓冲
+
+#ifdef _USE_PROTOBUF_
+    // protobuf消息解析arena，每条消息处理后重置，复用首块内存
+    alignas(8) char mArenaBuff[kPbArenaSize];
+    google::protobuf::Arena* mArena;
+#endif
     
     char *mRecvRead;
     char *mRecvWrite;
@@ -193,12 +241,19 @@ protected:
     char *mSendRead;
     char *mSendWrite;
     size_t mSendLen;  // 可发送数据长度
+    char *mSendReserve;	// Reserve返回地址（mSendWrite 或 跨越缓冲尾时为mTempBuff）
+    size_t mSendReserveLen;	// Reserve预留长度
 
     wServer* mServer;
     wMultiClient* mClient;
 
     // 0为server，1为client
     uint8_t mSCType;
+
+    // 响应缓存：当前请求键，记录中的响应
+    bool mMemoCapture;
+    std::string mMemoKey;
+    std::string mMemoData;
 };
 
 }	// namespace hnet
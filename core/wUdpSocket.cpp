@@ -6,12 +6,30 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <poll.h>
+#include <algorithm>
 #include "wUdpSocket.h"
 #include "wMisc.h"
 
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO		104
+#endif
+
 namespace hnet {
 
+// 单个消息的控制信息缓冲（UDP_SEGMENT、UDP_GRO分段长度）
+union wUdpCtrl_t {
+	char mBuf[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr mAlign;
+};
+
 int wUdpSocket::Open() {
 	mFD = socket(AF_INET, SOCK_DGRAM, 0);
 	if (mFD == -1) {
@@ -82,6 +100,157 @@ int wUdpSocket::RecvBytes(char buf[], size_t len, ssize_t *size) {
     return ret;
 }
 
+int wUdpSocket::RecvBatch(wDatagram_t dgram[], int num, int* size) {
+	mRecvTm = soft::TimeUsec();
+
+	struct mmsghdr msg[kUdpBatch];
+	struct iovec iov[kUdpBatch];
+	union wUdpCtrl_t ctrl[kUdpBatch];
+	num = std::min(num, static_cast<int>(kUdpBatch));
+	memset(msg, 0, sizeof(struct mmsghdr) * num);
+	for (int i = 0; i < num; i++) {
+		iov[i].iov_base = dgram[i].mBuf;
+		iov[i].iov_len = dgram[i].mLen;
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+		msg[i].msg_hdr.msg_name = &dgram[i].mAddr;
+		msg[i].msg_hdr.msg_namelen = sizeof(dgram[i].mAddr);
+		if (mGro) {
+			msg[i].msg_hdr.msg_control = ctrl[i].mBuf;
+			msg[i].msg_hdr.msg_controllen = sizeof(ctrl[i].mBuf);
+		}
+	}
+
+	*size = 0;
+	int ret = recvmmsg(mFD, msg, num, 0, NULL);
+	if (ret == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+			return 0;
+		}
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpSocket::RecvBatch recvmmsg() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	for (int i = 0; i < ret; i++) {
+		dgram[i].mLen = (msg[i].msg_hdr.msg_flags & MSG_TRUNC)? 0: msg[i].msg_len;
+		dgram[i].mSeg = 0;
+		if (mGro) {
+			for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg[i].msg_hdr, cmsg)) {
+				if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+					int seg = 0;
+					memcpy(&seg, CMSG_DATA(cmsg), sizeof(int));
+					if (seg > 0 && static_cast<uint32_t>(seg) < dgram[i].mLen) {
+						dgram[i].mSeg = static_cast<uint32_t>(seg);
+					}
+					break;
+				}
+			}
+		}
+	}
+	*size = ret;
+	return 0;
+}
+
+int wUdpSocket::SendBatch(const wDatagram_t dgram[], int num, int* size) {
+	mSendTm = soft::TimeUsec();
+
+	struct mmsghdr msg[kUdpBatch];
+	struct iovec iov[kUdpBatch];
+	union wUdpCtrl_t ctrl[kUdpBatch];
+	int run[kUdpBatch];
+	num = std::min(num, static_cast<int>(kUdpBatch));
+	memset(msg, 0, sizeof(struct mmsghdr) * num);
+
+	// 每个消息为一个数据报，或GSO合并的连续数据报（每个数据报一个iovec）
+	int nmsg = 0;
+	for (int i = 0; i < num; i += run[nmsg++]) {
+		run[nmsg] = mGso? GsoRun(dgram + i, num - i): 1;
+		for (int j = i; j < i + run[nmsg]; j++) {
+			iov[j].iov_base = dgram[j].mBuf;
+			iov[j].iov_len = dgram[j].mLen;
+		}
+		msg[nmsg].msg_hdr.msg_iov = &iov[i];
+		msg[nmsg].msg_hdr.msg_iovlen = run[nmsg];
+		msg[nmsg].msg_hdr.msg_name = const_cast<struct sockaddr_in*>(&dgram[i].mAddr);
+		msg[nmsg].msg_hdr.msg_namelen = sizeof(dgram[i].mAddr);
+		if (run[nmsg] > 1) {
+			msg[nmsg].msg_hdr.msg_control = ctrl[nmsg].mBuf;
+			msg[nmsg].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+			struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg[nmsg].msg_hdr);
+			cmsg->cmsg_level = SOL_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			uint16_t seg = static_cast<uint16_t>(dgram[i].mLen);
+			memcpy(CMSG_DATA(cmsg), &seg, sizeof(uint16_t));
+		}
+	}
+
+	*size = 0;
+	int ret = sendmmsg(mFD, msg, nmsg, 0);
+	if (ret == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+			return 0;
+		}
+		if (run[0] > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+			// 网卡、路由不支持分段卸载，关闭GSO后重发
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpSocket::SendBatch sendmmsg(UDP_SEGMENT) failed, gso disabled", error::Strerror(errno).c_str());
+			mGso = false;
+			return SendBatch(dgram, num, size);
+		}
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpSocket::SendBatch sendmmsg() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	for (int i = 0; i < ret; i++) {
+		*size += run[i];
+	}
+	return 0;
+}
+
+int wUdpSocket::GsoRun(const wDatagram_t dgram[], int num) {
+	const uint32_t seg = dgram[0].mLen;
+	uint32_t total = seg;
+	int i = 1;
+	for (; i < num && i < static_cast<int>(kUdpGsoSegs); i++) {
+		if (dgram[i].mLen > seg || total + dgram[i].mLen > kUdpGsoSize) {
+			break;
+		} else if (dgram[i].mAddr.sin_addr.s_addr != dgram[0].mAddr.sin_addr.s_addr || dgram[i].mAddr.sin_port != dgram[0].mAddr.sin_port) {
+			break;
+		}
+		total += dgram[i].mLen;
+		if (dgram[i].mLen < seg) {	// 较短的数据报只能为末段
+			i++;
+			break;
+		}
+	}
+	return i;
+}
+
+int wUdpSocket::SetGso(bool on) {
+	if (on) {
+		// 探测内核支持：分段长度0即按消息控制信息分段
+		int val = 0;
+		if (setsockopt(mFD, SOL_UDP, UDP_SEGMENT, reinterpret_cast<const void*>(&val), sizeof(val)) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpSocket::SetGso setsockopt(UDP_SEGMENT) failed", error::Strerror(errno).c_str());
+			mGso = false;
+			return -1;
+		}
+	}
+	mGso = on;
+	return 0;
+}
+
+int wUdpSocket::SetGro(bool on) {
+	int val = on? 1: 0;
+	if (setsockopt(mFD, SOL_UDP, UDP_GRO, reinterpret_cast<const void*>(&val), sizeof(val)) == -1) {
+		if (on) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpSocket::SetGro setsockopt(UDP_GRO) failed", error::Strerror(errno).c_str());
+		}
+		mGro = false;
+		return on? -1: 0;
+	}
+	mGro = on;
+	return 0;
+}
+
 int wUdpSocket::SendBytes(char buf[], size_t len, ssize_t *size) {
 	mSendTm = soft::TimeUsec();
 
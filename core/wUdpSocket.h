@@ -8,27 +8,67 @@
 #define _W_UDP_SOCKET_H_
 
 #include <sys/socket.h>
+#include <netinet/in.h>
 #include "wCore.h"
 #include "wSocket.h"
 
 namespace hnet {
 
+// 每次recvmmsg、sendmmsg最多数据报数
+const uint32_t	kUdpBatch = 32;
+
+// GSO：单次发送最多分段数（内核UDP_MAX_SEGMENTS）、最大总长度（ipv4 udp负载上限）
+const uint32_t	kUdpGsoSegs = 64;
+const uint32_t	kUdpGsoSize = 65507;
+
+// GRO：开启后单次接收的合并数据报最大长度，接收缓冲应不小于此值
+const uint32_t	kUdpGroSize = 65536;
+
+// 数据报：缓冲、长度、对端地址
+// GRO开启时一项可为多个合并的数据报（来源地址相同）：mSeg为分段长度，按mSeg切分（末段可较短）；单个数据报mSeg为0
+struct wDatagram_t {
+	char* mBuf;
+	uint32_t mLen;
+	uint32_t mSeg;
+	struct sockaddr_in mAddr;
+};
+
 // Udp Socket基础类
 class wUdpSocket : public wSocket {
 public:
-	wUdpSocket(SockType type = kStConnect, SockProto proto = kSpUdp, SockFlag flag = kSfRvsd) : wSocket(type, proto, flag) { }
+	wUdpSocket(SockType type = kStConnect, SockProto proto = kSpUdp, SockFlag flag = kSfRvsd) : wSocket(type, proto, flag), mGso(false), mGro(false) { }
 
 	virtual int RecvBytes(char buf[], size_t len, ssize_t *size);
     virtual int SendBytes(char buf[], size_t len, ssize_t *size);
 
+    // 批量接收（recvmmsg，至多kUdpBatch个）：dgram[i].mBuf、mLen为接收缓冲，返回后mLen为数据报长度、mAddr为来源地址
+    // 超出缓冲长度（被截断）的数据报mLen置0。*size为接收个数，无数据时为0
+    int RecvBatch(wDatagram_t dgram[], int num, int* size);
+    // 批量发送（sendmmsg，至多kUdpBatch个），每项一个数据报。*size为已发送个数，发送缓冲满时可小于num
+    // 首个数据报发送失败（非EAGAIN）返回-1
+    // GSO开启时，发往同一地址的连续等长数据报（末个可较短）合并为一个UDP_SEGMENT消息，由内核（或网卡）分段
+    int SendBatch(const wDatagram_t dgram[], int num, int* size);
+
+    // 发送分段卸载（UDP_SEGMENT，linux 4.18+）、接收合并卸载（UDP_GRO，linux 5.0+）
+    // 内核不支持时返回-1，保持关闭（普通recvmmsg、sendmmsg）。GSO发送失败（如网卡不支持校验和卸载）时自动关闭并重发
+    int SetGso(bool on);
+    int SetGro(bool on);
+    inline bool Gso() const { return mGso;}
+    inline bool Gro() const { return mGro;}
+
     virtual int Open();
     virtual int Listen(const std::string& host, uint16_t port = 0);
 
 protected:
     virtual int Bind(const std::string& host, uint16_t port = 0);
 
+    // 按GSO合并规则，dgram起的连续数据报可合并个数
+    int GsoRun(const wDatagram_t dgram[], int num);
+
     std::string mClientHost;
     uint16_t mClientPort;
+    bool mGso;
+    bool mGro;
 };
 
 }	// namespace hnet
@@ -0,0 +1,204 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wUdpTask.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+wUdpTask::wUdpTask(wSocket *socket, int32_t type) : wTask(socket, type), mBatching(false), mOutHead(0) {
+	memset(&mPeer, 0, sizeof(mPeer));
+	mOut.reserve(kUdpBatch);
+}
+
+int wUdpTask::SetOffload(bool gso, bool gro) {
+	wUdpSocket* socket = static_cast<wUdpSocket*>(mSocket);
+	int ret = 0;
+	if (socket->SetGso(gso) == -1) {
+		ret = -1;
+	}
+	if (socket->SetGro(gro) == -1) {
+		ret = -1;
+	}
+	return ret;
+}
+
+int wUdpTask::TaskRecv(ssize_t *size) {
+	// 接收缓冲均分：GRO开启时每项可为合并的多个数据报，按kUdpGroSize分
+	wUdpSocket* socket = static_cast<wUdpSocket*>(mSocket);
+	const uint32_t slot = socket->Gro()? kUdpGroSize: kUdpDatagramSize;
+	const int batch = static_cast<int>(kPackageSize / slot);
+	for (int i = 0; i < batch; i++) {
+		mRecv[i].mBuf = mRecvBuff + i * slot;
+		mRecv[i].mLen = slot;
+	}
+	int num = 0;
+	int ret = socket->RecvBatch(mRecv, batch, &num);
+
+	// 逐个分发，响应延后至批次结束一次发送
+	*size = 0;
+	mBatching = true;
+	for (int i = 0; i < num; i++) {
+		mPeer = mRecv[i].mAddr;
+		if (mRecv[i].mLen == 0) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpTask::TaskRecv () failed", "datagram too large");
+			continue;
+		}
+		*size += mRecv[i].mLen;
+		if (mRecv[i].mSeg == 0) {
+			Dispatch(mRecv[i].mBuf, mRecv[i].mLen);
+			continue;
+		}
+		for (uint32_t off = 0; off < mRecv[i].mLen; off += mRecv[i].mSeg) {
+			Dispatch(mRecv[i].mBuf + off, std::min(mRecv[i].mSeg, mRecv[i].mLen - off));
+		}
+	}
+	DispatchEnd();
+	mBatching = false;
+
+	if (mOutHead < mOut.size()) {
+		Flush();
+	}
+	return ret;
+}
+
+int wUdpTask::TaskSend(ssize_t *size) {
+	size_t len = mSendLen;
+	int ret = Flush();
+	*size = static_cast<ssize_t>(len - mSendLen);
+	return ret;
+}
+
+int wUdpTask::Dispatch(char buf[], uint32_t len) {
+	while (len > 0) {
+		uint32_t reallen = len > sizeof(uint32_t)? coding::DecodeFixed32(buf): 0;
+		if (reallen < kMinPackageSize || reallen > len - sizeof(uint32_t)) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpTask::Dispatch () failed", "message length error");
+			return -1;
+		}
+		Handlemsg(buf + sizeof(uint32_t), reallen);
+		buf += sizeof(uint32_t) + reallen;
+		len -= sizeof(uint32_t) + reallen;
+	}
+	return 0;
+}
+
+int wUdpTask::Send2Buf(char cmd[], size_t len) {
+	return SendTo(mPeer, cmd, len);
+}
+
+#ifdef _USE_PROTOBUF_
+int wUdpTask::Send2Buf(const google::protobuf::Message* msg, bool cached) {
+	return SendTo(mPeer, msg);
+}
+#endif
+
+int wUdpTask::SendTo(const struct sockaddr_in& addr, char cmd[], size_t len) {
+	// 消息体总长度
+	len += sizeof(uint8_t);
+	if (len < kMinPackageSize || sizeof(uint32_t) + len > kUdpDatagramSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpTask::SendTo () failed", "message too large");
+		return -1;
+	}
+
+	char* buf = Queue(addr, sizeof(uint32_t) + len);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpTask::SendTo () failed", "left buffer not enough");
+		return -1;
+	}
+	Assertbuf(buf, cmd, len - sizeof(uint8_t));
+	if (mMemoCapture) {
+		mMemoData.append(buf, sizeof(uint32_t) + len);
+	}
+	return mBatching? 0: Flush();
+}
+
+#ifdef _USE_PROTOBUF_
+int wUdpTask::SendTo(const struct sockaddr_in& addr, const google::protobuf::Message* msg) {
+	// 消息体总长度
+	size_t len = PbPackLen(msg);
+	if (len < kMinPackageSize || sizeof(uint32_t) + len > kUdpDatagramSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpTask::SendTo () failed", "message too large");
+		return -1;
+	}
+
+	char* buf = Queue(addr, sizeof(uint32_t) + len);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpTask::SendTo () failed", "left buffer not enough");
+		return -1;
+	}
+	Assertbuf(buf, msg, true);
+	if (mMemoCapture) {
+		mMemoData.append(buf, sizeof(uint32_t) + len);
+	}
+	return mBatching? 0: Flush();
+}
+#endif
+
+char* wUdpTask::Queue(const struct sockaddr_in& addr, size_t len) {
+	if (mSendWrite + len > mSendBuff + kPackageSize) {
+		Flush();
+		if (mSendWrite + len > mSendBuff + kPackageSize) {
+			return NULL;
+		}
+	}
+
+	wDatagram_t dgram;
+	dgram.mBuf = mSendWrite;
+	dgram.mLen = static_cast<uint32_t>(len);
+	dgram.mAddr = addr;
+	mOut.push_back(dgram);
+	mSendWrite += len;
+	mSendLen += len;
+	return dgram.mBuf;
+}
+
+int wUdpTask::Flush() {
+	wUdpSocket* socket = static_cast<wUdpSocket*>(mSocket);
+	while (mOutHead < mOut.size()) {
+		int num = 0;
+		if (socket->SendBatch(&mOut[mOutHead], static_cast<int>(mOut.size() - mOutHead), &num) == -1) {
+			// 首个数据报无法发送（如地址不可达），丢弃
+			num = 1;
+		} else if (num == 0) {
+			// 发送缓冲满，等待可写事件
+			break;
+		}
+		for (int i = 0; i < num; i++, mOutHead++) {
+			mSendLen -= mOut[mOutHead].mLen;
+		}
+	}
+
+	if (mOutHead == mOut.size()) {
+		// 已全部发送，缓冲从头使用
+		mOut.clear();
+		mOutHead = 0;
+		mSendRead = mSendWrite = mSendBuff;
+		mSendLen = 0;
+		return 0;
+	}
+	return Output();
+}
+
+int wUdpTask::MemoSend(const std::string& data) {
+	// 缓存为连续的完整消息，每个消息一个数据报
+	const char* p = data.data();
+	const char* end = p + data.size();
+	while (p < end) {
+		size_t len = sizeof(uint32_t) + coding::DecodeFixed32(p);
+		char* buf = Queue(mPeer, len);
+		if (buf == NULL) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUdpTask::MemoSend () failed", "left buffer not enough");
+			return p == data.data()? -1: 0;
+		}
+		memcpy(buf, p, len);
+		p += len;
+	}
+	return mBatching? 0: Flush();
+}
+
+}	// namespace hnet
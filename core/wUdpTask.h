@@ -7,15 +7,68 @@
 #ifndef _W_UDP_TASK_H_
 #define _W_UDP_TASK_H_
 
+#include <vector>
+#include <algorithm>
 #include "wCore.h"
 #include "wCommand.h"
 #include "wTask.h"
+#include "wUdpSocket.h"
 
 namespace hnet {
 
+// 单个数据报最大长度（接收缓冲均分为kUdpBatch个），更长的数据报被丢弃
+const uint32_t	kUdpDatagramSize = kPackageSize / kUdpBatch;
+
+// udp任务：按数据报收发，保持消息边界
+// 每次可读事件以recvmmsg接收至多kUdpBatch个数据报，数据报内为一个或多个完整消息（同tcp：[uint32长度][uint8数据协议][消息]，消息不跨数据报），
+// 逐个以wTask::Handlemsg分发，处理函数中Peer()为该数据报来源地址
+// 发送（Send2Buf，含AsyncSend）：每个消息一个数据报，发往当前数据报来源地址。处理函数中的响应在本批数据报处理完后以sendmmsg批量发送，
+// 处理函数外立即发送；发送缓冲满时等待可写事件
+// 可选GSO、GRO卸载（SetOffload）：同一对端的连续等长响应合并发送；接收合并的数据报按分段逐个分发，处理方式不变
 class wUdpTask : public wTask {
 public:
-	wUdpTask(wSocket *socket, int32_t type = 0) : wTask(socket, type) { }
+	wUdpTask(wSocket *socket, int32_t type = 0);
+
+	virtual int TaskRecv(ssize_t *size);
+	virtual int TaskSend(ssize_t *size);
+
+	virtual int Send2Buf(char cmd[], size_t len);
+#ifdef _USE_PROTOBUF_
+	virtual int Send2Buf(const google::protobuf::Message* msg, bool cached = false);
+#endif
+
+	// 发送至指定地址（如保存的Peer()，异步响应）
+	int SendTo(const struct sockaddr_in& addr, char cmd[], size_t len);
+#ifdef _USE_PROTOBUF_
+	int SendTo(const struct sockaddr_in& addr, const google::protobuf::Message* msg);
+#endif
+
+	// 当前数据报来源地址（处理函数外为最近一个数据报来源）
+	inline const struct sockaddr_in& Peer() const { return mPeer;}
+
+	// 开启GSO、GRO卸载（派生类构造函数中调用），内核不支持的项保持关闭并返回-1
+	// 监听socket为全部worker共享（GRO为socket选项），各worker应一致开启
+	int SetOffload(bool gso, bool gro);
+
+protected:
+	// 数据报内的消息逐个分发（派生类可覆盖数据报格式，如wArqTask）
+	virtual int Dispatch(char buf[], uint32_t len);
+	// 接收批次分发完毕，批量发送响应之前
+	virtual void DispatchEnd() { }
+	// 待发送队列追加一个len字节数据报，返回其缓冲（mSendBuff中）。空间不足时先发送，仍不足返回NULL
+	char* Queue(const struct sockaddr_in& addr, size_t len);
+	// sendmmsg发送队列，发送缓冲满时注册可写事件
+	int Flush();
+	// 缓存响应按消息分为数据报发送
+	virtual int MemoSend(const std::string& data);
+
+	wDatagram_t mRecv[kUdpBatch];
+	struct sockaddr_in mPeer;
+	bool mBatching;		// 处理接收批次中，响应延后至批次结束发送
+
+	// 待发送数据报（缓冲在mSendBuff中顺序排列），mOutHead为首个未发送项
+	std::vector<wDatagram_t> mOut;
+	size_t mOutHead;
 };
 
 }	// namespace hnet
@@ -0,0 +1,49 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_UNIX_CMD_H_
+#define _W_UNIX_CMD_H_
+
+#include "wCore.h"
+#include "wCommand.h"
+
+namespace hnet {
+
+#pragma pack(1)
+
+// 本机共享内存传输协商（见wUnixTask），框架保留命令
+const uint8_t CMD_UNIX_REQ = 0;
+
+// 客户端请求：环容量（0为kShmRingSize）
+const uint8_t UNIX_REQ_SHM = 20;
+struct wUnixReqShm_t : public hnet::wCommand {
+    uint32_t mSize;
+    wUnixReqShm_t() : wCommand(CMD_UNIX_REQ, UNIX_REQ_SHM), mSize(0) { }
+
+    inline void set_size(uint32_t size) {
+        mSize = size;
+    }
+    inline uint32_t size() {
+        return mSize;
+    }
+};
+
+// 服务端响应：mRet为0时附带（SCM_RIGHTS）memfd、服务端eventfd、客户端eventfd，mRing为两个环（客户端->服务端、服务端->客户端）在共享内存中的偏移
+const uint8_t UNIX_RES_SHM = 21;
+struct wUnixResShm_t : public hnet::wCommand {
+    int32_t mRet;
+    uint32_t mSize;
+    uint64_t mRing[2];
+    wUnixResShm_t() : wCommand(CMD_UNIX_REQ, UNIX_RES_SHM), mRet(-1), mSize(0) {
+        mRing[0] = mRing[1] = 0;
+    }
+};
+
+#pragma pack()
+
+}	// namespace hnet
+
+#endif
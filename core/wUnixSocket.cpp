@@ -248,4 +248,93 @@ int wUnixSocket::SetRecvTimeout(float timeout) {
 	return 0;
 }
 
+int wUnixSocket::SendFds(const char buf[], size_t len, const int fds[], int num, ssize_t *size) {
+	mSendTm = soft::TimeUsec();
+
+	union {
+		struct cmsghdr cm;
+		char space[CMSG_SPACE(sizeof(int) * kUnixFdMax)];
+	} cmsg;
+
+	struct iovec iov[1];
+	iov[0].iov_base = const_cast<char*>(buf);
+	iov[0].iov_len = len;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+	if (num > 0 && num <= kUnixFdMax) {
+		memset(&cmsg, 0, sizeof(cmsg));
+		cmsg.cm.cmsg_level = SOL_SOCKET;
+		cmsg.cm.cmsg_type = SCM_RIGHTS;
+		cmsg.cm.cmsg_len = CMSG_LEN(sizeof(int) * num);
+		memcpy(CMSG_DATA(&cmsg.cm), fds, sizeof(int) * num);
+		msg.msg_control = reinterpret_cast<caddr_t>(&cmsg);
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * num);
+	}
+
+	*size = sendmsg(mFD, &msg, MSG_NOSIGNAL);
+	if (*size == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixSocket::SendFds sendmsg() failed", error::Strerror(errno).c_str());
+		return -1;
+	} else if (static_cast<size_t>(*size) != len) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixSocket::SendFds sendmsg() failed", "send a part of message");
+		return -1;
+	}
+	return 0;
+}
+
+int wUnixSocket::RecvFds(char buf[], size_t len, int fds[], int* num, ssize_t *size) {
+	mRecvTm = soft::TimeUsec();
+
+	union {
+		struct cmsghdr cm;
+		char space[CMSG_SPACE(sizeof(int) * kUnixFdMax)];
+	} cmsg;
+
+	struct iovec iov[1];
+	iov[0].iov_base = buf;
+	iov[0].iov_len = len;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = reinterpret_cast<caddr_t>(&cmsg);
+	msg.msg_controllen = sizeof(cmsg);
+
+	*num = 0;
+	*size = recvmsg(mFD, &msg, MSG_CMSG_CLOEXEC);
+	if (*size == -1) {
+		if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 0;
+		}
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixSocket::RecvFds recvmsg() failed", error::Strerror(errno).c_str());
+		return -1;
+	} else if (*size == 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixSocket::RecvFds recvmsg(0) failed", "peer closed");
+		return -1;
+	}
+
+	for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+		if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+			int n = static_cast<int>((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+			for (int i = 0; i < n; i++) {
+				int fd;
+				memcpy(&fd, CMSG_DATA(cm) + sizeof(int) * i, sizeof(int));
+				if (*num < kUnixFdMax) {
+					fds[(*num)++] = fd;
+				} else {
+					close(fd);
+				}
+			}
+		}
+	}
+	if (msg.msg_flags & MSG_CTRUNC) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixSocket::RecvFds recvmsg() failed", "ancillary data truncated");
+	}
+	return 0;
+}
+
 }	// namespace hnet
@@ -14,6 +14,7 @@
 namespace hnet {
 
 const char kUnixSockPrefix[] = "/tmp/hnet_";
+const int kUnixFdMax = 4;	// 单条消息附带描述符上限
 
 class wUnixSocket : public wSocket {
 public:
@@ -29,6 +30,14 @@ public:
     virtual int SetSendTimeout(float timeout = 30);
     virtual int SetRecvTimeout(float timeout = 30);
 
+    // 发送消息并附带num个描述符（SCM_RIGHTS，num不超过kUnixFdMax），消息须一次发送完整
+    int SendFds(const char buf[], size_t len, const int fds[], int num, ssize_t *size);
+    // 接收消息及附带的描述符（至多kUnixFdMax个，写入fds，*num为个数）
+    // size = -1 对端发生错误|稍后重试
+    // size = 0  对端关闭
+    // size > 0  接受字符
+    int RecvFds(char buf[], size_t len, int fds[], int* num, ssize_t *size);
+
 protected:
 	virtual int Bind(const std::string& host, uint16_t port = 0);	// host为sock路径
 };
@@ -0,0 +1,562 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <algorithm>
+#include "wUnixTask.h"
+#include "wServer.h"
+#include "wUnixSocket.h"
+#include "wUnixCmd.h"
+#include "wTcpSocket.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+namespace {
+
+// 共享内存连接的eventfd（每连接一个，客户端写入环且服务端空闲时唤醒）加入本进程内部epoll，内部epoll注册至wServer事件循环
+class wUnixShmPoller : public wTask {
+public:
+	wUnixShmPoller(wSocket* socket) : wTask(socket) { }
+
+	virtual int TaskRecv(ssize_t *size) {
+		*size = 0;
+		wUnixTask::ShmPoll(mServer);
+		return 0;
+	}
+};
+
+const int kShmPollEvents = 64;	// 单次处理就绪连接数
+
+inline void Wake(int fd) {
+	uint64_t one = 1;
+	if (write(fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::Wake write() failed", error::Strerror(errno).c_str());
+	}
+}
+
+}	// namespace anonymous
+
+wUnixTask::~wUnixTask() {
+	ShmClose();
+}
+
+void wUnixTask::ShmClose() {
+	if (mServer != NULL && mServer->ShmTask().erase(this) > 0) {
+		// 客户端仍持有同一eventfd，关闭本端描述符不会自动移出epoll
+		struct epoll_event evt;
+		if (epoll_ctl(static_cast<int>(mServer->ShmPoller()->Socket()->FD()), EPOLL_CTL_DEL, mShmWait, &evt) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmClose epoll_ctl() failed", error::Strerror(errno).c_str());
+		}
+	}
+	HNET_DELETE(mShm);
+	if (mShmWake != -1) {
+		close(mShmWake);
+	}
+	if (mShmWait != -1) {
+		close(mShmWait);
+	}
+	mShmWake = mShmWait = -1;
+}
+
+int wUnixTask::Handlemsg(char cmd[], uint32_t len) {
+	if (static_cast<uint8_t>(coding::DecodeFixed8(cmd)) == kMpCommand && len >= sizeof(uint8_t) + sizeof(struct wUnixReqShm_t)) {
+		struct wUnixReqShm_t* req = reinterpret_cast<struct wUnixReqShm_t*>(cmd + sizeof(uint8_t));
+		if (req->GetId() == CmdId(CMD_UNIX_REQ, UNIX_REQ_SHM)) {
+			return ShmAccept(req->size());
+		}
+	}
+	return wTask::Handlemsg(cmd, len);
+}
+
+int wUnixTask::ShmAccept(uint32_t size) {
+	struct wUnixResShm_t res;
+	int fds[3] = {-1, -1, -1};
+	size = size == 0? kShmRingSize: size;
+
+	// 响应须紧随已发送数据（发送缓冲非空时不建立）
+	if (mShm != NULL || mSendLen > 0 || mServer == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmAccept () failed", "shm established or send buffer not empty");
+	} else if (size < 2 * kPackageSize || size > kShmRingSizeMax || (size & (size - 1)) != 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmAccept () failed", "ring size illegal");
+	} else {
+		// 内部epoll
+		wTask*& poller = mServer->ShmPoller();
+		if (poller == NULL) {
+			int efd = epoll_create1(EPOLL_CLOEXEC);
+			if (efd == -1) {
+				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmAccept epoll_create1() failed", error::Strerror(errno).c_str());
+			} else {
+				wSocket* socket;
+				HNET_NEW(wTcpSocket(kStConnect, kSpUnknown), socket);
+				if (socket == NULL) {
+					close(efd);
+				} else {
+					socket->FD() = efd;
+					socket->SS() = kSsConnected;
+					HNET_NEW(wUnixShmPoller(socket), poller);
+					if (poller == NULL) {
+						HNET_DELETE(socket);
+					} else if (mServer->AddTask(poller, EPOLLIN) == -1) {
+						HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmAccept AddTask() failed", "");
+						HNET_DELETE(poller);
+					}
+				}
+			}
+		}
+
+		void* ring[2] = {NULL, NULL};
+		if (poller != NULL) {
+			HNET_NEW(wMemShm("hnet_unix", 2 * (wShmRing::Space(size) + 64)), mShm);
+		}
+		if (mShm != NULL && mShm->CreateShm() == 0 && (ring[0] = mShm->AllocShm(wShmRing::Space(size))) != NULL &&
+			(ring[1] = mShm->AllocShm(wShmRing::Space(size))) != NULL && mRecvRing.Init(ring[0], size, true) == 0 &&
+			mSendRing.Init(ring[1], size, true) == 0 && (mShmWake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) != -1 &&
+			(mShmWait = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) != -1 && ShmRegister() == 0) {
+			res.mRet = 0;
+			res.mSize = size;
+			res.mRing[0] = mShm->Offset(ring[0]);
+			res.mRing[1] = mShm->Offset(ring[1]);
+			fds[0] = mShm->FD();
+			fds[1] = mShmWait;
+			fds[2] = mShmWake;
+			// 响应前标记空闲：客户端首条消息即唤醒
+			mRecvRing.Sleep();
+		} else {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmAccept () failed", "create shm failed");
+			ShmClose();
+		}
+	}
+
+	ssize_t n;
+	Assertbuf(mTempBuff, reinterpret_cast<char*>(&res), sizeof(res));
+	int ret = static_cast<wUnixSocket*>(mSocket)->SendFds(mTempBuff, sizeof(uint32_t) + sizeof(uint8_t) + sizeof(res), fds, res.mRet == 0? 3: 0, &n);
+	if (res.mRet == 0 && ret == -1) {
+		ShmClose();
+	}
+	return ret;
+}
+
+int wUnixTask::ShmRegister() {
+	struct epoll_event evt;
+	evt.events = EPOLLIN;
+	evt.data.ptr = this;
+	if (epoll_ctl(static_cast<int>(mServer->ShmPoller()->Socket()->FD()), EPOLL_CTL_ADD, mShmWait, &evt) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmRegister epoll_ctl() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	mServer->ShmTask().insert(this);
+	return 0;
+}
+
+void wUnixTask::ShmPoll(wServer* server) {
+	struct epoll_event evts[kShmPollEvents];
+	int num = epoll_wait(static_cast<int>(server->ShmPoller()->Socket()->FD()), evts, kShmPollEvents, 0);
+	if (num == -1 && errno != EINTR) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmPoll epoll_wait() failed", error::Strerror(errno).c_str());
+	}
+	for (int i = 0; i < num; i++) {
+		// 处理消息时连接可能已关闭
+		wUnixTask* task = static_cast<wUnixTask*>(evts[i].data.ptr);
+		if (server->ShmTask().find(task) == server->ShmTask().end()) {
+			continue;
+		}
+		uint64_t count;
+		if (read(task->mShmWait, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmPoll read() failed", error::Strerror(errno).c_str());
+		}
+		if (task->ShmRecv() == -1) {
+			// 关闭socket，由事件循环删除task
+			shutdown(static_cast<int>(task->Socket()->FD()), SHUT_RDWR);
+		}
+	}
+}
+
+int wUnixTask::ShmRecv() {
+	char* msg;
+	uint32_t len;
+	int ret;
+	do {
+		// 消息原地分发（环中连续存储）
+		while ((ret = mRecvRing.Front(&msg, &len)) == 1) {
+			int r = Handlemsg(msg, len);
+			ShmPop();
+			if (r == -1) {
+				return -1;
+			}
+		}
+		if (ret == -1) {
+			return -1;
+		}
+	} while (!mRecvRing.Sleep());
+	return 0;
+}
+
+char* wUnixTask::ShmReserve(size_t len, uint32_t timeout) {
+	char* buf = mSendRing.Reserve(len);
+	if (buf != NULL || timeout == 0) {
+		return buf;
+	}
+
+	int64_t deadline = soft::TimeUpdate() + static_cast<int64_t>(timeout) * 1000000;
+	for (uint32_t spin = 0; (buf = mSendRing.Reserve(len)) == NULL; spin++) {
+		if (spin < kShmSpin || !mSendRing.PushSleep(len)) {
+			continue;
+		} else if (ShmWait(deadline) == -1) {
+			return NULL;
+		}
+		spin = 0;
+	}
+	return buf;
+}
+
+void wUnixTask::ShmCommit(size_t len) {
+	if (mSendRing.Commit(len)) {
+		Wake(mShmWake);
+	}
+}
+
+int wUnixTask::ShmFront(char** msg, uint32_t* len, uint32_t timeout) {
+	int64_t deadline = soft::TimeUpdate() + static_cast<int64_t>(timeout) * 1000000;
+	for (uint32_t spin = 0; ; spin++) {
+		int ret = mRecvRing.Front(msg, len);
+		if (ret == -1) {
+			return -1;
+		} else if (ret == 1) {
+			// 忽略心跳包干扰
+			struct wCommand* nullcmd = reinterpret_cast<struct wCommand*>(*msg + sizeof(uint8_t));
+			if (static_cast<uint8_t>(coding::DecodeFixed8(*msg)) == kMpCommand && *len == sizeof(uint8_t) + sizeof(struct wCommand) &&
+				nullcmd->GetId() == CmdId(kCmdNull, kParaNull)) {
+				ShmPop();
+				continue;
+			}
+			return 0;
+		}
+
+		if (spin < kShmSpin || !mRecvRing.Sleep()) {
+			continue;
+		} else if (ShmWait(timeout > 0? deadline: 0) == -1) {
+			return -1;
+		}
+		spin = 0;
+	}
+}
+
+void wUnixTask::ShmPop() {
+	mRecvRing.Pop();
+	if (mRecvRing.Released()) {
+		Wake(mShmWake);
+	}
+}
+
+int wUnixTask::ShmWait(int64_t deadline) {
+	struct pollfd pfd[2];
+	pfd[0].fd = mShmWait;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = static_cast<int>(mSocket->FD());
+	pfd[1].events = POLLIN;
+
+	while (true) {
+		int tm = -1;
+		if (deadline > 0) {
+			int64_t left = deadline - soft::TimeUpdate();
+			if (left <= 0) {
+				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmWait () failed", "timeout");
+				return -1;
+			}
+			tm = static_cast<int>((left + 999) / 1000);
+		}
+
+		int ret = poll(pfd, 2, tm);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmWait poll() failed", error::Strerror(errno).c_str());
+			return -1;
+		} else if (ret == 0) {
+			continue;
+		} else if (pfd[1].revents != 0) {
+			// 传输建立后socket无数据，可读即对端关闭
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmWait () failed", "peer closed");
+			return -1;
+		}
+
+		uint64_t count;
+		if (read(mShmWait, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmWait read() failed", error::Strerror(errno).c_str());
+			return -1;
+		}
+		return 0;
+	}
+}
+
+int wUnixTask::ShmConnect(uint32_t size, uint32_t timeout) {
+	if (mShm != NULL) {
+		return 0;
+	}
+
+	struct wUnixReqShm_t req;
+	req.set_size(size);
+	ssize_t n;
+	if (wTask::SyncSend(reinterpret_cast<char*>(&req), sizeof(req), &n) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmConnect SyncSend() failed", "");
+		return -1;
+	}
+
+	// 接收响应及描述符（忽略心跳包）
+	struct wUnixResShm_t res;
+	int fds[kUnixFdMax], num = 0;
+	const size_t headlen = sizeof(uint32_t) + sizeof(uint8_t);
+	size_t recvlen = 0, msglen = headlen + sizeof(struct wCommand);
+	int64_t deadline = soft::TimeUpdate() + static_cast<int64_t>(timeout) * 1000000;
+	int ret = 0;
+	while (ret == 0) {
+		struct pollfd pfd;
+		pfd.fd = static_cast<int>(mSocket->FD());
+		pfd.events = POLLIN;
+		int64_t left = deadline - soft::TimeUpdate();
+		if (left <= 0 || poll(&pfd, 1, static_cast<int>((left + 999) / 1000)) <= 0) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmConnect () failed", "recv response timeout");
+			ret = -1;
+			break;
+		}
+
+		int got = 0;
+		ssize_t size;
+		if (static_cast<wUnixSocket*>(mSocket)->RecvFds(mTempBuff + recvlen, std::min(msglen, headlen + sizeof(res)) - recvlen, fds + num, &got, &size) == -1) {
+			ret = -1;
+			break;
+		}
+		num += got;
+		if (size > 0) {
+			recvlen += size;
+		}
+		if (recvlen < headlen) {
+			continue;
+		}
+		msglen = sizeof(uint32_t) + coding::DecodeFixed32(mTempBuff);
+		if (msglen > headlen + sizeof(res) || msglen < headlen + sizeof(struct wCommand)) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmConnect () failed", "response length error");
+			ret = -1;
+		} else if (recvlen == msglen) {
+			struct wCommand* cmd = reinterpret_cast<struct wCommand*>(mTempBuff + headlen);
+			if (cmd->GetId() == CmdId(kCmdNull, kParaNull)) {
+				recvlen = 0;
+				msglen = headlen + sizeof(struct wCommand);
+			} else if (cmd->GetId() == CmdId(CMD_UNIX_REQ, UNIX_RES_SHM) && msglen == headlen + sizeof(res)) {
+				memcpy(&res, mTempBuff + headlen, sizeof(res));
+				break;
+			} else {
+				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmConnect () failed", "response invalid");
+				ret = -1;
+			}
+		}
+	}
+
+	if (ret == 0 && (res.mRet != 0 || num != 3)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmConnect () failed", "server refused");
+		ret = -1;
+	}
+	if (ret == 0) {
+		mShmWake = fds[1];
+		mShmWait = fds[2];
+		HNET_NEW(wMemShm("hnet_unix", 0, fds[0]), mShm);
+		if (mShm == NULL) {
+			close(fds[0]);
+		}
+
+		void* ring[2] = {NULL, NULL};
+		if (mShm == NULL || mShm->AttachShm() == -1 || (ring[0] = mShm->Address(res.mRing[0], wShmRing::Space(res.mSize))) == NULL ||
+			(ring[1] = mShm->Address(res.mRing[1], wShmRing::Space(res.mSize))) == NULL || mSendRing.Init(ring[0], res.mSize, false) == -1 ||
+			mRecvRing.Init(ring[1], res.mSize, false) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::ShmConnect () failed", "attach shm failed");
+			ShmClose();
+			return -1;
+		}
+		return 0;
+	}
+	for (int i = 0; i < num; i++) {
+		close(fds[i]);
+	}
+	return -1;
+}
+
+int wUnixTask::Send2Buf(char cmd[], size_t len) {
+	if (mShm == NULL) {
+		return wTask::Send2Buf(cmd, len);
+	} else if (len + sizeof(uint8_t) < kMinPackageSize || len + sizeof(uint8_t) > kMaxPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::Send2Buf () failed", "message too large");
+		return -1;
+	}
+
+	size_t size = sizeof(uint32_t) + sizeof(uint8_t) + len;
+	char* buf = ShmReserve(size, 0);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::Send2Buf () failed", "shm ring full");
+		return -1;
+	}
+	Assertbuf(buf, cmd, len);
+	if (mMemoCapture) {
+		mMemoData.append(buf, size);
+	}
+	ShmCommit(size);
+	return 0;
+}
+
+#ifdef _USE_PROTOBUF_
+int wUnixTask::Send2Buf(const google::protobuf::Message* msg, bool cached) {
+	if (mShm == NULL) {
+		return wTask::Send2Buf(msg, cached);
+	}
+	size_t len = PbPackLen(msg, cached);
+	if (len < kMinPackageSize || len > kMaxPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::Send2Buf () failed", "message too large");
+		return -1;
+	}
+
+	char* buf = ShmReserve(sizeof(uint32_t) + len, 0);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::Send2Buf () failed", "shm ring full");
+		return -1;
+	}
+	Assertbuf(buf, msg, true);
+	if (mMemoCapture) {
+		mMemoData.append(buf, sizeof(uint32_t) + len);
+	}
+	ShmCommit(sizeof(uint32_t) + len);
+	return 0;
+}
+#endif
+
+int wUnixTask::MemoSend(const std::string& data) {
+	if (mShm == NULL) {
+		return wTask::MemoSend(data);
+	}
+
+	// 缓存为连续的完整消息，逐条写入环
+	const char* p = data.data();
+	const char* end = p + data.size();
+	while (p < end) {
+		size_t len = sizeof(uint32_t) + coding::DecodeFixed32(p);
+		char* buf = ShmReserve(len, 0);
+		if (buf == NULL) {
+			return p == data.data()? -1: 0;
+		}
+		memcpy(buf, p, len);
+		ShmCommit(len);
+		p += len;
+	}
+	return 0;
+}
+
+int wUnixTask::SyncSend(char cmd[], size_t len, ssize_t *size) {
+	if (mShm == NULL) {
+		return wTask::SyncSend(cmd, len, size);
+	} else if (len + sizeof(uint8_t) < kMinPackageSize || len + sizeof(uint8_t) > kMaxPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::SyncSend () failed", "message length error");
+		return -1;
+	}
+
+	*size = static_cast<ssize_t>(sizeof(uint32_t) + sizeof(uint8_t) + len);
+	char* buf = ShmReserve(*size, 30);
+	if (buf == NULL) {
+		*size = -1;
+		return -1;
+	}
+	Assertbuf(buf, cmd, len);
+	ShmCommit(*size);
+	return 0;
+}
+
+#ifdef _USE_PROTOBUF_
+int wUnixTask::SyncSend(const google::protobuf::Message* msg, ssize_t *size) {
+	if (mShm == NULL) {
+		return wTask::SyncSend(msg, size);
+	}
+	size_t len = PbPackLen(msg);
+	if (len < kMinPackageSize || len > kMaxPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::SyncSend () failed", "message length error");
+		return -1;
+	}
+
+	*size = static_cast<ssize_t>(sizeof(uint32_t) + len);
+	char* buf = ShmReserve(*size, 30);
+	if (buf == NULL) {
+		*size = -1;
+		return -1;
+	}
+	Assertbuf(buf, msg, true);
+	ShmCommit(*size);
+	return 0;
+}
+#endif
+
+int wUnixTask::SyncRecv(char cmd[], ssize_t *size, size_t msglen, uint32_t timeout) {
+	if (mShm == NULL) {
+		return wTask::SyncRecv(cmd, size, msglen, timeout);
+	}
+
+	char* msg;
+	uint32_t len;
+	if (ShmFront(&msg, &len, timeout) == -1) {
+		*size = -1;
+		return -1;
+	}
+	*size = len - sizeof(uint8_t);
+	if (msglen > 0 && msglen != static_cast<size_t>(*size)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::SyncRecv () failed", "message length error,error message");
+		ShmPop();
+		return -1;
+	}
+	memcpy(cmd, msg + sizeof(uint8_t), *size);
+	ShmPop();
+	return 0;
+}
+
+#ifdef _USE_PROTOBUF_
+int wUnixTask::SyncRecv(google::protobuf::Message* msg, ssize_t *size, size_t msglen, uint32_t timeout) {
+	if (mShm == NULL) {
+		return wTask::SyncRecv(msg, size, msglen, timeout);
+	}
+
+	char* buf;
+	uint32_t len;
+	if (ShmFront(&buf, &len, timeout) == -1) {
+		*size = -1;
+		return -1;
+	}
+
+	// 类型头长度
+	uint32_t n = 0;
+	uint8_t sp = static_cast<uint8_t>(coding::DecodeFixed8(buf));
+	if (sp == kMpProtobufId && len >= sizeof(uint8_t) + sizeof(uint32_t)) {
+		n = sizeof(uint32_t);
+	} else if (sp == kMpProtobuf && len >= sizeof(uint8_t) + sizeof(uint16_t) &&
+		len >= sizeof(uint8_t) + sizeof(uint16_t) + coding::DecodeFixed16(buf + sizeof(uint8_t))) {
+		n = sizeof(uint16_t) + coding::DecodeFixed16(buf + sizeof(uint8_t));
+	} else {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[sp=%d]", "wUnixTask::SyncRecv () failed", "protobuf invalid", sp);
+		ShmPop();
+		return -1;
+	}
+	*size = len - sizeof(uint8_t) - n;
+	if (msglen > 0 && msglen != static_cast<size_t>(*size)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wUnixTask::SyncRecv () failed", "message length error,error message");
+		ShmPop();
+		return -1;
+	}
+	msg->ParseFromArray(buf + sizeof(uint8_t) + n, static_cast<int>(*size));
+	ShmPop();
+	return 0;
+}
+#endif
+
+}	// namespace hnet
@@ -10,12 +10,75 @@
 #include "wCore.h"
 #include "wCommand.h"
 #include "wTask.h"
+#include "wShm.h"
+#include "wShmRing.h"
 
 namespace hnet {
 
+const uint32_t	kShmSpin = 4096;	// 客户端同步接收、发送无进展时自旋检查次数，之后经eventfd等待
+
+// unix socket任务，本机客户端可协商共享内存传输（wSingleClient协议"SHM"，或客户端task调用ShmConnect）：
+// 服务端创建memfd共享内存（两个wShmRing，每方向一个）及eventfd，经SCM_RIGHTS传给客户端，此后双方消息经环收发（每条消息一次拷贝，服务端原地分发，无系统调用）
+// 读端空闲时写端才以eventfd唤醒；socket仅用于协商及连接存活（任一端关闭socket即结束传输）
+// 服务端：Send2Buf（含AsyncSend）写入环，环满时返回-1（同发送缓冲满）；每连接一对eventfd（各唤醒一方），服务端一侧加入本进程内部epoll（注册至wServer事件循环），唤醒时仅处理就绪连接的环
+// memfd已封印大小，客户端无法缩小共享内存；不向客户端传递其他连接或进程共用的描述符
+// 无法建立（内核不支持memfd、服务端发送缓冲非空等）时继续使用socket
 class wUnixTask : public wTask {
 public:
-    wUnixTask(wSocket *socket, int32_t type = 0) : wTask(socket, type) { }
+    wUnixTask(wSocket *socket, int32_t type = 0) : wTask(socket, type), mShm(NULL), mShmWake(-1), mShmWait(-1) { }
+    virtual ~wUnixTask();
+
+    // 处理共享内存协商请求，其他消息同wTask
+    virtual int Handlemsg(char cmd[], uint32_t len);
+
+    virtual int Send2Buf(char cmd[], size_t len);
+#ifdef _USE_PROTOBUF_
+    virtual int Send2Buf(const google::protobuf::Message* msg, bool cached = false);
+#endif
+
+    virtual int SyncSend(char cmd[], size_t len, ssize_t *size);
+#ifdef _USE_PROTOBUF_
+    virtual int SyncSend(const google::protobuf::Message* msg, ssize_t *size);
+#endif
+    virtual int SyncRecv(char cmd[], ssize_t *size, size_t msglen = 0, uint32_t timeout = 30);
+#ifdef _USE_PROTOBUF_
+    virtual int SyncRecv(google::protobuf::Message* msg, ssize_t *size, size_t msglen = 0, uint32_t timeout = 30);
+#endif
+
+    // 客户端：协商共享内存传输（socket未加入epoll），size为环容量（2的幂，0为kShmRingSize）。失败返回-1，继续使用socket
+    int ShmConnect(uint32_t size = 0, uint32_t timeout = 30);
+
+    // 服务端：处理本进程就绪共享内存连接的环（内部epoll可读）
+    static void ShmPoll(wServer* server);
+
+    inline bool Shm() const { return mShm != NULL;}
+
+protected:
+    // 缓存响应按消息写入环
+    virtual int MemoSend(const std::string& data);
+
+    // 服务端：创建共享内存、eventfd并响应客户端
+    int ShmAccept(uint32_t size);
+    // 服务端：本端eventfd加入内部epoll
+    int ShmRegister();
+    // 服务端：分发环中消息，处理完标记空闲
+    int ShmRecv();
+
+    // 写端：预留len字节（完整消息）。timeout为0时空间不足立即返回NULL，否则等待（秒）
+    char* ShmReserve(size_t len, uint32_t timeout);
+    void ShmCommit(size_t len);
+    // 客户端：等待首条非心跳消息（秒）
+    int ShmFront(char** msg, uint32_t* len, uint32_t timeout);
+    void ShmPop();
+    // 客户端：等待本端eventfd（截止时刻，微秒），超时、连接关闭返回-1
+    int ShmWait(int64_t deadline);
+    void ShmClose();
+
+    wMemShm* mShm;
+    wShmRing mRecvRing;
+    wShmRing mSendRing;
+    int mShmWake;	// 对端eventfd（唤醒对端）
+    int mShmWait;	// 本端eventfd（被对端唤醒；服务端加入内部epoll）
 };
 
 }	// namespace hnet
@@ -0,0 +1,481 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wWebSocketTask.h"
+#include "wSocket.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+namespace {
+
+// 掩码原地异或，每次8字节
+void Unmask(char* data, size_t len, const char* mask) {
+	uint32_t k32;
+	memcpy(&k32, mask, sizeof(k32));
+	const uint64_t k64 = (static_cast<uint64_t>(k32) << 32) | k32;
+	size_t i = 0;
+	for (; i + sizeof(k64) <= len; i += sizeof(k64)) {
+		uint64_t v;
+		memcpy(&v, data + i, sizeof(v));
+		v ^= k64;
+		memcpy(data + i, &v, sizeof(v));
+	}
+	for (; i < len; i++) {
+		data[i] ^= mask[i & 3];
+	}
+}
+
+// UTF-8校验（拒绝过长编码、代理区、超过U+10FFFF）
+bool ValidUtf8(const char* data, size_t len) {
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+	const unsigned char* end = p + len;
+	while (p < end) {
+		if (*p < 0x80) {
+			p++;
+			continue;
+		}
+		size_t n;
+		unsigned char lo = 0x80, hi = 0xbf;
+		if (*p >= 0xc2 && *p <= 0xdf) {
+			n = 1;
+		} else if (*p >= 0xe0 && *p <= 0xef) {
+			n = 2;
+			lo = *p == 0xe0? 0xa0: 0x80;
+			hi = *p == 0xed? 0x9f: 0xbf;
+		} else if (*p >= 0xf0 && *p <= 0xf4) {
+			n = 3;
+			lo = *p == 0xf0? 0x90: 0x80;
+			hi = *p == 0xf4? 0x8f: 0xbf;
+		} else {
+			return false;
+		}
+		if (static_cast<size_t>(end - p) <= n || p[1] < lo || p[1] > hi) {
+			return false;
+		}
+		for (size_t i = 2; i <= n; i++) {
+			if (p[i] < 0x80 || p[i] > 0xbf) {
+				return false;
+			}
+		}
+		p += n + 1;
+	}
+	return true;
+}
+
+inline uint64_t DecodeBig(const char* p, size_t n) {
+	uint64_t v = 0;
+	for (size_t i = 0; i < n; i++) {
+		v = (v << 8) | static_cast<unsigned char>(p[i]);
+	}
+	return v;
+}
+
+// 关闭帧可携带的状态码（RFC6455 7.4）
+inline bool ValidCloseCode(uint16_t code) {
+	return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) || (code >= 3000 && code <= 4999);
+}
+
+}	// namespace anonymous
+
+int wWebSocketTask::TaskRecv(ssize_t *size) {
+	const char *buffend = mRecvBuff + kPackageSize;
+	*size = 0;
+
+	// 线性缓冲：未处理数据位于[mRecvRead, mRecvWrite)，尾部空间不足时整体前移
+	if (mRecvLen == 0) {
+		mRecvRead = mRecvWrite = mRecvBuff;
+	} else if (mRecvRead != mRecvBuff && buffend - mRecvWrite < mRecvRead - mRecvBuff) {
+		memmove(mRecvBuff, mRecvRead, mRecvLen);
+		mRecvRead = mRecvBuff;
+		mRecvWrite = mRecvBuff + mRecvLen;
+	}
+
+	size_t leftlen = buffend - mRecvWrite;
+	if (leftlen > 0) {
+		// socket接受数据
+		int ret = mSocket->RecvBytes(mRecvWrite, leftlen, size);
+		if (ret == -1 || (ret == 0 && *size < 0)) {
+			return ret;
+		}
+
+		mRecvLen += *size;
+		mRecvWrite += *size;
+	}
+
+	int ret = 0;
+	if (mState == kWsHandshake) {
+		ret = ParseHandshake();
+	}
+	if (ret == 0 && mState == kWsOpen) {
+		ret = ParseFrame();
+	}
+	if (mState == kWsClosing) {
+		// 即将关闭，丢弃后续数据；关闭帧（或握手失败响应）已发完则关闭连接
+		mRecvRead = mRecvWrite = mRecvBuff;
+		mRecvLen = mMsgLen = 0;
+		return mSendLen > 0? ret: -1;
+	}
+	return ret;
+}
+
+int wWebSocketTask::TaskSend(ssize_t *size) {
+	int ret = wTask::TaskSend(size);
+	if (ret == -1 || mSendLen > 0) {
+		return ret;
+	} else if (mState == kWsClosing) {
+		return -1;
+	}
+	return 0;
+}
+
+int wWebSocketTask::ParseHandshake() {
+	int len = mParser.ParseHead(mRecvRead, mRecvLen);
+	if (len == 0) {
+		return 0;
+	} else if (len == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[%d]", "wWebSocketTask::ParseHandshake ParseHead() failed", "request illegal", mParser.Error());
+		return Reject(mParser.Error());
+	}
+
+	// GET、HTTP/1.1+，Upgrade: websocket，Connection: Upgrade，Sec-WebSocket-Version: 13，16字节key（base64）
+	wSlice upgrade, connection, version, key;
+	if (mParser.Method() != "GET" || mParser.Major() != 1 || mParser.Minor() < 1 || mParser.ContentLength() > 0 || mParser.Chunked() ||
+		!mParser.Header("Upgrade", &upgrade) || !wHttpParser::HasToken(upgrade, "websocket") ||
+		!mParser.Header("Connection", &connection) || !wHttpParser::HasToken(connection, "upgrade") ||
+		!mParser.Header("Sec-WebSocket-Key", &key) || key.size() != 24) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWebSocketTask::ParseHandshake () failed", "upgrade request illegal");
+		return Reject(400);
+	} else if (!mParser.Header("Sec-WebSocket-Version", &version) || version != "13") {
+		return Reject(426);
+	} else if (Handshake() == -1) {
+		return Reject(403);
+	}
+
+	// Sec-WebSocket-Accept = base64(sha1(key + GUID))
+	std::string accept = key.ToString() + kWsGuid;
+	uint8_t digest[20];
+	misc::Sha1(accept.data(), accept.size(), digest);
+	accept = coding::Base64Encode(wSlice(reinterpret_cast<const char*>(digest), sizeof(digest)));
+
+	std::string res = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+	res += accept;
+	res += "\r\n\r\n";
+
+	mRecvRead += mParser.HeadLength();
+	mRecvLen -= mParser.HeadLength();
+	mParser.Reset();
+	mState = kWsOpen;
+
+	const bool idle = mSendLen == 0;
+	char* buf = Reserve(res.size());
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWebSocketTask::ParseHandshake () failed", "left buffer not enough");
+		return -1;
+	}
+	memcpy(buf, res.data(), res.size());
+	Commit(res.size());
+	if (Flush(idle) == -1) {
+		return -1;
+	}
+	return HandleOpen();
+}
+
+int wWebSocketTask::Reject(uint16_t code) {
+	const char* text = http::StatusText(code);
+	std::string res = "HTTP/1.1 ";
+	logging::AppendNumberTo(&res, code);
+	res += " ";
+	res += text != NULL? text: "Bad Request";
+	if (code == 426) {
+		res += "\r\nSec-WebSocket-Version: 13";
+	}
+	res += "\r\nConnection: close\r\nContent-Length: 0";
+	res += "\r\n\r\n";
+
+	mState = kWsClosing;
+	mCloseSent = true;
+	char* buf = Reserve(res.size());
+	if (buf == NULL) {
+		return -1;
+	}
+	memcpy(buf, res.data(), res.size());
+	Commit(res.size());
+	return Flush(false);
+}
+
+int wWebSocketTask::ParseFrame() {
+	int ret = 0;
+	while (mState == kWsOpen && ret == 0) {
+		// 帧起始于已拼接的分片消息之后
+		char* p = mRecvRead + mMsgLen;
+		const size_t avail = mRecvLen - mMsgLen;
+		if (avail < 2) {
+			break;
+		}
+
+		const uint8_t b0 = static_cast<uint8_t>(p[0]);
+		const uint8_t b1 = static_cast<uint8_t>(p[1]);
+		const bool fin = (b0 & 0x80) != 0;
+		const uint8_t opcode = b0 & 0x0f;
+		uint64_t n = b1 & 0x7f;
+		size_t head = n == 126? 8: (n == 127? 14: 6);
+		if (avail < head) {
+			break;
+		} else if (n == 126) {
+			n = DecodeBig(p + 2, 2);
+		} else if (n == 127) {
+			n = DecodeBig(p + 2, 8);
+		}
+
+		// 无扩展（RSV为0）；客户端帧须掩码；控制帧不可分片、载荷不超过125；分片须以text、binary开始
+		if ((b0 & 0x70) != 0 || (b1 & 0x80) == 0) {
+			return Fail(kWsCloseProtocol);
+		} else if (opcode & 0x8) {
+			if (!fin || n > kWsControlMax || (opcode != kWsClose && opcode != kWsPing && opcode != kWsPong)) {
+				return Fail(kWsCloseProtocol);
+			}
+		} else if ((opcode == kWsContinuation && mMsgOp == 0) || ((opcode == kWsText || opcode == kWsBinary) && mMsgOp != 0) ||
+			opcode > kWsBinary) {
+			return Fail(kWsCloseProtocol);
+		}
+		if (n > kMaxPackageSize - mMsgLen || n > kPackageSize - kWsHeadMax - mMsgLen) {
+			return Fail(kWsCloseTooBig);
+		} else if (avail < head + n) {
+			break;
+		}
+
+		HeartbeatReset();
+		char* data = p + head;
+		Unmask(data, n, data - 4);
+		const size_t flen = head + n;
+
+		if (opcode & 0x8) {
+			// 控制帧：处理后从缓冲中移除（可位于分片之间）
+			ret = HandleControl(opcode, data, n);
+			if (mMsgLen == 0) {
+				mRecvRead += flen;
+			} else {
+				memmove(p, p + flen, avail - flen);
+				mRecvWrite -= flen;
+			}
+			mRecvLen -= flen;
+			continue;
+		}
+
+		if (opcode != kWsContinuation) {
+			mMsgOp = opcode;
+		}
+		if (fin && mMsgLen == 0) {
+			// 单帧消息：载荷原地交付
+			ret = Deliver(data, n);
+			mRecvRead += flen;
+			mRecvLen -= flen;
+			continue;
+		}
+
+		// 分片：载荷前移至已拼接消息之后，消息完整后交付
+		memmove(p, data, avail - head);
+		mRecvWrite -= head;
+		mRecvLen -= head;
+		mMsgLen += n;
+		if (fin) {
+			size_t len = mMsgLen;
+			mMsgLen = 0;
+			ret = Deliver(mRecvRead, len);
+			mRecvRead += len;
+			mRecvLen -= len;
+		}
+	}
+	return ret;
+}
+
+int wWebSocketTask::Deliver(char* data, size_t len) {
+	if (mMsgOp == kWsText && !ValidUtf8(data, len)) {
+		mMsgOp = 0;
+		return Fail(kWsCloseData);
+	}
+	int ret = Handlemsg(data, static_cast<uint32_t>(len));
+	mMsgOp = 0;
+	return ret;
+}
+
+int wWebSocketTask::Handlemsg(char buf[], uint32_t len) {
+	if (mMsgOp == kWsText) {
+		return HandleText(wSlice(buf, len));
+	} else if (len < kMinPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[len=%u]", "wWebSocketTask::Handlemsg () failed", "message too short", len);
+		return -1;
+	}
+	return wTask::Handlemsg(buf, len);
+}
+
+int wWebSocketTask::HandleControl(uint8_t opcode, const char* data, size_t len) {
+	if (opcode == kWsPing) {
+		return mCloseSent? 0: SendFrame(kWsPong, data, len);
+	} else if (opcode == kWsPong) {
+		return 0;
+	}
+
+	// 关闭帧：[uint16状态码][UTF-8原因]，回复同一状态码
+	uint16_t code = kWsCloseNormal;
+	wSlice reason;
+	if (len == 1) {
+		return Fail(kWsCloseProtocol);
+	} else if (len >= 2) {
+		code = static_cast<uint16_t>(DecodeBig(data, 2));
+		reason = wSlice(data + 2, len - 2);
+		if (!ValidCloseCode(code)) {
+			return Fail(kWsCloseProtocol);
+		} else if (!ValidUtf8(reason.data(), reason.size())) {
+			return Fail(kWsCloseData);
+		}
+	}
+	HandleClose(code, reason);
+	return Close(code);
+}
+
+int wWebSocketTask::Fail(uint16_t code) {
+	HNET_ERROR(soft::GetLogPath(), "%s : %s[%d]", "wWebSocketTask::ParseFrame () failed", "frame illegal", code);
+	return Close(code);
+}
+
+int wWebSocketTask::WriteFrame(uint8_t opcode, const wSlice& data) {
+	if (mState != kWsOpen || mCloseSent) {
+		return -1;
+	}
+	return SendFrame(opcode, data.data(), data.size());
+}
+
+int wWebSocketTask::Close(uint16_t code, const wSlice& reason) {
+	if (mCloseSent || mState == kWsHandshake) {
+		return 0;
+	}
+	char payload[kWsControlMax];
+	size_t len = std::min(reason.size(), static_cast<size_t>(kWsControlMax - sizeof(uint16_t)));
+	payload[0] = static_cast<char>(code >> 8);
+	payload[1] = static_cast<char>(code);
+	memcpy(payload + sizeof(uint16_t), reason.data(), len);
+
+	mCloseSent = true;
+	mState = kWsClosing;
+	return SendFrame(kWsClose, payload, sizeof(uint16_t) + len);
+}
+
+int wWebSocketTask::SendFrame(uint8_t opcode, const char* data, size_t len) {
+	const bool idle = mSendLen == 0;
+	size_t head = FrameHeadLen(len);
+	char* buf = Reserve(head + len);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWebSocketTask::SendFrame () failed", "left buffer not enough");
+		return -1;
+	}
+	EncodeFrameHead(buf, opcode, len);
+	if (len > 0) {
+		memcpy(buf + head, data, len);
+	}
+	Commit(head + len);
+	return Flush(idle);
+}
+
+int wWebSocketTask::Flush(bool idle) {
+	if (idle && mState != kWsClosing) {
+		// 发送缓冲此前为空：直接发送，发完则无需注册写事件
+		ssize_t size;
+		if (wTask::TaskSend(&size) == 0 && mSendLen == 0) {
+			return 0;
+		}
+	}
+	// 未发完、发送失败（由事件循环回收连接），或发完后关闭
+	return Output();
+}
+
+int wWebSocketTask::Send2Buf(char cmd[], size_t len) {
+	if (mState != kWsOpen || mCloseSent) {
+		return -1;
+	}
+	// 载荷长度
+	size_t n = len + sizeof(uint8_t);
+	if (n < kMinPackageSize || n > kMaxPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWebSocketTask::Send2Buf () failed", "message too large");
+		return -1;
+	}
+
+	size_t head = FrameHeadLen(n);
+	char* buf = Reserve(head + n);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWebSocketTask::Send2Buf () failed", "left buffer not enough");
+		return -1;
+	}
+	EncodeFrameHead(buf, kWsBinary, n);
+	coding::EncodeFixed8(buf + head, static_cast<uint8_t>(kMpCommand));
+	memcpy(buf + head + sizeof(uint8_t), cmd, len);
+	Commit(head + n);
+	return 0;
+}
+
+#ifdef _USE_PROTOBUF_
+int wWebSocketTask::Send2Buf(const google::protobuf::Message* msg, bool cached) {
+	if (mState != kWsOpen || mCloseSent) {
+		return -1;
+	}
+	// 载荷长度
+	size_t n = PbPackLen(msg, cached);
+	if (n < kMinPackageSize || n > kMaxPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWebSocketTask::Send2Buf () failed", "message too large");
+		return -1;
+	}
+
+	size_t head = FrameHeadLen(n);
+	char* buf = Reserve(head + n);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWebSocketTask::Send2Buf () failed", "left buffer not enough");
+		return -1;
+	}
+	if (head >= sizeof(uint32_t)) {
+		// Assertbuf的长度头写入帧头尾部，随后被帧头覆盖
+		Assertbuf(buf + head - sizeof(uint32_t), msg, true);
+	} else {
+		char tmp[sizeof(uint32_t) + kWsControlMax + 1];
+		Assertbuf(tmp, msg, true);
+		memcpy(buf + head, tmp + sizeof(uint32_t), n);
+	}
+	EncodeFrameHead(buf, kWsBinary, n);
+	Commit(head + n);
+	return 0;
+}
+#endif
+
+int wWebSocketTask::HeartbeatSend() {
+	mHeartbeat++;
+	if (mState != kWsOpen || mCloseSent) {
+		return 0;
+	}
+	return SendFrame(kWsPing, NULL, 0);
+}
+
+size_t wWebSocketTask::FrameHeadLen(size_t len) {
+	return len < 126? 2: (len <= 0xffff? 4: 10);
+}
+
+void wWebSocketTask::EncodeFrameHead(char* buf, uint8_t opcode, size_t len) {
+	buf[0] = static_cast<char>(0x80 | opcode);
+	if (len < 126) {
+		buf[1] = static_cast<char>(len);
+	} else if (len <= 0xffff) {
+		buf[1] = 126;
+		buf[2] = static_cast<char>(len >> 8);
+		buf[3] = static_cast<char>(len);
+	} else {
+		buf[1] = 127;
+		for (int i = 0; i < 8; i++) {
+			buf[2 + i] = static_cast<char>(static_cast<uint64_t>(len) >> (56 - 8*i));
+		}
+	}
+}
+
+}	// namespace hnet
@@ -0,0 +1,119 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_WEBSOCKET_TASK_H_
+#define _W_WEBSOCKET_TASK_H_
+
+#include "wCore.h"
+#include "wTask.h"
+#include "wSlice.h"
+#include "wHttpParser.h"
+
+namespace hnet {
+
+// 帧类型（RFC6455 5.2）
+const uint8_t	kWsContinuation = 0x0;
+const uint8_t	kWsText = 0x1;
+const uint8_t	kWsBinary = 0x2;
+const uint8_t	kWsClose = 0x8;
+const uint8_t	kWsPing = 0x9;
+const uint8_t	kWsPong = 0xa;
+
+// 关闭状态码（RFC6455 7.4.1）
+const uint16_t	kWsCloseNormal = 1000;
+const uint16_t	kWsCloseProtocol = 1002;
+const uint16_t	kWsCloseData = 1007;	// text非UTF-8
+const uint16_t	kWsCloseTooBig = 1009;
+
+// 帧头最大长度：2字节 + 8字节扩展长度 + 4字节掩码
+const uint32_t	kWsHeadMax = 14;
+const uint32_t	kWsControlMax = 125;
+const char		kWsGuid[] = "258EAFA5-E914-47D7-A95B-C5AB0DC11B85";
+
+// websocket连接（wServer监听协议"WEBSOCKET"）
+// 首个请求为http Upgrade握手，之后收发RFC6455帧：帧在接收缓冲中原地去掩码，分片消息原地拼接，消息最大kMaxPackageSize
+// 二进制消息载荷同tcp消息去除长度头（[uint8数据协议][消息]），由wTask::Handlemsg按command、protobuf路由分发；
+// Send2Buf（含wServer::Send、Broadcast、AsyncSend）以二进制帧发送。文本消息交付HandleText
+// 心跳为ping帧，收到任意帧即重置心跳计数
+class wWebSocketTask : public wTask {
+public:
+    wWebSocketTask(wSocket *socket, int32_t type = 0) : wTask(socket, type), mParser(false), mState(kWsHandshake), mMsgOp(0), mMsgLen(0),
+    mCloseSent(false) { }
+
+    virtual int TaskRecv(ssize_t *size);
+    virtual int TaskSend(ssize_t *size);
+
+    // 握手请求校验（Request()有效），返回-1拒绝（403）。可检查路径、Origin等
+    virtual int Handshake() { return 0;}
+    // 握手完成
+    virtual int HandleOpen() { return 0;}
+    // 文本消息（已校验UTF-8），仅在返回前有效
+    virtual int HandleText(const wSlice& data) { return 0;}
+    // 收到关闭帧（已回复关闭帧，发送完后关闭连接）
+    virtual int HandleClose(uint16_t code, const wSlice& reason) { return 0;}
+
+    // 二进制消息默认wTask::Handlemsg分发；文本消息HandleText
+    virtual int Handlemsg(char buf[], uint32_t len);
+
+    // 发送一帧（不分片、不掩码）。未握手或已关闭、发送缓冲不足返回-1
+    int WriteFrame(uint8_t opcode, const wSlice& data);
+    inline int WriteText(const wSlice& data) { return WriteFrame(kWsText, data);}
+    inline int WriteBinary(const wSlice& data) { return WriteFrame(kWsBinary, data);}
+    // 发送关闭帧，发送完后关闭连接
+    int Close(uint16_t code = kWsCloseNormal, const wSlice& reason = wSlice());
+
+    // 消息以二进制帧发送（载荷为[uint8数据协议][消息]）
+    virtual int Send2Buf(char cmd[], size_t len);
+#ifdef _USE_PROTOBUF_
+    virtual int Send2Buf(const google::protobuf::Message* msg, bool cached = false);
+#endif
+
+    // 心跳：ping帧
+    virtual int HeartbeatSend();
+
+    // 握手请求，仅在Handshake中有效
+    inline const wHttpParser& Request() const { return mParser;}
+    inline bool Open() const { return mState == kWsOpen;}
+    // 当前消息类型（kWsText、kWsBinary）
+    inline uint8_t Opcode() const { return mMsgOp;}
+
+protected:
+	enum {
+		kWsHandshake = 0,
+		kWsOpen,
+		kWsClosing
+	};
+
+	int ParseHandshake();
+	// 握手失败：响应错误状态，发送完后关闭
+	int Reject(uint16_t code);
+	// 解析接收缓冲中的完整帧
+	int ParseFrame();
+	int HandleControl(uint8_t opcode, const char* data, size_t len);
+	// 完整消息交付
+	int Deliver(char* data, size_t len);
+	// 协议错误：发送关闭帧，发送完后关闭
+	int Fail(uint16_t code);
+
+	// 发送一帧，不检查连接状态
+	int SendFrame(uint8_t opcode, const char* data, size_t len);
+	// 已提交至发送缓冲：此前为空时直接发送，否则（或即将关闭）注册写事件
+	int Flush(bool idle);
+
+	// 服务端帧头（无掩码）长度；写入帧头
+	static size_t FrameHeadLen(size_t len);
+	static void EncodeFrameHead(char* buf, uint8_t opcode, size_t len);
+
+	wHttpParser mParser;
+	uint8_t mState;
+	uint8_t mMsgOp;		// 分片消息类型，0为无
+	size_t mMsgLen;		// 已拼接的分片消息长度，位于mRecvRead起始处
+	bool mCloseSent;
+};
+
+}	// namespace hnet
+
+#endif
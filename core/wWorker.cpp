@@ -16,7 +16,7 @@
 namespace hnet {
 
 wWorker::wWorker(std::string title, uint32_t slot, wMaster* master) : mMaster(master), mTitle(title), mPid(-1), mPriority(0), mRlimitCore(kRlimitCore), 
-mDetached(0), mExited(0), mExiting(0), mStat(0), mRespawn(1), mJustSpawn(0), mTimeline(soft::TimeUnix()), mSlot(slot), mChannel(NULL) { }
+mDetached(0), mExited(0), mExiting(0), mStat(0), mRespawn(1), mJustSpawn(0), mTimeline(soft::TimeUnix()), mSlot(slot), mChannel(NULL), mChannelTask(NULL), mRingFallback(false) { }
 
 wWorker::~wWorker() { }
 
@@ -12,15 +12,18 @@
 #include "wCore.h"
 #include "wNoncopyable.h"
 #include "wChannelSocket.h"
+#include "wShmRing.h"
 
 namespace hnet {
 
 const uint32_t	kRlimitCore = 1024;
 const char     	kWorkerTitle[] = " - worker process";
+const uint32_t	kChannelRingSize = 65536;	// worker消息环容量（进程间控制消息，更大消息经channel socket发送）
 
 class wMaster;
 class wServer;
 class wChannelSocket;
+class wTask;
 
 class wWorker : public wNoncopyable {
 public:
@@ -53,6 +56,13 @@ public:
 	inline wChannelSocket* Channel() { return mChannel;}
 
 	inline int& ChannelFD(uint8_t i) { return (*mChannel)[i];}
+
+	// 该worker消息环（其他进程写入，该worker读取）
+	inline wMpscRing* Ring() { return &mRing;}
+	// 本进程该worker channel socket的task（异步发送），未加入事件循环时为NULL
+	inline wTask*& ChannelTask() { return mChannelTask;}
+	// 本进程发往该worker的消息已改经channel socket（环满等），socket数据全部被读取前不再写入环
+	inline bool& RingFallback() { return mRingFallback;}
 	
 	inline int ChannelClose(uint8_t i) {
 		if (close(ChannelFD(i)) == -1) {
@@ -82,6 +92,9 @@ protected:
 
 	uint32_t mSlot;	// 进程表中索引
 	wChannelSocket* mChannel;	// worker进程channel
+	wTask* mChannelTask;
+	wMpscRing mRing;
+	bool mRingFallback;
 };
 
 }	// namespace hnet
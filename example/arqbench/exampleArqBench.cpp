@@ -0,0 +1,170 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <poll.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <algorithm>
+#include "wCore.h"
+#include "wMisc.h"
+#include "wRandom.h"
+#include "wArq.h"
+#include "wUdpSocket.h"
+#include "exampleCmd.h"
+
+using namespace hnet;
+
+// 可靠UDP丢包测试：本机回环，客户端以wArq会话向example/server（-x ARQ -n 1，非protobuf版本）发送echo请求，
+// 在客户端两个方向按比例随机丢弃数据报（模拟丢包链路），校验全部响应按请求顺序到达、内容一致
+// 每个会话消息打包多个请求（超过mss时分段），窗口内最多32个消息在途；输出耗时、延迟分位、重传统计
+// ./examplearqbench 127.0.0.1 10025 [丢包率%] [请求数] [每消息请求数]
+
+struct Stat_t {
+	uint64_t mSent;		// 发送数据报数
+	uint64_t mDropped;	// 丢弃数据报数（发送、接收）
+	uint64_t mRecv;		// 接收数据报数
+};
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		std::cout << "usage: ./examplearqbench host port [loss%] [requests] [batch]" << std::endl;
+		return -1;
+	}
+	const std::string host = argv[1];
+	const uint16_t port = static_cast<uint16_t>(atoi(argv[2]));
+	const uint32_t loss = argc > 3? static_cast<uint32_t>(atoi(argv[3])): 10;
+	const uint32_t total = argc > 4? static_cast<uint32_t>(atoi(argv[4])): 20000;
+	const uint32_t batch = argc > 5? std::max(1, atoi(argv[5])): 4;
+	const uint32_t inflight = 32;
+
+	wUdpSocket socket;
+	if (socket.Open() == -1 || socket.SetNonblock() == -1) {
+		std::cout << "socket open failed" << std::endl;
+		return -1;
+	}
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = misc::Text2IP(host.c_str());
+
+	// 丢包注入：发送、接收各按loss%随机丢弃
+	wRandom random(static_cast<uint32_t>(misc::GetTimeofday()));
+	Stat_t stat;
+	memset(&stat, 0, sizeof(stat));
+	const int fd = static_cast<int>(socket.FD());
+	const uint32_t conv = random.Next() | 1;
+	wArq arq(conv, [&] (const char* buf, uint32_t len) {
+		if (random.Uniform(100) < loss) {
+			stat.mDropped++;
+			return;
+		}
+		if (sendto(fd, buf, len, 0, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(addr)) > 0) {
+			stat.mSent++;
+		}
+	});
+	arq.SetRto(0, 20);
+	arq.SetWindow(256, 256);
+
+	std::cout << "[session]	:	conv " << conv << ", loss " << loss << "%, " << total << " requests, " << batch << " per message" << std::endl;
+
+	// 请求：cmd为定长序号，响应"return:"后应为相同序号
+	char msg[(sizeof(uint32_t) + sizeof(uint8_t) + sizeof(example::ExampleReqEcho_t)) * 64];
+	std::vector<int64_t> sendTm(total, 0);
+	std::vector<int64_t> latency;
+	latency.reserve(total);
+	uint32_t next = 0, expect = 0;
+	std::string res;
+	char dgram[65536];
+
+	const int64_t start = misc::GetTimeofday();
+	int64_t progress = start;
+	while (expect < total) {
+		const int64_t now = misc::GetTimeofday();
+		if (now - progress > 30 * 1000000LL) {
+			std::cout << "[result]	:	FAIL, no progress in 30s at response " << expect << std::endl;
+			return -1;
+		}
+
+		// 在途消息不超过inflight个
+		while (next < total && (next - expect) / batch < inflight) {
+			size_t len = 0;
+			for (uint32_t i = 0; i < batch && i < 64 && next < total; i++, next++) {
+				example::ExampleReqEcho_t req;
+				memset(req.mCmd, 0, sizeof(req.mCmd));
+				req.mLen = 0;
+				char seq[32];
+				snprintf(seq, sizeof(seq), "seq:%010u", next);
+				req.set_cmd(seq);
+				coding::EncodeFixed32(msg + len, static_cast<uint32_t>(sizeof(uint8_t) + sizeof(req)));
+				msg[len + sizeof(uint32_t)] = static_cast<char>(kMpCommand);
+				memcpy(msg + len + sizeof(uint32_t) + sizeof(uint8_t), &req, sizeof(req));
+				len += sizeof(uint32_t) + sizeof(uint8_t) + sizeof(req);
+				sendTm[next] = now;
+			}
+			if (arq.Send(msg, len) == -1) {
+				std::cout << "arq send failed" << std::endl;
+				return -1;
+			}
+		}
+		arq.Update(static_cast<uint32_t>(now / 1000));
+
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		poll(&pfd, 1, kArqInterval);
+
+		ssize_t size;
+		while ((size = recv(fd, dgram, sizeof(dgram), 0)) > 0) {
+			stat.mRecv++;
+			if (random.Uniform(100) < loss) {
+				stat.mDropped++;
+				continue;
+			}
+			arq.Update(static_cast<uint32_t>(misc::GetTimeofday() / 1000));
+			if (arq.Input(dgram, static_cast<size_t>(size)) == -1) {
+				std::cout << "arq input failed" << std::endl;
+			}
+		}
+
+		// 校验响应顺序、内容
+		while (arq.Recv(&res) == 0) {
+			const int64_t recvTm = misc::GetTimeofday();
+			size_t pos = 0;
+			while (pos + sizeof(uint32_t) <= res.size()) {
+				const uint32_t len = coding::DecodeFixed32(res.data() + pos);
+				const size_t head = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(hnet::wCommand) + sizeof(int8_t);
+				char seq[32];
+				snprintf(seq, sizeof(seq), "return:seq:%010u", expect);
+				if (pos + sizeof(uint32_t) + len > res.size() || len + sizeof(uint32_t) < head + strlen(seq) ||
+					memcmp(res.data() + pos + head, seq, strlen(seq)) != 0) {
+					std::cout << "[result]	:	FAIL, response " << expect << " mismatch or out of order" << std::endl;
+					return -1;
+				}
+				latency.push_back(recvTm - sendTm[expect]);
+				expect++;
+				pos += sizeof(uint32_t) + len;
+			}
+			progress = recvTm;
+		}
+		// 确认、新请求立即发出，不等下个刷新周期
+		arq.Flush();
+		if (arq.Dead()) {
+			std::cout << "[result]	:	FAIL, link dead" << std::endl;
+			return -1;
+		}
+	}
+	const int64_t usec = misc::GetTimeofday() - start;
+
+	std::sort(latency.begin(), latency.end());
+	std::cout << "[result]	:	OK, " << total << " responses in order" << std::endl;
+	std::cout << "[elapsed]	:	" << usec / 1000 << "ms, " << static_cast<int64_t>(total * 1000000.0 / std::max(usec, static_cast<int64_t>(1))) << " req/s" << std::endl;
+	std::cout << "[latency]	:	p50 " << latency[latency.size() / 2] / 1000.0 << "ms, p99 " << latency[latency.size() * 99 / 100] / 1000.0
+		<< "ms, max " << latency.back() / 1000.0 << "ms" << std::endl;
+	std::cout << "[datagram]	:	sent " << stat.mSent << ", recv " << stat.mRecv << ", dropped " << stat.mDropped << std::endl;
+	std::cout << "[retrans]	:	timeout " << arq.Retrans() << ", fast " << arq.FastRetrans() << ", srtt " << arq.Srtt() << "ms, rto " << arq.Rto() << "ms" << std::endl;
+	return 0;
+}
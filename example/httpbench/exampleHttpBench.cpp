@@ -0,0 +1,164 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <vector>
+#include <algorithm>
+#include "wCore.h"
+#include "wMisc.h"
+#include "wConfig.h"
+#include "wSingleClient.h"
+#include "exampleCmd.h"
+
+using namespace hnet;
+
+// http持久连接压测：同样的请求数，分别以 每请求一连接（Connection: close）、持久连接（keep-alive）发送，对比qps
+// 服务端为example/server（-x HTTP）
+
+int Bench(bool keepalive, int worker, int request);
+pid_t SpawnProcess(bool keepalive, int request);
+int Handle(bool keepalive, int request);
+int HttpConnect(wSingleClient** client);
+
+static std::string hnet_host = "";
+static uint16_t hnet_port = 0;
+
+int main(int argc, char *argv[]) {
+	// 设置运行目录
+	if (misc::SetBinPath() == -1) {
+		std::cout << "set bin path failed" << std::endl;
+		return -1;
+	}
+
+	// 创建配置对象
+	wConfig* config;
+	HNET_NEW(wConfig, config);
+	if (!config) {
+		std::cout << "config new failed" << std::endl;
+		return -1;
+	}
+
+	// 解析命令行
+	if (config->GetOption(argc, argv) == -1) {
+		std::cout << "get configure failed" << std::endl;
+		HNET_DELETE(config);
+		return -1;
+	}
+
+	// 日志路径
+	std::string log_path;
+	if (config->GetConf("log_path", &log_path)) {
+		soft::SetLogdirPath(log_path);
+	}
+
+	// 命令行-h、-p解析
+    if (!config->GetConf("host", &hnet_host) || !config->GetConf("port", &hnet_port)) {
+    	std::cout << "host or port error" << std::endl;
+    	HNET_DELETE(config);
+    	return -1;
+    }
+    HNET_DELETE(config);
+
+	const int worker = 10;
+	const int request = 5000;
+
+	std::cout << "[close-per-request]" << std::endl;
+	Bench(false, worker, request);
+	std::cout << "[keep-alive]" << std::endl;
+	Bench(true, worker, request);
+	return 0;
+}
+
+int Bench(bool keepalive, int worker, int request) {
+	int64_t start_usec = misc::GetTimeofday();
+
+	// 创建进程
+	std::vector<pid_t> process;
+	for (int i = 0; i < worker; i++) {
+		pid_t pid = SpawnProcess(keepalive, request);
+		if (pid > 0) {
+			process.push_back(pid);
+		}
+	}
+
+	// 回收进程
+	int error = 0, status;
+	while (!process.empty()) {
+		pid_t pid = wait(&status);
+		if (WIFEXITED(status) != 0 && WEXITSTATUS(status) > 0) {
+			error += WEXITSTATUS(status);
+		}
+
+		std::vector<pid_t>::iterator it = std::find(process.begin(), process.end(), pid);
+		if (it != process.end()) {
+			process.erase(it);
+		}
+	}
+
+	int64_t total_usec = std::max(misc::GetTimeofday() - start_usec, static_cast<int64_t>(1));
+
+	std::cout << "[error]	:	" << error << std::endl;
+	std::cout << "[success]	:	" << request*worker - error << std::endl;
+	std::cout << "[second]	:	" << total_usec/1000000.0 << "s" << std::endl;
+	std::cout << "[qps]		:	" << static_cast<int64_t>(request*worker*1000000.0/total_usec) << "req/s" << std::endl;
+	return 0;
+}
+
+pid_t SpawnProcess(bool keepalive, int request) {
+	pid_t pid = fork();
+
+	switch (pid) {
+	case -1:
+		exit(0);
+		break;
+
+	case 0:
+		exit(std::min(Handle(keepalive, request), 255));
+		break;
+	}
+	return pid;
+}
+
+int Handle(bool keepalive, int request) {
+	std::map<std::string, std::string> header;
+	if (keepalive) {
+		header.insert(std::make_pair("Connection", "keep-alive"));
+	}
+
+	wSingleClient* client = NULL;
+	int error = 0;
+	std::string res;
+	for (int i = 0; i < request; i++) {
+		// 每请求一连接；或服务端关闭连接（达到单连接请求数上限）后重连
+		if (client == NULL && HttpConnect(&client) == -1) {
+			error++;
+			continue;
+		}
+
+		if (client->HttpGet("/?cmd=50&para=0", header, res) == -1) {
+			error++;
+			HNET_DELETE(client);
+		} else if (!keepalive || res.find("Connection: close") != std::string::npos) {
+			HNET_DELETE(client);
+		}
+	}
+	HNET_DELETE(client);
+	return error;
+}
+
+int HttpConnect(wSingleClient** client) {
+	HNET_NEW(wSingleClient, *client);
+	if (!*client) {
+		std::cout << "client new failed" << std::endl;
+		return -1;
+	}
+
+	if ((*client)->Connect(hnet_host, hnet_port, "HTTP") == -1) {
+		std::cout << "client connect failed" << std::endl;
+		HNET_DELETE(*client);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <functional>
+#include "wCore.h"
+#include "wMisc.h"
+#include "wConfig.h"
+#include "wHttpClient.h"
+#include "exampleCmd.h"
+
+using namespace hnet;
+
+// 异步http客户端压测：单线程事件循环，保持固定并发请求数
+// 分别以 连接池（每连接一个请求）、连接池 + 流水线 发送，对比qps
+// 服务端为example/server（-x HTTP）
+
+class Bench {
+public:
+	Bench(wHttpClient* client, const std::string& url, int total, int concurrency) : mClient(client), mUrl(url), mTotal(total),
+	mConcurrency(concurrency), mSent(0), mDone(0), mError(0) { }
+
+	int Run() {
+		int64_t start_usec = misc::GetTimeofday();
+		while (mDone < mTotal) {
+			while (mSent < mTotal && mSent - mDone < mConcurrency) {
+				if (mClient->Get(mUrl, std::bind(&Bench::OnResponse, this, std::placeholders::_1)) == -1) {
+					return -1;
+				}
+				mSent++;
+			}
+			mClient->Poll(10);
+		}
+		int64_t total_usec = std::max(misc::GetTimeofday() - start_usec, static_cast<int64_t>(1));
+
+		std::cout << "[error]	:	" << mError << std::endl;
+		std::cout << "[success]	:	" << mTotal - mError << std::endl;
+		std::cout << "[second]	:	" << total_usec/1000000.0 << "s" << std::endl;
+		std::cout << "[qps]		:	" << static_cast<int64_t>(mTotal*1000000.0/total_usec) << "req/s" << std::endl;
+		return 0;
+	}
+
+	void OnResponse(const wHttpResponse_t& res) {
+		mDone++;
+		if (res.mError != kHttpClientOk || res.mStatus != 200) {
+			mError++;
+		}
+	}
+
+protected:
+	wHttpClient* mClient;
+	std::string mUrl;
+	int mTotal;
+	int mConcurrency;
+	int mSent;
+	int mDone;
+	int mError;
+};
+
+int main(int argc, char *argv[]) {
+	// 设置运行目录
+	if (misc::SetBinPath() == -1) {
+		std::cout << "set bin path failed" << std::endl;
+		return -1;
+	}
+
+	// 创建配置对象
+	wConfig* config;
+	HNET_NEW(wConfig, config);
+	if (!config) {
+		std::cout << "config new failed" << std::endl;
+		return -1;
+	}
+
+	// 解析命令行
+	if (config->GetOption(argc, argv) == -1) {
+		std::cout << "get configure failed" << std::endl;
+		HNET_DELETE(config);
+		return -1;
+	}
+
+	// 日志路径
+	std::string log_path;
+	if (config->GetConf("log_path", &log_path)) {
+		soft::SetLogdirPath(log_path);
+	}
+
+	// 命令行-h、-p解析
+	std::string host;
+	uint16_t port = 0;
+	if (!config->GetConf("host", &host) || !config->GetConf("port", &port)) {
+		std::cout << "host or port error" << std::endl;
+		HNET_DELETE(config);
+		return -1;
+	}
+	const std::string url = "http://" + host + ":" + logging::NumberToString(port) + "/?cmd=50&para=0";
+
+	const int total = 50000;
+	const int concurrency = 32;
+	const uint32_t pipeline[] = {1, kHttpClientPipeline};
+	for (size_t i = 0; i < sizeof(pipeline)/sizeof(pipeline[0]); i++) {
+		wHttpClient* client;
+		HNET_NEW(wHttpClient(config), client);
+		if (!client || client->PrepareStart() == -1) {
+			std::cout << "client start failed" << std::endl;
+			HNET_DELETE(client);
+			HNET_DELETE(config);
+			return -1;
+		}
+		client->SetPipeline(pipeline[i]);
+
+		std::cout << "[conn " << kHttpClientConnMax << " x pipeline " << pipeline[i] << "]" << std::endl;
+		Bench bench(client, url, total, concurrency);
+		bench.Run();
+		HNET_DELETE(client);
+	}
+	HNET_DELETE(config);
+	return 0;
+}
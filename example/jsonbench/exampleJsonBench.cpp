@@ -0,0 +1,229 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <vector>
+#include "wCore.h"
+#include "wMisc.h"
+#include "wJson.h"
+#include "json/json.h"
+
+using namespace hnet;
+
+// JSON编解码性能测试：hnet wJson（原地解析）、wJsonWriter，对比vendor/jsoncpp（Json::CharReader、Json::Value + Json::FastWriter）
+// 测试文档为缩进格式，字符串含转义、\u及UTF-8字符；输出吞吐量（MB/s，按文档字节数计）
+// ./examplejsonbench [记录数]
+
+struct Record_t {
+	int64_t mId;
+	std::string mName;
+	std::string mDesc;
+	double mScore;
+	bool mActive;
+	std::vector<std::string> mTags;
+};
+
+void BuildRecord(int num, std::vector<Record_t>* records);
+void WriteHnet(const std::vector<Record_t>& records, std::string* out);
+void WriteJsoncpp(const std::vector<Record_t>& records, std::string* out);
+void Dump(const wJsonValue& v, wJsonWriter* json);
+void Report(const std::string& name, size_t bytes, int loop, int64_t usec);
+
+int main(int argc, char *argv[]) {
+	const int num = argc > 1? atoi(argv[1]): 2000;
+	std::vector<Record_t> records;
+	BuildRecord(num, &records);
+
+	// 测试文档：jsoncpp缩进格式
+	std::string doc;
+	{
+		std::string compact;
+		WriteJsoncpp(records, &compact);
+		Json::Value root;
+		Json::Reader reader;
+		if (!reader.parse(compact, root)) {
+			std::cout << "build document failed" << std::endl;
+			return -1;
+		}
+		doc = root.toStyledString();
+	}
+	const int loop = std::max(1, static_cast<int>((64 << 20) / doc.size()));
+	std::cout << "[document]	:	" << doc.size() << " bytes, " << loop << " loops" << std::endl;
+
+	// 正确性：hnet解析后重新生成，与jsoncpp解析原文档结果一致
+	std::vector<char> buf(doc.begin(), doc.end());
+	wJson parser;
+	if (parser.Parse(&buf[0], buf.size()) == -1) {
+		std::cout << "hnet parse failed at " << parser.Error() << std::endl;
+		return -1;
+	}
+	std::string dump;
+	wJsonWriter dumper(&dump);
+	Dump(parser.Root(), &dumper);
+	{
+		Json::Value a, b;
+		Json::Reader reader;
+		if (!reader.parse(doc, a) || !reader.parse(dump, b) || a != b) {
+			std::cout << "hnet roundtrip mismatch" << std::endl;
+			return -1;
+		}
+	}
+
+	// 解析：hnet每次拷贝文档（原地解析修改缓冲），拷贝计入耗时
+	int64_t start_usec = misc::GetTimeofday();
+	uint64_t sum = 0;
+	for (int i = 0; i < loop; i++) {
+		memcpy(&buf[0], doc.data(), doc.size());
+		if (parser.Parse(&buf[0], buf.size()) == -1) {
+			std::cout << "hnet parse failed" << std::endl;
+			return -1;
+		}
+		sum += parser.Root()[static_cast<size_t>(0)]["id"].Int();
+	}
+	Report("parse hnet", doc.size(), loop, misc::GetTimeofday() - start_usec);
+
+	Json::CharReaderBuilder builder;
+	Json::CharReader* reader = builder.newCharReader();
+	start_usec = misc::GetTimeofday();
+	for (int i = 0; i < loop; i++) {
+		Json::Value root;
+		std::string errs;
+		if (!reader->parse(doc.data(), doc.data() + doc.size(), &root, &errs)) {
+			std::cout << "jsoncpp parse failed" << std::endl;
+			delete reader;
+			return -1;
+		}
+		sum += root[0]["id"].asInt64();
+	}
+	Report("parse jsoncpp", doc.size(), loop, misc::GetTimeofday() - start_usec);
+	delete reader;
+
+	// 生成：紧凑格式，out跨次复用（同响应body缓冲）
+	std::string out;
+	WriteHnet(records, &out);
+	const size_t bytes = out.size();
+	start_usec = misc::GetTimeofday();
+	for (int i = 0; i < loop; i++) {
+		out.clear();
+		WriteHnet(records, &out);
+		sum += out.size();
+	}
+	Report("write hnet", bytes, loop, misc::GetTimeofday() - start_usec);
+
+	start_usec = misc::GetTimeofday();
+	for (int i = 0; i < loop; i++) {
+		out.clear();
+		WriteJsoncpp(records, &out);
+		sum += out.size();
+	}
+	Report("write jsoncpp", bytes, loop, misc::GetTimeofday() - start_usec);
+
+	std::cout << "[checksum]	:	" << sum << std::endl;
+	return 0;
+}
+
+void BuildRecord(int num, std::vector<Record_t>* records) {
+	static const char* kTags[] = {"hnet", "epoll", "json", "\xe4\xb8\xad\xe6\x96\x87", "tab\tnewline\n"};
+	records->resize(num);
+	for (int i = 0; i < num; i++) {
+		Record_t& r = (*records)[i];
+		r.mId = 1000000000LL + i;
+		r.mName = "user_" + logging::NumberToString(i) + " \"quoted\"";
+		r.mDesc = "line one\nline two\t\\ path/to/" + logging::NumberToString(i) + " \xe4\xbd\xa0\xe5\xa5\xbd \xf0\x9f\x98\x80";
+		r.mScore = i * 1.25 + 0.001;
+		r.mActive = (i % 3) != 0;
+		for (int j = 0; j <= i % 5; j++) {
+			r.mTags.push_back(kTags[j]);
+		}
+	}
+}
+
+void WriteHnet(const std::vector<Record_t>& records, std::string* out) {
+	wJsonWriter json(out);
+	json.BeginArray();
+	for (size_t i = 0; i < records.size(); i++) {
+		const Record_t& r = records[i];
+		json.BeginObject();
+		json.Key("id");
+		json.Int(r.mId);
+		json.Key("name");
+		json.String(r.mName);
+		json.Key("desc");
+		json.String(r.mDesc);
+		json.Key("score");
+		json.Double(r.mScore);
+		json.Key("active");
+		json.Bool(r.mActive);
+		json.Key("parent");
+		json.Null();
+		json.Key("tags");
+		json.BeginArray();
+		for (size_t j = 0; j < r.mTags.size(); j++) {
+			json.String(r.mTags[j]);
+		}
+		json.EndArray();
+		json.EndObject();
+	}
+	json.EndArray();
+}
+
+void WriteJsoncpp(const std::vector<Record_t>& records, std::string* out) {
+	Json::Value root(Json::arrayValue);
+	for (size_t i = 0; i < records.size(); i++) {
+		const Record_t& r = records[i];
+		Json::Value v(Json::objectValue);
+		v["id"] = static_cast<Json::Int64>(r.mId);
+		v["name"] = r.mName;
+		v["desc"] = r.mDesc;
+		v["score"] = r.mScore;
+		v["active"] = r.mActive;
+		v["parent"] = Json::Value();
+		Json::Value& tags = v["tags"] = Json::Value(Json::arrayValue);
+		for (size_t j = 0; j < r.mTags.size(); j++) {
+			tags.append(r.mTags[j]);
+		}
+		root.append(v);
+	}
+	Json::FastWriter writer;
+	*out += writer.write(root);
+}
+
+void Dump(const wJsonValue& v, wJsonWriter* json) {
+	switch (v.Type()) {
+	case kJsonNull:
+		json->Null();
+		break;
+	case kJsonFalse:
+	case kJsonTrue:
+		json->Bool(v.Bool());
+		break;
+	case kJsonNumber:
+		json->Raw(v.Raw());
+		break;
+	case kJsonString:
+		json->String(v.String());
+		break;
+	case kJsonArray:
+		json->BeginArray();
+		for (wJsonValue c = v.Child(); c.Valid(); c = c.Next()) {
+			Dump(c, json);
+		}
+		json->EndArray();
+		break;
+	case kJsonObject:
+		json->BeginObject();
+		for (wJsonValue c = v.Child(); c.Valid(); c = c.Next()) {
+			json->Key(c.Key());
+			Dump(c, json);
+		}
+		json->EndObject();
+		break;
+	}
+}
+
+void Report(const std::string& name, size_t bytes, int loop, int64_t usec) {
+	const double sec = usec > 0? usec / 1000000.0: 0.000001;
+	std::cout << "[" << name << "]	:	" << usec / loop << "us/doc, " << static_cast<int64_t>(bytes * static_cast<double>(loop) / sec / (1 << 20)) << " MB/s" << std::endl;
+}
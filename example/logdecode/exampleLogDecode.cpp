@@ -0,0 +1,77 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+// 二进制日志（_USE_BINLOG_）解码工具，输出与文本日志相同的格式
+// 用法：hnetlogdecode hnet.log.bin.2 hnet.log.bin.1 hnet.log.bin > hnet.log
+// 多个文件按写入先后顺序给出；不给文件时读标准输入
+
+#include <vector>
+#include "wCore.h"
+#include "wEnv.h"
+#include "wFile.h"
+#include "wSlice.h"
+#include "wLogger.h"
+
+using namespace hnet;
+
+const size_t kReadSize = 1048576;
+
+int Decode(wLogDecoder* decoder, wSequentialFile* file, const char* name) {
+	std::vector<char> scratch(kReadSize);
+	std::string pending, text;
+	while (true) {
+		wSlice result;
+		if (file->Read(kReadSize, &result, &scratch[0]) == -1) {
+			std::cerr << name << ": read failed" << std::endl;
+			return -1;
+		} else if (result.size() == 0) {
+			break;
+		}
+
+		pending.append(result.data(), result.size());
+		text.clear();
+		ssize_t used = decoder->Decode(pending.data(), pending.size(), &text);
+		if (used == -1) {
+			std::cerr << name << ": corrupted log record" << std::endl;
+			return -1;
+		}
+		std::cout << text;
+		pending.erase(0, used);
+	}
+	if (!pending.empty()) {
+		std::cerr << name << ": truncated log record, " << pending.size() << " bytes" << std::endl;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	std::ios::sync_with_stdio(false);
+
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		files.push_back(argv[i]);
+	}
+	if (files.empty()) {
+		files.push_back("/dev/stdin");
+	}
+
+	// 格式描述符跨文件累积：归档文件中的描述符对后续文件同样有效
+	wLogDecoder decoder;
+	int ret = 0;
+	for (std::vector<std::string>::iterator it = files.begin(); it != files.end(); it++) {
+		wSequentialFile* file;
+		if (wEnv::Default()->NewSequentialFile(*it, &file) == -1) {
+			std::cerr << *it << ": open failed" << std::endl;
+			ret = -1;
+			continue;
+		}
+		if (Decode(&decoder, file, it->c_str()) == -1) {
+			ret = -1;
+		}
+		HNET_DELETE(file);
+	}
+	return ret;
+}
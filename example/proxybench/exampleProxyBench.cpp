@@ -0,0 +1,124 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <vector>
+#include <algorithm>
+#include "wCore.h"
+#include "wMisc.h"
+#include "wConfig.h"
+#include "wSingleClient.h"
+#include "exampleCmd.h"
+
+using namespace hnet;
+
+// 反向代理延迟测试（本机回环）：单连接（keep-alive）顺序请求，分别直连上游、经代理转发，对比每请求延迟，差值为代理增加的延迟
+// 上游为example/server（-x HTTP）；代理为example/server（-x HTTP -u 上游ip:port）
+// ./exampleproxybench -h 代理ip -p 代理port -u 上游ip:port
+
+int Bench(const std::string& name, const std::string& host, uint16_t port, int request, std::vector<int64_t>* latency);
+int64_t Percentile(const std::vector<int64_t>& latency, double p);
+
+int main(int argc, char *argv[]) {
+	// 设置运行目录
+	if (misc::SetBinPath() == -1) {
+		std::cout << "set bin path failed" << std::endl;
+		return -1;
+	}
+
+	// 创建配置对象
+	wConfig* config;
+	HNET_NEW(wConfig, config);
+	if (!config) {
+		std::cout << "config new failed" << std::endl;
+		return -1;
+	}
+
+	// 解析命令行
+	if (config->GetOption(argc, argv) == -1) {
+		std::cout << "get configure failed" << std::endl;
+		HNET_DELETE(config);
+		return -1;
+	}
+
+	// 日志路径
+	std::string log_path;
+	if (config->GetConf("log_path", &log_path)) {
+		soft::SetLogdirPath(log_path);
+	}
+
+	// 命令行-h、-p（代理）、-u（上游）解析
+	std::string host, upstream;
+	uint16_t port = 0;
+	if (!config->GetConf("host", &host) || !config->GetConf("port", &port) || !config->GetConf("upstream", &upstream) || upstream.find(':') == std::string::npos) {
+		std::cout << "host, port or upstream error" << std::endl;
+		HNET_DELETE(config);
+		return -1;
+	}
+	HNET_DELETE(config);
+	const std::string uphost = upstream.substr(0, upstream.find(':'));
+	const uint16_t upport = static_cast<uint16_t>(atoi(upstream.c_str() + upstream.find(':') + 1));
+
+	const int request = 20000;
+	std::vector<int64_t> direct, proxy;
+	if (Bench("direct", uphost, upport, request, &direct) == -1 || Bench("proxy", host, port, request, &proxy) == -1) {
+		return -1;
+	}
+
+	std::cout << "[added]" << std::endl;
+	std::cout << "[p50]		:	" << Percentile(proxy, 0.5) - Percentile(direct, 0.5) << "us" << std::endl;
+	std::cout << "[p99]		:	" << Percentile(proxy, 0.99) - Percentile(direct, 0.99) << "us" << std::endl;
+	return 0;
+}
+
+int Bench(const std::string& name, const std::string& host, uint16_t port, int request, std::vector<int64_t>* latency) {
+	std::map<std::string, std::string> header;
+	header.insert(std::make_pair("Connection", "keep-alive"));
+
+	wSingleClient* client = NULL;
+	int error = 0;
+	int64_t total = 0;
+	std::string res;
+	latency->reserve(request);
+	for (int i = 0; i < request; i++) {
+		// 服务端关闭连接（达到单连接请求数上限）后重连，重连不计入延迟
+		if (client == NULL) {
+			HNET_NEW(wSingleClient, client);
+			if (!client || client->Connect(host, port, "HTTP") == -1) {
+				std::cout << "client connect failed" << std::endl;
+				HNET_DELETE(client);
+				return -1;
+			}
+		}
+
+		int64_t start_usec = misc::GetTimeofday();
+		if (client->HttpGet("/?cmd=50&para=0", header, res) == -1) {
+			error++;
+			HNET_DELETE(client);
+			continue;
+		}
+		latency->push_back(misc::GetTimeofday() - start_usec);
+		total += latency->back();
+		if (res.find("Connection: close") != std::string::npos) {
+			HNET_DELETE(client);
+		}
+	}
+	HNET_DELETE(client);
+	std::sort(latency->begin(), latency->end());
+
+	std::cout << "[" << name << "]" << std::endl;
+	std::cout << "[error]	:	" << error << std::endl;
+	std::cout << "[avg]		:	" << (latency->empty()? 0: total/static_cast<int64_t>(latency->size())) << "us" << std::endl;
+	std::cout << "[p50]		:	" << Percentile(*latency, 0.5) << "us" << std::endl;
+	std::cout << "[p99]		:	" << Percentile(*latency, 0.99) << "us" << std::endl;
+	return latency->empty()? -1: 0;
+}
+
+int64_t Percentile(const std::vector<int64_t>& latency, double p) {
+	if (latency.empty()) {
+		return 0;
+	}
+	return latency[std::min(static_cast<size_t>(latency.size() * p), latency.size() - 1)];
+}
@@ -9,7 +9,14 @@
 #include "wDaemon.h"
 #include "wChannelTask.h"
 #include "wTcpTask.h"
+#include "wUdpTask.h"
+#include "wArqTask.h"
+#include "wUnixTask.h"
 #include "wHttpTask.h"
+#include "wHttpFile.h"
+#include "wHttpProxy.h"
+#include "wJson.h"
+#include "wWebSocketTask.h"
 #include "wConfig.h"
 #include "wServer.h"
 #include "wMaster.h"
@@ -64,11 +71,16 @@ public:
 
 int ExampleTcpTask::ExampleEchoReq(struct Request_t *request) {
 #ifdef _USE_PROTOBUF_
-	example::ExampleEchoReq req;
+	// 解析至arena，处理函数返回后统一释放
+	example::ExampleEchoReq* reqp = request->Parse<example::ExampleEchoReq>();
+	if (reqp == NULL) {
+		return -1;
+	}
+	example::ExampleEchoReq& req = *reqp;
 #else
 	example::ExampleReqEcho_t req;
-#endif
 	req.ParseFromArray(request->mBuf, request->mLen);
+#endif
 	std::cout << "tcp receive 1:" << req.cmd() << std::endl;
 
 	// 响应客户端
@@ -113,28 +125,231 @@ public:
 	ExampleHttpTask(wSocket *socket, int32_t type = 0) : wHttpTask(socket, type) {
 		// 多播事件注册
 		On(example::CMD_EXAMPLE_REQ, example::EXAMPLE_REQ_ECHO, &ExampleHttpTask::ExampleEchoReq, this);
+		// 路径路由
+		On("GET", "/user/:id", &ExampleHttpTask::ExampleUserReq, this);
+		On("POST", "/json", &ExampleHttpTask::ExampleJsonReq, this);
+		// 响应缓存1秒
+		Memo("GET", "/user/:id", 1000);
 	}
 	int ExampleEchoReq(struct Request_t *request);
+	int ExampleUserReq(struct Request_t *request);
+	int ExampleJsonReq(struct Request_t *request);
+
+protected:
+	wJson mJson;
 };
 
 int ExampleHttpTask::ExampleEchoReq(struct Request_t *request) {
 
 	std::cout << QueryGet("cmd") << " | " << QueryGet("para") << std::endl;
-	for (std::map<std::string, std::string>::iterator it = Req().begin(); it != Req().end(); it++) {
-		std::cout << "REQ: " << it->first << " = " << it->second << std::endl;
+	std::cout << Method() << " " << Pathinfo() << " " << Request().Version() << std::endl;
+	for (size_t i = 0; i < Request().HeaderNum(); i++) {
+		std::cout << "REQ: " << Request().HeaderName(i) << " = " << Request().HeaderValue(i) << std::endl;
 	}
 
 	// 返回
 	ResponseSet("Content-Type", "text/html; charset=UTF-8");
 	Write("<h1>hnet is work!<h1>");
 
-	for (std::map<std::string, std::string>::iterator it = Res().begin(); it != Res().end(); it++) {
-		std::cout << "RES: " << it->first << " = " << it->second << std::endl;
-	}
+	std::cout << "RES: " << ResponseStatus() << std::endl << ResponseHeader();
 	std::cout << "-------------------" << std::endl;
 	return 0;
 }
 
+int ExampleHttpTask::ExampleUserReq(struct Request_t *request) {
+	ResponseSet("Content-Type", "text/plain; charset=UTF-8");
+	Write("user: " + Param("id").ToString() + ", time: " + logging::NumberToString(misc::GetTimeofday()));
+	return 0;
+}
+
+int ExampleHttpTask::ExampleJsonReq(struct Request_t *request) {
+	// 请求body原地解析
+	if (mJson.Parse(MutableBody(), Request().Body().size()) == -1) {
+		SetStatus(400);
+		return 0;
+	}
+
+	// 响应：对象的成员名称、类型
+	ResponseSet("Content-Type", "application/json");
+	wJsonWriter json(WriteBuffer());
+	json.BeginObject();
+	json.Key("size");
+	json.Uint(mJson.Root().Size());
+	json.Key("members");
+	json.BeginArray();
+	for (wJsonValue v = mJson.Root().Child(); v.Valid(); v = v.Next()) {
+		json.BeginObject();
+		json.Key("name");
+		json.String(v.Key());
+		json.Key("type");
+		json.Int(v.Type());
+		json.EndObject();
+	}
+	json.EndArray();
+	json.EndObject();
+	return 0;
+}
+
+// WebSocket客户端类（-x WEBSOCKET）：文本消息原样返回；二进制消息同tcp按command、protobuf路由
+class ExampleWebSocketTask : public wWebSocketTask {
+public:
+	ExampleWebSocketTask(wSocket *socket, int32_t type = 0) : wWebSocketTask(socket, type) {
+#ifdef _USE_PROTOBUF_
+		On("example.ExampleEchoReq", &ExampleWebSocketTask::ExampleEchoReq, this);
+#else
+		On(example::CMD_EXAMPLE_REQ, example::EXAMPLE_REQ_ECHO, &ExampleWebSocketTask::ExampleEchoReq, this);
+#endif
+	}
+	virtual int HandleText(const wSlice& data) { return WriteText(data);}
+	int ExampleEchoReq(struct Request_t *request);
+};
+
+int ExampleWebSocketTask::ExampleEchoReq(struct Request_t *request) {
+#ifdef _USE_PROTOBUF_
+	example::ExampleEchoReq* reqp = request->Parse<example::ExampleEchoReq>();
+	if (reqp == NULL) {
+		return -1;
+	}
+	example::ExampleEchoReq& req = *reqp;
+	example::ExampleEchoRes res;
+#else
+	example::ExampleReqEcho_t req;
+	req.ParseFromArray(request->mBuf, request->mLen);
+	example::ExampleResEcho_t res;
+#endif
+	res.set_ret(1);
+	res.set_cmd("return:" + req.cmd());
+
+	// 响应以二进制帧发送
+#ifdef _USE_PROTOBUF_
+	AsyncSend(&res);
+#else
+	AsyncSend(reinterpret_cast<char*>(&res), sizeof(res));
+#endif
+	return 0;
+}
+
+// UDP客户端类（-x UDP）：每个数据报按command、protobuf路由，响应发往数据报来源地址（同一批数据报的响应以sendmmsg一次发送）
+class ExampleUdpTask : public wUdpTask {
+public:
+	ExampleUdpTask(wSocket *socket, int32_t type = 0) : wUdpTask(socket, type) {
+		// 内核不支持时自动回退为普通recvmmsg、sendmmsg
+		SetOffload(true, true);
+#ifdef _USE_PROTOBUF_
+		On("example.ExampleEchoReq", &ExampleUdpTask::ExampleEchoReq, this);
+#else
+		On(example::CMD_EXAMPLE_REQ, example::EXAMPLE_REQ_ECHO, &ExampleUdpTask::ExampleEchoReq, this);
+#endif
+	}
+	int ExampleEchoReq(struct Request_t *request);
+};
+
+int ExampleUdpTask::ExampleEchoReq(struct Request_t *request) {
+#ifdef _USE_PROTOBUF_
+	example::ExampleEchoReq* reqp = request->Parse<example::ExampleEchoReq>();
+	if (reqp == NULL) {
+		return -1;
+	}
+	example::ExampleEchoReq& req = *reqp;
+	example::ExampleEchoRes res;
+#else
+	example::ExampleReqEcho_t req;
+	req.ParseFromArray(request->mBuf, request->mLen);
+	example::ExampleResEcho_t res;
+#endif
+	res.set_ret(1);
+	res.set_cmd("return:" + req.cmd());
+
+#ifdef _USE_PROTOBUF_
+	AsyncSend(&res);
+#else
+	AsyncSend(reinterpret_cast<char*>(&res), sizeof(res));
+#endif
+	return 0;
+}
+
+// 可靠UDP客户端类（-x ARQ -n 1）：会话内消息可靠有序，按command、protobuf路由，响应发往当前会话
+class ExampleArqTask : public wArqTask {
+public:
+	ExampleArqTask(wSocket *socket, int32_t type = 0) : wArqTask(socket, type) {
+#ifdef _USE_PROTOBUF_
+		On("example.ExampleEchoReq", &ExampleArqTask::ExampleEchoReq, this);
+#else
+		On(example::CMD_EXAMPLE_REQ, example::EXAMPLE_REQ_ECHO, &ExampleArqTask::ExampleEchoReq, this);
+#endif
+	}
+	int ExampleEchoReq(struct Request_t *request);
+
+protected:
+	// 移动网络：最小RTO 20ms，窗口256
+	virtual int SessionOpen(wArqSession_t* session) {
+		session->mArq->SetRto(0, 20);
+		session->mArq->SetWindow(256, 256);
+		return 0;
+	}
+};
+
+int ExampleArqTask::ExampleEchoReq(struct Request_t *request) {
+#ifdef _USE_PROTOBUF_
+	example::ExampleEchoReq* reqp = request->Parse<example::ExampleEchoReq>();
+	if (reqp == NULL) {
+		return -1;
+	}
+	example::ExampleEchoReq& req = *reqp;
+	example::ExampleEchoRes res;
+#else
+	example::ExampleReqEcho_t req;
+	req.ParseFromArray(request->mBuf, request->mLen);
+	example::ExampleResEcho_t res;
+#endif
+	res.set_ret(1);
+	res.set_cmd("return:" + req.cmd());
+
+#ifdef _USE_PROTOBUF_
+	AsyncSend(&res);
+#else
+	AsyncSend(reinterpret_cast<char*>(&res), sizeof(res));
+#endif
+	return 0;
+}
+
+// 本机客户端类（-x UNIX，-h为sock路径）：客户端可协商共享内存传输（wSingleClient协议"SHM"），消息处理同tcp
+class ExampleUnixTask : public wUnixTask {
+public:
+	ExampleUnixTask(wSocket *socket, int32_t type = 0) : wUnixTask(socket, type) {
+#ifdef _USE_PROTOBUF_
+		On("example.ExampleEchoReq", &ExampleUnixTask::ExampleEchoReq, this);
+#else
+		On(example::CMD_EXAMPLE_REQ, example::EXAMPLE_REQ_ECHO, &ExampleUnixTask::ExampleEchoReq, this);
+#endif
+	}
+	int ExampleEchoReq(struct Request_t *request);
+};
+
+int ExampleUnixTask::ExampleEchoReq(struct Request_t *request) {
+#ifdef _USE_PROTOBUF_
+	example::ExampleEchoReq* reqp = request->Parse<example::ExampleEchoReq>();
+	if (reqp == NULL) {
+		return -1;
+	}
+	example::ExampleEchoReq& req = *reqp;
+	example::ExampleEchoRes res;
+#else
+	example::ExampleReqEcho_t req;
+	req.ParseFromArray(request->mBuf, request->mLen);
+	example::ExampleResEcho_t res;
+#endif
+	res.set_ret(1);
+	res.set_cmd("return:" + req.cmd());
+
+#ifdef _USE_PROTOBUF_
+	AsyncSend(&res);
+#else
+	AsyncSend(reinterpret_cast<char*>(&res), sizeof(res));
+#endif
+	return 0;
+}
+
 class ExampleServer : public wServer {
 public:
 	ExampleServer(wConfig* config) : wServer(config) { }
@@ -148,8 +363,22 @@ public:
 	    return 0;
 	}
 	
+	virtual int NewUdpTask(wSocket* sock, wTask** ptr) {
+	    HNET_NEW(ExampleUdpTask(sock), *ptr);
+	    if (!*ptr) {
+	    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "ExampleServer::NewUdpTask new() failed", "");
+	    	return -1;
+	    }
+	    return 0;
+	}
+
 	virtual int NewHttpTask(wSocket* sock, wTask** ptr) {
-	    HNET_NEW(ExampleHttpTask(sock), *ptr);
+		// 反向代理模式（-u）：请求转发至上游
+		if (!wHttpProxy::Default()->Empty()) {
+			HNET_NEW(wHttpProxyTask(sock), *ptr);
+		} else {
+			HNET_NEW(ExampleHttpTask(sock), *ptr);
+		}
 	    if (!*ptr) {
 	    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "ExampleServer::NewHttpTask new() failed", "");
 	    	return -1;
@@ -157,6 +386,33 @@ public:
 	    return 0;
 	}
 
+	virtual int NewWebSocketTask(wSocket* sock, wTask** ptr) {
+	    HNET_NEW(ExampleWebSocketTask(sock), *ptr);
+	    if (!*ptr) {
+	    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "ExampleServer::NewWebSocketTask new() failed", "");
+	    	return -1;
+	    }
+	    return 0;
+	}
+
+	virtual int NewUnixTask(wSocket* sock, wTask** ptr) {
+	    HNET_NEW(ExampleUnixTask(sock), *ptr);
+	    if (!*ptr) {
+	    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "ExampleServer::NewUnixTask new() failed", "");
+	    	return -1;
+	    }
+	    return 0;
+	}
+
+	virtual int NewArqTask(wSocket* sock, wTask** ptr) {
+	    HNET_NEW(ExampleArqTask(sock), *ptr);
+	    if (!*ptr) {
+	    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "ExampleServer::NewArqTask new() failed", "");
+	    	return -1;
+	    }
+	    return 0;
+	}
+
 	virtual int NewChannelTask(wSocket* sock, wTask** ptr) {
 		HNET_NEW(ExampleChannelTask(sock, mMaster), *ptr);
 	    if (!*ptr) {
@@ -216,6 +472,17 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	// 静态文件：http请求/static/下路径映射到运行目录下static目录
+	wHttpFile::Default()->Mount("/static/", "static");
+
+	// 反向代理上游：-u 127.0.0.1:10026,127.0.0.1:10027
+	std::string upstream;
+	if (config->GetConf("upstream", &upstream) && wHttpProxy::Default()->AddUpstream(upstream) == -1) {
+		std::cout << "upstream illegal" << std::endl;
+		HNET_DELETE(config);
+		return -1;
+	}
+
 	// 创建服务器对象
 	ExampleServer* server;
 	HNET_NEW(ExampleServer(config), server);
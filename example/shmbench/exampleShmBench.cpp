@@ -0,0 +1,98 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <sys/resource.h>
+#include <vector>
+#include <algorithm>
+#include "wCore.h"
+#include "wMisc.h"
+#include "wSingleClient.h"
+#include "wUnixTask.h"
+#include "exampleCmd.h"
+
+using namespace hnet;
+
+// 本机传输性能测试：以wSingleClient分别经unix socket（"UNIX"）、共享内存环（"SHM"）向example/server（-x UNIX，非protobuf版本）发送echo请求
+// 每轮连续发送pipeline个请求后接收全部响应，校验响应顺序、内容；输出请求速率、每轮延迟分位及客户端每请求CPU耗时（用户态 + 内核态）
+// ./exampleshmbench /tmp/hnet_shm.sock [请求数] [pipeline]
+
+int64_t CpuUsec() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+int Run(const std::string& path, const std::string& protocol, uint32_t total, uint32_t pipeline) {
+	wSingleClient client;
+	if (client.Connect(path, 0, protocol) == -1) {
+		std::cout << "[" << protocol << "]	:	connect failed" << std::endl;
+		return -1;
+	}
+	wUnixTask* task = static_cast<wUnixTask*>(client.Task());
+	if (protocol == "SHM" && !task->Shm()) {
+		std::cout << "[" << protocol << "]	:	shm unavailable, fallback to unix socket" << std::endl;
+	}
+
+	std::vector<int64_t> latency;
+	latency.reserve(total / pipeline + 1);
+	char buf[sizeof(example::ExampleResEcho_t) + 64];
+	const int64_t cpu = CpuUsec();
+	const int64_t start = misc::GetTimeofday();
+	for (uint32_t next = 0, expect = 0; expect < total;) {
+		const int64_t tm = misc::GetTimeofday();
+		ssize_t size;
+		for (uint32_t i = 0; i < pipeline && next < total; i++, next++) {
+			example::ExampleReqEcho_t req;
+			memset(req.mCmd, 0, sizeof(req.mCmd));
+			req.mLen = 0;
+			char seq[32];
+			snprintf(seq, sizeof(seq), "seq:%010u", next);
+			req.set_cmd(seq);
+			if (client.SyncSend(reinterpret_cast<char*>(&req), sizeof(req), &size) == -1) {
+				std::cout << "[" << protocol << "]	:	FAIL, send " << next << " failed" << std::endl;
+				return -1;
+			}
+		}
+		for (; expect < next; expect++) {
+			if (client.SyncRecv(buf, &size) == -1 || static_cast<size_t>(size) != sizeof(example::ExampleResEcho_t)) {
+				std::cout << "[" << protocol << "]	:	FAIL, recv " << expect << " failed" << std::endl;
+				return -1;
+			}
+			example::ExampleResEcho_t* res = reinterpret_cast<example::ExampleResEcho_t*>(buf);
+			char seq[32];
+			snprintf(seq, sizeof(seq), "return:seq:%010u", expect);
+			if (memcmp(res->mCmd, seq, strlen(seq)) != 0) {
+				std::cout << "[" << protocol << "]	:	FAIL, response " << expect << " mismatch or out of order" << std::endl;
+				return -1;
+			}
+		}
+		latency.push_back(misc::GetTimeofday() - tm);
+	}
+	const int64_t usec = std::max(misc::GetTimeofday() - start, static_cast<int64_t>(1));
+	const int64_t used = CpuUsec() - cpu;
+
+	std::sort(latency.begin(), latency.end());
+	std::cout << "[" << protocol << (task->Shm()? "(shm)": "(socket)") << "]	:	" << total << " requests in " << usec / 1000 << "ms, "
+		<< static_cast<int64_t>(total * 1000000.0 / usec) << " req/s, round p50 " << latency[latency.size() / 2] << "us, p99 "
+		<< latency[latency.size() * 99 / 100] << "us, client cpu " << used * 1000.0 / total << "us/1000 req" << std::endl;
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		std::cout << "usage: ./exampleshmbench sockpath [requests] [pipeline]" << std::endl;
+		return -1;
+	}
+	const std::string path = argv[1];
+	const uint32_t total = argc > 2? static_cast<uint32_t>(atoi(argv[2])): 200000;
+	const uint32_t pipeline = argc > 3? std::max(1, atoi(argv[3])): 1;
+	std::cout << "[session]	:	" << total << " requests, pipeline " << pipeline << std::endl;
+
+	if (Run(path, "UNIX", total, pipeline) == -1 || Run(path, "SHM", total, pipeline) == -1) {
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,209 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <vector>
+#include "wCore.h"
+#include "wMisc.h"
+#include "wUdpSocket.h"
+
+using namespace hnet;
+
+// UDP卸载性能测试：本机回环，发送进程以SendBatch（sendmmsg，每次kUdpBatch个数据报）持续发送，接收子进程以RecvBatch（recvmmsg）接收
+// 分别测试普通模式与卸载模式（发送UDP_SEGMENT、接收UDP_GRO），输出收发包速率、丢包率及每千个数据报CPU耗时（用户态 + 内核态）
+// 内核不支持卸载时回退为普通模式并提示
+// ./exampleudpbench [秒数] [数据报长度]
+
+struct Result_t {
+	uint64_t mPackets;		// 数据报数
+	uint64_t mCalls;		// 系统调用次数（recvmmsg、sendmmsg）
+	int64_t mUsec;			// 首个至最后一个数据报耗时
+	int64_t mCpu;			// 进程CPU耗时（微秒）
+	bool mOffload;			// 卸载是否生效
+};
+
+int64_t CpuUsec();
+int Receive(wUdpSocket* socket, bool gro, int secs, Result_t* result);
+int Send(wUdpSocket* socket, const struct sockaddr_in& addr, bool gso, int secs, uint32_t len, Result_t* result);
+int Run(bool offload, int secs, uint32_t len);
+void Report(const std::string& name, const Result_t& tx, const Result_t& rx);
+
+int main(int argc, char *argv[]) {
+	const int secs = argc > 1? atoi(argv[1]): 3;
+	const uint32_t len = argc > 2? static_cast<uint32_t>(atoi(argv[2])): 1200;
+	if (secs <= 0 || len == 0 || len > 1472) {
+		std::cout << "usage: ./exampleudpbench [secs] [len(1-1472)]" << std::endl;
+		return -1;
+	}
+	std::cout << "[datagram]	:	" << len << " bytes, " << secs << "s per mode" << std::endl;
+
+	if (Run(false, secs, len) == -1 || Run(true, secs, len) == -1) {
+		return -1;
+	}
+	return 0;
+}
+
+int Run(bool offload, int secs, uint32_t len) {
+	wUdpSocket rx;
+	if (rx.Open() == -1 || rx.Listen("127.0.0.1", 0) == -1) {
+		std::cout << "receiver listen failed" << std::endl;
+		return -1;
+	}
+	// 接收缓冲8M，减少突发丢包
+	int optVal = 0x800000;
+	setsockopt(rx.FD(), SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const void*>(&optVal), sizeof(optVal));
+	struct sockaddr_in addr;
+	socklen_t addrLen = sizeof(addr);
+	getsockname(rx.FD(), reinterpret_cast<struct sockaddr*>(&addr), &addrLen);
+
+	int fd[2];
+	if (pipe(fd) == -1) {
+		std::cout << "pipe failed" << std::endl;
+		return -1;
+	}
+	pid_t pid = fork();
+	if (pid == -1) {
+		std::cout << "fork failed" << std::endl;
+		return -1;
+	} else if (pid == 0) {
+		close(fd[0]);
+		Result_t result;
+		Receive(&rx, offload, secs, &result);
+		ssize_t n = write(fd[1], &result, sizeof(result));
+		_exit(n == sizeof(result)? 0: 1);
+	}
+	close(fd[1]);
+
+	// 等待接收进程就绪
+	usleep(100000);
+	Result_t tx, rx_result;
+	wUdpSocket sock;
+	if (sock.Open() == -1 || sock.Listen("127.0.0.1", 0) == -1 || Send(&sock, addr, offload, secs, len, &tx) == -1) {
+		std::cout << "sender failed" << std::endl;
+		close(fd[0]);
+		waitpid(pid, NULL, 0);
+		return -1;
+	}
+	ssize_t n = read(fd[0], &rx_result, sizeof(rx_result));
+	close(fd[0]);
+	waitpid(pid, NULL, 0);
+	if (n != sizeof(rx_result)) {
+		std::cout << "receiver failed" << std::endl;
+		return -1;
+	}
+
+	if (offload && (!tx.mOffload || !rx_result.mOffload)) {
+		std::cout << "[offload]	:	" << (tx.mOffload? "": "gso ") << (rx_result.mOffload? "": "gro ") << "unsupported, fallback" << std::endl;
+	}
+	Report(offload? "offload": "plain", tx, rx_result);
+	return 0;
+}
+
+int Receive(wUdpSocket* socket, bool gro, int secs, Result_t* result) {
+	memset(result, 0, sizeof(Result_t));
+	result->mOffload = gro && socket->SetGro(true) == 0;
+
+	// GRO开启时每项可为合并的多个数据报
+	const uint32_t slot = result->mOffload? kUdpGroSize: 2048;
+	std::vector<char> buf(slot * kUdpBatch);
+	wDatagram_t dgram[kUdpBatch];
+
+	struct pollfd pfd;
+	pfd.fd = static_cast<int>(socket->FD());
+	pfd.events = POLLIN;
+	int64_t first = 0, last = 0, cpu = 0;
+	const int64_t deadline = misc::GetTimeofday() + (secs + 5) * 1000000LL;
+	while (misc::GetTimeofday() < deadline) {
+		// 发送结束后空闲300ms退出
+		if (poll(&pfd, 1, 300) <= 0) {
+			if (first > 0) {
+				break;
+			}
+			continue;
+		}
+		for (uint32_t i = 0; i < kUdpBatch; i++) {
+			dgram[i].mBuf = &buf[i * slot];
+			dgram[i].mLen = slot;
+		}
+		int num = 0;
+		if (socket->RecvBatch(dgram, kUdpBatch, &num) == -1) {
+			return -1;
+		}
+		result->mCalls++;
+		if (first == 0 && num > 0) {
+			first = misc::GetTimeofday();
+			cpu = CpuUsec();
+		}
+		for (int i = 0; i < num; i++) {
+			result->mPackets += dgram[i].mSeg == 0? 1: (dgram[i].mLen + dgram[i].mSeg - 1) / dgram[i].mSeg;
+		}
+		if (num > 0) {
+			last = misc::GetTimeofday();
+		}
+	}
+	result->mUsec = last - first;
+	result->mCpu = CpuUsec() - cpu;
+	return 0;
+}
+
+int Send(wUdpSocket* socket, const struct sockaddr_in& addr, bool gso, int secs, uint32_t len, Result_t* result) {
+	memset(result, 0, sizeof(Result_t));
+	result->mOffload = gso && socket->SetGso(true) == 0;
+
+	std::vector<char> buf(len, 'x');
+	wDatagram_t dgram[kUdpBatch];
+	for (uint32_t i = 0; i < kUdpBatch; i++) {
+		dgram[i].mBuf = &buf[0];
+		dgram[i].mLen = len;
+		dgram[i].mAddr = addr;
+	}
+
+	struct pollfd pfd;
+	pfd.fd = static_cast<int>(socket->FD());
+	pfd.events = POLLOUT;
+	const int64_t cpu = CpuUsec();
+	const int64_t start = misc::GetTimeofday();
+	const int64_t end = start + secs * 1000000LL;
+	int64_t now = start;
+	while (now < end) {
+		int num = 0;
+		if (socket->SendBatch(dgram, kUdpBatch, &num) == -1) {
+			return -1;
+		}
+		result->mCalls++;
+		result->mPackets += num;
+		if (num == 0) {
+			poll(&pfd, 1, 10);
+		}
+		now = misc::GetTimeofday();
+	}
+	// 发送中GSO失败时已自动关闭
+	result->mOffload = result->mOffload && socket->Gso();
+	result->mUsec = now - start;
+	result->mCpu = CpuUsec() - cpu;
+	return 0;
+}
+
+int64_t CpuUsec() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec * 1000000LL + usage.ru_utime.tv_usec + usage.ru_stime.tv_sec * 1000000LL + usage.ru_stime.tv_usec;
+}
+
+void Report(const std::string& name, const Result_t& tx, const Result_t& rx) {
+	const double txsec = tx.mUsec > 0? tx.mUsec / 1000000.0: 0.000001;
+	const double rxsec = rx.mUsec > 0? rx.mUsec / 1000000.0: 0.000001;
+	const double loss = tx.mPackets > 0? 100.0 * (tx.mPackets - std::min(tx.mPackets, rx.mPackets)) / tx.mPackets: 0;
+	std::cout << "[" << name << "]	:	"
+		<< "send " << static_cast<int64_t>(tx.mPackets / txsec) << " pps, "
+		<< "recv " << static_cast<int64_t>(rx.mPackets / rxsec) << " pps, "
+		<< "loss " << static_cast<int64_t>(loss * 100) / 100.0 << "%, "
+		<< "cpu send " << (tx.mPackets > 0? tx.mCpu * 1000 / static_cast<int64_t>(tx.mPackets): 0) << "us/k, "
+		<< "recv " << (rx.mPackets > 0? rx.mCpu * 1000 / static_cast<int64_t>(rx.mPackets): 0) << "us/k, "
+		<< "syscalls " << tx.mCalls << "/" << rx.mCalls << std::endl;
+}
@@ -0,0 +1,233 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <vector>
+#include <algorithm>
+#include "wCore.h"
+#include "wMisc.h"
+#include "wConfig.h"
+#include "wTcpSocket.h"
+
+using namespace hnet;
+
+// websocket echo压测：多进程，每进程一个连接，同步发送文本帧（掩码）并等待回显，分别以小消息、大消息对比吞吐
+// 服务端为example/server（-x WEBSOCKET）
+
+int Bench(int worker, int request, size_t size);
+pid_t SpawnProcess(int request, size_t size);
+int Handle(int request, size_t size);
+int SendAll(wSocket* socket, const char* buf, size_t len);
+int RecvAll(wSocket* socket, char* buf, size_t len);
+int RecvFrame(wSocket* socket, uint8_t* opcode, std::vector<char>* payload);
+
+static std::string hnet_host = "";
+static uint16_t hnet_port = 0;
+
+int main(int argc, char *argv[]) {
+	// 设置运行目录
+	if (misc::SetBinPath() == -1) {
+		std::cout << "set bin path failed" << std::endl;
+		return -1;
+	}
+
+	// 创建配置对象
+	wConfig* config;
+	HNET_NEW(wConfig, config);
+	if (!config) {
+		std::cout << "config new failed" << std::endl;
+		return -1;
+	}
+
+	// 解析命令行
+	if (config->GetOption(argc, argv) == -1) {
+		std::cout << "get configure failed" << std::endl;
+		HNET_DELETE(config);
+		return -1;
+	}
+
+	// 日志路径
+	std::string log_path;
+	if (config->GetConf("log_path", &log_path)) {
+		soft::SetLogdirPath(log_path);
+	}
+
+	// 命令行-h、-p解析
+    if (!config->GetConf("host", &hnet_host) || !config->GetConf("port", &hnet_port)) {
+    	std::cout << "host or port error" << std::endl;
+    	HNET_DELETE(config);
+    	return -1;
+    }
+    HNET_DELETE(config);
+
+	const int worker = 10;
+	const int request = 20000;
+	const size_t size[] = {64, 4096};
+	for (size_t i = 0; i < sizeof(size)/sizeof(size[0]); i++) {
+		std::cout << "[message " << size[i] << "B]" << std::endl;
+		Bench(worker, request, size[i]);
+	}
+	return 0;
+}
+
+int Bench(int worker, int request, size_t size) {
+	int64_t start_usec = misc::GetTimeofday();
+
+	// 创建进程
+	std::vector<pid_t> process;
+	for (int i = 0; i < worker; i++) {
+		pid_t pid = SpawnProcess(request, size);
+		if (pid > 0) {
+			process.push_back(pid);
+		}
+	}
+
+	// 回收进程
+	int error = 0, status;
+	while (!process.empty()) {
+		pid_t pid = wait(&status);
+		if (WIFEXITED(status) != 0 && WEXITSTATUS(status) > 0) {
+			error += WEXITSTATUS(status);
+		}
+
+		std::vector<pid_t>::iterator it = std::find(process.begin(), process.end(), pid);
+		if (it != process.end()) {
+			process.erase(it);
+		}
+	}
+
+	int64_t total_usec = std::max(misc::GetTimeofday() - start_usec, static_cast<int64_t>(1));
+
+	std::cout << "[error]	:	" << error << std::endl;
+	std::cout << "[success]	:	" << request*worker - error << std::endl;
+	std::cout << "[second]	:	" << total_usec/1000000.0 << "s" << std::endl;
+	std::cout << "[qps]		:	" << static_cast<int64_t>(request*worker*1000000.0/total_usec) << "msg/s" << std::endl;
+	std::cout << "[MB/s]	:	" << request*worker*size*2/1048576.0/(total_usec/1000000.0) << std::endl;
+	return 0;
+}
+
+pid_t SpawnProcess(int request, size_t size) {
+	pid_t pid = fork();
+
+	switch (pid) {
+	case -1:
+		exit(0);
+		break;
+
+	case 0:
+		exit(std::min(Handle(request, size), 255));
+		break;
+	}
+	return pid;
+}
+
+int Handle(int request, size_t size) {
+	wTcpSocket socket(kStConnect);
+	if (socket.Open() == -1 || socket.Connect(hnet_host, hnet_port) == -1) {
+		std::cout << "client connect failed" << std::endl;
+		return request;
+	}
+
+	// 握手
+	std::string req = "GET / HTTP/1.1\r\nHost: " + hnet_host + "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+	if (SendAll(&socket, req.data(), req.size()) == -1) {
+		return request;
+	}
+	std::string res;
+	char c;
+	while (res.size() < 4 || res.compare(res.size() - 4, 4, "\r\n\r\n") != 0) {
+		if (RecvAll(&socket, &c, 1) == -1) {
+			return request;
+		}
+		res += c;
+	}
+	if (res.compare(0, 12, "HTTP/1.1 101") != 0) {
+		std::cout << "handshake failed" << std::endl;
+		return request;
+	}
+
+	// 客户端文本帧：FIN + text，掩码
+	std::vector<char> frame;
+	frame.push_back(static_cast<char>(0x81));
+	if (size < 126) {
+		frame.push_back(static_cast<char>(0x80 | size));
+	} else {
+		frame.push_back(static_cast<char>(0x80 | 126));
+		frame.push_back(static_cast<char>(size >> 8));
+		frame.push_back(static_cast<char>(size));
+	}
+	const char mask[4] = {0x12, 0x34, 0x56, 0x78};
+	frame.insert(frame.end(), mask, mask + 4);
+	std::string payload(size, 'w');
+	for (size_t i = 0; i < size; i++) {
+		frame.push_back(payload[i] ^ mask[i & 3]);
+	}
+
+	// 回显帧（跳过服务端心跳ping）
+	std::vector<char> echo;
+	int error = 0;
+	for (int i = 0; i < request; i++) {
+		uint8_t opcode = 0;
+		if (SendAll(&socket, &frame[0], frame.size()) == -1) {
+			return request - i;
+		}
+		do {
+			if (RecvFrame(&socket, &opcode, &echo) == -1) {
+				return request - i;
+			}
+		} while (opcode == 0x9);
+		if (opcode != 0x1 || echo.size() != size || memcmp(&echo[0], payload.data(), size) != 0) {
+			error++;
+		}
+	}
+
+	// 关闭
+	const char close[] = {static_cast<char>(0x88), static_cast<char>(0x80), 0, 0, 0, 0};
+	SendAll(&socket, close, sizeof(close));
+	return error;
+}
+
+int SendAll(wSocket* socket, const char* buf, size_t len) {
+	ssize_t size;
+	if (socket->SendBytes(const_cast<char*>(buf), len, &size) == -1 || size != static_cast<ssize_t>(len)) {
+		return -1;
+	}
+	return 0;
+}
+
+int RecvAll(wSocket* socket, char* buf, size_t len) {
+	size_t recvlen = 0;
+	while (recvlen < len) {
+		ssize_t size;
+		if (socket->RecvBytes(buf + recvlen, len - recvlen, &size) == -1 || size <= 0) {
+			return -1;
+		}
+		recvlen += size;
+	}
+	return 0;
+}
+
+int RecvFrame(wSocket* socket, uint8_t* opcode, std::vector<char>* payload) {
+	// 服务端帧无掩码
+	char head[8];
+	if (RecvAll(socket, head, 2) == -1) {
+		return -1;
+	}
+	*opcode = head[0] & 0x0f;
+	uint64_t len = head[1] & 0x7f;
+	if (len >= 126) {
+		size_t n = len == 126? 2: 8;
+		if (RecvAll(socket, head, n) == -1) {
+			return -1;
+		}
+		len = 0;
+		for (size_t i = 0; i < n; i++) {
+			len = (len << 8) | static_cast<unsigned char>(head[i]);
+		}
+	}
+	payload->resize(len);
+	return len > 0? RecvAll(socket, &(*payload)[0], len): 0;
+}